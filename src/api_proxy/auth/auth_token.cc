@@ -20,6 +20,8 @@
 #include <openssl/hmac.h>
 #include <openssl/pem.h>
 #include <cstring>
+#include <map>
+#include <mutex>
 #include <string>
 
 extern "C" {
@@ -44,6 +46,23 @@ namespace {
 
 const gpr_timespec TOKEN_LIFETIME = {3600, 0, GPR_TIMESPAN};
 
+// Tokens carry an hour-long lifetime while refresh cycles are minutes
+// apart, so generated tokens are cached per (audience, secret) pair and the
+// expensive RSA signature is only recomputed when a cached token approaches
+// expiration.
+struct CachedToken {
+  std::string token;
+  gpr_timespec expiration;
+};
+
+// Leaked so no destructor runs at process exit.
+std::mutex *token_cache_mu = new std::mutex;
+std::map<std::string, CachedToken> *token_cache =
+    new std::map<std::string, CachedToken>;
+// Seconds before expiration at which a cached token stops being served.
+// Guarded by token_cache_mu.
+int token_refresh_ahead_seconds = 300;
+
 char *GenerateTokenSymmetricKey(const grpc_json *json, const char *audience);
 
 char *GenerateJoseHeader(const char *algorithm);
@@ -56,7 +75,31 @@ string DotConcat(const string &str1, const string &str2);
 
 // TODO: this function can return a string instead of char* that need to be
 // freed.
+int set_auth_token_refresh_ahead(int seconds) {
+  std::lock_guard<std::mutex> lock(*token_cache_mu);
+  int previous = token_refresh_ahead_seconds;
+  token_refresh_ahead_seconds = seconds;
+  return previous;
+}
+
 char *get_auth_token(const char *json_secret, const char *audience) {
+  const std::string cache_key = std::string(audience) + "\n" + json_secret;
+  const gpr_timespec now = gpr_now(GPR_CLOCK_REALTIME);
+  {
+    std::lock_guard<std::mutex> lock(*token_cache_mu);
+    auto it = token_cache->find(cache_key);
+    if (it != token_cache->end()) {
+      const gpr_timespec refresh_at = gpr_time_sub(
+          it->second.expiration,
+          gpr_time_from_seconds(token_refresh_ahead_seconds, GPR_TIMESPAN));
+      if (gpr_time_cmp(now, refresh_at) < 0) {
+        // Match return type of the generation path.
+        return gpr_strdup(it->second.token.c_str());
+      }
+      token_cache->erase(it);
+    }
+  }
+
   char *scratchpad = gpr_strdup(json_secret);
   grpc_json *json = grpc_json_parse_string(scratchpad);
   char *token = nullptr;
@@ -75,6 +118,12 @@ char *get_auth_token(const char *json_secret, const char *audience) {
 
   if (json != nullptr) grpc_json_destroy(json);
   gpr_free(scratchpad);
+
+  if (token != nullptr) {
+    std::lock_guard<std::mutex> lock(*token_cache_mu);
+    (*token_cache)[cache_key] =
+        CachedToken{token, gpr_time_add(now, TOKEN_LIFETIME)};
+  }
   return token;
 }
 
@@ -22,8 +22,15 @@ namespace auth {
 
 // Parse a json secret and generate auth_token
 // Returned pointer need to be freed by grpc_free
+// Tokens are cached per (audience, secret) pair until shortly before their
+// hour-long lifetime expires, so the RSA signature is computed roughly once
+// per hour per audience rather than on every refresh cycle.
 char* get_auth_token(const char* json_secret, const char* audience);
 
+// Sets how many seconds before expiration a cached token stops being served
+// (default 300). Returns the previous value.
+int set_auth_token_refresh_ahead(int seconds);
+
 // Free a buffer allocated by gRPC library.
 void grpc_free(char* token);
 
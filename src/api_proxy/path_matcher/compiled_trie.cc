@@ -0,0 +1,355 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/api_proxy/path_matcher/compiled_trie.h"
+
+#include <algorithm>
+
+#include "src/api_proxy/path_matcher/http_template.h"
+
+namespace google {
+namespace api_proxy {
+namespace path_matcher {
+
+HttpMethodId HttpMethodToId(absl::string_view http_method) {
+  if (http_method == "GET") return HttpMethodId::kGet;
+  if (http_method == "POST") return HttpMethodId::kPost;
+  if (http_method == "PUT") return HttpMethodId::kPut;
+  if (http_method == "DELETE") return HttpMethodId::kDelete;
+  if (http_method == "PATCH") return HttpMethodId::kPatch;
+  if (http_method == "HEAD") return HttpMethodId::kHead;
+  if (http_method == "OPTIONS") return HttpMethodId::kOptions;
+  if (http_method == "*") return HttpMethodId::kWildCard;
+  return HttpMethodId::kOther;
+}
+
+constexpr int32_t CompiledTrie::kNoChild;
+constexpr int32_t CompiledTrie::kNoSegment;
+constexpr size_t CompiledTrie::kMaxBacktrackFrames;
+
+std::unique_ptr<CompiledTrie> CompiledTrie::Compile(
+    const PathMatcherNode& root) {
+  std::unique_ptr<CompiledTrie> trie(new CompiledTrie());
+  trie->CompileNode(root);
+  return trie;
+}
+
+int32_t CompiledTrie::CompileNode(const PathMatcherNode& node) {
+  const int32_t index = static_cast<int32_t>(nodes_.size());
+  nodes_.emplace_back();
+
+  // Compile children first; their edges and results land in front of this
+  // node's, keeping each node's ranges contiguous. The node is addressed by
+  // index since recursion may reallocate |nodes_|.
+  std::vector<Edge> literals;
+  int32_t single_param_child = kNoChild;
+  int32_t wildcard_part_child = kNoChild;
+  int32_t wildcard_path_child = kNoChild;
+  for (const auto& entry : node.children_) {
+    const int32_t child = CompileNode(*entry.second);
+    if (entry.first == HttpTemplate::kSingleParameterKey) {
+      single_param_child = child;
+    } else if (entry.first == HttpTemplate::kWildCardPathPartKey) {
+      wildcard_part_child = child;
+    } else if (entry.first == HttpTemplate::kWildCardPathKey) {
+      wildcard_path_child = child;
+    } else {
+      literals.push_back({InternSegment(entry.first), child});
+    }
+  }
+  std::sort(literals.begin(), literals.end(),
+            [](const Edge& a, const Edge& b) {
+              return a.segment_id < b.segment_id;
+            });
+
+  Node& compiled = nodes_[index];
+  compiled.literal_begin = static_cast<int32_t>(edges_.size());
+  edges_.insert(edges_.end(), literals.begin(), literals.end());
+  compiled.literal_end = static_cast<int32_t>(edges_.size());
+  compiled.single_param_child = single_param_child;
+  compiled.wildcard_part_child = wildcard_part_child;
+  compiled.wildcard_path_child = wildcard_path_child;
+  compiled.results_begin = static_cast<int32_t>(results_.size());
+  for (const auto& entry : node.result_map_) {
+    results_.push_back({HttpMethodToId(entry.first), entry.first, entry.second});
+  }
+  compiled.results_end = static_cast<int32_t>(results_.size());
+  compiled.wildcard = node.wildcard_;
+  compiled.pure_suffix =
+      node.wildcard_ && literals.empty() && single_param_child == kNoChild &&
+      wildcard_part_child == kNoChild && wildcard_path_child == kNoChild;
+  return index;
+}
+
+int32_t CompiledTrie::InternSegment(const std::string& segment) {
+  auto insert = segment_ids_.emplace(
+      segment, static_cast<int32_t>(segment_ids_.size()));
+  return insert.first->second;
+}
+
+PathMatcherLookupResult CompiledTrie::Lookup(
+    const std::vector<absl::string_view>& parts,
+    const HttpMethod& http_method) const {
+  // Intern each request segment once; the walk below never hashes again.
+  std::vector<int32_t> segment_ids;
+  segment_ids.reserve(parts.size());
+  for (const auto& part : parts) {
+    auto it = segment_ids_.find(part);
+    segment_ids.push_back(it == segment_ids_.end() ? kNoSegment : it->second);
+  }
+  PathMatcherLookupResult result;
+  const HttpMethodId method_id = HttpMethodToId(http_method);
+  if (!LookupPathIterative(segment_ids, method_id, http_method, &result)) {
+    LookupPath(0, 0, segment_ids, method_id, http_method, &result);
+  }
+  return result;
+}
+
+bool CompiledTrie::LookupPathIterative(const std::vector<int32_t>& segment_ids,
+                                       HttpMethodId method_id,
+                                       const HttpMethod& http_method,
+                                       PathMatcherLookupResult* result) const {
+  // A deferred alternative: the walk resumes at (node, current) and tries
+  // the alternatives numbered |stage| and up.
+  struct Frame {
+    int32_t node;
+    uint32_t current;
+    uint8_t stage;
+  };
+  // Alternatives at one position, in template precedence order: 0 is the
+  // literal edge, then for a '**' node the in-place advance, otherwise the
+  // '/.' (single parameter), '*' and '**' children. Returns the child to
+  // descend into and advances |stage| past it, or kNoChild when the
+  // position is exhausted.
+  const auto next_alternative = [this](const Node& node, int32_t node_index,
+                                       int32_t segment_id,
+                                       uint8_t& stage) -> int32_t {
+    for (;;) {
+      switch (stage++) {
+        case 0:
+          if (segment_id != kNoSegment) {
+            const int32_t child = FindLiteralChild(node, segment_id);
+            if (child != kNoChild) {
+              return child;
+            }
+          }
+          break;
+        case 1:
+          if (node.wildcard) {
+            // A '**' node consumes the segment in place. Only constant
+            // segments are allowed after a wild card, so this is the last
+            // alternative (the recursive walk bails out after it too).
+            stage = 4;
+            return node_index;
+          }
+          if (node.single_param_child != kNoChild) {
+            return node.single_param_child;
+          }
+          break;
+        case 2:
+          if (node.wildcard_part_child != kNoChild) {
+            return node.wildcard_part_child;
+          }
+          break;
+        case 3:
+          if (node.wildcard_path_child != kNoChild) {
+            return node.wildcard_path_child;
+          }
+          break;
+        default:
+          return kNoChild;
+      }
+    }
+  };
+  // True if any alternative numbered |stage| or up can exist at |node|; a
+  // frame is only worth pushing when this holds.
+  const auto has_alternative = [](const Node& node, uint8_t stage) {
+    switch (stage) {
+      case 1:
+        return node.wildcard || node.single_param_child != kNoChild ||
+               node.wildcard_part_child != kNoChild ||
+               node.wildcard_path_child != kNoChild;
+      case 2:
+        return node.wildcard_part_child != kNoChild ||
+               node.wildcard_path_child != kNoChild;
+      case 3:
+        return node.wildcard_path_child != kNoChild;
+      default:
+        return false;
+    }
+  };
+
+  Frame stack[kMaxBacktrackFrames];
+  size_t depth = 0;
+  const uint32_t end = static_cast<uint32_t>(segment_ids.size());
+  int32_t node_index = 0;
+  uint32_t current = 0;
+  uint8_t stage = 0;
+  for (;;) {
+    const Node& node = nodes_[node_index];
+    if (current == end) {
+      // Same as the recursive base case, including the root-with-wildcard-
+      // template fallback to the '**' child's result.
+      if (!GetResultForHttpMethod(node, method_id, http_method, result) &&
+          node.wildcard_path_child != kNoChild) {
+        GetResultForHttpMethod(nodes_[node.wildcard_path_child], method_id,
+                               http_method, result);
+      }
+      if (result->data != nullptr) {
+        return true;
+      }
+    } else if (node.pure_suffix) {
+      // Trailing-'**' fast path: a childless '**' node can only swallow the
+      // whole remainder, which the recursive walk does one self-recursion
+      // per segment. Its result decides this branch in one step.
+      GetResultForHttpMethod(node, method_id, http_method, result);
+      if (result->data != nullptr) {
+        return true;
+      }
+    } else {
+      const int32_t child =
+          next_alternative(node, node_index, segment_ids[current], stage);
+      if (child != kNoChild) {
+        if (has_alternative(node, stage)) {
+          if (depth == kMaxBacktrackFrames) {
+            return false;
+          }
+          stack[depth++] = Frame{node_index, current, stage};
+        }
+        node_index = child;
+        ++current;
+        stage = 0;
+        continue;
+      }
+    }
+    // This branch is a dead end; resume at the most recent position with an
+    // untried alternative.
+    if (depth == 0) {
+      return true;
+    }
+    const Frame& frame = stack[--depth];
+    node_index = frame.node;
+    current = frame.current;
+    stage = frame.stage;
+  }
+}
+
+void CompiledTrie::LookupPath(int32_t node_index, size_t current,
+                              const std::vector<int32_t>& segment_ids,
+                              HttpMethodId method_id,
+                              const HttpMethod& http_method,
+                              PathMatcherLookupResult* result) const {
+  const Node& node = nodes_[node_index];
+  // base case
+  if (current == segment_ids.size()) {
+    if (!GetResultForHttpMethod(node, method_id, http_method, result)) {
+      // If we didn't find a result at this node, check if we have one in a
+      // wildcard (**) child. This ensures we match the root with wildcard
+      // templates.
+      if (node.wildcard_path_child != kNoChild) {
+        GetResultForHttpMethod(nodes_[node.wildcard_path_child], method_id,
+                               http_method, result);
+      }
+    }
+    return;
+  }
+  const int32_t segment_id = segment_ids[current];
+  if (segment_id != kNoSegment) {
+    const int32_t literal_child = FindLiteralChild(node, segment_id);
+    if (literal_child != kNoChild) {
+      LookupPath(literal_child, current + 1, segment_ids, method_id,
+                 http_method, result);
+      if (result->data != nullptr) {
+        return;
+      }
+    }
+  }
+  // For wild card node, keeps searching for next path segment until either
+  // 1) reaching the end (/foo/** case), or 2) all remaining segments match
+  // one of child branches (/foo/**/bar/xyz case).
+  if (node.wildcard) {
+    LookupPath(node_index, current + 1, segment_ids, method_id, http_method,
+               result);
+    // Since only constant segments are allowed after wild card, no need to
+    // search another wild card nodes from children, so bail out here.
+    return;
+  }
+  for (const int32_t child : {node.single_param_child, node.wildcard_part_child,
+                              node.wildcard_path_child}) {
+    if (child != kNoChild) {
+      LookupPath(child, current + 1, segment_ids, method_id, http_method,
+                 result);
+      if (result->data != nullptr) {
+        return;
+      }
+    }
+  }
+}
+
+bool CompiledTrie::GetResultForHttpMethod(
+    const Node& node, HttpMethodId method_id, const HttpMethod& http_method,
+    PathMatcherLookupResult* result) const {
+  // Lookup the exact http method first, then the http method wildcard. Ids
+  // decide the match; strings only break ties between methods outside the
+  // well-known list.
+  for (int32_t i = node.results_begin; i < node.results_end; ++i) {
+    if (results_[i].id == method_id &&
+        (method_id != HttpMethodId::kOther ||
+         results_[i].http_method == http_method)) {
+      *result = results_[i].result;
+      return true;
+    }
+  }
+  for (int32_t i = node.results_begin; i < node.results_end; ++i) {
+    if (results_[i].id == HttpMethodId::kWildCard) {
+      *result = results_[i].result;
+      return true;
+    }
+  }
+  return false;
+}
+
+CompiledTrie::Stats CompiledTrie::GetStats() const {
+  Stats stats;
+  stats.nodes = nodes_.size();
+  stats.edges = edges_.size();
+  stats.method_results = results_.size();
+  stats.interned_segments = segment_ids_.size();
+  stats.memory_bytes = nodes_.capacity() * sizeof(Node) +
+                       edges_.capacity() * sizeof(Edge) +
+                       results_.capacity() * sizeof(MethodResult);
+  // Slightly overestimates short strings stored inline, which is fine for
+  // a debugging figure.
+  for (const auto& entry : segment_ids_) {
+    stats.memory_bytes += sizeof(entry) + entry.first.capacity();
+  }
+  return stats;
+}
+
+int32_t CompiledTrie::FindLiteralChild(const Node& node,
+                                       int32_t segment_id) const {
+  const Edge* begin = edges_.data() + node.literal_begin;
+  const Edge* end = edges_.data() + node.literal_end;
+  const Edge* it = std::lower_bound(
+      begin, end, segment_id,
+      [](const Edge& edge, int32_t id) { return edge.segment_id < id; });
+  if (it != end && it->segment_id == segment_id) {
+    return it->child;
+  }
+  return kNoChild;
+}
+
+}  // namespace path_matcher
+}  // namespace api_proxy
+}  // namespace google
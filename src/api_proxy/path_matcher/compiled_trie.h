@@ -0,0 +1,191 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "src/api_proxy/path_matcher/path_matcher_node.h"
+
+namespace google {
+namespace api_proxy {
+namespace path_matcher {
+
+// Dense one-byte ids for the well-known HTTP methods plus the '*' method
+// wild card. Method tables in the compiled trie are matched by id, so the
+// per-node dispatch is a byte comparison; the method string is only compared
+// for methods outside this list (kOther).
+enum class HttpMethodId : uint8_t {
+  kGet,
+  kPost,
+  kPut,
+  kDelete,
+  kPatch,
+  kHead,
+  kOptions,
+  kWildCard,
+  kOther,
+};
+
+// Maps a request or template method to its id; unknown methods map to
+// kOther.
+HttpMethodId HttpMethodToId(absl::string_view http_method);
+
+// CompiledTrie is an immutable, flat representation of a PathMatcherNode trie.
+//
+// The pointer-based trie allocates each node separately and keys children by
+// std::string, so a lookup chases heap-scattered pointers and hashes one
+// string per path segment. CompiledTrie instead stores all nodes in one
+// contiguous array with integer child offsets, and interns every literal
+// segment that appears in any template into an integer id. A lookup interns
+// each request segment once up front (a single hash per segment), then the
+// trie walk itself is pure integer comparisons over cache-line-friendly
+// memory.
+//
+// Matching semantics are identical to PathMatcherNode::LookupPath.
+//
+// Thread safe after construction.
+class CompiledTrie {
+ public:
+  // Compiles the subtrie rooted at |root| into the flat representation. The
+  // PathMatcherLookupResults stored in |root| are copied, so the original
+  // trie may be discarded afterwards as long as the method data pointers
+  // stay alive.
+  static std::unique_ptr<CompiledTrie> Compile(const PathMatcherNode& root);
+
+  // Looks up |parts| the same way LookupInPathMatcherNode does on the
+  // pointer-based trie. The parts may borrow from the request path; no
+  // copies are made.
+  PathMatcherLookupResult Lookup(const std::vector<absl::string_view>& parts,
+                                 const HttpMethod& http_method) const;
+
+  // Element counts and an approximate heap footprint of the compiled form,
+  // for debugging and for sizing configs from data. The byte figure covers
+  // the flat arrays and the segment intern table; per-string heap storage
+  // is estimated from the stored lengths.
+  struct Stats {
+    size_t nodes = 0;
+    size_t edges = 0;
+    size_t method_results = 0;
+    size_t interned_segments = 0;
+    size_t memory_bytes = 0;
+  };
+  Stats GetStats() const;
+
+ private:
+  // Sentinel for "this node has no such child".
+  static constexpr int32_t kNoChild = -1;
+  // Sentinel segment id for request parts that appear in no template. Such
+  // parts can only be matched by parameter or wildcard children.
+  static constexpr int32_t kNoSegment = -1;
+
+  // A literal child edge. Edges of one node are stored contiguously in
+  // |edges_|, sorted by segment id for binary search.
+  struct Edge {
+    int32_t segment_id;
+    int32_t child;
+  };
+
+  // A (http method, result) entry of a node. Entries of one node are stored
+  // contiguously in |results_|; nodes have at most a handful of methods so a
+  // linear scan is cheaper than any map. Dispatch compares |id|; the string
+  // form only breaks ties between kOther methods.
+  struct MethodResult {
+    HttpMethodId id;
+    HttpMethod http_method;
+    PathMatcherLookupResult result;
+  };
+
+  struct Node {
+    // Range [literal_begin, literal_end) of this node's edges in |edges_|.
+    int32_t literal_begin = 0;
+    int32_t literal_end = 0;
+    // Children for the single-parameter ('/.'), one-segment wildcard ('*')
+    // and remaining-path wildcard ('**') template keys, or kNoChild.
+    int32_t single_param_child = kNoChild;
+    int32_t wildcard_part_child = kNoChild;
+    int32_t wildcard_path_child = kNoChild;
+    // Range [results_begin, results_end) of this node's method results in
+    // |results_|.
+    int32_t results_begin = 0;
+    int32_t results_end = 0;
+    // True if this node represents a wildcard path '**'.
+    bool wildcard = false;
+    // True if this is a trailing '**' node with no children. Such a node can
+    // only swallow the entire remaining path, so the matcher reads its
+    // result directly instead of advancing one segment at a time.
+    bool pure_suffix = false;
+  };
+
+  CompiledTrie() = default;
+
+  // Recursively appends |node| and its subtrie to |nodes_| and returns the
+  // index of the appended node.
+  int32_t CompileNode(const PathMatcherNode& node);
+
+  // Returns the id interned for |segment|, creating one on first use.
+  int32_t InternSegment(const std::string& segment);
+
+  // Frames are only pushed where an untried alternative actually remains,
+  // so typical lookups use a handful; this bounds the pathological case.
+  static constexpr size_t kMaxBacktrackFrames = 64;
+
+  // The hot-path matcher: walks the trie iteratively, deferring untried
+  // alternatives to an explicit fixed-size backtrack stack, so the stack
+  // traffic per lookup is a few dozen bytes regardless of path length.
+  // Returns false when a pathological path needs more than
+  // kMaxBacktrackFrames deferred alternatives; Lookup() then falls back to
+  // the recursive walk.
+  bool LookupPathIterative(const std::vector<int32_t>& segment_ids,
+                           HttpMethodId method_id,
+                           const HttpMethod& http_method,
+                           PathMatcherLookupResult* result) const;
+
+  // The compiled counterpart of PathMatcherNode::LookupPath; the reference
+  // walk, used only when LookupPathIterative overflows its backtrack stack.
+  // |current| indexes into |segment_ids|; |method_id| is
+  // HttpMethodToId(http_method), computed once per lookup.
+  void LookupPath(int32_t node_index, size_t current,
+                  const std::vector<int32_t>& segment_ids,
+                  HttpMethodId method_id, const HttpMethod& http_method,
+                  PathMatcherLookupResult* result) const;
+
+  // The compiled counterpart of PathMatcherNode::GetResultForHttpMethod.
+  bool GetResultForHttpMethod(const Node& node, HttpMethodId method_id,
+                              const HttpMethod& http_method,
+                              PathMatcherLookupResult* result) const;
+
+  // Returns the child index for the literal edge |segment_id| of |node|, or
+  // kNoChild.
+  int32_t FindLiteralChild(const Node& node, int32_t segment_id) const;
+
+  // All nodes of the trie; index 0 is the root.
+  std::vector<Node> nodes_;
+  // Literal child edges of all nodes, grouped per node and sorted by
+  // segment id within a group.
+  std::vector<Edge> edges_;
+  // Method results of all nodes, grouped per node.
+  std::vector<MethodResult> results_;
+  // Maps every literal template segment to its interned id.
+  absl::flat_hash_map<std::string, int32_t> segment_ids_;
+};
+
+}  // namespace path_matcher
+}  // namespace api_proxy
+}  // namespace google
@@ -13,9 +13,13 @@
 // limitations under the License.
 
 #include <cassert>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_join.h"
 #include "src/api_proxy/path_matcher/http_template.h"
 
 namespace google {
@@ -357,6 +361,36 @@ class Parser {
   std::vector<HttpTemplate::Variable> variables_;
 };
 
+// The parsed form of one template string, retained by the parse cache.
+// Segments are interned so identical segment lists are stored once;
+// variables are copied into each HttpTemplate because Register moves them
+// out of the instance it parses.
+struct ParsedTemplate {
+  std::shared_ptr<const std::vector<std::string>> segments;
+  std::string verb;
+  std::vector<HttpTemplate::Variable> variables;
+};
+
+// Returns the canonical shared copy of |segments|, interning it on first
+// sight. Different template strings can parse to the same segment list
+// (e.g. "/v1/{name=*}" and "/v1/{id=*}" both yield ["v1", "*"]), so the
+// intern table is keyed by the '/'-joined segments — unambiguous because
+// segments never contain '/'. Must be called with the parse cache lock
+// held.
+std::shared_ptr<const std::vector<std::string>> InternSegments(
+    std::vector<std::string>&& segments) {
+  static absl::flat_hash_map<
+      std::string, std::shared_ptr<const std::vector<std::string>>>* interned =
+      new absl::flat_hash_map<std::string,
+                              std::shared_ptr<const std::vector<std::string>>>;
+  auto& entry = (*interned)[absl::StrJoin(segments, "/")];
+  if (entry == nullptr) {
+    entry = std::make_shared<const std::vector<std::string>>(
+        std::move(segments));
+  }
+  return entry;
+}
+
 }  // namespace
 
 constexpr char HttpTemplate::kSingleParameterKey[] = "/.";
@@ -366,13 +400,44 @@ constexpr char HttpTemplate::kWildCardPathPartKey[] = "*";
 constexpr char HttpTemplate::kWildCardPathKey[] = "**";
 
 std::unique_ptr<HttpTemplate> HttpTemplate::Parse(const std::string& ht) {
+  // Parsed results are cached process-wide by template string, so the rules
+  // of a config push that repeat a template string pay the parser cost once.
+  // Invalid templates are not cached; they fail config validation and are
+  // not re-parsed at steady state.
+  static std::mutex* cache_mutex = new std::mutex;
+  static absl::flat_hash_map<std::string,
+                             std::shared_ptr<const ParsedTemplate>>* cache =
+      new absl::flat_hash_map<std::string,
+                              std::shared_ptr<const ParsedTemplate>>;
+
+  {
+    std::lock_guard<std::mutex> lock(*cache_mutex);
+    auto it = cache->find(ht);
+    if (it != cache->end()) {
+      const ParsedTemplate& parsed = *it->second;
+      return std::unique_ptr<HttpTemplate>(new HttpTemplate(
+          parsed.segments, parsed.verb, parsed.variables));
+    }
+  }
+
   Parser p(ht);
   if (!p.Parse() || !p.ValidateParts()) {
     return nullptr;
   }
 
-  return std::unique_ptr<HttpTemplate>(new HttpTemplate(
-      std::move(p.segments()), std::move(p.verb()), std::move(p.variables())));
+  auto parsed = std::make_shared<ParsedTemplate>();
+  parsed->verb = std::move(p.verb());
+  parsed->variables = std::move(p.variables());
+  std::lock_guard<std::mutex> lock(*cache_mutex);
+  parsed->segments = InternSegments(std::move(p.segments()));
+  // A racing thread may have inserted the same template meanwhile; either
+  // entry is equivalent, keep whichever wins.
+  auto& entry = (*cache)[ht];
+  if (entry == nullptr) {
+    entry = std::move(parsed);
+  }
+  return std::unique_ptr<HttpTemplate>(
+      new HttpTemplate(entry->segments, entry->verb, entry->variables));
 }
 
 }  // namespace path_matcher
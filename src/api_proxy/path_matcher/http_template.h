@@ -23,8 +23,12 @@ namespace path_matcher {
 
 class HttpTemplate {
  public:
+  // Parses |ht| into a template. Configs repeat template strings across http
+  // rules, so parsed results are cached process-wide by template string and
+  // a repeat parse skips the parser; identical segment lists are shared
+  // between templates rather than stored per instance.
   static std::unique_ptr<HttpTemplate> Parse(const std::string& ht);
-  const std::vector<std::string>& segments() const { return segments_; }
+  const std::vector<std::string>& segments() const { return *segments_; }
   const std::string& verb() const { return verb_; }
 
   // The info about a variable binding {variable=subpath} in the template.
@@ -45,6 +49,7 @@ class HttpTemplate {
   };
 
   std::vector<Variable>& Variables() { return variables_; }
+  const std::vector<Variable>& Variables() const { return variables_; }
 
   // '/.': match any single path segment.
   static const char kSingleParameterKey[];
@@ -54,12 +59,14 @@ class HttpTemplate {
   static const char kWildCardPathKey[];
 
  private:
-  HttpTemplate(std::vector<std::string>&& segments, std::string&& verb,
-               std::vector<Variable>&& variables)
+  HttpTemplate(std::shared_ptr<const std::vector<std::string>> segments,
+               std::string verb, std::vector<Variable> variables)
       : segments_(std::move(segments)),
         verb_(std::move(verb)),
         variables_(std::move(variables)) {}
-  const std::vector<std::string> segments_;
+  // The segment list is immutable and shared with the parse cache and with
+  // every other template that parses to the same segments.
+  std::shared_ptr<const std::vector<std::string>> segments_;
   std::string verb_;
   std::vector<Variable> variables_;
 };
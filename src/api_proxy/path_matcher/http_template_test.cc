@@ -507,6 +507,43 @@ TEST(HttpTemplate, ParseNonVerbTest) {
   ASSERT_EQ(nullptr, HttpTemplate::Parse("/a/{b=*}/**:"));
 }
 
+TEST(HttpTemplate, CachedParseMatchesFirstParse) {
+  auto first = HttpTemplate::Parse("/v1/{name=shelves/*}/books:import");
+  auto second = HttpTemplate::Parse("/v1/{name=shelves/*}/books:import");
+  ASSERT_NE(nullptr, first);
+  ASSERT_NE(nullptr, second);
+  ASSERT_EQ(first->segments(), second->segments());
+  ASSERT_EQ(first->verb(), second->verb());
+  ASSERT_EQ(first->Variables(), second->Variables());
+  // The cached parse shares one segment list instead of owning a copy.
+  ASSERT_EQ(&first->segments(), &second->segments());
+}
+
+TEST(HttpTemplate, IdenticalSegmentListsAreShared) {
+  // Different template strings with the same shape parse to one shared
+  // segment list; variables stay per template.
+  auto ht1 = HttpTemplate::Parse("/v1/{name=*}/operations");
+  auto ht2 = HttpTemplate::Parse("/v1/{id=*}/operations");
+  ASSERT_NE(nullptr, ht1);
+  ASSERT_NE(nullptr, ht2);
+  ASSERT_EQ(&ht1->segments(), &ht2->segments());
+  ASSERT_EQ(FieldPath{"name"}, ht1->Variables()[0].field_path);
+  ASSERT_EQ(FieldPath{"id"}, ht2->Variables()[0].field_path);
+}
+
+TEST(HttpTemplate, CachedParseVariablesAreIndependent) {
+  // Register moves variables out of the instance it parses; a later parse
+  // of the same template must still carry them.
+  auto first = HttpTemplate::Parse("/a/{b=c/*/d}/e");
+  ASSERT_NE(nullptr, first);
+  Variables moved = std::move(first->Variables());
+  ASSERT_EQ(1, moved.size());
+
+  auto second = HttpTemplate::Parse("/a/{b=c/*/d}/e");
+  ASSERT_NE(nullptr, second);
+  ASSERT_EQ(moved, second->Variables());
+}
+
 }  // namespace path_matcher
 }  // namespace api_proxy
 }  // namespace google
@@ -14,8 +14,19 @@
 
 #include "src/api_proxy/path_matcher/path_matcher.h"
 
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
 
+#if !defined(ESPV2_PATH_MATCHER_NO_SIMD)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#endif
+
 namespace google {
 namespace api_proxy {
 namespace path_matcher {
@@ -75,7 +86,7 @@ inline int hex_digit_to_int(char c) {
 //
 // If the next three characters are an escaped character then this function will
 // also return what character is escaped.
-bool GetEscapedChar(const std::string& src, size_t i,
+bool GetEscapedChar(absl::string_view src, size_t i,
                     bool unescape_reserved_chars, char* out) {
   if (i + 2 < src.size() && src[i] == '%') {
     if (ascii_isxdigit(src[i + 1]) && ascii_isxdigit(src[i + 2])) {
@@ -91,49 +102,91 @@ bool GetEscapedChar(const std::string& src, size_t i,
   return false;
 }
 
+// Returns the position of the next '%' in |part| at or after |from|, or
+// absl::string_view::npos. This is the inner loop of percent-decoding, so it
+// scans 16 bytes at a time where SSE2 or NEON is available at build time and
+// falls back to a scalar loop elsewhere (or when the path_matcher BUILD
+// target defines ESPV2_PATH_MATCHER_NO_SIMD).
+size_t FindNextPercent(absl::string_view part, size_t from) {
+  const char* data = part.data();
+  size_t i = from;
+#if !defined(ESPV2_PATH_MATCHER_NO_SIMD) && defined(__SSE2__)
+  for (; i + 16 <= part.size(); i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const int mask =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('%')));
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif !defined(ESPV2_PATH_MATCHER_NO_SIMD) && defined(__aarch64__) && \
+    defined(__ARM_NEON)
+  for (; i + 16 <= part.size(); i += 16) {
+    const uint8x16_t block =
+        vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+    if (vmaxvq_u8(vceqq_u8(block, vdupq_n_u8('%'))) != 0) {
+      // A '%' is in this block; locate the lane with a scalar scan.
+      break;
+    }
+  }
+#endif
+  // Scalar tail (and whole-string scan on platforms without SIMD).
+  for (; i < part.size(); ++i) {
+    if (data[i] == '%') {
+      return i;
+    }
+  }
+  return absl::string_view::npos;
+}
+
 // Unescapes string 'part' and returns the unescaped string. Reserved characters
 // (as specified in RFC 6570) are not escaped if unescape_reserved_chars is
 // false.
-std::string UrlUnescapeString(const std::string& part,
+std::string UrlUnescapeString(absl::string_view part,
                               bool unescape_reserved_chars) {
-  std::string unescaped;
-  // Check whether we need to escape at all.
-  bool needs_unescaping = false;
+  // Check whether we need to unescape at all; the common case has no
+  // unescapable sequence and returns a plain copy.
   char ch = '\0';
-  for (size_t i = 0; i < part.size(); ++i) {
+  size_t first = absl::string_view::npos;
+  for (size_t i = FindNextPercent(part, 0); i != absl::string_view::npos;
+       i = FindNextPercent(part, i + 1)) {
     if (GetEscapedChar(part, i, unescape_reserved_chars, &ch)) {
-      needs_unescaping = true;
+      first = i;
       break;
     }
   }
-  if (!needs_unescaping) {
-    unescaped = part;
-    return unescaped;
+  if (first == absl::string_view::npos) {
+    return std::string(part);
   }
 
-  unescaped.resize(part.size());
-
-  char* begin = &(unescaped)[0];
-  char* p = begin;
-
-  for (size_t i = 0; i < part.size();) {
-    if (GetEscapedChar(part, i, unescape_reserved_chars, &ch)) {
-      *p++ = ch;
+  std::string unescaped;
+  unescaped.reserve(part.size());
+  unescaped.append(part.data(), first);
+  for (size_t i = first; i < part.size();) {
+    if (part[i] != '%') {
+      // Bulk-copy the untouched run up to the next '%'.
+      size_t next = FindNextPercent(part, i);
+      if (next == absl::string_view::npos) {
+        next = part.size();
+      }
+      unescaped.append(part.data() + i, next - i);
+      i = next;
+    } else if (GetEscapedChar(part, i, unescape_reserved_chars, &ch)) {
+      unescaped.push_back(ch);
       i += 3;
     } else {
-      *p++ = part[i];
+      unescaped.push_back(part[i]);
       i += 1;
     }
   }
-
-  unescaped.resize(p - begin);
   return unescaped;
 }
 
 }  // namespace
 
 void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
-                             const std::vector<std::string>& parts,
+                             const std::vector<absl::string_view>& parts,
                              std::vector<VariableBinding>* bindings,
                              bool keep_binding_escaped) {
   for (const auto& var : vars) {
@@ -157,9 +210,10 @@ void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
     for (size_t i = var.start_segment; i < end_segment; ++i) {
       // For multipart matches only unescape non-reserved characters.
       if (keep_binding_escaped) {
-        binding.value += parts[i];
+        absl::StrAppend(&binding.value, parts[i]);
       } else {
-        binding.value += UrlUnescapeString(parts[i], !is_multipart);
+        absl::StrAppend(&binding.value,
+                        UrlUnescapeString(parts[i], !is_multipart));
       }
       if (i < end_segment - 1) {
         binding.value += "/";
@@ -170,58 +224,115 @@ void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
 }
 
 void ExtractBindingsFromQueryParameters(
-    const std::string& query_params, const std::set<std::string>& system_params,
+    absl::string_view query_params, const std::set<std::string>& system_params,
     std::vector<VariableBinding>* bindings, bool keep_binding_escaped) {
   // The bindings in URL the query parameters have the following form:
   //      <field_path1>=value1&<field_path2>=value2&...&<field_pathN>=valueN
   // Query parameters may also contain system parameters such as `api_key`.
   // We'll need to ignore these. Example:
   //      book.id=123&book.author=Neal%20Stephenson&api_key=AIzaSyAz7fhBkC35D2M
-  std::vector<std::string> params = absl::StrSplit(query_params, '&');
-  for (const auto& param : params) {
-    size_t pos = param.find('=');
-    if (pos != 0 && pos != std::string::npos) {
-      auto name = param.substr(0, pos);
-      // Make sure the query parameter is not a system parameter (e.g.
-      // `api_key`) before adding the binding.
-      if (system_params.find(name) == std::end(system_params)) {
-        // The name of the parameter is a field path, which is a dot-delimited
-        // sequence of field names that identify the (potentially deep) field
-        // in the request, e.g. `book.author.name`.
-        VariableBinding binding;
-        binding.field_path = absl::StrSplit(name, '.');
-        if (keep_binding_escaped) {
-          binding.value = param.substr(pos + 1);
-        } else {
-          binding.value = UrlUnescapeString(param.substr(pos + 1), true);
-        }
-        bindings->emplace_back(std::move(binding));
+  //
+  // A single forward scan over views of the query string; strings are only
+  // materialized for the parameters that actually produce a binding.
+  for (size_t begin = 0; begin <= query_params.size();) {
+    size_t end = query_params.find('&', begin);
+    if (end == absl::string_view::npos) {
+      end = query_params.size();
+    }
+    const absl::string_view param = query_params.substr(begin, end - begin);
+    begin = end + 1;
+
+    const size_t pos = param.find('=');
+    if (pos == 0 || pos == absl::string_view::npos) {
+      continue;
+    }
+    const absl::string_view name = param.substr(0, pos);
+    // Make sure the query parameter is not a system parameter (e.g.
+    // `api_key`) before adding the binding. The set is tiny, so a linear
+    // scan beats building a lookup key.
+    bool is_system_param = false;
+    for (const std::string& system_param : system_params) {
+      if (system_param == name) {
+        is_system_param = true;
+        break;
       }
     }
+    if (is_system_param) {
+      continue;
+    }
+    // The name of the parameter is a field path, which is a dot-delimited
+    // sequence of field names that identify the (potentially deep) field
+    // in the request, e.g. `book.author.name`.
+    VariableBinding binding;
+    binding.field_path = absl::StrSplit(name, '.');
+    if (keep_binding_escaped) {
+      binding.value = std::string(param.substr(pos + 1));
+    } else {
+      binding.value = UrlUnescapeString(param.substr(pos + 1), true);
+    }
+    bindings->emplace_back(std::move(binding));
   }
 }
 
-std::vector<std::string> ExtractRequestParts(
-    std::string path, const std::set<std::string>& custom_verbs) {
-  // Remove query parameters.
-  path = path.substr(0, path.find_first_of('?'));
+std::vector<absl::string_view> ExtractRequestParts(
+    absl::string_view path, const std::set<std::string>& custom_verbs) {
+  std::vector<absl::string_view> result;
+  if (path.empty()) {
+    return result;
+  }
 
-  // Replace last ':' with '/' to handle custom verb.
-  // But not for /foo:bar/const.
-  std::size_t last_colon_pos = path.find_last_of(':');
-  std::size_t last_slash_pos = path.find_last_of('/');
-  if (last_colon_pos != std::string::npos && last_colon_pos > last_slash_pos) {
-    std::string verb = path.substr(last_colon_pos + 1);
-    // only verb in the configured custom verbs, treat it as verb
-    // replace ":" with / as a separate segment.
-    if (custom_verbs.find(verb) != custom_verbs.end()) {
-      path[last_colon_pos] = '/';
+  // One forward pass performs the query string cutoff, the segmentation and
+  // the custom verb detection together. The leading character (the root '/')
+  // is not part of any segment; a ':' only counts as a verb separator when
+  // it sits in the last segment, so the marker is dropped at every '/'.
+  size_t end = path.size();
+  size_t segment_start = 1;
+  size_t last_colon = absl::string_view::npos;
+  bool seen_slash = false;
+  for (size_t i = 0; i < path.size(); ++i) {
+    const char c = path[i];
+    if (c == '?') {
+      // Remove query parameters.
+      end = i;
+      break;
+    }
+    if (c == '/') {
+      seen_slash = true;
+      last_colon = absl::string_view::npos;
+      if (i > 0) {
+        result.push_back(path.substr(segment_start, i - segment_start));
+      }
+      segment_start = i + 1;
+    } else if (c == ':') {
+      last_colon = i;
     }
   }
 
-  std::vector<std::string> result;
-  if (!path.empty()) {
-    result = absl::StrSplit(path.substr(1), '/');
+  // Separate a trailing custom verb into its own part to handle it the same
+  // way as a '/' separated segment. But not for /foo:bar/const, and not for
+  // a path without any '/' before the ':'. The verb borrows from |path|
+  // like every other part, so no copy is made; the set is tiny, so a linear
+  // scan beats building a lookup key.
+  absl::string_view verb;
+  bool has_verb = false;
+  size_t final_end = end;
+  if (seen_slash && last_colon != absl::string_view::npos) {
+    const absl::string_view candidate =
+        path.substr(last_colon + 1, end - last_colon - 1);
+    for (const std::string& custom_verb : custom_verbs) {
+      if (custom_verb == candidate) {
+        verb = candidate;
+        has_verb = true;
+        final_end = last_colon;
+        break;
+      }
+    }
+  }
+  if (end > 0) {
+    result.push_back(path.substr(segment_start, final_end - segment_start));
+  }
+  if (has_verb) {
+    result.push_back(verb);
   }
   // Removes all trailing empty parts caused by extra "/".
   while (!result.empty() && (*(--result.end())).empty()) {
@@ -238,6 +349,41 @@ PathMatcherLookupResult LookupInPathMatcherNode(
   return result;
 }
 
+std::string ExactMatchKey(absl::string_view http_method,
+                          const std::vector<absl::string_view>& parts) {
+  size_t size = http_method.size() + 1;
+  for (const auto& part : parts) {
+    size += part.size() + 1;
+  }
+  std::string key;
+  key.reserve(size);
+  // '\0' cannot occur in a http method, so it unambiguously separates the
+  // method from the path parts.
+  absl::StrAppend(&key, http_method);
+  key.push_back('\0');
+  for (size_t i = 0; i < parts.size(); ++i) {
+    if (i > 0) {
+      key.push_back('/');
+    }
+    absl::StrAppend(&key, parts[i]);
+  }
+  return key;
+}
+
+bool IsLiteralTemplate(const HttpTemplate& ht) {
+  if (!ht.Variables().empty()) {
+    return false;
+  }
+  for (const std::string& segment : ht.segments()) {
+    if (segment == HttpTemplate::kSingleParameterKey ||
+        segment == HttpTemplate::kWildCardPathPartKey ||
+        segment == HttpTemplate::kWildCardPathKey) {
+      return false;
+    }
+  }
+  return true;
+}
+
 PathMatcherNode::PathInfo TransformHttpTemplate(const HttpTemplate& ht) {
   PathMatcherNode::PathInfo::Builder builder;
 
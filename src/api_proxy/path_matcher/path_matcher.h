@@ -21,6 +21,10 @@
 #include <string>
 #include <unordered_map>
 
+#include "absl/container/flat_hash_map.h"
+
+#include "absl/strings/string_view.h"
+#include "src/api_proxy/path_matcher/compiled_trie.h"
 #include "src/api_proxy/path_matcher/http_template.h"
 #include "src/api_proxy/path_matcher/path_matcher_node.h"
 
@@ -48,6 +52,36 @@ inline bool operator==(const VariableBinding& b1, const VariableBinding& b2) {
 template <class Method>
 class PathMatcherBuilder;  // required for PathMatcher constructor
 
+// Block arena the per-method data records are carved from, mirroring
+// NodeArena for trie nodes. Packing the records into a few contiguous
+// blocks instead of one heap allocation (plus shared_ptr control block)
+// per http rule keeps large configs compact and lookup-sized reads local.
+// Blocks never reallocate, so record addresses are stable — the trie
+// nodes and the exact match map store raw pointers into the arena.
+// Records are never returned individually; like trie nodes they live
+// until the last builder or matcher sharing the arena goes away.
+template <class MethodData>
+class MethodDataArena {
+ public:
+  // Returns a fresh record. It lives until the arena is destroyed.
+  MethodData* Allocate() {
+    if (blocks_.empty() || blocks_.back().size() == kMethodsPerBlock) {
+      blocks_.emplace_back();
+      blocks_.back().reserve(kMethodsPerBlock);
+    }
+    blocks_.back().emplace_back();
+    return &blocks_.back().back();
+  }
+
+ private:
+  // Sized so one block spans a few memory pages.
+  static constexpr size_t kMethodsPerBlock = 256;
+
+  // Blocks never reallocate (each is reserved up front), so record
+  // addresses are stable.
+  std::vector<std::vector<MethodData>> blocks_;
+};
+
 // The immutable, thread safe PathMatcher stores a mapping from a combination of
 // a service (host) name and a HTTP path to your method (MethodInfo*). It is
 // constructed with a PathMatcherBuilder and supports one operation: Lookup.
@@ -81,13 +115,41 @@ class PathMatcher {
 
   Method Lookup(const std::string& http_method, const std::string& path) const;
 
- private:
-  // Creates a Path Matcher with a Builder by moving the builder's root node.
-  explicit PathMatcher(PathMatcherBuilder<Method>&& builder);
+  // Element counts of the structures backing this matcher, exposed for the
+  // proxy's admin debug dump so cache and trie sizing can be done from data.
+  struct DebugStats {
+    size_t methods = 0;
+    size_t exact_map_entries = 0;
+    size_t arena_nodes = 0;
+    CompiledTrie::Stats trie;
+  };
+  DebugStats GetDebugStats() const;
 
+ private:
+  // Creates a Path Matcher snapshot of the builder's current registrations.
+  // The trie nodes and method data are shared with the builder; lookups go
+  // through the compiled form, which is immutable.
+  explicit PathMatcher(const PathMatcherBuilder<Method>& builder);
+
+  // Single-probe lookup of |parts| among the literal templates. Returns the
+  // matching method data, or nullptr when the request has to walk the trie.
+  void* LookupInExactMap(const std::string& http_method,
+                         const std::vector<absl::string_view>& parts) const;
+
+  // The arena all trie nodes (including the root) are carved from; shared
+  // with the builder and any other matchers built from it.
+  std::shared_ptr<NodeArena> arena_;
   // A root node shared by all services, i.e. paths of all services will be
-  // registered to this node.
-  std::unique_ptr<PathMatcherNode> root_ptr_;
+  // registered to this node. Owned by |arena_|.
+  PathMatcherNode* root_ptr_;
+  // The flat, cache-friendly form of the trie under |root_ptr_|; lookups
+  // that miss |exact_map_| go through it.
+  std::unique_ptr<CompiledTrie> compiled_trie_;
+  // Literal templates (no variables, no wildcards) keyed by
+  // ExactMatchKey(http method, parts). Most configured http rules are
+  // literal, so the common case is a single hash probe that skips the trie
+  // walk entirely.
+  absl::flat_hash_map<std::string, void*> exact_map_;
   // Holds the set of custom verbs found in configured templates.
   std::set<std::string> custom_verbs_;
   // Data we store per each registered method
@@ -96,9 +158,13 @@ class PathMatcher {
     std::vector<HttpTemplate::Variable> variables;
     std::string body_field_path;
   };
-  // The info associated with each method. The path matcher nodes
-  // will hold pointers to MethodData objects in this vector.
-  std::vector<std::unique_ptr<MethodData>> methods_;
+  // The arena all MethodData records are carved from; shared with the
+  // builder so incremental rebuilds reuse them and the records stay alive
+  // as long as any matcher does.
+  std::shared_ptr<MethodDataArena<MethodData>> method_arena_;
+  // The records currently registered; the path matcher nodes hold raw
+  // pointers to them. Owned by |method_arena_|.
+  std::vector<MethodData*> methods_;
 
  private:
   friend class PathMatcherBuilder<Method>;
@@ -110,6 +176,12 @@ using PathMatcherPtr = std::unique_ptr<PathMatcher<Method>>;
 // This PathMatcherBuilder is used to register path-WrapperGraph pairs and
 // instantiate an immutable, thread safe PathMatcher.
 //
+// The builder may be kept alive across config rollouts: Build() does not
+// consume it, so a rollout that changes a handful of http rules applies the
+// diff with Register()/Unregister() and calls Build() again. Unchanged
+// subtrees and method data are shared by reference between the builder and
+// all matchers built from it; only the flat lookup snapshot is re-emitted.
+//
 // The PathMatcherBuilder itself is NOT THREAD SAFE.
 template <class Method>
 class PathMatcherBuilder {
@@ -125,33 +197,49 @@ class PathMatcherBuilder {
   bool Register(std::string http_method, std::string path,
                 std::string body_field_path, Method method);
 
+  // Removes a previously registered (http_method, path) pair so the next
+  // Build() no longer matches it. Matchers built earlier are unaffected.
+  // Returns false if path is an invalid http template or the pair is not
+  // registered.
+  bool Unregister(std::string http_method, std::string path);
+
   // Returns a unique_ptr to a thread safe PathMatcher that contains all
-  // registered path-WrapperGraph pairs. Note the PathMatchBuilder instance
-  // will be moved so cannot use after invoking Build().
-  PathMatcherPtr<Method> Build();
+  // registered path-WrapperGraph pairs. The builder stays valid and can keep
+  // taking Register()/Unregister() calls for later incremental Build()s.
+  PathMatcherPtr<Method> Build() const;
 
  private:
+  // The arena all trie nodes are carved from; shared with every matcher
+  // built from this builder so shared subtrees stay alive, and freed as a
+  // few blocks once the last of them goes away.
+  std::shared_ptr<NodeArena> arena_;
   // A root node shared by all services, i.e. paths of all services will be
-  // registered to this node.
-  std::unique_ptr<PathMatcherNode> root_ptr_;
+  // registered to this node. Owned by |arena_|.
+  PathMatcherNode* root_ptr_;
   // The set of custom verbs configured.
   // TODO: Perhaps this should not be at this level because there will
   // be multiple templates in different services on a server. Consider moving
   // this to PathMatcherNode.
   std::set<std::string> custom_verbs_;
   typedef typename PathMatcher<Method>::MethodData MethodData;
-  std::vector<std::unique_ptr<MethodData>> methods_;
+  // The arena all MethodData records are carved from; shared with every
+  // matcher built from this builder, like |arena_| for the trie nodes.
+  std::shared_ptr<MethodDataArena<MethodData>> method_arena_;
+  // The records currently registered. Owned by |method_arena_|.
+  std::vector<MethodData*> methods_;
+  // Exact match entries collected by Register(); moved into the matcher.
+  absl::flat_hash_map<std::string, void*> exact_map_;
 
   friend class PathMatcher<Method>;
 };
 
 void ExtractBindingsFromPath(const std::vector<HttpTemplate::Variable>& vars,
-                             const std::vector<std::string>& parts,
+                             const std::vector<absl::string_view>& parts,
                              std::vector<VariableBinding>* bindings,
                              bool keep_binding_escaped);
 
 void ExtractBindingsFromQueryParameters(
-    const std::string& query_params, const std::set<std::string>& system_params,
+    absl::string_view query_params, const std::set<std::string>& system_params,
     std::vector<VariableBinding>* bindings, bool keep_binding_escaped);
 
 // Converts a request path into a format that can be used to perform a request
@@ -165,8 +253,11 @@ void ExtractBindingsFromQueryParameters(
 //
 // - Strips off query string: "/a?foo=bar" --> "/a"
 // - Collapses extra slashes: "///" --> "/"
-std::vector<std::string> ExtractRequestParts(
-    std::string path, const std::set<std::string>& custom_verbs);
+//
+// The returned parts are views borrowing from |path|; no per-segment string
+// is allocated. They are only valid while the original path is alive.
+std::vector<absl::string_view> ExtractRequestParts(
+    absl::string_view path, const std::set<std::string>& custom_verbs);
 
 // Looks up on a PathMatcherNode.
 PathMatcherLookupResult LookupInPathMatcherNode(
@@ -175,17 +266,34 @@ PathMatcherLookupResult LookupInPathMatcherNode(
 
 PathMatcherNode::PathInfo TransformHttpTemplate(const HttpTemplate& ht);
 
+// Returns the exact match map key for a http method and the normalized,
+// slash separated request parts: "METHOD\0part1/part2/...". Templates use
+// the same normalized form, so one key equality check decides a full match.
+std::string ExactMatchKey(absl::string_view http_method,
+                          const std::vector<absl::string_view>& parts);
+
+// Returns true if |ht| matches exactly one literal path, i.e. it contains no
+// variables, no wildcard segments and no single-parameter segments.
+bool IsLiteralTemplate(const HttpTemplate& ht);
+
 template <class Method>
-PathMatcher<Method>::PathMatcher(PathMatcherBuilder<Method>&& builder)
-    : root_ptr_(std::move(builder.root_ptr_)),
-      custom_verbs_(std::move(builder.custom_verbs_)),
-      methods_(std::move(builder.methods_)) {}
+PathMatcher<Method>::PathMatcher(const PathMatcherBuilder<Method>& builder)
+    : arena_(builder.arena_),
+      root_ptr_(builder.root_ptr_),
+      custom_verbs_(builder.custom_verbs_),
+      method_arena_(builder.method_arena_),
+      methods_(builder.methods_) {
+  exact_map_ = builder.exact_map_;
+  if (root_ptr_ != nullptr) {
+    compiled_trie_ = CompiledTrie::Compile(*root_ptr_);
+  }
+}
 
 template <class Method>
 Method PathMatcher<Method>::Lookup(
     const std::string& http_method, const std::string& path,
     std::vector<VariableBinding>* variable_bindings) const {
-  const std::vector<std::string> parts =
+  const std::vector<absl::string_view> parts =
       ExtractRequestParts(path, custom_verbs_);
 
   // If service_name has not been registered to ESP V2 and
@@ -195,14 +303,16 @@ Method PathMatcher<Method>::Lookup(
     return nullptr;
   }
 
-  PathMatcherLookupResult lookup_result =
-      LookupInPathMatcherNode(*root_ptr_, parts, http_method);
+  void* data = LookupInExactMap(http_method, parts);
+  if (data == nullptr) {
+    // Not need to check duplication. Only first item is stored for duplicated
+    data = compiled_trie_->Lookup(parts, http_method).data;
+  }
   // Return nullptr if nothing is found.
-  // Not need to check duplication. Only first item is stored for duplicated
-  if (lookup_result.data == nullptr) {
+  if (data == nullptr) {
     return nullptr;
   }
-  MethodData* method_data = reinterpret_cast<MethodData*>(lookup_result.data);
+  MethodData* method_data = reinterpret_cast<MethodData*>(data);
   if (variable_bindings != nullptr) {
     variable_bindings->clear();
     ExtractBindingsFromPath(method_data->variables, parts, variable_bindings,
@@ -225,7 +335,7 @@ Method PathMatcher<Method>::Lookup(
     const std::string& query_params,
     std::vector<VariableBinding>* variable_bindings,
     std::string* body_field_path) const {
-  const std::vector<std::string> parts =
+  const std::vector<absl::string_view> parts =
       ExtractRequestParts(path, custom_verbs_);
 
   // If service_name has not been registered to ESP V2 and
@@ -235,14 +345,16 @@ Method PathMatcher<Method>::Lookup(
     return nullptr;
   }
 
-  PathMatcherLookupResult lookup_result =
-      LookupInPathMatcherNode(*root_ptr_, parts, http_method);
+  void* data = LookupInExactMap(http_method, parts);
+  if (data == nullptr) {
+    // Not need to check duplication. Only first item is stored for duplicated
+    data = compiled_trie_->Lookup(parts, http_method).data;
+  }
   // Return nullptr if nothing is found.
-  // Not need to check duplication. Only first item is stored for duplicated
-  if (lookup_result.data == nullptr) {
+  if (data == nullptr) {
     return nullptr;
   }
-  MethodData* method_data = reinterpret_cast<MethodData*>(lookup_result.data);
+  MethodData* method_data = reinterpret_cast<MethodData*>(data);
   if (variable_bindings != nullptr) {
     variable_bindings->clear();
     ExtractBindingsFromPath(method_data->variables, parts, variable_bindings,
@@ -261,7 +373,7 @@ Method PathMatcher<Method>::Lookup(
 template <class Method>
 Method PathMatcher<Method>::Lookup(const std::string& http_method,
                                    const std::string& path) const {
-  const std::vector<std::string> parts =
+  const std::vector<absl::string_view> parts =
       ExtractRequestParts(path, custom_verbs_);
 
   // If service_name has not been registered to ESP and strict_service_matching_
@@ -270,25 +382,60 @@ Method PathMatcher<Method>::Lookup(const std::string& http_method,
     return nullptr;
   }
 
-  PathMatcherLookupResult lookup_result =
-      LookupInPathMatcherNode(*root_ptr_, parts, http_method);
+  void* data = LookupInExactMap(http_method, parts);
+  if (data == nullptr) {
+    // Not need to check duplication. Only first item is stored for duplicated
+    data = compiled_trie_->Lookup(parts, http_method).data;
+  }
   // Return nullptr if nothing is found.
-  // Not need to check duplication. Only first item is stored for duplicated
-  if (lookup_result.data == nullptr) {
+  if (data == nullptr) {
     return nullptr;
   }
-  MethodData* method_data = reinterpret_cast<MethodData*>(lookup_result.data);
+  MethodData* method_data = reinterpret_cast<MethodData*>(data);
   return method_data->method;
 }
 
+template <class Method>
+typename PathMatcher<Method>::DebugStats PathMatcher<Method>::GetDebugStats()
+    const {
+  DebugStats stats;
+  stats.methods = methods_.size();
+  stats.exact_map_entries = exact_map_.size();
+  if (arena_ != nullptr) {
+    stats.arena_nodes = arena_->NodeCount();
+  }
+  if (compiled_trie_ != nullptr) {
+    stats.trie = compiled_trie_->GetStats();
+  }
+  return stats;
+}
+
+template <class Method>
+void* PathMatcher<Method>::LookupInExactMap(
+    const std::string& http_method,
+    const std::vector<absl::string_view>& parts) const {
+  if (exact_map_.empty()) {
+    return nullptr;
+  }
+  auto it = exact_map_.find(ExactMatchKey(http_method, parts));
+  if (it == exact_map_.end()) {
+    // Fall back to literal templates registered for the http method wild
+    // card, mirroring GetResultForHttpMethod on the trie.
+    it = exact_map_.find(ExactMatchKey("*", parts));
+  }
+  return it == exact_map_.end() ? nullptr : it->second;
+}
+
 // Initializes the builder with a root Path Segment
 template <class Method>
 PathMatcherBuilder<Method>::PathMatcherBuilder()
-    : root_ptr_(new PathMatcherNode()) {}
+    : arena_(new NodeArena()),
+      root_ptr_(arena_->AllocateNode()),
+      method_arena_(new MethodDataArena<MethodData>()) {}
 
 template <class Method>
-PathMatcherPtr<Method> PathMatcherBuilder<Method>::Build() {
-  return PathMatcherPtr<Method>(new PathMatcher<Method>(std::move(*this)));
+PathMatcherPtr<Method> PathMatcherBuilder<Method>::Build() const {
+  return PathMatcherPtr<Method>(new PathMatcher<Method>(*this));
 }
 
 // This wrapper converts the |http_rule| into a HttpTemplate. Then, inserts the
@@ -306,24 +453,67 @@ bool PathMatcherBuilder<Method>::Register(std::string http_method,
   if (path_info.path_info().size() == 0) {
     return false;
   }
-  // Create & initialize a MethodData struct. Then insert its pointer
-  // into the path matcher trie.
-  auto method_data = std::unique_ptr<MethodData>(new MethodData());
+  // Carve & initialize a MethodData record from the arena. Then insert its
+  // pointer into the path matcher trie.
+  MethodData* method_data = method_arena_->Allocate();
   method_data->method = method;
   method_data->variables = std::move(ht->Variables());
   method_data->body_field_path = std::move(body_field_path);
 
-  if (!root_ptr_->InsertPath(path_info, http_method, method_data.get(), true)) {
+  if (!root_ptr_->InsertPath(path_info, http_method, method_data, true,
+                             arena_.get())) {
     return false;
   }
-  // Add the method_data to the methods_ vector for cleanup
-  methods_.emplace_back(std::move(method_data));
+  // Literal templates additionally go into the exact match map, so requests
+  // for them resolve with a single hash probe instead of a trie walk.
+  if (IsLiteralTemplate(*ht)) {
+    std::vector<absl::string_view> parts(ht->segments().begin(),
+                                         ht->segments().end());
+    if (!ht->verb().empty()) {
+      parts.push_back(ht->verb());
+    }
+    exact_map_.emplace(ExactMatchKey(http_method, parts), method_data);
+  }
+  // Track the record so the registered method count stays exact.
+  methods_.emplace_back(method_data);
   if (!ht->verb().empty()) {
     custom_verbs_.insert(ht->verb());
   }
   return true;
 }
 
+template <class Method>
+bool PathMatcherBuilder<Method>::Unregister(std::string http_method,
+                                            std::string http_template) {
+  std::unique_ptr<HttpTemplate> ht(HttpTemplate::Parse(http_template));
+  if (nullptr == ht) {
+    return false;
+  }
+  PathMatcherNode::PathInfo path_info = TransformHttpTemplate(*ht);
+  void* removed_data = nullptr;
+  if (!root_ptr_->ErasePath(path_info, http_method, &removed_data)) {
+    return false;
+  }
+  if (IsLiteralTemplate(*ht)) {
+    std::vector<absl::string_view> parts(ht->segments().begin(),
+                                         ht->segments().end());
+    if (!ht->verb().empty()) {
+      parts.push_back(ht->verb());
+    }
+    exact_map_.erase(ExactMatchKey(http_method, parts));
+  }
+  // Drop the record from the registered list. Its storage stays in the
+  // arena (records, like trie nodes, are never returned individually), so
+  // matchers built earlier keep dereferencing it safely.
+  for (auto it = methods_.begin(); it != methods_.end(); ++it) {
+    if (*it == removed_data) {
+      methods_.erase(it);
+      break;
+    }
+  }
+  return true;
+}
+
 }  // namespace path_matcher
 }  // namespace api_proxy
 }  // namespace google
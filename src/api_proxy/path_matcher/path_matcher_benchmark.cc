@@ -0,0 +1,179 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// Benchmarks for the path matcher under realistic rule set sizes, so lookup
+// or build regressions can be quantified before deploying new proxy builds.
+//
+//   bazel run -c opt //src/api_proxy/path_matcher:path_matcher_benchmark
+//
+// Rule sets are synthetic: |size| templates of 4-8 segments where
+// |variable_density| percent of the segments are {variables}. The request
+// mix replays registered paths in random order.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "benchmark/benchmark.h"
+#include "src/api_proxy/path_matcher/path_matcher.h"
+
+namespace google {
+namespace api_proxy {
+namespace path_matcher {
+namespace {
+
+// Counts global allocations so benchmarks can report allocations per
+// iteration next to latency.
+std::atomic<int64_t> g_allocations{0};
+
+struct RuleSet {
+  std::vector<std::string> templates;
+  std::vector<std::string> request_paths;
+};
+
+// Builds |size| distinct templates; |variable_density| percent of the
+// segments become single-segment variables.
+RuleSet MakeRuleSet(int size, int variable_density) {
+  RuleSet rules;
+  std::mt19937 rng(size + variable_density);
+  std::uniform_int_distribution<int> depth_dist(4, 8);
+  std::uniform_int_distribution<int> percent(0, 99);
+  for (int i = 0; i < size; ++i) {
+    std::string http_template;
+    std::string request_path;
+    const int depth = depth_dist(rng);
+    for (int d = 0; d < depth; ++d) {
+      // The leading segments spread rules over a realistic shared prefix
+      // space; the last segment makes the template unique.
+      const int value = (d + 1 == depth) ? i : (i / 100 + d * 7) % 50;
+      if (percent(rng) < variable_density) {
+        absl::StrAppend(&http_template, "/{var", d, "}");
+      } else {
+        absl::StrAppend(&http_template, "/seg", d, "_", value);
+      }
+      absl::StrAppend(&request_path, "/seg", d, "_", value);
+    }
+    rules.templates.push_back(http_template);
+    rules.request_paths.push_back(request_path);
+  }
+  return rules;
+}
+
+PathMatcherPtr<int*> BuildMatcher(const RuleSet& rules) {
+  static int method_data = 0;
+  PathMatcherBuilder<int*> builder;
+  for (const auto& http_template : rules.templates) {
+    builder.Register("GET", http_template, "", &method_data);
+  }
+  return builder.Build();
+}
+
+void BM_BuilderBuild(benchmark::State& state) {
+  const RuleSet rules =
+      MakeRuleSet(state.range(0), /*variable_density=*/state.range(1));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(BuildMatcher(rules));
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_Lookup(benchmark::State& state) {
+  const RuleSet rules =
+      MakeRuleSet(state.range(0), /*variable_density=*/state.range(1));
+  const auto matcher = BuildMatcher(rules);
+  std::vector<std::string> paths = rules.request_paths;
+  std::shuffle(paths.begin(), paths.end(), std::mt19937(42));
+
+  size_t i = 0;
+  const int64_t allocations_before = g_allocations.load();
+  std::vector<VariableBinding> bindings;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(matcher->Lookup("GET", paths[i], &bindings));
+    if (++i == paths.size()) {
+      i = 0;
+    }
+  }
+  state.counters["allocs_per_lookup"] = benchmark::Counter(
+      static_cast<double>(g_allocations.load() - allocations_before) /
+      static_cast<double>(state.iterations()));
+}
+
+// Storage-style lookups: a trailing-'**' template matched against paths of
+// |depth| segments. Sensitive to how the matcher consumes the suffix.
+void BM_LookupDeepWildcard(benchmark::State& state) {
+  static int method_data = 0;
+  PathMatcherBuilder<int*> builder;
+  builder.Register("GET", "/objects/{name=**}", "", &method_data);
+  builder.Register("GET", "/buckets/{name=**}/acl", "", &method_data);
+  const auto matcher = builder.Build();
+
+  std::string path = "/objects";
+  for (int d = 0; d < state.range(0); ++d) {
+    absl::StrAppend(&path, "/dir", d % 10);
+  }
+  std::vector<VariableBinding> bindings;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(matcher->Lookup("GET", path, &bindings));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ExtractRequestParts(benchmark::State& state) {
+  const std::string path = "/seg0_1/seg1_8/seg2_15/seg3_22/seg4_29/seg5_36";
+  const std::set<std::string> custom_verbs;
+  const int64_t allocations_before = g_allocations.load();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ExtractRequestParts(path, custom_verbs));
+  }
+  state.counters["allocs_per_call"] = benchmark::Counter(
+      static_cast<double>(g_allocations.load() - allocations_before) /
+      static_cast<double>(state.iterations()));
+}
+
+// (rule count, variable density in percent).
+BENCHMARK(BM_BuilderBuild)
+    ->Args({100, 30})
+    ->Args({5000, 30})
+    ->Args({50000, 30})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Lookup)
+    ->Args({100, 0})
+    ->Args({100, 30})
+    ->Args({5000, 0})
+    ->Args({5000, 30})
+    ->Args({50000, 0})
+    ->Args({50000, 30});
+// (path depth in segments).
+BENCHMARK(BM_LookupDeepWildcard)->Arg(8)->Arg(64)->Arg(512);
+BENCHMARK(BM_ExtractRequestParts);
+
+}  // namespace
+}  // namespace path_matcher
+}  // namespace api_proxy
+}  // namespace google
+
+void* operator new(size_t size) {
+  ::google::api_proxy::path_matcher::g_allocations.fetch_add(
+      1, std::memory_order_relaxed);
+  return malloc(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+BENCHMARK_MAIN();
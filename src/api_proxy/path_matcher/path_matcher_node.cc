@@ -51,24 +51,6 @@ typename Collection::value_type::second_type* InsertOrReturnExisting(
                                 typename Collection::value_type(key, data));
 }
 
-// Returns a reference to the pointer associated with key. If not found,
-// a pointee is constructed and added to the map. In that case, the new
-// pointee is value-initialized (aka "default-constructed").
-// Useful for containers of the form Map<Key, Ptr>, where Ptr is pointer-like.
-template <class Collection>
-typename Collection::value_type::second_type& LookupOrInsertNew(
-    Collection* const collection,
-    const typename Collection::value_type::first_type& key) {
-  typedef typename Collection::value_type::second_type Mapped;
-  typedef typename Mapped::element_type Element;
-  std::pair<typename Collection::iterator, bool> ret =
-      collection->insert(typename Collection::value_type(key, Mapped()));
-  if (ret.second) {
-    ret.first->second = Mapped(new Element());
-  }
-  return ret.first->second;
-}
-
 // A convinent function to lookup a STL colllection with two keys.
 // Lookup key1 first, if not found, lookup key2, or return nullptr.
 template <class Collection>
@@ -109,12 +91,12 @@ PathMatcherNode::PathInfo PathMatcherNode::PathInfo::Builder::Build() const {
 
 PathMatcherNode::~PathMatcherNode() {}
 
-std::unique_ptr<PathMatcherNode> PathMatcherNode::Clone() const {
-  std::unique_ptr<PathMatcherNode> clone(new PathMatcherNode());
+PathMatcherNode* PathMatcherNode::Clone(NodeArena* arena) const {
+  PathMatcherNode* clone = arena->AllocateNode();
   clone->result_map_ = result_map_;
   // deep-copy literal children
   for (const auto& entry : children_) {
-    clone->children_.emplace(entry.first, entry.second->Clone());
+    clone->children_.emplace(entry.first, entry.second->Clone(arena));
   }
   clone->wildcard_ = wildcard_;
   return clone;
@@ -176,10 +158,32 @@ void PathMatcherNode::LookupPath(const RequestPathParts::const_iterator current,
 
 bool PathMatcherNode::InsertPath(const PathInfo& node_path_info,
                                  std::string http_method, void* method_data,
-                                 bool mark_duplicates) {
+                                 bool mark_duplicates, NodeArena* arena) {
   return InsertTemplate(node_path_info.path_info().begin(),
                         node_path_info.path_info().end(), http_method,
-                        method_data, mark_duplicates);
+                        method_data, mark_duplicates, arena);
+}
+
+bool PathMatcherNode::ErasePath(const PathInfo& node_path_info,
+                                const HttpMethod& http_method,
+                                void** removed_data) {
+  PathMatcherNode* node = this;
+  for (const std::string& part : node_path_info.path_info()) {
+    auto child = node->children_.find(part);
+    if (child == node->children_.end()) {
+      return false;
+    }
+    node = child->second;
+  }
+  auto result = node->result_map_.find(http_method);
+  if (result == node->result_map_.end()) {
+    return false;
+  }
+  if (removed_data != nullptr) {
+    *removed_data = result->second.data;
+  }
+  node->result_map_.erase(result);
+  return true;
 }
 
 // This method locates a matching child for the |current| path part, inserting a
@@ -193,7 +197,7 @@ bool PathMatcherNode::InsertPath(const PathInfo& node_path_info,
 bool PathMatcherNode::InsertTemplate(
     const std::vector<std::string>::const_iterator current,
     const std::vector<std::string>::const_iterator end, HttpMethod http_method,
-    void* method_data, bool mark_duplicates) {
+    void* method_data, bool mark_duplicates, NodeArena* arena) {
   if (current == end) {
     PathMatcherLookupResult* const existing = InsertOrReturnExisting(
         &result_map_, http_method, PathMatcherLookupResult(method_data, false));
@@ -205,13 +209,15 @@ bool PathMatcherNode::InsertTemplate(
     }
     return true;
   }
-  std::unique_ptr<PathMatcherNode>& child =
-      LookupOrInsertNew(&children_, *current);
+  PathMatcherNode*& child = children_[*current];
+  if (child == nullptr) {
+    child = arena->AllocateNode();
+  }
   if (*current == HttpTemplate::kWildCardPathKey) {
     child->set_wildcard(true);
   }
   return child->InsertTemplate(current + 1, end, http_method, method_data,
-                               mark_duplicates);
+                               mark_duplicates, arena);
 }
 
 bool PathMatcherNode::LookupPathFromChild(
@@ -26,6 +26,8 @@ namespace path_matcher {
 
 typedef std::string HttpMethod;
 
+class NodeArena;
+
 struct PathMatcherLookupResult {
   PathMatcherLookupResult() : data(nullptr), is_multiple(false) {}
 
@@ -115,8 +117,8 @@ class PathMatcherNode {
 
   ~PathMatcherNode();
 
-  // Creates a clone of this node and its subtrie
-  std::unique_ptr<PathMatcherNode> Clone() const;
+  // Creates a clone of this node and its subtrie, carved from |arena|.
+  PathMatcherNode* Clone(NodeArena* arena) const;
 
   // Searches subtrie by finding a matching child for the current path part. If
   // a matching child exists, this function recurses on current + 1 with that
@@ -134,12 +136,24 @@ class PathMatcherNode {
   // otherwise and depends on if mark_duplicates is true, the template will be
   // marked as having been registered for more than once and the lookup of the
   // template will yield a special error reporting WrapperGraph.
+  // New trie nodes created along the way are carved from |arena|, which must
+  // outlive this trie.
   bool InsertPath(const PathInfo& node_path_info, std::string http_method,
-                  void* method_data, bool mark_duplicates);
+                  void* method_data, bool mark_duplicates, NodeArena* arena);
+
+  // Removes the registration of |http_method| at the terminal node of
+  // |node_path_info|. The nodes themselves stay in place since sibling
+  // templates may run through them. Returns true if a registration was
+  // removed; |removed_data| (may be nullptr) receives its method data.
+  bool ErasePath(const PathInfo& node_path_info, const HttpMethod& http_method,
+                 void** removed_data);
 
   void set_wildcard(bool wildcard) { wildcard_ = wildcard; }
 
  private:
+  // CompiledTrie flattens this trie into contiguous arrays at Build() time.
+  friend class CompiledTrie;
+
   // This method inserts a path of nodes into this subtrie (described by the
   // vector<Info>, starting from the |current| position in the iterator of path
   // parts, and if necessary, creating intermediate nodes along the way. The
@@ -152,7 +166,7 @@ class PathMatcherNode {
   bool InsertTemplate(const std::vector<std::string>::const_iterator current,
                       const std::vector<std::string>::const_iterator end,
                       HttpMethod http_method, void* method_data,
-                      bool mark_duplicates);
+                      bool mark_duplicates, NodeArena* arena);
 
   // Helper method for LookupPath. If the given child key exists, search
   // continues on the child node pointed by the child key with the next part
@@ -181,12 +195,50 @@ class PathMatcherNode {
   //
   // To ensure fast lookups when n grows large, it is prudent to consider an
   // alternative to binary search on a sorted vector.
-  std::unordered_map<std::string, std::unique_ptr<PathMatcherNode>> children_;
+  // The children are owned by the NodeArena the trie was built with, not by
+  // this map.
+  std::unordered_map<std::string, PathMatcherNode*> children_;
 
   // True if this node represents a wildcard path '**'.
   bool wildcard_;
 };
 
+// NodeArena owns all PathMatcherNodes of one trie. Nodes are carved from
+// large blocks instead of being heap-allocated one by one, so building a
+// trie for a config with tens of thousands of http rules does one allocation
+// per block rather than per trie edge, and tearing a matcher down on config
+// swap frees a handful of blocks instead of walking the whole trie deleting
+// nodes.
+class NodeArena {
+ public:
+  // Returns a fresh node. The node lives until the arena is destroyed.
+  PathMatcherNode* AllocateNode() {
+    if (blocks_.empty() || blocks_.back().size() == kNodesPerBlock) {
+      blocks_.emplace_back();
+      blocks_.back().reserve(kNodesPerBlock);
+    }
+    blocks_.back().emplace_back();
+    return &blocks_.back().back();
+  }
+
+  // Number of nodes ever carved from this arena (nodes are never returned).
+  size_t NodeCount() const {
+    size_t count = 0;
+    for (const auto& block : blocks_) {
+      count += block.size();
+    }
+    return count;
+  }
+
+ private:
+  // Sized so one block spans a few memory pages.
+  static constexpr size_t kNodesPerBlock = 256;
+
+  // Blocks never reallocate (each is reserved up front), so node addresses
+  // are stable.
+  std::vector<std::vector<PathMatcherNode>> blocks_;
+};
+
 }  // namespace path_matcher
 }  // namespace api_proxy
 }  // namespace google
@@ -136,7 +136,7 @@ class PathMatcherTest : public ::testing::Test {
     return result;
   }
 
- private:
+ protected:
   PathMatcherBuilder<MethodInfo*> builder_;
   PathMatcherPtr<MethodInfo*> matcher_;
   std::vector<std::unique_ptr<MethodInfo>> stored_methods_;
@@ -185,6 +185,26 @@ TEST_F(PathMatcherTest, WildCardMatches) {
   EXPECT_EQ(LookupNoVariableBindings("GET", "/c/f/d/e"), cfde);
 }
 
+TEST_F(PathMatcherTest, WildCardMatchesDeepPaths) {
+  MethodInfo* a__ = AddGetPath("/a/**");
+  MethodInfo* b__yz = AddGetPath("/b/**/y/z");
+  Build();
+
+  EXPECT_NE(nullptr, a__);
+  EXPECT_NE(nullptr, b__yz);
+
+  // Deep paths exercise the trailing-'**' suffix fast path and, for the
+  // constant-suffix template, one abandoned literal probe per segment.
+  std::string deep;
+  for (int i = 0; i < 200; ++i) {
+    deep += "/seg";
+  }
+  EXPECT_EQ(LookupNoVariableBindings("GET", "/a" + deep), a__);
+  EXPECT_EQ(LookupNoVariableBindings("GET", "/b" + deep + "/y/z"), b__yz);
+  EXPECT_EQ(LookupNoVariableBindings("GET", "/b" + deep), nullptr);
+  EXPECT_EQ(LookupNoVariableBindings("GET", "/b" + deep + "/y"), nullptr);
+}
+
 TEST_F(PathMatcherTest, WildCardMethodMatches) {
   MethodInfo* a__ = AddPath("*", "/a/**");
   MethodInfo* b_ = AddPath("*", "/b/*");
@@ -790,6 +810,59 @@ TEST_F(PathMatcherTest,
             bindings);
 }
 
+TEST_F(PathMatcherTest, IncrementalRebuildAfterUnregister) {
+  MethodInfo* a_b = AddGetPath("/a/b");
+  MethodInfo* c_x = AddGetPath("/c/{x}");
+  Build();
+
+  EXPECT_NE(nullptr, a_b);
+  EXPECT_NE(nullptr, c_x);
+
+  VariableBindings bindings;
+  EXPECT_EQ(Lookup("GET", "/a/b", &bindings), a_b);
+
+  // Apply a diff: drop one rule, add another, and build a new snapshot.
+  EXPECT_TRUE(builder_.Unregister("GET", "/a/b"));
+  MethodInfo* d = AddGetPath("/d");
+  auto new_matcher = builder_.Build();
+
+  EXPECT_NE(nullptr, d);
+  EXPECT_EQ(new_matcher->Lookup("GET", "/a/b", &bindings), nullptr);
+  EXPECT_EQ(new_matcher->Lookup("GET", "/c/foo", &bindings), c_x);
+  EXPECT_EQ(new_matcher->Lookup("GET", "/d", &bindings), d);
+
+  // The previously built matcher is an unaffected snapshot.
+  EXPECT_EQ(Lookup("GET", "/a/b", &bindings), a_b);
+  EXPECT_EQ(Lookup("GET", "/c/foo", &bindings), c_x);
+  EXPECT_EQ(Lookup("GET", "/d", &bindings), nullptr);
+}
+
+TEST_F(PathMatcherTest, DebugStatsCountRegistrations) {
+  AddGetPath("/a/b");
+  AddGetPath("/a/{x}");
+  AddGetPath("/c/**");
+  Build();
+
+  const auto stats = matcher_->GetDebugStats();
+  EXPECT_EQ(stats.methods, 3u);
+  // Only the literal template is in the exact match map.
+  EXPECT_EQ(stats.exact_map_entries, 1u);
+  EXPECT_GT(stats.arena_nodes, 0u);
+  EXPECT_GT(stats.trie.nodes, 0u);
+  EXPECT_EQ(stats.trie.method_results, 3u);
+  EXPECT_GT(stats.trie.memory_bytes, 0u);
+}
+
+TEST_F(PathMatcherTest, UnregisterUnknownTemplate) {
+  MethodInfo* a = AddGetPath("/a");
+  Build();
+
+  EXPECT_NE(nullptr, a);
+  EXPECT_FALSE(builder_.Unregister("GET", "/never/registered"));
+  EXPECT_FALSE(builder_.Unregister("POST", "/a"));
+  EXPECT_TRUE(builder_.Unregister("GET", "/a"));
+}
+
 }  // namespace
 
 }  // namespace path_matcher
@@ -23,33 +23,57 @@ namespace path_matcher {
 const std::string VariableBindingsToQueryParameters(
     const std::vector<VariableBinding>& variable_bindings,
     const absl::flat_hash_map<std::string, std::string>& snake_to_json) {
-  std::string query_params;
-  for (size_t i = 0; i < variable_bindings.size(); i++) {
-    const VariableBinding& variable_binding = variable_bindings[i];
-    for (size_t j = 0; j < variable_binding.field_path.size(); j++) {
-      const std::string& segment = variable_binding.field_path[j];
-
+  // Resolve each field path segment to the string that will be emitted (its
+  // JSON name when one is configured) and sum the exact output length, so
+  // the result is assembled into a single allocation without the growth
+  // reallocations of appending piecemeal. The resolution map is consulted
+  // once per segment; the assembly pass below reuses the pointers.
+  size_t total_size = 0;
+  size_t total_segments = 0;
+  for (const VariableBinding& variable_binding : variable_bindings) {
+    total_segments += variable_binding.field_path.size();
+  }
+  std::vector<const std::string*> resolved_segments;
+  resolved_segments.reserve(total_segments);
+  for (const VariableBinding& variable_binding : variable_bindings) {
+    for (const std::string& segment : variable_binding.field_path) {
+      const std::string* resolved = &segment;
       // If the segment has JSON name, use JSON name instead.
       if (absl::StrContains(segment, "_")) {
         auto json_name_it = snake_to_json.find(segment);
         if (json_name_it != snake_to_json.end()) {
-          query_params.append(json_name_it->second);
-        } else {
-          query_params.append(segment);
+          resolved = &json_name_it->second;
         }
-      } else {
-        query_params.append(segment);
       }
+      resolved_segments.push_back(resolved);
+      total_size += resolved->size();
+    }
+    // The '.' separators, the '=' and the value; the '&' separators add
+    // one byte per binding beyond the first.
+    total_size += variable_binding.field_path.empty()
+                      ? 0
+                      : variable_binding.field_path.size() - 1;
+    total_size += 1 + variable_binding.value.size();
+  }
+  if (!variable_bindings.empty()) {
+    total_size += variable_bindings.size() - 1;
+  }
 
-      if (j < variable_binding.field_path.size() - 1) {
-        query_params.append(".");
+  std::string query_params;
+  query_params.reserve(total_size);
+  size_t segment_index = 0;
+  for (size_t i = 0; i < variable_bindings.size(); i++) {
+    const VariableBinding& variable_binding = variable_bindings[i];
+    for (size_t j = 0; j < variable_binding.field_path.size(); j++) {
+      if (j > 0) {
+        query_params.push_back('.');
       }
+      query_params.append(*resolved_segments[segment_index++]);
     }
-
-    query_params.append("=");
+    query_params.push_back('=');
     query_params.append(variable_binding.value);
     if (i < variable_bindings.size() - 1) {
-      query_params.append("&");
+      query_params.push_back('&');
     }
   }
   return query_params;
@@ -141,6 +141,43 @@ TEST(CheckResponseTest, WhenResponseIsBlockedWithConsumerInvalid) {
   EXPECT_EQ(Code::PERMISSION_DENIED, result.code());
 }
 
+TEST(CheckResponseTest, DeniedResponseCarriesPrecomputedDenialInfo) {
+  gasv1::CheckResponse response;
+  response.add_check_errors()->set_code(CheckError::API_KEY_INVALID);
+
+  CheckResponseInfo info;
+  Status result =
+      RequestBuilder::ConvertCheckResponse(response, "api_xxxx", &info);
+  ASSERT_NE(info.denial, nullptr);
+  EXPECT_EQ(info.denial->status, result);
+  EXPECT_EQ(info.denial->body, result.ToString());
+  EXPECT_FALSE(info.is_api_key_valid);
+
+  // The same denial reason resolves to the same process-lifetime entry.
+  CheckResponseInfo other_info;
+  RequestBuilder::ConvertCheckResponse(response, "api_xxxx", &other_info);
+  EXPECT_EQ(info.denial, other_info.denial);
+}
+
+TEST(CheckResponseTest, ServiceNameDenialsArePrecomputedPerService) {
+  gasv1::CheckResponse response;
+  response.add_check_errors()->set_code(CheckError::SERVICE_NOT_ACTIVATED);
+
+  CheckResponseInfo info;
+  Status result =
+      RequestBuilder::ConvertCheckResponse(response, "api_xxxx", &info);
+  ASSERT_NE(info.denial, nullptr);
+  EXPECT_EQ(result.message(), "API api_xxxx is not enabled for the project.");
+  EXPECT_EQ(info.denial->body, result.ToString());
+
+  CheckResponseInfo other_info;
+  RequestBuilder::ConvertCheckResponse(response, "api_yyyy", &other_info);
+  ASSERT_NE(other_info.denial, nullptr);
+  EXPECT_NE(info.denial, other_info.denial);
+  EXPECT_EQ(other_info.denial->status.message(),
+            "API api_yyyy is not enabled for the project.");
+}
+
 TEST(CheckResponseTest, FailOpenWhenResponseIsUnknownNamespaceLookup) {
   EXPECT_TRUE(
       ConvertCheckErrorToStatus(CheckError::NAMESPACE_LOOKUP_UNAVAILABLE).ok());
@@ -0,0 +1,83 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/api_proxy/service_control/coarse_clock.h"
+
+#include <time.h>
+
+namespace google {
+namespace api_proxy {
+namespace service_control {
+namespace {
+
+#ifdef CLOCK_REALTIME_COARSE
+constexpr clockid_t kCoarseClockId = CLOCK_REALTIME_COARSE;
+#else
+constexpr clockid_t kCoarseClockId = CLOCK_REALTIME;
+#endif
+
+struct CachedTime {
+  // The raw coarse reading the cache was built from; refresh is a no-op
+  // while the coarse clock reports the same tick.
+  time_t sec = -1;
+  long nsec = -1;
+  std::chrono::system_clock::time_point time_point;
+  ::google::protobuf::Timestamp timestamp;
+};
+
+CachedTime& workerCache() {
+  static thread_local CachedTime cache;
+  timespec ts;
+  clock_gettime(kCoarseClockId, &ts);
+  if (ts.tv_sec != cache.sec || ts.tv_nsec != cache.nsec) {
+    cache.sec = ts.tv_sec;
+    cache.nsec = ts.tv_nsec;
+    cache.time_point = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(ts.tv_sec) +
+            std::chrono::nanoseconds(ts.tv_nsec)));
+    cache.timestamp.set_seconds(ts.tv_sec);
+    cache.timestamp.set_nanos(ts.tv_nsec);
+  }
+  return cache;
+}
+
+}  // namespace
+
+std::chrono::system_clock::time_point CoarseClock::Now() {
+  return workerCache().time_point;
+}
+
+const ::google::protobuf::Timestamp& CoarseClock::NowTimestamp() {
+  return workerCache().timestamp;
+}
+
+::google::protobuf::Timestamp CoarseClock::TimestampFor(
+    std::chrono::system_clock::time_point tp) {
+  const CachedTime& cache = workerCache();
+  if (tp == cache.time_point) {
+    return cache.timestamp;
+  }
+  long long timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               tp.time_since_epoch())
+                               .count();
+  ::google::protobuf::Timestamp timestamp;
+  timestamp.set_seconds(timestamp_ns / 1000000000);
+  timestamp.set_nanos(timestamp_ns % 1000000000);
+  return timestamp;
+}
+
+}  // namespace service_control
+}  // namespace api_proxy
+}  // namespace google
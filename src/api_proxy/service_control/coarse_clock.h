@@ -0,0 +1,49 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "google/protobuf/timestamp.pb.h"
+
+#include <chrono>
+
+namespace google {
+namespace api_proxy {
+namespace service_control {
+
+// A per-worker coarse wall clock for request stamping. Check and Report
+// operations are stamped several times per request; reading the precise
+// clock and redoing the seconds/nanos split each time is wasted work for
+// timestamps that only need coarse-tick resolution. Each worker thread
+// caches the current time and its preconverted proto Timestamp, refreshed
+// only when the kernel's coarse clock ticks (a vDSO read, no syscall), so
+// repeated reads within a tick are cache hits with no conversion math.
+class CoarseClock {
+ public:
+  // The worker-cached current time, at coarse-tick resolution.
+  static std::chrono::system_clock::time_point Now();
+
+  // The preconverted proto Timestamp for Now().
+  static const ::google::protobuf::Timestamp& NowTimestamp();
+
+  // The proto Timestamp for |tp|: the cached preconverted Timestamp when
+  // |tp| is the worker's cached time (the common case, via Now()), else an
+  // exact conversion of |tp|.
+  static ::google::protobuf::Timestamp TimestampFor(
+      std::chrono::system_clock::time_point tp);
+};
+
+}  // namespace service_control
+}  // namespace api_proxy
+}  // namespace google
@@ -0,0 +1,84 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/api_proxy/service_control/coarse_clock.h"
+
+#include "gtest/gtest.h"
+
+namespace google {
+namespace api_proxy {
+namespace service_control {
+namespace {
+
+TEST(CoarseClockTest, NowTracksSystemClock) {
+  auto coarse = CoarseClock::Now();
+  auto precise = std::chrono::system_clock::now();
+  auto skew = std::chrono::duration_cast<std::chrono::milliseconds>(precise -
+                                                                    coarse);
+  // The coarse clock lags the precise clock by at most a few kernel ticks.
+  EXPECT_GE(skew.count(), 0);
+  EXPECT_LT(skew.count(), 200);
+}
+
+TEST(CoarseClockTest, NowIsMonotonicNonDecreasing) {
+  auto last = CoarseClock::Now();
+  for (int i = 0; i < 1000; i++) {
+    auto now = CoarseClock::Now();
+    EXPECT_GE(now, last);
+    last = now;
+  }
+}
+
+TEST(CoarseClockTest, NowTimestampMatchesNow) {
+  // Read both within one tick; retry in case the tick advances between
+  // the two reads.
+  for (int i = 0; i < 3; i++) {
+    auto now = CoarseClock::Now();
+    ::google::protobuf::Timestamp timestamp = CoarseClock::NowTimestamp();
+    if (CoarseClock::Now() != now) {
+      continue;
+    }
+    long long now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           now.time_since_epoch())
+                           .count();
+    EXPECT_EQ(timestamp.seconds(), now_ns / 1000000000);
+    EXPECT_EQ(timestamp.nanos(), now_ns % 1000000000);
+    return;
+  }
+}
+
+TEST(CoarseClockTest, TimestampForCachedTimeUsesPreconvertedProto) {
+  auto now = CoarseClock::Now();
+  ::google::protobuf::Timestamp timestamp = CoarseClock::TimestampFor(now);
+  long long now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         now.time_since_epoch())
+                         .count();
+  EXPECT_EQ(timestamp.seconds(), now_ns / 1000000000);
+  EXPECT_EQ(timestamp.nanos(), now_ns % 1000000000);
+}
+
+TEST(CoarseClockTest, TimestampForExplicitTimeConvertsExactly) {
+  std::chrono::system_clock::time_point tp(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::seconds(1550000000) +
+          std::chrono::microseconds(123456)));
+  ::google::protobuf::Timestamp timestamp = CoarseClock::TimestampFor(tp);
+  EXPECT_EQ(timestamp.seconds(), 1550000000LL);
+  EXPECT_EQ(timestamp.nanos(), 123456000);
+}
+
+}  // namespace
+}  // namespace service_control
+}  // namespace api_proxy
+}  // namespace google
@@ -35,12 +35,22 @@ using ::google::protobuf::util::Status;
 using ::google::protobuf::util::error::Code;
 
 Status LogsMetricsLoader::Load(const Service& service,
-                               std::set<std::string>* logs,
-                               std::set<std::string>* metrics,
-                               std::set<std::string>* labels) {
+                               std::vector<std::string>* logs,
+                               std::vector<std::string>* metrics,
+                               std::vector<std::string>* labels) {
   LogsMetricsLoader lml(RequestBuilder::IsLabelSupported,
                         RequestBuilder::IsMetricSupported);
-  return lml.LoadLogsMetrics(service, logs, metrics, labels);
+  // The sets dedup and order the names while the destinations are walked;
+  // the frozen arrays handed out stay sorted for binary search.
+  std::set<std::string> logs_set, metrics_set, labels_set;
+  Status s = lml.LoadLogsMetrics(service, &logs_set, &metrics_set, &labels_set);
+  if (!s.ok()) {
+    return s;
+  }
+  logs->assign(logs_set.begin(), logs_set.end());
+  metrics->assign(metrics_set.begin(), metrics_set.end());
+  labels->assign(labels_set.begin(), labels_set.end());
+  return Status::OK;
 }
 
 Status LogsMetricsLoader::AddLabels(
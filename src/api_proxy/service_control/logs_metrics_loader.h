@@ -15,6 +15,7 @@
 #pragma once
 
 #include <functional>
+#include <vector>
 
 #include "google/api/service.pb.h"
 #include "google/protobuf/stubs/status.h"
@@ -26,9 +27,13 @@ namespace service_control {
 
 class LogsMetricsLoader final {
  public:
+  // Emits the configured log, metric and label names as frozen, sorted and
+  // deduplicated arrays. The arrays never change after this call, so
+  // RequestBuilder resolves membership against them with binary search at
+  // construction instead of keeping tree-based sets around.
   static ::google::protobuf::util::Status Load(
-      const ::google::api::Service& service, std::set<std::string>* logs,
-      std::set<std::string>* metrics, std::set<std::string>* labels);
+      const ::google::api::Service& service, std::vector<std::string>* logs,
+      std::vector<std::string>* metrics, std::vector<std::string>* labels);
 
  private:
   LogsMetricsLoader(std::function<bool(const ::google::api::LabelDescriptor&)>
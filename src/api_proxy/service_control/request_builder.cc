@@ -14,16 +14,21 @@
 #include "src/api_proxy/service_control/request_builder.h"
 
 #include <time.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "common/common/base64.h"
 #include "google/api/metric.pb.h"
 #include "google/protobuf/timestamp.pb.h"
 #include "src/api_proxy/utils/version.h"
-#include "utils/distribution_helper.h"
-
 using ::google::api::servicecontrol::v1::CheckError;
 using ::google::api::servicecontrol::v1::CheckRequest;
 using ::google::api::servicecontrol::v1::CheckResponse;
@@ -38,7 +43,6 @@ using ::google::protobuf::Map;
 using ::google::protobuf::Timestamp;
 using ::google::protobuf::util::Status;
 using ::google::protobuf::util::error::Code;
-using ::google::service_control_client::DistributionHelper;
 
 namespace google {
 namespace api_proxy {
@@ -49,6 +53,8 @@ constexpr char kConsumerQuotaUsedCount[] =
 
 constexpr char kQuotaName[] = "/quota_name";
 
+constexpr char kRefererLabelName[] = "/referer";
+
 struct SupportedMetric {
   const char* name;
   ::google::api::MetricDescriptor_MetricKind metric_kind;
@@ -91,28 +97,102 @@ void AddInt64Metric(const char* metric_name, int64_t value,
   metric_value->set_int64_value(value);
 }
 
-// The parameters to initialize DistributionHelper
-struct DistributionHelperOptions {
-  int buckets;
-  double growth;
-  double scale;
+// An exponential bucket layout for the distribution metrics below. The
+// Distribution prototype and the exact bucket bounds are computed once per
+// layout, and a sample's bucket index comes from a closed-form exponent
+// read (a bit-scan of the binary exponent for the power-of-two layout)
+// corrected against the precomputed bounds, so adding a sample is
+// constant-time regardless of bucket count instead of an iterative scan
+// of the bounds for every sample.
+class ExponentialDistribution {
+ public:
+  ExponentialDistribution(int buckets, double growth, double scale)
+      : buckets_(buckets),
+        growth_(growth),
+        scale_(scale),
+        inv_ln_growth_(1.0 / std::log(growth)) {
+    auto* exponential = prototype_.mutable_exponential_buckets();
+    exponential->set_num_finite_buckets(buckets);
+    exponential->set_growth_factor(growth);
+    exponential->set_scale(scale);
+    prototype_.mutable_bucket_counts()->Resize(buckets + 2, 0);
+    // The same bounds an iterative scan would generate, by repeated
+    // multiplication, so bucket decisions stay bit-identical to it.
+    bounds_.reserve(buckets + 1);
+    double bound = scale;
+    for (int i = 0; i <= buckets; i++) {
+      bounds_.push_back(bound);
+      bound *= growth;
+    }
+  }
+
+  // Fills a distribution holding the single sample value.
+  void FillSingleSample(double value, Distribution* distribution) const {
+    *distribution = prototype_;
+    distribution->set_count(1);
+    distribution->set_mean(value);
+    distribution->set_minimum(value);
+    distribution->set_maximum(value);
+    distribution->set_bucket_counts(BucketIndex(value), 1);
+  }
+
+ private:
+  // Bucket 0 holds value < scale, bucket i in [1, buckets] holds
+  // scale * growth^(i-1) <= value < scale * growth^i, and bucket
+  // buckets + 1 is the overflow bucket.
+  int BucketIndex(double value) const {
+    if (!(value >= bounds_[0])) {
+      // Underflow bucket; also where NaN lands.
+      return 0;
+    }
+    int index;
+    if (growth_ == 2.0) {
+      // ilogb reads floor(log2(value / scale)) straight off the exponent
+      // bits.
+      index = 1 + std::ilogb(value / scale_);
+    } else {
+      index = 1 + static_cast<int>(
+                      std::floor(std::log(value / scale_) * inv_ln_growth_));
+    }
+    if (index < 1) {
+      index = 1;
+    } else if (index > buckets_ + 1) {
+      index = buckets_ + 1;
+    }
+    // The closed form can be off by one right at a bucket bound from
+    // floating-point rounding; settle against the exact bounds.
+    while (index <= buckets_ && value >= bounds_[index]) index++;
+    while (index > 1 && value < bounds_[index - 1]) index--;
+    return index;
+  }
+
+  const int buckets_;
+  const double growth_;
+  const double scale_;
+  const double inv_ln_growth_;
+  Distribution prototype_;
+  std::vector<double> bounds_;
 };
 
-const DistributionHelperOptions time_distribution = {29, 2.0, 1e-6};
-const DistributionHelperOptions size_distribution = {8, 10.0, 1};
+const ExponentialDistribution& time_distribution() {
+  static const ExponentialDistribution* layout =
+      new ExponentialDistribution(29, 2.0, 1e-6);
+  return *layout;
+}
+
+const ExponentialDistribution& size_distribution() {
+  static const ExponentialDistribution* layout =
+      new ExponentialDistribution(8, 10.0, 1);
+  return *layout;
+}
+
 const double kMsToSecs = 1e-3;
 
-Status AddDistributionMetric(const DistributionHelperOptions& options,
+Status AddDistributionMetric(const ExponentialDistribution& layout,
                              const char* metric_name, double value,
                              Operation* operation) {
   MetricValue* metric_value = AddMetricValue(metric_name, operation);
-  Distribution distribution;
-  Status status = DistributionHelper::InitExponential(
-      options.buckets, options.growth, options.scale, &distribution);
-  if (!status.ok()) return status;
-  status = DistributionHelper::AddSample(value, &distribution);
-  if (!status.ok()) return status;
-  *metric_value->mutable_distribution_value() = distribution;
+  layout.FillSingleSample(value, metric_value->mutable_distribution_value());
   return Status::OK;
 }
 
@@ -139,7 +219,7 @@ Status set_distribution_metric_to_request_size(const SupportedMetric& m,
                                                const ReportRequestInfo& info,
                                                Operation* operation) {
   if (info.request_size >= 0) {
-    return AddDistributionMetric(size_distribution, m.name, info.request_size,
+    return AddDistributionMetric(size_distribution(), m.name, info.request_size,
                                  operation);
   }
   return Status::OK;
@@ -149,7 +229,7 @@ Status set_distribution_metric_to_response_size(const SupportedMetric& m,
                                                 const ReportRequestInfo& info,
                                                 Operation* operation) {
   if (info.response_size >= 0) {
-    return AddDistributionMetric(size_distribution, m.name, info.response_size,
+    return AddDistributionMetric(size_distribution(), m.name, info.response_size,
                                  operation);
   }
   return Status::OK;
@@ -161,7 +241,7 @@ Status set_distribution_metric_to_request_time(const SupportedMetric& m,
                                                Operation* operation) {
   if (info.latency.request_time_ms >= 0) {
     double request_time_secs = info.latency.request_time_ms * kMsToSecs;
-    return AddDistributionMetric(time_distribution, m.name, request_time_secs,
+    return AddDistributionMetric(time_distribution(), m.name, request_time_secs,
                                  operation);
   }
   return Status::OK;
@@ -172,7 +252,7 @@ Status set_distribution_metric_to_backend_time(const SupportedMetric& m,
                                                Operation* operation) {
   if (info.latency.backend_time_ms >= 0) {
     double backend_time_secs = info.latency.backend_time_ms * kMsToSecs;
-    return AddDistributionMetric(time_distribution, m.name, backend_time_secs,
+    return AddDistributionMetric(time_distribution(), m.name, backend_time_secs,
                                  operation);
   }
   return Status::OK;
@@ -183,7 +263,7 @@ Status set_distribution_metric_to_overhead_time(const SupportedMetric& m,
                                                 Operation* operation) {
   if (info.latency.overhead_time_ms >= 0) {
     double overhead_time_secs = info.latency.overhead_time_ms * kMsToSecs;
-    return AddDistributionMetric(time_distribution, m.name, overhead_time_secs,
+    return AddDistributionMetric(time_distribution(), m.name, overhead_time_secs,
                                  operation);
   }
   return Status::OK;
@@ -211,7 +291,7 @@ Status set_distribution_metric_to_streaming_request_message_counts(
     const SupportedMetric& m, const ReportRequestInfo& info,
     Operation* operation) {
   if (info.streaming_request_message_counts > 0) {
-    (void)AddDistributionMetric(size_distribution, m.name,
+    (void)AddDistributionMetric(size_distribution(), m.name,
                                 info.streaming_request_message_counts,
                                 operation);
   }
@@ -221,7 +301,7 @@ Status set_distribution_metric_to_streaming_response_message_counts(
     const SupportedMetric& m, const ReportRequestInfo& info,
     Operation* operation) {
   if (info.streaming_response_message_counts > 0) {
-    (void)AddDistributionMetric(size_distribution, m.name,
+    (void)AddDistributionMetric(size_distribution(), m.name,
                                 info.streaming_response_message_counts,
                                 operation);
   }
@@ -232,7 +312,7 @@ Status set_distribution_metric_to_streaming_durations(
     const SupportedMetric& m, const ReportRequestInfo& info,
     Operation* operation) {
   if (info.streaming_durations > 0) {
-    (void)AddDistributionMetric(time_distribution, m.name,
+    (void)AddDistributionMetric(time_distribution(), m.name,
                                 info.streaming_durations, operation);
   }
   return Status::OK;
@@ -545,20 +625,35 @@ Status set_credential_id(const SupportedLabel& l, const ReportRequestInfo& info,
   // 2) If auth issuer and audience both are available, set it as:
   //    jwtAuth:issuer=base64(issuer)&audience=base64(audience)
   if (!info.api_key.empty()) {
-    std::string credential_id("apikey:");
-    credential_id += info.api_key;
-    (*labels)[l.name] = credential_id;
+    (*labels)[l.name] = absl::StrCat("apikey:", info.api_key);
   } else if (!info.auth_issuer.empty()) {
-    std::string base64_issuer = Envoy::Base64Url::encode(
-        info.auth_issuer.data(), info.auth_issuer.size());
-    std::string credential_id = absl::StrCat("jwtauth:issuer=", base64_issuer);
-    // auth audience is optional
-    if (!info.auth_audience.empty()) {
-      std::string base64_audience = Envoy::Base64Url::encode(
-          info.auth_audience.data(), info.auth_audience.size());
-      absl::StrAppend(&credential_id, "&audience=", base64_audience);
+    // A service sees only a handful of distinct (issuer, audience) pairs --
+    // essentially one per auth provider -- so the base64url encodings are
+    // memoized per worker instead of recomputed on every report. The cap
+    // keeps a stream of pathological tokens from growing the cache.
+    static thread_local auto* credential_id_cache =
+        new absl::flat_hash_map<std::string, std::string>;
+    constexpr size_t kCredentialIdCacheMaxEntries = 1000;
+    const std::string key =
+        absl::StrCat(info.auth_issuer, "\n", info.auth_audience);
+    auto it = credential_id_cache->find(key);
+    if (it == credential_id_cache->end()) {
+      std::string credential_id = absl::StrCat(
+          "jwtauth:issuer=", Envoy::Base64Url::encode(
+                                 info.auth_issuer.data(),
+                                 info.auth_issuer.size()));
+      // auth audience is optional
+      if (!info.auth_audience.empty()) {
+        absl::StrAppend(&credential_id, "&audience=",
+                        Envoy::Base64Url::encode(info.auth_audience.data(),
+                                                 info.auth_audience.size()));
+      }
+      if (credential_id_cache->size() >= kCredentialIdCacheMaxEntries) {
+        credential_id_cache->clear();
+      }
+      it = credential_id_cache->emplace(key, std::move(credential_id)).first;
     }
-    (*labels)[l.name] = credential_id;
+    (*labels)[l.name] = it->second;
   }
   return Status::OK;
 }
@@ -609,7 +704,7 @@ Status set_consumer_project(const SupportedLabel& l,
 Status set_referer(const SupportedLabel& l, const ReportRequestInfo& info,
                    Map<std::string, std::string>* labels) {
   if (!info.referer.empty()) {
-    (*labels)[l.name] = info.referer;
+    (*labels)[l.name] = std::string(info.referer);
   }
   return Status::OK;
 }
@@ -649,7 +744,7 @@ Status set_status_code(const SupportedLabel& l, const ReportRequestInfo& info,
 Status set_location(const SupportedLabel& l, const ReportRequestInfo& info,
                     Map<std::string, std::string>* labels) {
   if (!info.location.empty()) {
-    (*labels)[l.name] = info.location;
+    (*labels)[l.name] = std::string(info.location);
   }
   return Status::OK;
 }
@@ -658,7 +753,7 @@ Status set_location(const SupportedLabel& l, const ReportRequestInfo& info,
 Status set_api_method(const SupportedLabel& l, const ReportRequestInfo& info,
                       Map<std::string, std::string>* labels) {
   if (!info.api_method.empty()) {
-    (*labels)[l.name] = info.api_method;
+    (*labels)[l.name] = std::string(info.api_method);
   }
   return Status::OK;
 }
@@ -667,7 +762,7 @@ Status set_api_method(const SupportedLabel& l, const ReportRequestInfo& info,
 Status set_api_version(const SupportedLabel& l, const ReportRequestInfo& info,
                        Map<std::string, std::string>* labels) {
   if (!info.api_version.empty()) {
-    (*labels)[l.name] = info.api_version;
+    (*labels)[l.name] = std::string(info.api_version);
   }
   return Status::OK;
 }
@@ -675,7 +770,7 @@ Status set_api_version(const SupportedLabel& l, const ReportRequestInfo& info,
 // servicecontrol.googleapis.com/platform
 Status set_platform(const SupportedLabel& l, const ReportRequestInfo& info,
                     Map<std::string, std::string>* labels) {
-  (*labels)[l.name] = info.compute_platform;
+  (*labels)[l.name] = std::string(info.compute_platform);
   return Status::OK;
 }
 
@@ -693,6 +788,16 @@ Status set_user_agent(const SupportedLabel& l, const ReportRequestInfo& info,
   return Status::OK;
 }
 
+// Returns whether the label is invariant per operation, i.e. computed only
+// from config-derived info fields or from the process-constant platform
+// values resolved by PreparePlatformLabels, so it can live in a prepared
+// Operation template instead of being recomputed per request.
+bool IsPerOperationLabel(const SupportedLabel& l) {
+  return l.set == set_api_method || l.set == set_api_version ||
+         l.set == set_service_agent || l.set == set_user_agent ||
+         l.set == set_location || l.set == set_platform;
+}
+
 const SupportedLabel supported_labels[] = {
     {
         "/credential_id",
@@ -730,7 +835,7 @@ const SupportedLabel supported_labels[] = {
         false,
     },
     {
-        "/referer",
+        kRefererLabelName,
         ::google::api::LabelDescriptor_ValueType_STRING,
         SupportedLabel::USER,
         set_referer,
@@ -942,20 +1047,10 @@ constexpr char kLogFieldNameRequestSize[] = "request_size_in_bytes";
 constexpr char kLogFieldNameResponseHeaders[] = "response_headers";
 constexpr char kLogFieldNameResponseSize[] = "response_size_in_bytes";
 constexpr char kLogFieldNameTimestamp[] = "timestamp";
+constexpr char kLogFieldNameTruncated[] = "truncated";
 constexpr char kLogFieldNameUrl[] = "url";
 constexpr char kLogFieldNameClientIp[] = "client_ip";
 
-// Convert time point to proto Timestamp
-Timestamp CreateTimestamp(std::chrono::system_clock::time_point tp) {
-  long long timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
-                               tp.time_since_epoch())
-                               .count();
-  Timestamp timestamp;
-  timestamp.set_seconds(timestamp_ns / 1000000000);
-  timestamp.set_nanos(timestamp_ns % 1000000000);
-  return timestamp;
-}
-
 Status VerifyRequiredCheckFields(const OperationInfo& info) {
   if (info.operation_id.empty()) {
     return Status(Code::INVALID_ARGUMENT, "operation_id is required.");
@@ -973,21 +1068,39 @@ Status VerifyRequiredReportFields(const OperationInfo& info) {
 void SetOperationCommonFields(const OperationInfo& info,
                               const Timestamp& current_time, Operation* op) {
   if (!info.operation_id.empty()) {
-    op->set_operation_id(info.operation_id);
+    op->set_operation_id(info.operation_id.data(), info.operation_id.size());
   }
   if (!info.operation_name.empty()) {
-    op->set_operation_name(info.operation_name);
+    op->set_operation_name(info.operation_name.data(),
+                           info.operation_name.size());
   }
   if (!info.api_key.empty()) {
-    op->set_consumer_id(std::string(kConsumerIdApiKey) +
-                        std::string(info.api_key));
+    op->set_consumer_id(absl::StrCat(kConsumerIdApiKey, info.api_key));
   }
   *op->mutable_start_time() = current_time;
   *op->mutable_end_time() = current_time;
 }
 
+// Cuts |value| to at most |budget| bytes without splitting a UTF-8
+// sequence: the cut point backs off over continuation bytes so a
+// multi-byte character is dropped whole. A zero budget means unbounded.
+// Sets |*truncated| when bytes were dropped.
+absl::string_view TruncateFieldValue(absl::string_view value, size_t budget,
+                                     bool* truncated) {
+  if (budget == 0 || value.size() <= budget) {
+    return value;
+  }
+  size_t cut = budget;
+  while (cut > 0 && (static_cast<uint8_t>(value[cut]) & 0xC0) == 0x80) {
+    --cut;
+  }
+  *truncated = true;
+  return value.substr(0, cut);
+}
+
 void FillLogEntry(const ReportRequestInfo& info, const std::string& name,
-                  const Timestamp& current_time, LogEntry* log_entry) {
+                  const Timestamp& current_time, size_t field_budget,
+                  LogEntry* log_entry) {
   log_entry->set_name(name);
   *log_entry->mutable_timestamp() = current_time;
   auto severity = (info.response_code >= 400) ? google::logging::type::ERROR
@@ -995,36 +1108,51 @@ void FillLogEntry(const ReportRequestInfo& info, const std::string& name,
   log_entry->set_severity(severity);
 
   auto* fields = log_entry->mutable_struct_payload()->mutable_fields();
+  // Set when a budgeted field below was cut; the marker field records it.
+  bool truncated = false;
   (*fields)[kLogFieldNameTimestamp].set_number_value(
       (double)current_time.seconds() +
       (double)current_time.nanos() / (double)1000000000.0);
   if (!info.producer_project_id.empty()) {
     (*fields)[kLogFieldNameProducerProjectId].set_string_value(
-        info.producer_project_id);
+        info.producer_project_id.data(), info.producer_project_id.size());
   }
   if (!info.api_key.empty()) {
-    (*fields)[kLogFieldNameApiKey].set_string_value(info.api_key);
+    (*fields)[kLogFieldNameApiKey].set_string_value(info.api_key.data(),
+                                                    info.api_key.size());
   }
   if (!info.referer.empty()) {
-    (*fields)[kLogFieldNameReferer].set_string_value(info.referer);
+    const absl::string_view referer =
+        TruncateFieldValue(info.referer, field_budget, &truncated);
+    (*fields)[kLogFieldNameReferer].set_string_value(referer.data(),
+                                                     referer.size());
   }
   if (!info.api_name.empty()) {
-    (*fields)[kLogFieldNameApiName].set_string_value(info.api_name);
+    (*fields)[kLogFieldNameApiName].set_string_value(info.api_name.data(),
+                                                     info.api_name.size());
   }
   if (!info.api_version.empty()) {
-    (*fields)[kLogFieldNameApiVersion].set_string_value(info.api_version);
+    (*fields)[kLogFieldNameApiVersion].set_string_value(
+        info.api_version.data(), info.api_version.size());
   }
   if (!info.url.empty()) {
-    (*fields)[kLogFieldNameUrl].set_string_value(info.url);
+    const absl::string_view url =
+        TruncateFieldValue(info.url, field_budget, &truncated);
+    (*fields)[kLogFieldNameUrl].set_string_value(url.data(), url.size());
   }
   if (!info.api_method.empty()) {
-    (*fields)[kLogFieldNameApiMethod].set_string_value(info.api_method);
+    (*fields)[kLogFieldNameApiMethod].set_string_value(info.api_method.data(),
+                                                       info.api_method.size());
   }
   if (!info.location.empty()) {
-    (*fields)[kLogFieldNameLocation].set_string_value(info.location);
+    (*fields)[kLogFieldNameLocation].set_string_value(info.location.data(),
+                                                      info.location.size());
   }
   if (!info.log_message.empty()) {
-    (*fields)[kLogFieldNameLogMessage].set_string_value(info.log_message);
+    const absl::string_view message =
+        TruncateFieldValue(info.log_message, field_budget, &truncated);
+    (*fields)[kLogFieldNameLogMessage].set_string_value(message.data(),
+                                                        message.size());
   }
 
   (*fields)[kLogFieldNameHttpResponseCode].set_number_value(info.response_code);
@@ -1032,28 +1160,43 @@ void FillLogEntry(const ReportRequestInfo& info, const std::string& name,
     (*fields)[kLogFieldNameRequestSize].set_number_value(info.request_size);
   }
   if (!info.request_headers.empty()) {
-    (*fields)[kLogFieldNameRequestHeaders].set_string_value(
-        info.request_headers);
+    const absl::string_view headers =
+        TruncateFieldValue(info.request_headers, field_budget, &truncated);
+    (*fields)[kLogFieldNameRequestHeaders].set_string_value(headers.data(),
+                                                            headers.size());
   }
   if (info.response_size >= 0) {
     (*fields)[kLogFieldNameResponseSize].set_number_value(info.response_size);
   }
   if (!info.response_headers.empty()) {
-    (*fields)[kLogFieldNameResponseHeaders].set_string_value(
-        info.response_headers);
+    const absl::string_view headers =
+        TruncateFieldValue(info.response_headers, field_budget, &truncated);
+    (*fields)[kLogFieldNameResponseHeaders].set_string_value(headers.data(),
+                                                             headers.size());
   }
   if (info.latency.request_time_ms >= 0) {
     (*fields)[kLogFieldNameRequestLatency].set_number_value(
         info.latency.request_time_ms);
   }
   if (!info.method.empty()) {
-    (*fields)[kLogFieldNameHttpMethod].set_string_value(info.method);
+    (*fields)[kLogFieldNameHttpMethod].set_string_value(info.method.data(),
+                                                        info.method.size());
   }
   if (!info.client_ip.empty()) {
-    (*fields)[kLogFieldNameClientIp].set_string_value(info.client_ip);
+    (*fields)[kLogFieldNameClientIp].set_string_value(info.client_ip.data(),
+                                                      info.client_ip.size());
   }
   if (!info.jwt_payloads.empty()) {
-    (*fields)[kLogFieldNameJwtPayloads].set_string_value(info.jwt_payloads);
+    const absl::string_view payloads =
+        TruncateFieldValue(info.jwt_payloads, field_budget, &truncated);
+    (*fields)[kLogFieldNameJwtPayloads].set_string_value(payloads.data(),
+                                                         payloads.size());
+  }
+
+  if (truncated) {
+    // Marks that payload fields above were cut to the configured byte
+    // budget rather than received short.
+    (*fields)[kLogFieldNameTruncated].set_bool_value(true);
   }
 }
 
@@ -1071,9 +1214,25 @@ std::vector<const Element*> FilterPointers(
   return filtered;
 }
 
+// Compiles a fill plan from the already-filtered label set: the labels
+// matching pred, kept in configuration order. The per-label attribute
+// checks run here exactly once, so the fill loops can iterate a plan with
+// no per-call branching.
+std::vector<const SupportedLabel*> CompileLabelPlan(
+    const std::vector<const SupportedLabel*>& labels,
+    std::function<bool(const SupportedLabel*)> pred) {
+  std::vector<const SupportedLabel*> plan;
+  for (auto it = labels.begin(), end = labels.end(); it != end; it++) {
+    if (pred(*it)) {
+      plan.push_back(*it);
+    }
+  }
+  return plan;
+}
+
 }  // namespace
 
-RequestBuilder::RequestBuilder(const std::set<std::string>& logs,
+RequestBuilder::RequestBuilder(const std::vector<std::string>& logs,
                                const std::string& service_name,
                                const std::string& service_config_id)
     : logs_(logs.begin(), logs.end()),
@@ -1083,32 +1242,100 @@ RequestBuilder::RequestBuilder(const std::set<std::string>& logs,
       labels_(FilterPointers<SupportedLabel>(
           supported_labels, supported_labels + supported_labels_count,
           [](const struct SupportedLabel* l) { return l->set != nullptr; })),
+      report_label_plan_(CompileLabelPlan(
+          labels_,
+          [](const SupportedLabel* l) { return !l->by_consumer_only; })),
+      templated_report_label_plan_(
+          CompileLabelPlan(labels_,
+                           [](const SupportedLabel* l) {
+                             return !l->by_consumer_only &&
+                                    !IsPerOperationLabel(*l);
+                           })),
+      per_operation_label_plan_(
+          CompileLabelPlan(labels_,
+                           [](const SupportedLabel* l) {
+                             return !l->by_consumer_only &&
+                                    IsPerOperationLabel(*l);
+                           })),
       service_name_(service_name),
       service_config_id_(service_config_id) {}
 
-RequestBuilder::RequestBuilder(const std::set<std::string>& logs,
-                               const std::set<std::string>& metrics,
-                               const std::set<std::string>& labels,
+RequestBuilder::RequestBuilder(const std::vector<std::string>& logs,
+                               const std::vector<std::string>& metrics,
+                               const std::vector<std::string>& labels,
                                const std::string& service_name,
                                const std::string& service_config_id)
     : logs_(logs.begin(), logs.end()),
       metrics_(FilterPointers<SupportedMetric>(
           supported_metrics, supported_metrics + supported_metrics_count,
           [&metrics](const struct SupportedMetric* m) {
-            return m->set && metrics.find(m->name) != metrics.end();
+            return m->set && std::binary_search(metrics.begin(),
+                                                metrics.end(), m->name);
           })),
       labels_(FilterPointers<SupportedLabel>(
           supported_labels, supported_labels + supported_labels_count,
           [&labels](const struct SupportedLabel* l) {
             return l->set && (l->kind == SupportedLabel::SYSTEM ||
-                              labels.find(l->name) != labels.end());
+                              std::binary_search(labels.begin(), labels.end(),
+                                                 l->name));
           })),
+      report_label_plan_(CompileLabelPlan(
+          labels_,
+          [](const SupportedLabel* l) { return !l->by_consumer_only; })),
+      templated_report_label_plan_(
+          CompileLabelPlan(labels_,
+                           [](const SupportedLabel* l) {
+                             return !l->by_consumer_only &&
+                                    !IsPerOperationLabel(*l);
+                           })),
+      per_operation_label_plan_(
+          CompileLabelPlan(labels_,
+                           [](const SupportedLabel* l) {
+                             return !l->by_consumer_only &&
+                                    IsPerOperationLabel(*l);
+                           })),
       service_name_(service_name),
       service_config_id_(service_config_id) {}
 
 Status RequestBuilder::FillAllocateQuotaRequest(
     const QuotaRequestInfo& info,
     ::google::api::servicecontrol::v1::AllocateQuotaRequest* request) const {
+  const auto template_it = quota_request_templates_.find(info.method_name);
+  if (template_it != quota_request_templates_.end()) {
+    // Start from the frozen prototype; everything but the operation id,
+    // consumer id and caller labels is fixed per operation.
+    *request = template_it->second;
+    ::google::api::servicecontrol::v1::QuotaOperation* operation =
+        request->mutable_allocate_operation();
+    if (!info.operation_id.empty()) {
+      operation->set_operation_id(info.operation_id.data(),
+                                  info.operation_id.size());
+    }
+    if (!info.api_key.empty()) {
+      operation->set_consumer_id(absl::StrCat(kConsumerIdApiKey, info.api_key));
+    } else if (!info.producer_project_id.empty()) {
+      operation->set_consumer_id(
+          absl::StrCat(kConsumerIdProject, info.producer_project_id));
+    }
+    auto* labels = operation->mutable_labels();
+    if (!info.client_ip.empty()) {
+      (*labels)[kServiceControlCallerIp] = std::string(info.client_ip);
+    }
+    if (!info.referer.empty()) {
+      (*labels)[kServiceControlReferer] = std::string(info.referer);
+    }
+    // The prototype carries the costs of a single operation; a batched
+    // incremental charge scales them by the operation count.
+    if (info.operation_count > 1) {
+      for (auto& value_set : *operation->mutable_quota_metrics()) {
+        for (auto& value : *value_set.mutable_metric_values()) {
+          value.set_int64_value(value.int64_value() * info.operation_count);
+        }
+      }
+    }
+    return Status::OK;
+  }
+
   ::google::api::servicecontrol::v1::QuotaOperation* operation =
       request->mutable_allocate_operation();
 
@@ -1119,19 +1346,20 @@ Status RequestBuilder::FillAllocateQuotaRequest(
 
   // allocate_operation.operation_id
   if (!info.operation_id.empty()) {
-    operation->set_operation_id(info.operation_id);
+    operation->set_operation_id(info.operation_id.data(),
+                                info.operation_id.size());
   }
   // allocate_operation.method_name
   if (!info.method_name.empty()) {
-    operation->set_method_name(info.method_name);
+    operation->set_method_name(info.method_name.data(),
+                               info.method_name.size());
   }
   // allocate_operation.consumer_id
   if (!info.api_key.empty()) {
-    operation->set_consumer_id(std::string(kConsumerIdApiKey) +
-                               std::string(info.api_key));
+    operation->set_consumer_id(absl::StrCat(kConsumerIdApiKey, info.api_key));
   } else if (!info.producer_project_id.empty()) {
-    operation->set_consumer_id(std::string(kConsumerIdProject) +
-                               std::string(info.producer_project_id));
+    operation->set_consumer_id(
+        absl::StrCat(kConsumerIdProject, info.producer_project_id));
   }
 
   // allocate_operation.quota_mode
@@ -1142,11 +1370,11 @@ Status RequestBuilder::FillAllocateQuotaRequest(
   // allocate_operation.labels
   auto* labels = operation->mutable_labels();
   if (!info.client_ip.empty()) {
-    (*labels)[kServiceControlCallerIp] = info.client_ip;
+    (*labels)[kServiceControlCallerIp] = std::string(info.client_ip);
   }
 
   if (!info.referer.empty()) {
-    (*labels)[kServiceControlReferer] = info.referer;
+    (*labels)[kServiceControlReferer] = std::string(info.referer);
   }
   (*labels)[kServiceControlUserAgent] = kUserAgent;
   (*labels)[kServiceControlServiceAgent] = get_service_agent();
@@ -1157,7 +1385,7 @@ Status RequestBuilder::FillAllocateQuotaRequest(
       value_set->set_metric_name(metric.first);
       MetricValue* value = value_set->add_metric_values();
       const auto& cost = metric.second;
-      value->set_int64_value(cost <= 0 ? 1 : cost);
+      value->set_int64_value((cost <= 0 ? 1 : cost) * info.operation_count);
     }
   }
 
@@ -1174,29 +1402,30 @@ Status RequestBuilder::FillCheckRequest(
   request->set_service_name(service_name_);
   request->set_service_config_id(service_config_id_);
 
-  Timestamp current_time = CreateTimestamp(now);
+  Timestamp current_time = CoarseClock::TimestampFor(now);
   Operation* op = request->mutable_operation();
   SetOperationCommonFields(info, current_time, op);
 
   auto* labels = op->mutable_labels();
   if (!info.client_ip.empty()) {
-    (*labels)[kServiceControlCallerIp] = info.client_ip;
+    (*labels)[kServiceControlCallerIp] = std::string(info.client_ip);
   }
   if (!info.referer.empty()) {
-    (*labels)[kServiceControlReferer] = info.referer;
+    (*labels)[kServiceControlReferer] = std::string(info.referer);
   }
   (*labels)[kServiceControlUserAgent] = kUserAgent;
   (*labels)[kServiceControlServiceAgent] = get_service_agent();
 
   if (!info.android_package_name.empty()) {
-    (*labels)[kServiceControlAndroidPackageName] = info.android_package_name;
+    (*labels)[kServiceControlAndroidPackageName] =
+        std::string(info.android_package_name);
   }
   if (!info.android_cert_fingerprint.empty()) {
     (*labels)[kServiceControlAndroidCertFingerprint] =
-        info.android_cert_fingerprint;
+        std::string(info.android_cert_fingerprint);
   }
   if (!info.ios_bundle_id.empty()) {
-    (*labels)[kServiceControlIosBundleId] = info.ios_bundle_id;
+    (*labels)[kServiceControlIosBundleId] = std::string(info.ios_bundle_id);
   }
 
   return Status::OK;
@@ -1212,19 +1441,43 @@ Status RequestBuilder::FillReportRequest(
   request->set_service_name(service_name_);
   request->set_service_config_id(service_config_id_);
 
-  Timestamp current_time = CreateTimestamp(now);
+  Timestamp current_time = CoarseClock::TimestampFor(now);
   Operation* op = request->add_operations();
+
+  // Start from the frozen per-operation prototype when one was prepared, so
+  // only dynamic fields need to be computed below.
+  const auto template_it =
+      report_operation_templates_.find(info.operation_name);
+  const bool has_template = template_it != report_operation_templates_.end();
+  if (has_template) {
+    op->MergeFrom(template_it->second);
+  }
   SetOperationCommonFields(info, current_time, op);
 
   // Only populate metrics if we can associate them with a method/operation.
   if (!info.operation_id.empty() && !info.operation_name.empty()) {
     Map<std::string, std::string>* labels = op->mutable_labels();
-    // Set all labels with by_consumer_only is false
-    for (auto it = labels_.begin(), end = labels_.end(); it != end; it++) {
+    // Run the compiled fill plan; labels carried by the prototype are
+    // already in place, so the templated plan skips them.
+    const std::vector<const SupportedLabel*>& plan =
+        has_template ? templated_report_label_plan_ : report_label_plan_;
+    for (auto it = plan.begin(), end = plan.end(); it != end; it++) {
       const SupportedLabel* l = *it;
-      if (l->set && !l->by_consumer_only) {
-        status = (l->set)(*l, info, labels);
-        if (!status.ok()) return status;
+      status = (l->set)(*l, info, labels);
+      if (!status.ok()) return status;
+    }
+
+    // The referer is the only label whose value echoes an unbounded
+    // request header; cap it like the log entry fields below.
+    if (report_field_byte_budget_ > 0) {
+      auto referer_it = labels->find(kRefererLabelName);
+      if (referer_it != labels->end()) {
+        bool truncated = false;
+        const absl::string_view capped = TruncateFieldValue(
+            referer_it->second, report_field_byte_budget_, &truncated);
+        if (truncated) {
+          referer_it->second.resize(capped.size());
+        }
       }
     }
 
@@ -1257,7 +1510,8 @@ Status RequestBuilder::FillReportRequest(
   // Fill log entries.
   if (info.is_final_report) {
     for (auto it = logs_.begin(), end = logs_.end(); it != end; it++) {
-      FillLogEntry(info, *it, current_time, op->add_log_entries());
+      FillLogEntry(info, *it, current_time, report_field_byte_budget_,
+                   op->add_log_entries());
     }
   }
 
@@ -1268,6 +1522,72 @@ Status RequestBuilder::FillReportRequest(
   return Status::OK;
 }
 
+void RequestBuilder::PreparePlatformLabels(
+    const std::string& location, const std::string& compute_platform) {
+  platform_location_ = location;
+  platform_compute_platform_ = compute_platform;
+}
+
+void RequestBuilder::PrepareReportOperationTemplate(
+    const std::string& operation_name, const std::string& api_name,
+    const std::string& api_version) {
+  Operation& op = report_operation_templates_[operation_name];
+  op.Clear();
+  op.set_operation_name(operation_name);
+
+  // Run the per-operation label setters once against an info carrying only
+  // the config-derived fields, mirroring what the handler fills per request.
+  // The platform fields keep the ReportRequestInfo defaults unless
+  // PreparePlatformLabels resolved them, the same way fillGCPInfo only
+  // overrides them from a configured gcp_attributes.
+  ReportRequestInfo info;
+  info.operation_name = operation_name;
+  info.api_method = operation_name;
+  info.api_name = api_name;
+  info.api_version = api_version;
+  info.location = platform_location_;
+  if (!platform_compute_platform_.empty()) {
+    info.compute_platform = platform_compute_platform_;
+  }
+
+  Map<std::string, std::string>* labels = op.mutable_labels();
+  for (auto it = per_operation_label_plan_.begin(),
+            end = per_operation_label_plan_.end();
+       it != end; it++) {
+    const SupportedLabel* l = *it;
+    (void)(l->set)(*l, info, labels);
+  }
+}
+
+void RequestBuilder::PrepareQuotaOperationTemplate(
+    const std::string& method_name,
+    const std::vector<std::pair<std::string, int>>& metric_cost_vector) {
+  ::google::api::servicecontrol::v1::AllocateQuotaRequest& request =
+      quota_request_templates_[method_name];
+  request.Clear();
+  request.set_service_name(service_name_);
+  request.set_service_config_id(service_config_id_);
+
+  ::google::api::servicecontrol::v1::QuotaOperation* operation =
+      request.mutable_allocate_operation();
+  operation->set_method_name(method_name);
+  operation->set_quota_mode(
+      ::google::api::servicecontrol::v1::QuotaOperation_QuotaMode::
+          QuotaOperation_QuotaMode_BEST_EFFORT);
+
+  auto* labels = operation->mutable_labels();
+  (*labels)[kServiceControlUserAgent] = kUserAgent;
+  (*labels)[kServiceControlServiceAgent] = get_service_agent();
+
+  for (auto it = metric_cost_vector.begin(), end = metric_cost_vector.end();
+       it != end; it++) {
+    MetricValueSet* value_set = operation->add_quota_metrics();
+    value_set->set_metric_name(it->first);
+    MetricValue* value = value_set->add_metric_values();
+    value->set_int64_value(it->second <= 0 ? 1 : it->second);
+  }
+}
+
 Status RequestBuilder::AppendByConsumerOperations(
     const ReportRequestInfo& info,
     ::google::api::servicecontrol::v1::ReportRequest* request,
@@ -1280,12 +1600,23 @@ Status RequestBuilder::AppendByConsumerOperations(
   // Only populate metrics if we can associate them with a method/operation.
   if (!info.operation_id.empty() && !info.operation_name.empty()) {
     Map<std::string, std::string>* labels = op->mutable_labels();
-    // Set all labels.
+    // Set all labels; labels_ only holds entries with a setter.
     for (auto it = labels_.begin(), end = labels_.end(); it != end; it++) {
       const SupportedLabel* l = *it;
-      if (l->set) {
-        Status status = (l->set)(*l, info, labels);
-        if (!status.ok()) return status;
+      Status status = (l->set)(*l, info, labels);
+      if (!status.ok()) return status;
+    }
+
+    // Cap the referer label like the primary operation does.
+    if (report_field_byte_budget_ > 0) {
+      auto referer_it = labels->find(kRefererLabelName);
+      if (referer_it != labels->end()) {
+        bool truncated = false;
+        const absl::string_view capped = TruncateFieldValue(
+            referer_it->second, report_field_byte_budget_, &truncated);
+        if (truncated) {
+          referer_it->second.resize(capped.size());
+        }
       }
     }
 
@@ -1349,11 +1680,47 @@ Status RequestBuilder::ConvertAllocateQuotaResponse(
   return Status::OK;
 }
 
+namespace {
+
+// Builds a process-lifetime denial entry. The status message and the
+// response body are formatted once here, so the rejection path only hands
+// out pointers afterwards.
+const CheckDenialInfo* NewCheckDenial(Code code, const std::string& message) {
+  auto* denial = new CheckDenialInfo;
+  denial->status = Status(code, message);
+  denial->body = denial->status.ToString();
+  return denial;
+}
+
+// Denial messages that embed the service name, cached per (reason, service)
+// pair. A process serves a handful of services, so the map stays tiny; the
+// lock is only taken for these configuration-error reasons, never for the
+// api-key and permission denials abusive traffic hits.
+const CheckDenialInfo* ServiceCheckDenial(int error_code, Code code,
+                                          const std::string& service_name,
+                                          const char* message_suffix) {
+  static std::mutex* cache_mutex = new std::mutex;
+  static auto* cache =
+      new std::map<std::pair<int, std::string>, const CheckDenialInfo*>;
+  std::lock_guard<std::mutex> lock(*cache_mutex);
+  auto& denial = (*cache)[std::make_pair(error_code, service_name)];
+  if (denial == nullptr) {
+    denial = NewCheckDenial(
+        code, std::string("API ") + service_name + message_suffix);
+  }
+  return denial;
+}
+
+}  // namespace
+
 Status RequestBuilder::ConvertCheckResponse(
     const CheckResponse& check_response, const std::string& service_name,
     CheckResponseInfo* check_response_info) {
-  if (check_response.check_info().consumer_info().project_number() > 0) {
-    // Store project id to check_response_info
+  if (check_response_info && check_response_info->consumer_project_id.empty() &&
+      check_response.check_info().consumer_info().project_number() > 0) {
+    // Store project id to check_response_info. The caller may have
+    // pre-filled it from its per-api-key cache; keep that value instead of
+    // re-formatting the number on every check.
     check_response_info->consumer_project_id = std::to_string(
         check_response.check_info().consumer_info().project_number());
   }
@@ -1366,59 +1733,121 @@ Status RequestBuilder::ConvertCheckResponse(
   // TODO: report a detailed status to the producer project, but hide it from
   // consumer
   // TODO: unless they are the same entity
+  // Each denied reason resolves to a process-lifetime CheckDenialInfo
+  // entry carrying the status and the preformatted rejection body, so
+  // denying a request (exactly the path abusive traffic exercises) only
+  // hands out pointers.
   const CheckError& error = check_response.check_errors(0);
+  const CheckDenialInfo* denial = nullptr;
   switch (error.code()) {
-    case CheckError::NOT_FOUND:  // The consumer's project id is not found.
-      return Status(Code::INVALID_ARGUMENT,
-                    "Client project not found. Please pass a valid project.");
-    case CheckError::API_KEY_NOT_FOUND:
+    case CheckError::NOT_FOUND: {  // The consumer's project id is not found.
+      static const auto* entry = NewCheckDenial(
+          Code::INVALID_ARGUMENT,
+          "Client project not found. Please pass a valid project.");
+      denial = entry;
+      break;
+    }
+    case CheckError::API_KEY_NOT_FOUND: {
       if (check_response_info) check_response_info->is_api_key_valid = false;
-      return Status(Code::INVALID_ARGUMENT,
-                    "API key not found. Please pass a valid API key.");
-    case CheckError::API_KEY_EXPIRED:
+      static const auto* entry = NewCheckDenial(
+          Code::INVALID_ARGUMENT,
+          "API key not found. Please pass a valid API key.");
+      denial = entry;
+      break;
+    }
+    case CheckError::API_KEY_EXPIRED: {
       if (check_response_info) check_response_info->is_api_key_valid = false;
-      return Status(Code::INVALID_ARGUMENT,
-                    "API key expired. Please renew the API key.");
-    case CheckError::API_KEY_INVALID:
+      static const auto* entry = NewCheckDenial(
+          Code::INVALID_ARGUMENT, "API key expired. Please renew the API key.");
+      denial = entry;
+      break;
+    }
+    case CheckError::API_KEY_INVALID: {
       if (check_response_info) check_response_info->is_api_key_valid = false;
-      return Status(Code::INVALID_ARGUMENT,
-                    "API key not valid. Please pass a valid API key.");
+      static const auto* entry = NewCheckDenial(
+          Code::INVALID_ARGUMENT,
+          "API key not valid. Please pass a valid API key.");
+      denial = entry;
+      break;
+    }
     case CheckError::SERVICE_NOT_ACTIVATED:
       if (check_response_info)
         check_response_info->service_is_activated = false;
-      return Status(Code::PERMISSION_DENIED,
-                    std::string("API ") + service_name +
-                        " is not enabled for the project.");
-    case CheckError::PERMISSION_DENIED:
-      return Status(Code::PERMISSION_DENIED, "Permission denied.");
-    case CheckError::IP_ADDRESS_BLOCKED:
-      return Status(Code::PERMISSION_DENIED, "IP address blocked.");
-    case CheckError::REFERER_BLOCKED:
-      return Status(Code::PERMISSION_DENIED, "Referer blocked.");
-    case CheckError::CLIENT_APP_BLOCKED:
-      return Status(Code::PERMISSION_DENIED, "Client application blocked.");
-    case CheckError::PROJECT_DELETED:
-      return Status(Code::PERMISSION_DENIED, "Project has been deleted.");
-    case CheckError::PROJECT_INVALID:
-      return Status(Code::INVALID_ARGUMENT,
-                    "Client project not valid. Please pass a valid project.");
+      denial = ServiceCheckDenial(CheckError::SERVICE_NOT_ACTIVATED,
+                                  Code::PERMISSION_DENIED, service_name,
+                                  " is not enabled for the project.");
+      break;
+    case CheckError::PERMISSION_DENIED: {
+      static const auto* entry =
+          NewCheckDenial(Code::PERMISSION_DENIED, "Permission denied.");
+      denial = entry;
+      break;
+    }
+    case CheckError::IP_ADDRESS_BLOCKED: {
+      static const auto* entry =
+          NewCheckDenial(Code::PERMISSION_DENIED, "IP address blocked.");
+      denial = entry;
+      break;
+    }
+    case CheckError::REFERER_BLOCKED: {
+      static const auto* entry =
+          NewCheckDenial(Code::PERMISSION_DENIED, "Referer blocked.");
+      denial = entry;
+      break;
+    }
+    case CheckError::CLIENT_APP_BLOCKED: {
+      static const auto* entry = NewCheckDenial(Code::PERMISSION_DENIED,
+                                                "Client application blocked.");
+      denial = entry;
+      break;
+    }
+    case CheckError::PROJECT_DELETED: {
+      static const auto* entry =
+          NewCheckDenial(Code::PERMISSION_DENIED, "Project has been deleted.");
+      denial = entry;
+      break;
+    }
+    case CheckError::PROJECT_INVALID: {
+      static const auto* entry = NewCheckDenial(
+          Code::INVALID_ARGUMENT,
+          "Client project not valid. Please pass a valid project.");
+      denial = entry;
+      break;
+    }
     case CheckError::BILLING_DISABLED:
-      return Status(Code::PERMISSION_DENIED,
-                    std::string("API ") + service_name +
-                        " has billing disabled. Please enable it.");
-    case CheckError::SECURITY_POLICY_VIOLATED:
-      return Status(Code::PERMISSION_DENIED,
-                    "Request is not allowed as per security policies.");
-    case CheckError::INVALID_CREDENTIAL:
-      return Status(Code::PERMISSION_DENIED,
-                    "The credential in the request can not be verified");
-    case CheckError::LOCATION_POLICY_VIOLATED:
-      return Status(Code::PERMISSION_DENIED,
-                    "Request is not allowed as per location policies.");
-    case CheckError::CONSUMER_INVALID:
-      return Status(Code::PERMISSION_DENIED,
-                    "The consumer from the API key does not represent"
-                    " a valid consumer folder or organization");
+      denial = ServiceCheckDenial(CheckError::BILLING_DISABLED,
+                                  Code::PERMISSION_DENIED, service_name,
+                                  " has billing disabled. Please enable it.");
+      break;
+    case CheckError::SECURITY_POLICY_VIOLATED: {
+      static const auto* entry = NewCheckDenial(
+          Code::PERMISSION_DENIED,
+          "Request is not allowed as per security policies.");
+      denial = entry;
+      break;
+    }
+    case CheckError::INVALID_CREDENTIAL: {
+      static const auto* entry = NewCheckDenial(
+          Code::PERMISSION_DENIED,
+          "The credential in the request can not be verified");
+      denial = entry;
+      break;
+    }
+    case CheckError::LOCATION_POLICY_VIOLATED: {
+      static const auto* entry = NewCheckDenial(
+          Code::PERMISSION_DENIED,
+          "Request is not allowed as per location policies.");
+      denial = entry;
+      break;
+    }
+    case CheckError::CONSUMER_INVALID: {
+      static const auto* entry = NewCheckDenial(
+          Code::PERMISSION_DENIED,
+          "The consumer from the API key does not represent"
+          " a valid consumer folder or organization");
+      denial = entry;
+      break;
+    }
 
     case CheckError::NAMESPACE_LOOKUP_UNAVAILABLE:
     case CheckError::SERVICE_STATUS_UNAVAILABLE:
@@ -1430,12 +1859,15 @@ Status RequestBuilder::ConvertCheckResponse(
       // Fail open for internal server errors per recommendation
       return Status::OK;
     default:
+      // Unsupported codes keep the dynamic message; they never carry a
+      // table entry.
       return Status(
           Code::INTERNAL,
           std::string("Request blocked due to unsupported error code: ") +
               std::to_string(error.code()));
   }
-  return Status::OK;
+  if (check_response_info) check_response_info->denial = denial;
+  return denial->status;
 }
 
 bool RequestBuilder::IsMetricSupported(
@@ -15,7 +15,9 @@
 #pragma once
 
 #include <chrono>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "google/api/label.pb.h"
 #include "google/api/metric.pb.h"
 #include "google/api/servicecontrol/v1/quota_controller.pb.h"
@@ -23,6 +25,7 @@
 #include "google/protobuf/stubs/status.h"
 #include "google/protobuf/timestamp.pb.h"
 
+#include "src/api_proxy/service_control/coarse_clock.h"
 #include "src/api_proxy/service_control/request_info.h"
 
 namespace google {
@@ -32,15 +35,17 @@ namespace service_control {
 class RequestBuilder final {
  public:
   // Initializes RequestBuilder with all supported metrics and labels.
-  RequestBuilder(const std::set<std::string>& logs,
+  RequestBuilder(const std::vector<std::string>& logs,
                  const std::string& service_name,
                  const std::string& service_config_id);
 
   // Initializes RequestBuilder with specified (and supported) metrics and
-  // labels.
-  RequestBuilder(const std::set<std::string>& logs,
-                 const std::set<std::string>& metrics,
-                 const std::set<std::string>& labels,
+  // labels. |metrics| and |labels| must be sorted, the way
+  // LogsMetricsLoader::Load emits them; membership is resolved by binary
+  // search while the fill plans are compiled.
+  RequestBuilder(const std::vector<std::string>& logs,
+                 const std::vector<std::string>& metrics,
+                 const std::vector<std::string>& labels,
                  const std::string& service_name,
                  const std::string& service_config_id);
 
@@ -54,8 +59,7 @@ class RequestBuilder final {
   ::google::protobuf::util::Status FillCheckRequest(
       const CheckRequestInfo& info,
       ::google::api::servicecontrol::v1::CheckRequest* request,
-      std::chrono::system_clock::time_point now =
-          std::chrono::system_clock::now()) const;
+      std::chrono::system_clock::time_point now = CoarseClock::Now()) const;
 
   ::google::protobuf::util::Status FillAllocateQuotaRequest(
       const QuotaRequestInfo& info,
@@ -67,8 +71,51 @@ class RequestBuilder final {
   ::google::protobuf::util::Status FillReportRequest(
       const ReportRequestInfo& info,
       ::google::api::servicecontrol::v1::ReportRequest* request,
-      std::chrono::system_clock::time_point now =
-          std::chrono::system_clock::now()) const;
+      std::chrono::system_clock::time_point now = CoarseClock::Now()) const;
+
+  // Resolves the process-constant GCP platform values into the label set
+  // the report operation prototypes carry: cloud.googleapis.com/location
+  // from |location| and servicecontrol.googleapis.com/platform from
+  // |compute_platform| (the ReportRequestInfo default when empty). Must be
+  // called before PrepareReportOperationTemplate so the frozen prototypes
+  // pick the values up; the templated per-report label loop then never
+  // assembles them.
+  void PreparePlatformLabels(const std::string& location,
+                             const std::string& compute_platform);
+
+  // Precomputes a frozen Operation prototype for |operation_name| carrying
+  // the labels that never vary per request for that operation: api_method
+  // (the operation name), api_version, service_agent, user_agent and the
+  // platform labels resolved by PreparePlatformLabels.
+  // FillReportRequest starts report operations from the prototype and skips
+  // recomputing those labels. Must be called at config time, before the
+  // Fill* methods run on worker threads; the template map is read-only
+  // afterwards.
+  void PrepareReportOperationTemplate(const std::string& operation_name,
+                                      const std::string& api_name,
+                                      const std::string& api_version);
+
+  // Precomputes a frozen AllocateQuotaRequest prototype for |method_name|:
+  // the service identity, quota mode, agent labels and the quota metrics
+  // with their fixed costs never vary per request, so
+  // FillAllocateQuotaRequest starts from the prototype and patches only
+  // the operation id, consumer id and caller labels. Must be called at
+  // config time, before the Fill* methods run on worker threads; the
+  // template map is read-only afterwards.
+  void PrepareQuotaOperationTemplate(
+      const std::string& method_name,
+      const std::vector<std::pair<std::string, int>>& metric_cost_vector);
+
+  // Caps each variable-size request string the report path copies into
+  // operation labels and log entry payloads (url, referer, log message,
+  // jwt payloads and the header dumps). Values over the budget are
+  // truncated at copy time on a UTF-8 sequence boundary and the log
+  // entry carries a "truncated" marker field. Zero, the default, copies
+  // fields unbounded. Must be called at config time, before the Fill*
+  // methods run on worker threads.
+  void SetReportFieldByteBudget(uint32_t budget) {
+    report_field_byte_budget_ = budget;
+  }
 
   // Append a new consumer project Operations to the ReportRequest, if customer
   // project id from the CheckResponse is not empty
@@ -99,8 +146,35 @@ class RequestBuilder final {
   const std::vector<std::string> logs_;
   const std::vector<const struct SupportedMetric*> metrics_;
   const std::vector<const struct SupportedLabel*> labels_;
+  // Fill plans compiled from labels_ at construction: each is the dense,
+  // configuration-ordered subset of labels a fill loop runs straight
+  // through, so no per-call branching on label attributes is needed.
+  // Labels recomputed on every report operation.
+  const std::vector<const struct SupportedLabel*> report_label_plan_;
+  // report_label_plan_ minus the labels a prepared operation template
+  // already carries.
+  const std::vector<const struct SupportedLabel*> templated_report_label_plan_;
+  // The per-operation labels baked into report operation templates.
+  const std::vector<const struct SupportedLabel*> per_operation_label_plan_;
   const std::string service_name_;
   const std::string service_config_id_;
+  // The process-constant platform values baked into report operation
+  // prototypes; see PreparePlatformLabels().
+  std::string platform_location_;
+  std::string platform_compute_platform_;
+  // Per-field byte budget for variable-size report strings; 0 is
+  // unbounded. See SetReportFieldByteBudget().
+  uint32_t report_field_byte_budget_{0};
+  // Operation name to frozen report Operation prototype. flat_hash_map so
+  // FillReportRequest can look up the string_view operation name without
+  // materializing a std::string key.
+  absl::flat_hash_map<std::string,
+                      ::google::api::servicecontrol::v1::Operation>
+      report_operation_templates_;
+  // Method name to frozen AllocateQuotaRequest prototype.
+  absl::flat_hash_map<std::string,
+                      ::google::api::servicecontrol::v1::AllocateQuotaRequest>
+      quota_request_templates_;
 };
 
 }  // namespace service_control
@@ -201,6 +201,67 @@ TEST_F(RequestBuilderTest, FillGoodAllocateQuotaRequestTest) {
   ASSERT_EQ(expected_text, text);
 }
 
+TEST_F(RequestBuilderTest, AllocateQuotaWithPreparedTemplateMatchesUnprepared) {
+  // The prepared-prototype path must produce exactly the same request as
+  // rebuilding the metric value sets per call.
+  std::vector<std::pair<std::string, int>> metric_cost_vector = {
+      {"metric_first", 1}, {"metric_second", 2}};
+
+  QuotaRequestInfo info;
+  info.metric_cost_vector = &metric_cost_vector;
+
+  FillOperationInfo(&info);
+  FillAllocateQuotaRequestInfo(&info);
+
+  gasv1::AllocateQuotaRequest unprepared_request;
+  ASSERT_TRUE(scp_.FillAllocateQuotaRequest(info, &unprepared_request).ok());
+
+  RequestBuilder prepared_scp({"local_test_log"}, "test_service",
+                              "2016-09-19r0");
+  prepared_scp.PrepareQuotaOperationTemplate(std::string(info.method_name),
+                                             metric_cost_vector);
+  gasv1::AllocateQuotaRequest prepared_request;
+  ASSERT_TRUE(
+      prepared_scp.FillAllocateQuotaRequest(info, &prepared_request).ok());
+
+  ASSERT_EQ(AllocateQuotaRequestToString(&unprepared_request),
+            AllocateQuotaRequestToString(&prepared_request));
+}
+
+TEST_F(RequestBuilderTest, AllocateQuotaOperationCountScalesCosts) {
+  // A batched incremental charge multiplies every metric cost by the
+  // operation count, identically on the prepared and unprepared paths.
+  std::vector<std::pair<std::string, int>> metric_cost_vector = {
+      {"metric_first", 1}, {"metric_second", 2}};
+
+  QuotaRequestInfo info;
+  info.metric_cost_vector = &metric_cost_vector;
+
+  FillOperationInfo(&info);
+  FillAllocateQuotaRequestInfo(&info);
+  info.operation_count = 5;
+
+  gasv1::AllocateQuotaRequest unprepared_request;
+  ASSERT_TRUE(scp_.FillAllocateQuotaRequest(info, &unprepared_request).ok());
+
+  RequestBuilder prepared_scp({"local_test_log"}, "test_service",
+                              "2016-09-19r0");
+  prepared_scp.PrepareQuotaOperationTemplate(std::string(info.method_name),
+                                             metric_cost_vector);
+  gasv1::AllocateQuotaRequest prepared_request;
+  ASSERT_TRUE(
+      prepared_scp.FillAllocateQuotaRequest(info, &prepared_request).ok());
+
+  ASSERT_EQ(AllocateQuotaRequestToString(&unprepared_request),
+            AllocateQuotaRequestToString(&prepared_request));
+
+  for (const auto& metrics :
+       unprepared_request.allocate_operation().quota_metrics()) {
+    const int cost = metrics.metric_name() == "metric_first" ? 1 : 2;
+    ASSERT_EQ(cost * 5, metrics.metric_values(0).int64_value());
+  }
+}
+
 TEST_F(RequestBuilderTest, FillAllocateQuotaRequestNoMethodNameTest) {
   std::vector<std::pair<std::string, int>> metric_cost_vector = {
       {"metric_first", 1}, {"metric_second", 2}};
@@ -268,6 +329,96 @@ TEST_F(RequestBuilderTest, FillGoodReportRequestTest) {
   ASSERT_EQ(expected_text, text);
 }
 
+TEST_F(RequestBuilderTest, ReportWithPreparedTemplateMatchesUnprepared) {
+  // The prepared-template path must produce exactly the same request as
+  // recomputing every label per call.
+  ReportRequestInfo info;
+  FillOperationInfo(&info);
+  FillReportRequestInfo(&info);
+  info.backend_protocol = protocol::GRPC;
+  // In production api_method is the operation name; the template relies on
+  // that invariant.
+  info.api_method = info.operation_name;
+
+  gasv1::ReportRequest unprepared_request;
+  ASSERT_TRUE(
+      scp_.FillReportRequest(info, &unprepared_request, mock_now_).ok());
+
+  RequestBuilder prepared_scp({"local_test_log"}, "test_service",
+                              "2016-09-19r0");
+  // In production the platform labels and the info fields come from the
+  // same filter config, so resolving the same values here preserves the
+  // equivalence below.
+  prepared_scp.PreparePlatformLabels(std::string(info.location),
+                                     std::string(info.compute_platform));
+  prepared_scp.PrepareReportOperationTemplate(info.operation_name,
+                                              info.api_name, info.api_version);
+  gasv1::ReportRequest prepared_request;
+  ASSERT_TRUE(
+      prepared_scp.FillReportRequest(info, &prepared_request, mock_now_).ok());
+
+  ASSERT_EQ(ReportRequestToString(&unprepared_request),
+            ReportRequestToString(&prepared_request));
+}
+
+TEST_F(RequestBuilderTest, ReportFieldByteBudgetTruncatesOversizedFields) {
+  ReportRequestInfo info;
+  FillOperationInfo(&info);
+  FillReportRequestInfo(&info);
+  // 16 bytes with two-byte UTF-8 sequences at offsets 1, 3 and 11.
+  const std::string oversized_referer =
+      std::string("r\xc3\xa9"
+                  "f\xc3\xa9"
+                  "rer-p") +
+      "\xc3\xa9"
+      "dia";
+  const std::string oversized_url = "/echo?big=" + std::string(40, 'x');
+  info.referer = oversized_referer;
+  info.url = oversized_url;
+
+  RequestBuilder budgeted_scp({"local_test_log"}, "test_service",
+                              "2016-09-19r0");
+  budgeted_scp.SetReportFieldByteBudget(12);
+
+  gasv1::ReportRequest request;
+  ASSERT_TRUE(budgeted_scp.FillReportRequest(info, &request, mock_now_).ok());
+
+  const auto& op = request.operations(0);
+  const auto& fields = op.log_entries(0).struct_payload().fields();
+  EXPECT_EQ("/echo?big=xx", fields.at("url").string_value());
+  // Byte 12 of the referer falls inside a two-byte sequence; the cut
+  // backs off to the sequence start instead of splitting it.
+  EXPECT_EQ(
+      "r\xc3\xa9"
+      "f\xc3\xa9"
+      "rer-p",
+      fields.at("referer").string_value());
+  EXPECT_TRUE(fields.at("truncated").bool_value());
+  // The referer label is capped the same way as the log entry field.
+  EXPECT_EQ(
+      "r\xc3\xa9"
+      "f\xc3\xa9"
+      "rer-p",
+      op.labels().at("/referer"));
+}
+
+TEST_F(RequestBuilderTest, ReportFieldByteBudgetZeroIsUnbounded) {
+  ReportRequestInfo info;
+  FillOperationInfo(&info);
+  FillReportRequestInfo(&info);
+  const std::string oversized_url = "/echo?big=" + std::string(40, 'x');
+  info.url = oversized_url;
+
+  // The fixture's builder never had a budget set.
+  gasv1::ReportRequest request;
+  ASSERT_TRUE(scp_.FillReportRequest(info, &request, mock_now_).ok());
+
+  const auto& fields =
+      request.operations(0).log_entries(0).struct_payload().fields();
+  EXPECT_EQ(oversized_url, fields.at("url").string_value());
+  EXPECT_TRUE(fields.find("truncated") == fields.end());
+}
+
 TEST_F(RequestBuilderTest, FillGoodReportRequestByConsumerTest) {
   ReportRequestInfo info;
   FillOperationInfo(&info);
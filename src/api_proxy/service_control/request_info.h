@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include "absl/strings/string_view.h"
 #include "google/api/quota.pb.h"
 #include "google/protobuf/stubs/status.h"
 
@@ -61,36 +62,43 @@ struct LatencyInfo {
 // Use the CheckRequestInfo and ReportRequestInfo to fill Service Control
 // request protocol buffers. Use following two structures to pass
 // in minimum info and call Fill functions to fill the protobuf.
+//
+// The string_view fields below are views into storage owned by the caller
+// (header-derived buffers, config protos). They are only read while the
+// Fill functions copy them into the request protobuf, so each string is
+// copied exactly once; the caller must keep the backing storage alive
+// until then. Fields the caller builds up in place (log_message, logged
+// headers, jwt payloads) stay owned strings.
 
 // Basic information about the API call (operation).
 struct OperationInfo {
   // Identity of the operation. It must be unique within the scope of the
   // service. If the service calls Check() and Report() on the same operation,
   // the two calls should carry the same operation id.
-  std::string operation_id;
+  absl::string_view operation_id;
 
   // Fully qualified name of the operation.
-  std::string operation_name;
+  absl::string_view operation_name;
 
   // The producer project id.
-  std::string producer_project_id;
+  absl::string_view producer_project_id;
 
   // The API key.
-  std::string api_key;
+  absl::string_view api_key;
 
   // Uses Referer header, if the Referer header doesn't present, use the
   // Origin header. If both of them not present, it's empty.
-  std::string referer;
+  absl::string_view referer;
 
   // The start time of the call. Used to set operation.start_time for both Check
   // and Report.
   std::chrono::system_clock::time_point request_start_time;
 
   // The client IP address.
-  std::string client_ip;
+  absl::string_view client_ip;
 
   // The client host name.
-  std::string client_host;
+  absl::string_view client_host;
 
   OperationInfo() {}
 };
@@ -98,9 +106,21 @@ struct OperationInfo {
 // Information to fill Check request protobuf.
 struct CheckRequestInfo : public OperationInfo {
   // used for api key restriction check
-  std::string android_package_name;
-  std::string android_cert_fingerprint;
-  std::string ios_bundle_id;
+  absl::string_view android_package_name;
+  absl::string_view android_cert_fingerprint;
+  absl::string_view ios_bundle_id;
+};
+
+// A precomputed check denial verdict. Entries live for the process
+// lifetime in static tables (see RequestBuilder::ConvertCheckResponse), so
+// denying a request hands out a pointer instead of formatting a status
+// message and response body per request.
+struct CheckDenialInfo {
+  // The status ConvertCheckResponse returns for this denial reason.
+  ::google::protobuf::util::Status status;
+  // The response body for the rejection, preformatted once as
+  // status.ToString().
+  std::string body;
 };
 
 // Stores the information subtracted from the check response.
@@ -112,15 +132,25 @@ struct CheckResponseInfo {
   // Consumer project id
   std::string consumer_project_id;
 
+  // The denial verdict when the check response rejected the request, or
+  // nullptr. Points into a process-lifetime table; never owned here.
+  const CheckDenialInfo* denial;
+
   // By default api_key is valid and service is activated.
   // They only set to false by the check response from server.
-  CheckResponseInfo() : is_api_key_valid(true), service_is_activated(true) {}
+  CheckResponseInfo()
+      : is_api_key_valid(true), service_is_activated(true), denial(nullptr) {}
 };
 
 struct QuotaRequestInfo : public OperationInfo {
-  std::string method_name;
+  absl::string_view method_name;
 
   const std::vector<std::pair<std::string, int>>* metric_cost_vector;
+
+  // The number of logical operations this charge covers. gRPC streams
+  // charge quota incrementally and batch several stream messages into one
+  // charge, with every metric cost multiplied by this count.
+  int64_t operation_count = 1;
 };
 
 // Information to fill Report request protobuf.
@@ -132,14 +162,14 @@ struct ReportRequestInfo : public OperationInfo {
   ::google::protobuf::util::Status status;
 
   // Original request URL.
-  std::string url;
+  absl::string_view url;
 
   // location of the service, such as us-central.
-  std::string location;
+  absl::string_view location;
   // API name and version.
-  std::string api_name;
-  std::string api_version;
-  std::string api_method;
+  absl::string_view api_name;
+  absl::string_view api_version;
+  absl::string_view api_method;
 
   // The request size in bytes. -1 if not available.
   int64_t request_size;
@@ -162,10 +192,10 @@ struct ReportRequestInfo : public OperationInfo {
   protocol::Protocol backend_protocol;
 
   // HTTP method. all-caps string such as "GET", "POST" etc.
-  std::string method;
+  absl::string_view method;
 
   // A recognized compute platform (GAE, GCE, GKE).
-  std::string compute_platform;
+  absl::string_view compute_platform;
 
   // If consumer data should be sent.
   CheckResponseInfo check_response_info;
@@ -26,8 +26,14 @@ namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
 namespace BackendAuth {
-// Use shared_ptr to do atomic token update.
-typedef std::shared_ptr<std::string> TokenSharedPtr;
+
+// A published token together with its Authorization header value, formatted
+// once when the token callback fires instead of per request.
+struct TokenInfo {
+  std::string token;
+  // "Bearer " + token.
+  std::string authorization;
+};
 
 class FilterConfigParser {
  public:
@@ -35,8 +41,19 @@ class FilterConfigParser {
 
   virtual absl::string_view getAudience(absl::string_view operation) const PURE;
 
-  virtual const TokenSharedPtr getJwtToken(
-      absl::string_view audience) const PURE;
+  // Returns the current token for the audience, or nullptr if no token has
+  // been fetched yet. The pointed-to object is owned by the parser and stays
+  // valid for the duration of the calling filter callback; callers must not
+  // hold it across dispatcher callbacks.
+  virtual const TokenInfo* getJwtToken(absl::string_view audience) const PURE;
+
+  // Id-indexed variants of the lookups above, keyed by the dense operation
+  // id the path matcher stored in filter state; one array access instead of
+  // hashing the operation and audience names. Every rule of this config
+  // interned its operation id at load time, so an id outside the table has
+  // no rule here.
+  virtual absl::string_view getAudienceById(uint32_t operation_id) const PURE;
+  virtual const TokenInfo* getJwtTokenById(uint32_t operation_id) const PURE;
 };
 
 typedef std::unique_ptr<FilterConfigParser> FilterConfigParserPtr;
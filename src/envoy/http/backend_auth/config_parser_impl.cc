@@ -15,6 +15,9 @@
 #include <memory>
 
 #include "src/envoy/http/backend_auth/config_parser_impl.h"
+
+#include "src/envoy/utils/operation_interner.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -27,23 +30,84 @@ using Utils::TokenSubscriber;
 
 // TODO(kyuc): add unit tests for all possible backend rule configs.
 
+TokenTablePublisher::TokenTablePublisher(
+    Server::Configuration::FactoryContext& context)
+    : tls_(context.threadLocal().allocateSlot()) {
+  tls_->set([](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+    return std::make_shared<TokenTable>();
+  });
+}
+
+uint32_t TokenTablePublisher::addEntry() {
+  live_.emplace_back(nullptr);
+  return live_.size() - 1;
+}
+
+void TokenTablePublisher::publish(uint32_t index,
+                                  std::unique_ptr<TokenInfo> info) {
+  if (live_[index] != nullptr) {
+    pending_retire_.push_back(std::move(live_[index]));
+  }
+  live_[index] = std::move(info);
+  flush_needed_ = true;
+  if (!flush_in_flight_) {
+    flush();
+  }
+}
+
+const TokenInfo* TokenTablePublisher::token(uint32_t index) const {
+  const auto& tokens = tls_->getTyped<TokenTable>().tokens_;
+  return index < tokens.size() ? tokens[index] : nullptr;
+}
+
+void TokenTablePublisher::flush() {
+  flush_needed_ = false;
+  flush_in_flight_ = true;
+  const uint64_t epoch = ++current_epoch_;
+  for (auto& info : pending_retire_) {
+    retired_.emplace_back(epoch, std::move(info));
+  }
+  pending_retire_.clear();
+  auto snapshot = std::make_shared<std::vector<const TokenInfo*>>();
+  snapshot->reserve(live_.size());
+  for (const auto& info : live_) {
+    snapshot->push_back(info.get());
+  }
+  tls_->runOnAllThreads(
+      [this, snapshot]() { tls_->getTyped<TokenTable>().tokens_ = *snapshot; },
+      [this, epoch]() {
+        // Every worker now runs a table at least this new; anything retired
+        // by it (or an earlier flush) is unreachable.
+        while (!retired_.empty() && retired_.front().first <= epoch) {
+          retired_.pop_front();
+        }
+        flush_in_flight_ = false;
+        // Updates that arrived while this swap propagated go out together
+        // in one post; the in-flight swap acts as the batching window.
+        if (flush_needed_) {
+          flush();
+        }
+      });
+}
+
 AudienceContext::AudienceContext(
     const ::google::api::envoy::http::backend_auth::BackendAuthRule&
         proto_config,
-    Server::Configuration::FactoryContext& context,
     const FilterConfig& filter_config,
     const Utils::TokenSubscriberFactory& token_subscriber_factory,
-    IamTokenSubscriber::TokenGetFunc access_token_fn)
-    : tls_(context.threadLocal().allocateSlot()) {
-  tls_->set([](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
-    return std::make_shared<TokenCache>();
-  });
-
+    IamTokenSubscriber::TokenGetFunc access_token_fn,
+    TokenTablePublisher& token_publisher)
+    : token_publisher_(token_publisher),
+      token_index_(token_publisher.addEntry()) {
   TokenSubscriber::TokenUpdateFunc callback = [this](const std::string& token) {
-    TokenSharedPtr new_token = std::make_shared<std::string>(token);
-    tls_->runOnAllThreads([this, new_token]() {
-      tls_->getTyped<TokenCache>().token_ = new_token;
-    });
+    // The token is owned by the publisher on the main thread and workers
+    // only get a plain pointer, so requests read the token without bouncing
+    // a shared_ptr refcount cacheline between them. Its Authorization
+    // header value is formatted once here rather than per request.
+    auto info = std::make_unique<TokenInfo>();
+    info->token = token;
+    info->authorization = "Bearer " + token;
+    token_publisher_.publish(token_index_, std::move(info));
   };
 
   switch (filter_config.id_token_info_case()) {
@@ -106,14 +170,29 @@ FilterConfigParserImpl::FilterConfigParserImpl(
     }
   }
 
+  token_publisher_ = std::make_unique<TokenTablePublisher>(context);
+  auto& interner = Utils::OperationInterner::instance();
   for (const auto& rule : config.rules()) {
-    operation_map_[rule.operation()] = rule.jwt_audience();
-    auto it = audience_map_.find(rule.jwt_audience());
+    const absl::string_view audience = interner.InternName(rule.jwt_audience());
+    operation_map_[interner.InternName(rule.operation())] = audience;
+    auto it = audience_map_.find(audience);
     if (it == audience_map_.end()) {
-      audience_map_[rule.jwt_audience()] = AudienceContextPtr(
-          new AudienceContext(rule, context, config, token_subscriber_factory,
-                              [this]() { return access_token_; }));
+      audience_map_[audience] = AudienceContextPtr(
+          new AudienceContext(rule, config, token_subscriber_factory,
+                              [this]() { return access_token_; },
+                              *token_publisher_));
+    }
+  }
+
+  // Index the rules by their interned operation id. Built after the maps
+  // are complete so the stored views and pointers are final.
+  for (const auto& it : operation_map_) {
+    const uint32_t id = interner.Intern(it.first);
+    if (id >= rules_by_id_.size()) {
+      rules_by_id_.resize(id + 1);
     }
+    rules_by_id_[id].audience = it.second;
+    rules_by_id_[id].context = audience_map_.find(it.second)->second.get();
   }
 }
 }  // namespace BackendAuth
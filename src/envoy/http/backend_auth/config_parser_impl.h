@@ -12,7 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #pragma once
+#include <deque>
 #include <list>
+#include <memory>
 #include <unordered_map>
 
 #include "absl/container/flat_hash_map.h"
@@ -29,9 +31,57 @@ namespace Extensions {
 namespace HttpFilters {
 namespace BackendAuth {
 
-class TokenCache : public ThreadLocal::ThreadLocalObject {
+// Per-worker view of the tokens for every audience of one config, indexed
+// by the audience's table slot. The entries point to TokenInfos owned by
+// the TokenTablePublisher on the main thread, and the vector is only
+// written from this worker's dispatcher via runOnAllThreads, so the
+// request hot path reads tokens with no atomic operations at all.
+class TokenTable : public ThreadLocal::ThreadLocalObject {
  public:
-  TokenSharedPtr token_;
+  std::vector<const TokenInfo*> tokens_;
+};
+
+// Publishes the token table to the workers with one cross-thread post per
+// publication wave, shared by all audiences of one config. Token refreshes
+// of different audiences tend to arrive close together (the subscribers
+// are created together and follow similar TTLs), and posting each one
+// separately woke every worker dispatcher once per audience. Instead, at
+// most one table swap is in flight at a time: updates arriving while one
+// is propagating accumulate in the main-thread master copy and go out in a
+// single post when the in-flight swap completes. All methods except
+// token() run on the main thread.
+class TokenTablePublisher {
+ public:
+  explicit TokenTablePublisher(
+      Server::Configuration::FactoryContext& context);
+
+  // Grows the table by one slot and returns its index; config time only.
+  uint32_t addEntry();
+
+  // Replaces the token at |index| and schedules its propagation. The old
+  // TokenInfo stays alive until every worker has installed a table without
+  // it.
+  void publish(uint32_t index, std::unique_ptr<TokenInfo> info);
+
+  // Reads this worker's view; null until a table with a token for |index|
+  // has reached the worker.
+  const TokenInfo* token(uint32_t index) const;
+
+ private:
+  void flush();
+
+  ThreadLocal::SlotPtr tls_;
+  // Main-thread master copy, one entry per audience.
+  std::vector<std::unique_ptr<TokenInfo>> live_;
+  // Replaced TokenInfos with the epoch of the first table swap that no
+  // longer carries them, oldest first; dropped in that swap's completion
+  // callback, when every worker has moved past them.
+  std::deque<std::pair<uint64_t, std::unique_ptr<TokenInfo>>> retired_;
+  // Replacements since the last flush, not yet tagged with an epoch.
+  std::vector<std::unique_ptr<TokenInfo>> pending_retire_;
+  uint64_t current_epoch_{0};
+  bool flush_in_flight_{false};
+  bool flush_needed_{false};
 };
 
 class AudienceContext {
@@ -39,19 +89,18 @@ class AudienceContext {
   AudienceContext(
       const ::google::api::envoy::http::backend_auth::BackendAuthRule&
           proto_config,
-      Server::Configuration::FactoryContext& context,
       const ::google::api::envoy::http::backend_auth::FilterConfig& config,
       const Utils::TokenSubscriberFactory& token_subscriber_factory,
-      Utils::IamTokenSubscriber::TokenGetFunc access_token_fn);
-  TokenSharedPtr token() const {
-    if (tls_->getTyped<TokenCache>().token_) {
-      return tls_->getTyped<TokenCache>().token_;
-    }
-    return nullptr;
+      Utils::IamTokenSubscriber::TokenGetFunc access_token_fn,
+      TokenTablePublisher& token_publisher);
+  const TokenInfo* token() const {
+    return token_publisher_.token(token_index_);
   }
 
  private:
-  ThreadLocal::SlotPtr tls_;
+  // The config's shared publisher and this audience's slot in its table.
+  TokenTablePublisher& token_publisher_;
+  const uint32_t token_index_;
   Utils::IamTokenSubscriberPtr iam_token_sub_ptr_;
   Utils::TokenSubscriberPtr imds_token_sub_ptr_;
 };
@@ -76,7 +125,7 @@ class FilterConfigParserImpl
     return operation_it->second;
   }
 
-  const TokenSharedPtr getJwtToken(absl::string_view audience) const override {
+  const TokenInfo* getJwtToken(absl::string_view audience) const override {
     auto audience_it = audience_map_.find(audience);
     if (audience_it == audience_map_.end()) {
       return nullptr;
@@ -84,13 +133,46 @@ class FilterConfigParserImpl
     return audience_it->second->token();
   }
 
+  absl::string_view getAudienceById(uint32_t operation_id) const override {
+    if (operation_id >= rules_by_id_.size()) {
+      return absl::string_view();
+    }
+    return rules_by_id_[operation_id].audience;
+  }
+
+  const TokenInfo* getJwtTokenById(uint32_t operation_id) const override {
+    if (operation_id >= rules_by_id_.size() ||
+        rules_by_id_[operation_id].context == nullptr) {
+      return nullptr;
+    }
+    return rules_by_id_[operation_id].context->token();
+  }
+
  private:
+  // One rule as seen from the id-indexed lookups: the audience and the
+  // context owning its token. Default-constructed slots mean no backend
+  // auth rule for that operation id.
+  struct RuleById {
+    absl::string_view audience;
+    const AudienceContext* context = nullptr;
+  };
+
   //  access_token_ is required for authentication during fetching id_token from
   //  IAM server.
   std::string access_token_;
+  // Declared before audience_map_ so the contexts' references to it stay
+  // valid while they are destroyed.
+  std::unique_ptr<TokenTablePublisher> token_publisher_;
   Utils::TokenSubscriberPtr access_token_sub_ptr_;
-  absl::flat_hash_map<std::string, std::string> operation_map_;
-  absl::flat_hash_map<std::string, AudienceContextPtr> audience_map_;
+  // Both maps are keyed by (and operation_map_ values are) the canonical
+  // string copies owned by the process-wide operation interner, so the
+  // selector and audience strings are stored once per process rather than
+  // once per map.
+  absl::flat_hash_map<absl::string_view, absl::string_view> operation_map_;
+  absl::flat_hash_map<absl::string_view, AudienceContextPtr> audience_map_;
+  // The rules indexed by interned operation id; the audience views point
+  // into the interner's storage, which is never mutated.
+  std::vector<RuleById> rules_by_id_;
 };
 
 }  // namespace BackendAuth
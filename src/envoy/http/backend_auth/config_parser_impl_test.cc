@@ -113,8 +113,10 @@ rules {
   EXPECT_EQ(config_parser_->getAudience("operation-foo"), "audience-foo");
   EXPECT_EQ(config_parser_->getAudience("operation-bar"), "audience-bar");
 
-  EXPECT_EQ(*config_parser_->getJwtToken("audience-foo"), "token-foo");
-  EXPECT_EQ(*config_parser_->getJwtToken("audience-bar"), "token-bar");
+  EXPECT_EQ(config_parser_->getJwtToken("audience-foo")->token, "token-foo");
+  EXPECT_EQ(config_parser_->getJwtToken("audience-foo")->authorization,
+            "Bearer token-foo");
+  EXPECT_EQ(config_parser_->getJwtToken("audience-bar")->token, "token-bar");
 }
 
 TEST_F(ConfigParserImplTest, GetIdTokenByIam) {
@@ -189,8 +191,8 @@ rules {
   EXPECT_EQ(config_parser_->getAudience("operation-foo"), "audience-foo");
   EXPECT_EQ(config_parser_->getAudience("operation-bar"), "audience-bar");
 
-  EXPECT_EQ(*config_parser_->getJwtToken("audience-foo"), "id-token-foo");
-  EXPECT_EQ(*config_parser_->getJwtToken("audience-bar"), "id-token-bar");
+  EXPECT_EQ(config_parser_->getJwtToken("audience-foo")->token, "id-token-foo");
+  EXPECT_EQ(config_parser_->getJwtToken("audience-bar")->token, "id-token-bar");
 }
 
 }  // namespace BackendAuth
@@ -20,6 +20,7 @@
 
 #include "common/http/headers.h"
 #include "common/http/utility.h"
+#include "src/envoy/http/backend_auth/per_route_filter_config.h"
 #include "src/envoy/utils/filter_state_utils.h"
 
 namespace Envoy {
@@ -32,9 +33,9 @@ using Http::FilterHeadersStatus;
 using Http::FilterTrailersStatus;
 using Http::HeaderMap;
 
-namespace {
-constexpr char kBearer[] = "Bearer ";
+const std::string FilterName = "envoy.filters.http.backend_auth";
 
+namespace {
 struct RcDetailsValues {
   // The request is rejected due to missing backend auth token.
   const std::string MissingBackendToken = "missing_backend_token";
@@ -44,24 +45,45 @@ typedef ConstSingleton<RcDetailsValues> RcDetails;
 }  // namespace
 
 FilterHeadersStatus Filter::decodeHeaders(HeaderMap& headers, bool) {
-  absl::string_view operation = Utils::getStringFilterState(
-      decoder_callbacks_->streamInfo().filterState(), Utils::kOperation);
-  // NOTE: this shouldn't happen in practice because Path Matcher filter would
-  // have already rejected the request.
-  if (operation.empty()) {
-    ENVOY_LOG(debug, "No operation found from DynamicMetadata");
-    return FilterHeadersStatus::Continue;
-  }
+  uint32_t operation_id = Utils::kInvalidOperationId;
+  absl::string_view audience;
+  const auto* per_route =
+      Http::Utility::resolveMostSpecificPerFilterConfig<PerRouteFilterConfig>(
+          FilterName, decoder_callbacks_->route());
+  if (per_route != nullptr) {
+    // The route serves a single operation and its id was interned when the
+    // route table was loaded, so the filter-state reads are skipped entirely.
+    operation_id = per_route->operation_id();
+    audience = config_->cfg_parser().getAudienceById(operation_id);
+  } else {
+    const auto& filter_state = decoder_callbacks_->streamInfo().filterState();
+    absl::string_view operation =
+        Utils::getStringFilterState(filter_state, Utils::kOperation);
+    // NOTE: this shouldn't happen in practice because Path Matcher filter
+    // would have already rejected the request.
+    if (operation.empty()) {
+      ENVOY_LOG(debug, "No operation found from DynamicMetadata");
+      return FilterHeadersStatus::Continue;
+    }
 
-  ENVOY_LOG(debug, "Found operation: {}", operation);
-  absl::string_view audience = config_->cfg_parser().getAudience(operation);
+    ENVOY_LOG(debug, "Found operation: {}", operation);
+    // Prefer the dense operation id the path matcher stored; the name-keyed
+    // lookups stay as a fallback for streams without one.
+    operation_id = Utils::getOperationIdFilterState(filter_state);
+    audience = operation_id != Utils::kInvalidOperationId
+                   ? config_->cfg_parser().getAudienceById(operation_id)
+                   : config_->cfg_parser().getAudience(operation);
+  }
   if (audience.empty()) {
     // JWT Token is not required for this operation.
     return FilterHeadersStatus::Continue;
   }
 
-  const TokenSharedPtr jwt_token = config_->cfg_parser().getJwtToken(audience);
-  if (!jwt_token) {
+  const TokenInfo* jwt_token =
+      operation_id != Utils::kInvalidOperationId
+          ? config_->cfg_parser().getJwtTokenById(operation_id)
+          : config_->cfg_parser().getJwtToken(audience);
+  if (jwt_token == nullptr) {
     ENVOY_LOG(debug, "Token not found for audience: {}", audience);
     decoder_callbacks_->sendLocalReply(Http::Code::InternalServerError,
                                        "missing tokens", nullptr, absl::nullopt,
@@ -73,7 +95,9 @@ FilterHeadersStatus Filter::decodeHeaders(HeaderMap& headers, bool) {
 
   const auto& authorization = Http::Headers::get().Authorization;
   headers.remove(authorization);
-  headers.addCopy(authorization, kBearer + *jwt_token);
+  // The value was formatted when the token was published; the header map
+  // still copies it, since request headers can outlive a token refresh.
+  headers.addCopy(authorization, jwt_token->authorization);
   config_->stats().token_added_.inc();
   return FilterHeadersStatus::Continue;
 }
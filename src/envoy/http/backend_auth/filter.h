@@ -27,6 +27,10 @@ namespace Extensions {
 namespace HttpFilters {
 namespace BackendAuth {
 
+// The name this filter is registered under; also the key the config
+// translator uses for the per-route config on the dynamic routing routes.
+extern const std::string FilterName;
+
 class Filter : public Http::PassThroughDecoderFilter,
                public Logger::Loggable<Logger::Id::filter> {
  public:
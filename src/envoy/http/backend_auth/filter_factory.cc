@@ -19,20 +19,20 @@
 #include "src/envoy/http/backend_auth/config_parser_impl.h"
 #include "src/envoy/http/backend_auth/filter.h"
 #include "src/envoy/http/backend_auth/filter_config_impl.h"
+#include "src/envoy/http/backend_auth/per_route_filter_config.h"
 
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
 namespace BackendAuth {
 
-const std::string FilterName = "envoy.filters.http.backend_auth";
-
 /**
  * Config registration for ESPv2 backend auth filter.
  */
 class FilterFactory
     : public Common::FactoryBase<
-          ::google::api::envoy::http::backend_auth::FilterConfig> {
+          ::google::api::envoy::http::backend_auth::FilterConfig,
+          ::google::api::envoy::http::backend_auth::PerRouteFilterConfig> {
  public:
   FilterFactory() : FactoryBase(FilterName) {}
 
@@ -51,6 +51,15 @@ class FilterFactory
               Http::StreamDecoderFilterSharedPtr(filter));
         };
   }
+
+  Router::RouteSpecificFilterConfigConstSharedPtr
+  createRouteSpecificFilterConfigTyped(
+      const ::google::api::envoy::http::backend_auth::PerRouteFilterConfig&
+          proto_config,
+      Server::Configuration::ServerFactoryContext&,
+      ProtobufMessage::ValidationVisitor&) override {
+    return std::make_shared<PerRouteFilterConfig>(proto_config);
+  }
 };
 /**
  * Static registration for the rate limit filter. @see RegisterFactory.
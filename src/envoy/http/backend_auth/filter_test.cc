@@ -18,6 +18,7 @@
 #include "gtest/gtest.h"
 #include "src/envoy/http/backend_auth/config_parser.h"
 #include "src/envoy/http/backend_auth/mocks.h"
+#include "src/envoy/http/backend_auth/per_route_filter_config.h"
 #include "src/envoy/utils/filter_state_utils.h"
 #include "test/mocks/http/mocks.h"
 #include "test/mocks/server/mocks.h"
@@ -122,10 +123,50 @@ TEST_F(BackendAuthFilterTest, SucceedAppendToken) {
   EXPECT_CALL(*mock_filter_config_parser_, getAudience)
       .Times(1)
       .WillRepeatedly(testing::Return("this-is-audience"));
+  const TokenInfo token_info{"this-is-token", "Bearer this-is-token"};
   EXPECT_CALL(*mock_filter_config_parser_, getJwtToken)
       .Times(1)
-      .WillRepeatedly(
-          testing::Return(std::make_shared<std::string>("this-is-token")));
+      .WillRepeatedly(testing::Return(&token_info));
+
+  Envoy::Http::FilterHeadersStatus status =
+      filter_->decodeHeaders(headers, false);
+
+  EXPECT_EQ(
+      headers.get(Http::Headers::get().Authorization)->value().getStringView(),
+      "Bearer this-is-token");
+  EXPECT_EQ(status, Envoy::Http::FilterHeadersStatus::Continue);
+}
+
+TEST_F(BackendAuthFilterTest, SucceedAppendTokenFromPerRouteConfig) {
+  Http::TestHeaderMapImpl headers{{":method", "GET"}, {":path", "/books/1"}};
+  // No operation is stored in filter state: the operation pinned on the
+  // route alone must drive the lookups, by id.
+  ::google::api::envoy::http::backend_auth::PerRouteFilterConfig
+      per_route_proto;
+  per_route_proto.set_operation("operation-pinned-by-route");
+  PerRouteFilterConfig per_route(per_route_proto);
+  ON_CALL(*mock_decoder_callbacks_.route_, perFilterConfig(FilterName))
+      .WillByDefault(testing::Return(&per_route));
+  testing::NiceMock<Stats::MockStore> scope;
+  const std::string prefix = "";
+  FilterStats filter_stats{
+      ALL_BACKEND_AUTH_FILTER_STATS(POOL_COUNTER_PREFIX(scope, prefix))};
+
+  EXPECT_CALL(*mock_filter_config_, cfg_parser)
+      .WillRepeatedly(testing::ReturnRef(*mock_filter_config_parser_));
+  EXPECT_CALL(*mock_filter_config_, stats)
+      .WillRepeatedly(testing::ReturnRef(filter_stats));
+
+  EXPECT_CALL(*mock_filter_config_parser_, getAudience).Times(0);
+  EXPECT_CALL(*mock_filter_config_parser_,
+              getAudienceById(per_route.operation_id()))
+      .Times(1)
+      .WillRepeatedly(testing::Return("this-is-audience"));
+  const TokenInfo token_info{"this-is-token", "Bearer this-is-token"};
+  EXPECT_CALL(*mock_filter_config_parser_,
+              getJwtTokenById(per_route.operation_id()))
+      .Times(1)
+      .WillRepeatedly(testing::Return(&token_info));
 
   Envoy::Http::FilterHeadersStatus status =
       filter_->decodeHeaders(headers, false);
@@ -25,7 +25,13 @@ class MockFilterConfigParser : public FilterConfigParser {
   MOCK_METHOD(absl::string_view, getAudience, (absl::string_view operation),
               (const));
 
-  MOCK_METHOD(const TokenSharedPtr, getJwtToken, (absl::string_view audience),
+  MOCK_METHOD(const TokenInfo*, getJwtToken, (absl::string_view audience),
+              (const));
+
+  MOCK_METHOD(absl::string_view, getAudienceById, (uint32_t operation_id),
+              (const));
+
+  MOCK_METHOD(const TokenInfo*, getJwtTokenById, (uint32_t operation_id),
               (const));
 };
 
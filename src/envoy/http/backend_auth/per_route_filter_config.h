@@ -0,0 +1,47 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include "api/envoy/http/backend_auth/config.pb.h"
+#include "envoy/router/router.h"
+#include "src/envoy/utils/operation_interner.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace BackendAuth {
+
+// Route-level view of a backend auth rule. The config translator pins the
+// dynamic routing routes to their single operation, so the operation id is
+// resolved here, once per route at route-table load, through the process-wide
+// operation interner. The request path then goes straight to the id-indexed
+// rule table without touching per-request filter state.
+class PerRouteFilterConfig : public Router::RouteSpecificFilterConfig {
+ public:
+  PerRouteFilterConfig(
+      const ::google::api::envoy::http::backend_auth::PerRouteFilterConfig&
+          config)
+      : operation_id_(
+            Utils::OperationInterner::instance().Intern(config.operation())) {}
+
+  uint32_t operation_id() const { return operation_id_; }
+
+ private:
+  const uint32_t operation_id_;
+};
+
+}  // namespace BackendAuth
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
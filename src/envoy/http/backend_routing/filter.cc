@@ -40,8 +40,14 @@ FilterHeadersStatus Filter::decodeHeaders(Http::HeaderMap& headers, bool) {
   }
 
   ENVOY_LOG(debug, "Found operation: {}", operation);
-  const auto* rule = config_->findRule(operation);
-  if (rule == nullptr) {
+  // Prefer the dense operation id the path matcher stored; the name-keyed
+  // lookup stays as a fallback for streams without one.
+  const uint32_t operation_id = Utils::getOperationIdFilterState(filter_state);
+  const RewriteProgram* program =
+      operation_id != Utils::kInvalidOperationId
+          ? config_->findProgramById(operation_id)
+          : config_->findProgram(operation);
+  if (program == nullptr) {
     ENVOY_LOG(debug, "No backend routing rule found for operation {}",
               operation);
     return FilterHeadersStatus::Continue;
@@ -55,42 +61,47 @@ FilterHeadersStatus Filter::decodeHeaders(Http::HeaderMap& headers, bool) {
       headers.Path()->value().getStringView();
   ENVOY_LOG(debug, "backend routing for operation {}, original path: {}",
             operation, original_path);
-  std::string newPath;
+  // The new path is assembled into a per-worker scratch buffer that keeps
+  // its capacity across requests (it grows to the largest path seen on the
+  // worker), so the rewrite does no per-request allocation.
+  static thread_local std::string new_path;
+  new_path.clear();
+  new_path.append(program->path_prefix);
 
-  if (rule->is_const_address()) {  // CONSTANT_ADDRESS
-    absl::string_view queryParamFromPathParam =
+  if (program->path_mode ==
+      RewriteProgram::PathMode::kKeepQueryOnly) {  // CONSTANT_ADDRESS
+    absl::string_view query_params =
         Utils::getStringFilterState(filter_state, Utils::kQueryParams);
-    const auto originalPath = std::string(original_path);
-    std::size_t originalQueryParamPos = originalPath.find('?');
-    if (originalQueryParamPos != std::string::npos) {
+    const std::size_t query_pos = original_path.find('?');
+    if (query_pos != absl::string_view::npos) {
       // has query parameters in original url
-      const std::string& originalQueryParam =
-          originalPath.substr(originalQueryParamPos);
-      newPath = absl::StrCat(rule->path_prefix(), originalQueryParam);
-      if (!queryParamFromPathParam.empty()) {
-        absl::StrAppend(&newPath, "&", queryParamFromPathParam);
-      }
-    } else {
-      newPath = rule->path_prefix();
-      if (!queryParamFromPathParam.empty()) {
-        absl::StrAppend(&newPath, "?", queryParamFromPathParam);
+      const absl::string_view original_query = original_path.substr(query_pos);
+      new_path.append(original_query.data(), original_query.size());
+      if (!query_params.empty()) {
+        new_path.push_back('&');
+        new_path.append(query_params.data(), query_params.size());
       }
+    } else if (!query_params.empty()) {
+      new_path.push_back('?');
+      new_path.append(query_params.data(), query_params.size());
     }
     config_->stats().constant_address_request_.inc();
     ENVOY_LOG(debug,
               "constant address backend routing for operation {}, new path: {}",
-              operation, newPath);
+              operation, new_path);
   } else {  // APPEND_PATH_TO_ADDRESS
-    newPath = absl::StrCat(rule->path_prefix(), original_path);
+    new_path.append(original_path.data(), original_path.size());
     config_->stats().append_path_to_address_request_.inc();
     ENVOY_LOG(
         debug,
         "append path to address backend routing for operation {}, new path: {}",
-        operation, newPath);
+        operation, new_path);
   }
   const auto& pathField = Http::Headers::get().Path;
+  // original_path points into the header being replaced; the new value was
+  // fully assembled above, so removing it first is safe.
   headers.remove(pathField);
-  headers.addCopy(pathField, newPath);
+  headers.addCopy(pathField, new_path);
 
   return FilterHeadersStatus::Continue;
 }
@@ -14,9 +14,13 @@
 
 #pragma once
 
+#include <future>
+
 #include "api/envoy/http/backend_routing/config.pb.h"
 #include "common/common/logger.h"
 #include "envoy/server/filter_config.h"
+#include "src/envoy/utils/config_build_executor.h"
+#include "src/envoy/utils/operation_interner.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -40,6 +44,24 @@ struct FilterStats {
   ALL_BACKEND_ROUTING_FILTER_STATS(GENERATE_COUNTER_STRUCT)
 };
 
+// A BackendRoutingRule compiled at config load into the fixed plan
+// decodeHeaders executes: the prefix to emit first and how the rest of the
+// value is attached. The hot path reads this flat struct and never touches
+// the config proto.
+struct RewriteProgram {
+  enum class PathMode {
+    // Append the whole original path behind the prefix
+    // (APPEND_PATH_TO_ADDRESS).
+    kAppendOriginalPath,
+    // Drop the original path, keeping only its query string and the query
+    // params recovered from path parameters (CONSTANT_ADDRESS).
+    kKeepQueryOnly,
+  };
+
+  std::string path_prefix;
+  PathMode path_mode;
+};
+
 // The Envoy filter config for ESP V2 backend routing filter.
 class FilterConfig : public Logger::Loggable<Logger::Id::filter> {
  public:
@@ -47,40 +69,92 @@ class FilterConfig : public Logger::Loggable<Logger::Id::filter> {
                    proto_config,
                const std::string& stats_prefix,
                Server::Configuration::FactoryContext& context)
-      : proto_config_(proto_config),
-        stats_(generateStats(stats_prefix, context.scope())) {
-    for (const auto& rule : proto_config_.rules()) {
-      backend_routing_map_[rule.operation()] = &rule;
+      : stats_(generateStats(stats_prefix, context.scope())) {
+    // The program compile touches only the proto copy captured below and
+    // the thread-safe operation interner, so it runs on the shared
+    // config-build executor, overlapping the other filters' derivations of
+    // the same config push.
+    build_done_ = Utils::ConfigBuildExecutor::instance().Submit(
+        [this, proto_config]() { compilePrograms(proto_config); });
+  }
+
+  ~FilterConfig() {
+    // A config torn down before its build task ran must not leave the task
+    // writing into freed memory.
+    if (build_done_.valid()) {
+      build_done_.wait();
+    }
+  }
+
+  // Joins the background program compile; a no-op once it finished.
+  void ensureBuilt() const {
+    if (build_done_.valid()) {
+      build_done_.get();
     }
   }
 
-  const ::google::api::envoy::http::backend_routing::BackendRoutingRule* findRule(
-	  absl::string_view operation) const {
-    const auto it = backend_routing_map_.find(operation);
-    if (it == backend_routing_map_.end()) {
+  const RewriteProgram* findProgram(absl::string_view operation) const {
+    ensureBuilt();
+    const auto it = rewrite_programs_.find(operation);
+    if (it == rewrite_programs_.end()) {
       return nullptr;
     }
-    return it->second;
+    return &it->second;
+  }
+
+  // Id-indexed variant of findProgram; one array access instead of hashing
+  // the operation name. Every rule of this config interned its operation id
+  // at load time, so an id outside the table has no rule here.
+  const RewriteProgram* findProgramById(uint32_t operation_id) const {
+    ensureBuilt();
+    if (operation_id >= programs_by_id_.size()) {
+      return nullptr;
+    }
+    return programs_by_id_[operation_id];
   }
 
   FilterStats& stats() { return stats_; }
 
  private:
+  void compilePrograms(
+      const ::google::api::envoy::http::backend_routing::FilterConfig&
+          proto_config) {
+    for (const auto& rule : proto_config.rules()) {
+      RewriteProgram& program =
+          rewrite_programs_[Utils::OperationInterner::instance().InternName(
+              rule.operation())];
+      program.path_prefix = rule.path_prefix();
+      program.path_mode = rule.is_const_address()
+                              ? RewriteProgram::PathMode::kKeepQueryOnly
+                              : RewriteProgram::PathMode::kAppendOriginalPath;
+    }
+    // Index the programs by their interned operation id. Built after the
+    // map is complete so the stored pointers are final.
+    for (const auto& it : rewrite_programs_) {
+      const uint32_t id = Utils::OperationInterner::instance().Intern(it.first);
+      if (id >= programs_by_id_.size()) {
+        programs_by_id_.resize(id + 1, nullptr);
+      }
+      programs_by_id_[id] = &it.second;
+    }
+  }
+
   FilterStats generateStats(const std::string& prefix, Stats::Scope& scope) {
     const std::string final_prefix = prefix + "backend_routing.";
     return {ALL_BACKEND_ROUTING_FILTER_STATS(
         POOL_COUNTER_PREFIX(scope, final_prefix))};
   }
 
-  // The config proto
-  ::google::api::envoy::http::backend_routing::FilterConfig proto_config_;
   // The stats
   FilterStats stats_;
-  // The map from operation to rule.
-  absl::flat_hash_map<
-      std::string,
-      const ::google::api::envoy::http::backend_routing::BackendRoutingRule*>
-      backend_routing_map_;
+  // The map from operation to its compiled rewrite program, keyed by the
+  // canonical selector copies owned by the process-wide operation interner.
+  absl::flat_hash_map<absl::string_view, RewriteProgram> rewrite_programs_;
+  // The same programs indexed by interned operation id; null slots mean no
+  // rule for that operation.
+  std::vector<const RewriteProgram*> programs_by_id_;
+  // Ready once the executor task compiled the programs.
+  std::shared_future<void> build_done_;
 };
 
 typedef std::shared_ptr<FilterConfig> FilterConfigSharedPtr;
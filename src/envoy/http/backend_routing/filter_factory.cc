@@ -45,6 +45,9 @@ class FilterFactory
         std::make_shared<FilterConfig>(proto_config, stats_prefix, context);
     return
         [filter_config](Http::FilterChainFactoryCallbacks& callbacks) -> void {
+          // Joins the background program compile; a no-op once it finished,
+          // so only a stream arriving before the build completed ever waits.
+          filter_config->ensureBuilt();
           auto filter = std::make_shared<Filter>(filter_config);
           callbacks.addStreamDecoderFilter(
               Http::StreamDecoderFilterSharedPtr(filter));
@@ -0,0 +1,278 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/fused/filter.h"
+
+#include "common/grpc/status.h"
+#include "envoy/http/header_map.h"
+#include "src/envoy/utils/phase_timing_utils.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Fused {
+namespace {
+
+struct RcDetailsValues {
+  // Rejected by service control check call.
+  const std::string RejectedByServiceControlCheck =
+      "rejected_by_service_control_check";
+};
+typedef ConstSingleton<RcDetailsValues> RcDetails;
+
+}  // namespace
+
+Filter::Filter(PathMatcher::FilterConfigSharedPtr path_matcher_config,
+               ServiceControl::ServiceControlFilterStats& stats,
+               const ServiceControl::ServiceControlHandlerFactory&
+                   handler_factory,
+               BackendAuth::FilterConfigSharedPtr backend_auth_config,
+               BackendRouting::FilterConfigSharedPtr backend_routing_config)
+    : path_matcher_(path_matcher_config),
+      stats_(stats),
+      handler_factory_(handler_factory) {
+  if (backend_auth_config) {
+    backend_auth_ =
+        std::make_unique<BackendAuth::Filter>(backend_auth_config);
+  }
+  if (backend_routing_config) {
+    backend_routing_ =
+        std::make_unique<BackendRouting::Filter>(backend_routing_config);
+  }
+}
+
+void Filter::onDestroy() {
+  ENVOY_LOG(debug, "Called Fused Filter : {}", __func__);
+  // onDestroy runs synchronously on reset while our destruction is
+  // deferred; leave the resumption batch now so a pending resume cannot
+  // touch the dead stream callbacks.
+  ServiceControl::CheckResumeBatcher::instance().cancel(*this);
+  if (handler_) {
+    handler_->onDestroy();
+  }
+}
+
+void Filter::setDecoderFilterCallbacks(
+    Http::StreamDecoderFilterCallbacks& callbacks) {
+  // The stage sub-filters reject and rewrite through the same stream
+  // callbacks as the fused filter itself.
+  Http::PassThroughFilter::setDecoderFilterCallbacks(callbacks);
+  path_matcher_.setDecoderFilterCallbacks(callbacks);
+  if (backend_auth_) {
+    backend_auth_->setDecoderFilterCallbacks(callbacks);
+  }
+  if (backend_routing_) {
+    backend_routing_->setDecoderFilterCallbacks(callbacks);
+  }
+}
+
+Http::FilterHeadersStatus Filter::decodeHeaders(Http::HeaderMap& headers,
+                                                bool end_stream) {
+  ENVOY_LOG(debug, "Called Fused Filter : {}", __func__);
+
+  // Stage 1: path matcher. A non-matching request was already answered
+  // with a local reply inside the stage.
+  if (path_matcher_.decodeHeaders(headers, end_stream) !=
+      Http::FilterHeadersStatus::Continue) {
+    state_ = Responded;
+    return Http::FilterHeadersStatus::StopIteration;
+  }
+
+  // Stage 2: service control check. This mirrors
+  // ServiceControlFilter::decodeHeaders; see there for the phase timing
+  // stamp placement.
+  Envoy::Tracing::Span& parent_span = decoder_callbacks_->activeSpan();
+  const bool timing = Utils::phaseTimingEnabled();
+  const int64_t prepare_start = timing ? Utils::phaseTimingNow() : 0;
+
+  handler_ =
+      handler_factory_.createHandler(headers, decoder_callbacks_->streamInfo());
+
+  state_ = Calling;
+  stopped_ = false;
+
+  handler_->callCheck(headers, parent_span, *this);
+
+  if (timing) {
+    const int64_t now = Utils::phaseTimingNow();
+    stats_.phase_check_prepare_ns_.recordValue(now - prepare_start);
+    if (state_ == Calling) {
+      check_wait_start_ns_ = now;
+    }
+  }
+
+  // A synchronously answered check runs the remaining stages inline; the
+  // deferred case runs them from onCheckDone before decoding resumes.
+  if (state_ == Complete) {
+    return runPostCheckStages(headers);
+  }
+  if (state_ == Responded) {
+    return Http::FilterHeadersStatus::StopIteration;
+  }
+
+  ENVOY_LOG(debug, "Called Fused filter : Stop");
+  stopped_ = true;
+  request_headers_ = &headers;
+  return Http::FilterHeadersStatus::StopIteration;
+}
+
+Http::FilterHeadersStatus Filter::runPostCheckStages(
+    Http::HeaderMap& headers) {
+  // Stage 3: backend auth. A missing token is answered with a local reply
+  // inside the stage.
+  if (backend_auth_ != nullptr &&
+      backend_auth_->decodeHeaders(headers, false) !=
+          Http::FilterHeadersStatus::Continue) {
+    state_ = Responded;
+    return Http::FilterHeadersStatus::StopIteration;
+  }
+
+  // Stage 4: backend routing; a pure header rewrite, it always continues.
+  if (backend_routing_ != nullptr) {
+    backend_routing_->decodeHeaders(headers, false);
+  }
+  return Http::FilterHeadersStatus::Continue;
+}
+
+void Filter::onCheckDone(const ::google::protobuf::util::Status& status) {
+  if (check_wait_start_ns_ != 0) {
+    stats_.phase_check_wait_ns_.recordValue(Utils::phaseTimingNow() -
+                                            check_wait_start_ns_);
+    check_wait_start_ns_ = 0;
+  }
+  if (!status.ok()) {
+    // protobuf::util::Status.error_code is the same as Envoy GrpcStatus
+    // This cast is safe.
+    auto http_code = Grpc::Utility::grpcToHttpStatus(
+        static_cast<Grpc::Status::GrpcStatus>(status.error_code()));
+    const auto* denial = handler_->checkDenial();
+    if (denial != nullptr) {
+      rejectRequest(static_cast<Http::Code>(http_code), denial->body);
+    } else {
+      rejectRequest(static_cast<Http::Code>(http_code), status.ToString());
+    }
+    return;
+  }
+
+  stats_.allowed_.inc();
+  state_ = Complete;
+  if (stopped_) {
+    // Resume through the worker's batcher when one is bound, so bursts
+    // of close-together check completions walk their streams back to
+    // back from one deferred callback instead of interleaving each
+    // resume with the next response. Threads that never bound a batcher
+    // (direct construction in tests) resume inline.
+    auto& batcher = ServiceControl::CheckResumeBatcher::instance();
+    if (batcher.bound()) {
+      batcher.enqueue(*this);
+    } else {
+      onResumeBatch();
+    }
+  }
+}
+
+void Filter::onResumeBatch() {
+  // The auth and routing stages must rewrite the headers before the
+  // rest of the chain sees them.
+  if (runPostCheckStages(*request_headers_) ==
+      Http::FilterHeadersStatus::Continue) {
+    decoder_callbacks_->continueDecoding();
+  }
+}
+
+void Filter::rejectRequest(Http::Code code, absl::string_view error_msg) {
+  stats_.denied_.inc();
+  state_ = Responded;
+
+  decoder_callbacks_->sendLocalReply(
+      code, error_msg, nullptr, absl::nullopt,
+      RcDetails::get().RejectedByServiceControlCheck);
+  decoder_callbacks_->streamInfo().setResponseFlag(
+      StreamInfo::ResponseFlag::UnauthorizedExternalService);
+}
+
+Http::FilterDataStatus Filter::decodeData(Buffer::Instance& data,
+                                          bool end_stream) {
+  ENVOY_LOG(debug, "Called Fused Filter : {}", __func__);
+  if (!end_stream && data.length() > 0) {
+    handler_->collectDecodeData(data);
+  }
+
+  if (state_ == Calling) {
+    return Http::FilterDataStatus::StopIterationAndWatermark;
+  }
+  return Http::FilterDataStatus::Continue;
+}
+
+Http::FilterTrailersStatus Filter::decodeTrailers(Http::HeaderMap&) {
+  ENVOY_LOG(debug, "Called Fused Filter : {}", __func__);
+  if (state_ == Calling) {
+    return Http::FilterTrailersStatus::StopIteration;
+  }
+  return Http::FilterTrailersStatus::Continue;
+}
+
+Http::FilterHeadersStatus Filter::encodeHeaders(Http::HeaderMap& headers,
+                                                bool) {
+  ENVOY_LOG(debug, "Called Fused Filter : {} before", __func__);
+
+  // For the cases the decodeHeaders not called, like the request get failed
+  // in the Jwt-Authn filter, the handler_ is not initialized.
+  if (handler_ != nullptr) {
+    handler_->processResponseHeaders(headers);
+  }
+  return Http::FilterHeadersStatus::Continue;
+}
+
+Http::FilterDataStatus Filter::encodeData(Buffer::Instance& data,
+                                          bool end_stream) {
+  ENVOY_LOG(debug, "Called Fused Filter : {}", __func__);
+  if (!end_stream && data.length() > 0) {
+    handler_->collectEncodeData(data);
+  }
+  return Http::FilterDataStatus::Continue;
+}
+
+Http::FilterTrailersStatus Filter::encodeTrailers(Http::HeaderMap& trailers) {
+  ENVOY_LOG(debug, "Called Fused Filter : {}", __func__);
+  if (handler_ != nullptr) {
+    handler_->processResponseTrailers(trailers);
+  }
+  return Http::FilterTrailersStatus::Continue;
+}
+
+void Filter::log(const Http::HeaderMap* request_headers,
+                 const Http::HeaderMap* response_headers,
+                 const Http::HeaderMap* response_trailers,
+                 const StreamInfo::StreamInfo& stream_info) {
+  ENVOY_LOG(debug, "Called Fused Filter : {}", __func__);
+  if (!handler_) {
+    if (!request_headers) return;
+    handler_ = handler_factory_.createHandler(*request_headers, stream_info);
+  }
+
+  if (Utils::phaseTimingEnabled()) {
+    const int64_t report_start = Utils::phaseTimingNow();
+    handler_->callReport(request_headers, response_headers, response_trailers);
+    stats_.phase_report_build_ns_.recordValue(Utils::phaseTimingNow() -
+                                              report_start);
+    return;
+  }
+  handler_->callReport(request_headers, response_headers, response_trailers);
+}
+
+}  // namespace Fused
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
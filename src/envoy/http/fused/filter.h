@@ -0,0 +1,127 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+
+#include "common/common/logger.h"
+#include "envoy/access_log/access_log.h"
+#include "envoy/http/filter.h"
+#include "envoy/http/header_map.h"
+#include "extensions/filters/http/common/pass_through_filter.h"
+#include "src/envoy/http/backend_auth/filter.h"
+#include "src/envoy/http/backend_routing/filter.h"
+#include "src/envoy/http/path_matcher/filter.h"
+#include "src/envoy/http/service_control/check_resume_batcher.h"
+#include "src/envoy/http/service_control/filter_stats.h"
+#include "src/envoy/http/service_control/handler.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Fused {
+
+// The fused ESPv2 filter: runs the path matcher, service control, backend
+// auth and backend routing stages as direct calls on one per-stream
+// filter, so a request pays one filter chain entry instead of four.
+//
+// The path matcher, auth and routing stages reuse the standalone filters
+// wholesale — they are synchronous, header-only decoders. The service
+// control glue is inlined here (mirroring ServiceControlFilter) because
+// its check is asynchronous: when a check is answered off the fast path,
+// the auth and routing stages must still run before decoding resumes,
+// which a composed sub-filter could not arrange around continueDecoding().
+class Filter : public Http::PassThroughFilter,
+               public AccessLog::Instance,
+               public ServiceControl::ServiceControlHandler::CheckDoneCallback,
+               public ServiceControl::CheckResumeBatcher::Entry,
+               public Logger::Loggable<Logger::Id::filter> {
+ public:
+  // |backend_auth_config| and |backend_routing_config| may be nullptr;
+  // the corresponding stage is then skipped.
+  Filter(PathMatcher::FilterConfigSharedPtr path_matcher_config,
+         ServiceControl::ServiceControlFilterStats& stats,
+         const ServiceControl::ServiceControlHandlerFactory& handler_factory,
+         BackendAuth::FilterConfigSharedPtr backend_auth_config,
+         BackendRouting::FilterConfigSharedPtr backend_routing_config);
+
+  void onDestroy() override;
+
+  void setDecoderFilterCallbacks(
+      Http::StreamDecoderFilterCallbacks& callbacks) override;
+
+  // Http::StreamDecoderFilter
+  Http::FilterHeadersStatus decodeHeaders(Http::HeaderMap& headers,
+                                          bool end_stream) override;
+  Http::FilterDataStatus decodeData(Buffer::Instance& data,
+                                    bool end_stream) override;
+  Http::FilterTrailersStatus decodeTrailers(Http::HeaderMap&) override;
+
+  // Http::StreamEncoderFilter
+  Http::FilterHeadersStatus encodeHeaders(Http::HeaderMap& headers,
+                                          bool) override;
+  Http::FilterDataStatus encodeData(Buffer::Instance& data,
+                                    bool end_stream) override;
+  Http::FilterTrailersStatus encodeTrailers(Http::HeaderMap& trailers) override;
+
+  // AccessLog::Instance; called when the request is completed.
+  void log(const Http::HeaderMap* request_headers,
+           const Http::HeaderMap* response_headers,
+           const Http::HeaderMap* response_trailers,
+           const StreamInfo::StreamInfo& stream_info) override;
+
+  // ServiceControlHandler::CheckDoneCallback
+  void onCheckDone(const ::google::protobuf::util::Status& status) override;
+
+  // CheckResumeBatcher::Entry: runs the post-check stages and resumes
+  // the stream as part of the worker's deferred resumption batch.
+  void onResumeBatch() override;
+
+ private:
+  // Runs the backend auth and backend routing stages, after the check
+  // passed. Returns StopIteration when a stage responded locally (missing
+  // backend token); the local reply is already on its way then.
+  Http::FilterHeadersStatus runPostCheckStages(Http::HeaderMap& headers);
+
+  void rejectRequest(Http::Code code, absl::string_view error_msg);
+
+  // The stage sub-filters; auth and routing are nullptr when their stage
+  // is not configured.
+  PathMatcher::Filter path_matcher_;
+  std::unique_ptr<BackendAuth::Filter> backend_auth_;
+  std::unique_ptr<BackendRouting::Filter> backend_routing_;
+
+  // Service control stage state; mirrors ServiceControlFilter.
+  ServiceControl::ServiceControlFilterStats& stats_;
+  const ServiceControl::ServiceControlHandlerFactory& handler_factory_;
+  ServiceControl::ServiceControlHandlerPtr handler_;
+  // The request headers, stashed while a deferred check is in flight so
+  // the post-check stages can still rewrite them from onCheckDone().
+  Http::HeaderMap* request_headers_{};
+
+  // The state of the request.
+  enum State { Init, Calling, Responded, Complete };
+  State state_ = Init;
+  // Mark if request has been stopped.
+  bool stopped_ = false;
+  // Stamp of an asynchronous check wait in progress, or 0. Only set when
+  // phase timing is enabled.
+  int64_t check_wait_start_ns_ = 0;
+};
+
+}  // namespace Fused
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
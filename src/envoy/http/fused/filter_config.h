@@ -0,0 +1,82 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+
+#include "api/envoy/http/fused/config.pb.h"
+#include "src/envoy/http/backend_auth/filter_config_impl.h"
+#include "src/envoy/http/backend_routing/filter_config.h"
+#include "src/envoy/http/path_matcher/filter_config.h"
+#include "src/envoy/http/service_control/filter_config.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Fused {
+
+// The Envoy filter config for the fused ESPv2 filter. It is only an
+// aggregate: every stage keeps the config class of its standalone filter,
+// so the stats, parsers and background config builds are shared between
+// the fused and split deployments.
+class FilterConfig {
+ public:
+  FilterConfig(
+      const ::google::api::envoy::http::fused::FilterConfig& proto_config,
+      const std::string& stats_prefix,
+      Server::Configuration::FactoryContext& context)
+      : path_matcher_config_(std::make_shared<PathMatcher::FilterConfig>(
+            proto_config.path_matcher(), stats_prefix, context)),
+        service_control_config_(
+            std::make_shared<ServiceControl::ServiceControlFilterConfig>(
+                proto_config.service_control(), stats_prefix, context)) {
+    if (proto_config.has_backend_auth()) {
+      backend_auth_config_ = std::make_shared<BackendAuth::FilterConfigImpl>(
+          proto_config.backend_auth(), stats_prefix, context);
+    }
+    if (proto_config.has_backend_routing()) {
+      backend_routing_config_ = std::make_shared<BackendRouting::FilterConfig>(
+          proto_config.backend_routing(), stats_prefix, context);
+    }
+  }
+
+  const PathMatcher::FilterConfigSharedPtr& path_matcher_config() const {
+    return path_matcher_config_;
+  }
+  const ServiceControl::FilterConfigSharedPtr& service_control_config() const {
+    return service_control_config_;
+  }
+  // nullptr when the stage is not configured.
+  const BackendAuth::FilterConfigSharedPtr& backend_auth_config() const {
+    return backend_auth_config_;
+  }
+  // nullptr when the stage is not configured.
+  const BackendRouting::FilterConfigSharedPtr& backend_routing_config() const {
+    return backend_routing_config_;
+  }
+
+ private:
+  PathMatcher::FilterConfigSharedPtr path_matcher_config_;
+  ServiceControl::FilterConfigSharedPtr service_control_config_;
+  BackendAuth::FilterConfigSharedPtr backend_auth_config_;
+  BackendRouting::FilterConfigSharedPtr backend_routing_config_;
+};
+
+typedef std::shared_ptr<FilterConfig> FilterConfigSharedPtr;
+
+}  // namespace Fused
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,103 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "api/envoy/http/fused/config.pb.h"
+#include "api/envoy/http/fused/config.pb.validate.h"
+#include "src/envoy/http/fused/filter.h"
+#include "src/envoy/http/fused/filter_config.h"
+#include "src/envoy/http/service_control/client_cache_debug.h"
+#include "src/envoy/http/service_control/heavy_hitter_tracker.h"
+
+#include "envoy/registry/registry.h"
+#include "envoy/server/admin.h"
+#include "extensions/filters/http/common/factory_base.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Fused {
+
+const std::string FilterName = "envoy.filters.http.fused";
+
+/**
+ * Config registration for the fused ESPv2 filter.
+ */
+class FilterFactory
+    : public Common::FactoryBase<
+          ::google::api::envoy::http::fused::FilterConfig> {
+ public:
+  FilterFactory() : FactoryBase(FilterName) {}
+
+ private:
+  Http::FilterFactoryCb createFilterFactoryFromProtoTyped(
+      const ::google::api::envoy::http::fused::FilterConfig& proto_config,
+      const std::string& stats_prefix,
+      Server::Configuration::FactoryContext& context) override {
+    auto filter_config =
+        std::make_shared<FilterConfig>(proto_config, stats_prefix, context);
+    // Same admin surface as the standalone service control filter; the
+    // first config wins, repeated addHandler calls on config swaps failing
+    // is expected.
+    context.admin().addHandler(
+        "/service_control_debug",
+        "dump ESP V2 service control cache occupancy, per-operation call "
+        "tallies, circuit breaker state and report flush backlog as JSON",
+        [](absl::string_view, Http::HeaderMap&, Buffer::Instance& response,
+           Server::AdminStream&) -> Http::Code {
+          response.add(
+              ServiceControl::ClientCacheDebugRegistry::instance().DumpJson());
+          return Http::Code::OK;
+        },
+        false, false);
+    context.admin().addHandler(
+        "/service_control_heavy_hitters",
+        "dump the merged per-service top api keys by request count from the "
+        "opt-in heavy-hitter trackers as JSON",
+        [](absl::string_view, Http::HeaderMap&, Buffer::Instance& response,
+           Server::AdminStream&) -> Http::Code {
+          response.add(
+              ServiceControl::HeavyHitterRegistry::instance().DumpJson());
+          return Http::Code::OK;
+        },
+        false, false);
+    return
+        [filter_config](Http::FilterChainFactoryCallbacks& callbacks) -> void {
+          // Joins the backend routing background program compile, exactly
+          // as the standalone routing filter factory does.
+          if (filter_config->backend_routing_config()) {
+            filter_config->backend_routing_config()->ensureBuilt();
+          }
+          auto filter = std::make_shared<Filter>(
+              filter_config->path_matcher_config(),
+              filter_config->service_control_config()->stats(),
+              filter_config->service_control_config()->handler_factory(),
+              filter_config->backend_auth_config(),
+              filter_config->backend_routing_config());
+          callbacks.addStreamFilter(Http::StreamFilterSharedPtr(filter));
+          callbacks.addAccessLogHandler(AccessLog::InstanceSharedPtr(filter));
+        };
+  }
+};
+
+/**
+ * Static registration for the fused filter. @see RegisterFactory.
+ */
+static Registry::RegisterFactory<
+    FilterFactory, Server::Configuration::NamedHttpFilterConfigFactory>
+    register_;
+
+}  // namespace Fused
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
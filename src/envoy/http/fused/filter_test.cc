@@ -0,0 +1,208 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/fused/filter.h"
+
+#include "envoy/http/header_map.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+#include "src/envoy/http/backend_auth/mocks.h"
+#include "src/envoy/http/service_control/mocks.h"
+#include "src/envoy/utils/filter_state_utils.h"
+#include "test/mocks/server/mocks.h"
+#include "test/mocks/stats/mocks.h"
+#include "test/mocks/tracing/mocks.h"
+#include "test/test_common/utility.h"
+
+using Envoy::Http::MockStreamDecoderFilterCallbacks;
+using Envoy::Server::Configuration::MockFactoryContext;
+using ::google::protobuf::TextFormat;
+using ::google::protobuf::util::Status;
+using ::google::protobuf::util::error::Code;
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::NiceMock;
+using ::testing::Return;
+using ::testing::ReturnRef;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace Fused {
+namespace {
+
+const char kPathMatcherConfig[] = R"(
+rules {
+  operation: "1.cloudesf_testing_cloud_goog.Bar"
+  pattern {
+    http_method: "GET"
+    uri_template: "/bar"
+  }
+})";
+
+const Status kBadStatus(Code::UNAUTHENTICATED, "test");
+
+// The fused filter composes the standalone stage filters, whose own tests
+// cover the stage internals; these tests pin the fused-specific glue: the
+// stage ordering around the asynchronous check, and that a stage denial
+// stops the stages after it.
+class FusedFilterTest : public ::testing::Test {
+ protected:
+  FusedFilterTest() : stats_base_("", mock_stats_scope_) {}
+
+  void SetUp() override {
+    ::google::api::envoy::http::path_matcher::FilterConfig pm_config_pb;
+    ASSERT_TRUE(TextFormat::ParseFromString(kPathMatcherConfig, &pm_config_pb));
+    path_matcher_config_ = std::make_shared<PathMatcher::FilterConfig>(
+        pm_config_pb, "", mock_factory_context_);
+
+    mock_auth_parser_ =
+        std::make_shared<NiceMock<BackendAuth::MockFilterConfigParser>>();
+    mock_auth_config_ =
+        std::make_shared<NiceMock<BackendAuth::MockFilterConfig>>();
+    ON_CALL(*mock_auth_config_, cfg_parser)
+        .WillByDefault(ReturnRef(*mock_auth_parser_));
+    ON_CALL(*mock_auth_config_, stats)
+        .WillByDefault(ReturnRef(auth_stats_));
+
+    filter_ = std::make_unique<Filter>(
+        path_matcher_config_, stats_base_.stats(), mock_handler_factory_,
+        mock_auth_config_, nullptr);
+    filter_->setDecoderFilterCallbacks(mock_decoder_callbacks_);
+
+    mock_span_ = std::make_unique<Envoy::Tracing::MockSpan>();
+  }
+
+  // Makes the auth stage append a token for every operation.
+  void expectAuthToken() {
+    ON_CALL(*mock_auth_parser_, getAudience)
+        .WillByDefault(Return("this-is-audience"));
+    ON_CALL(*mock_auth_parser_, getAudienceById)
+        .WillByDefault(Return("this-is-audience"));
+    ON_CALL(*mock_auth_parser_, getJwtToken).WillByDefault(Return(&token_));
+    ON_CALL(*mock_auth_parser_, getJwtTokenById).WillByDefault(Return(&token_));
+  }
+
+  testing::NiceMock<MockFactoryContext> mock_factory_context_;
+  testing::NiceMock<MockStreamDecoderFilterCallbacks> mock_decoder_callbacks_;
+  testing::NiceMock<ServiceControl::MockServiceControlHandlerFactory>
+      mock_handler_factory_;
+  testing::NiceMock<Stats::MockStore> mock_stats_scope_;
+  ServiceControl::ServiceControlFilterStatBase stats_base_;
+
+  PathMatcher::FilterConfigSharedPtr path_matcher_config_;
+  std::shared_ptr<BackendAuth::MockFilterConfigParser> mock_auth_parser_;
+  std::shared_ptr<BackendAuth::MockFilterConfig> mock_auth_config_;
+  BackendAuth::FilterStats auth_stats_{ALL_BACKEND_AUTH_FILTER_STATS(
+      POOL_COUNTER_PREFIX(mock_stats_scope_, ""))};
+  const BackendAuth::TokenInfo token_{"this-is-token", "Bearer this-is-token"};
+
+  std::unique_ptr<Filter> filter_;
+  std::unique_ptr<Envoy::Tracing::MockSpan> mock_span_;
+};
+
+TEST_F(FusedFilterTest, SyncOKStatusRunsAuthStage) {
+  // Test: a synchronously allowed check still runs the auth stage before
+  // decodeHeaders returns Continue.
+  auto* mock_handler =
+      new NiceMock<ServiceControl::MockServiceControlHandler>();
+  EXPECT_CALL(mock_handler_factory_, createHandler_(_, _))
+      .WillOnce(Return(mock_handler));
+  EXPECT_CALL(*mock_handler, callCheck(_, _, _))
+      .WillOnce(Invoke(
+          [](Http::HeaderMap&, Envoy::Tracing::Span&,
+             ServiceControl::ServiceControlHandler::CheckDoneCallback& callback)
+              -> void { callback.onCheckDone(Status::OK); }));
+  expectAuthToken();
+
+  Http::TestHeaderMapImpl headers{{":method", "GET"}, {":path", "/bar"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, false));
+
+  // The path matcher resolved the operation and the auth stage ran.
+  EXPECT_EQ(Utils::getStringFilterState(
+                mock_decoder_callbacks_.stream_info_.filter_state_,
+                Utils::kOperation),
+            "1.cloudesf_testing_cloud_goog.Bar");
+  EXPECT_EQ(headers.get_("authorization"), "Bearer this-is-token");
+}
+
+TEST_F(FusedFilterTest, AsyncOKStatusRunsAuthStageBeforeResume) {
+  // Test: a deferred check runs the auth stage from onCheckDone, before
+  // continueDecoding resumes the chain.
+  auto* mock_handler =
+      new NiceMock<ServiceControl::MockServiceControlHandler>();
+  EXPECT_CALL(mock_handler_factory_, createHandler_(_, _))
+      .WillOnce(Return(mock_handler));
+  ServiceControl::ServiceControlHandler::CheckDoneCallback* stored_callback =
+      nullptr;
+  EXPECT_CALL(*mock_handler, callCheck(_, _, _))
+      .WillOnce(Invoke(
+          [&stored_callback](
+              Http::HeaderMap&, Envoy::Tracing::Span&,
+              ServiceControl::ServiceControlHandler::CheckDoneCallback&
+                  callback) -> void { stored_callback = &callback; }));
+  expectAuthToken();
+
+  Http::TestHeaderMapImpl headers{{":method", "GET"}, {":path", "/bar"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+  EXPECT_EQ(headers.get_("authorization"), "");
+
+  EXPECT_CALL(mock_decoder_callbacks_, continueDecoding())
+      .WillOnce(Invoke([&headers]() {
+        // The token must already be on the headers when decoding resumes.
+        EXPECT_EQ(headers.get_("authorization"), "Bearer this-is-token");
+      }));
+  stored_callback->onCheckDone(Status::OK);
+}
+
+TEST_F(FusedFilterTest, PathMatcherDenialSkipsLaterStages) {
+  // Test: a request matching no operation is rejected by the path matcher
+  // stage; the check never runs.
+  EXPECT_CALL(mock_handler_factory_, createHandler_(_, _)).Times(0);
+
+  Http::TestHeaderMapImpl headers{{":method", "GET"}, {":path", "/nomatch"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+}
+
+TEST_F(FusedFilterTest, CheckDenialSkipsLaterStages) {
+  // Test: a denied check rejects the request without running the auth
+  // stage.
+  auto* mock_handler =
+      new NiceMock<ServiceControl::MockServiceControlHandler>();
+  EXPECT_CALL(mock_handler_factory_, createHandler_(_, _))
+      .WillOnce(Return(mock_handler));
+  EXPECT_CALL(*mock_handler, callCheck(_, _, _))
+      .WillOnce(Invoke(
+          [](Http::HeaderMap&, Envoy::Tracing::Span&,
+             ServiceControl::ServiceControlHandler::CheckDoneCallback& callback)
+              -> void { callback.onCheckDone(kBadStatus); }));
+  EXPECT_CALL(*mock_auth_config_, cfg_parser).Times(0);
+  EXPECT_CALL(
+      mock_decoder_callbacks_.stream_info_,
+      setResponseFlag(StreamInfo::ResponseFlag::UnauthorizedExternalService));
+
+  Http::TestHeaderMapImpl headers{{":method", "GET"}, {":path", "/bar"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers, false));
+}
+
+}  // namespace
+}  // namespace Fused
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
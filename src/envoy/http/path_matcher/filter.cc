@@ -16,10 +16,12 @@
 
 #include "src/envoy/http/path_matcher/filter.h"
 
+#include "common/http/headers.h"
 #include "common/http/utility.h"
 #include "src/api_proxy/path_matcher/variable_binding_utils.h"
 #include "src/envoy/utils/filter_state_utils.h"
 #include "src/envoy/utils/http_header_utils.h"
+#include "src/envoy/utils/phase_timing_utils.h"
 
 using ::google::api_proxy::path_matcher::VariableBinding;
 using ::google::api_proxy::path_matcher::VariableBindingsToQueryParameters;
@@ -37,6 +39,138 @@ struct RcDetailsValues {
 };
 typedef ConstSingleton<RcDetailsValues> RcDetails;
 
+int hexDigit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Unreserved characters per RFC 3986; percent-escapes decoding to one of
+// these never change how a path splits into segments, so decoding them is
+// a canonical, loss-free normalization.
+bool isUnreservedChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' ||
+         c == '~';
+}
+
+// Decides in one forward scan, with no writes, whether normalizePath()
+// would change |path|. This is the only cost clean paths (the common case)
+// pay; the loop is a branchy-but-simple byte scan the compiler can keep in
+// registers. The scan stops at the query string, which is never touched.
+bool pathNeedsNormalization(absl::string_view path) {
+  for (size_t i = 0; i < path.size(); ++i) {
+    const char c = path[i];
+    if (c == '?') {
+      break;
+    }
+    if (c == '/') {
+      if (i + 1 >= path.size()) {
+        break;
+      }
+      if (path[i + 1] == '/') {
+        return true;
+      }
+      if (path[i + 1] == '.') {
+        // "/." or "/.." followed by a slash, the query or the end.
+        size_t j = i + 2;
+        if (j < path.size() && path[j] == '.') {
+          ++j;
+        }
+        if (j >= path.size() || path[j] == '/' || path[j] == '?') {
+          return true;
+        }
+      }
+    } else if (c == '%' && i + 2 < path.size()) {
+      const int hi = hexDigit(path[i + 1]);
+      const int lo = hexDigit(path[i + 2]);
+      if (hi >= 0 && lo >= 0 &&
+          isUnreservedChar(static_cast<char>((hi << 4) | lo))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Rewrites |path|: collapses duplicate slashes, resolves "." and ".."
+// segments and decodes percent-escaped unreserved characters. The query
+// string, if any, is appended untouched. Only runs on the rare paths
+// pathNeedsNormalization() flagged.
+std::string normalizePath(absl::string_view path) {
+  const size_t query_pos = path.find('?');
+  const absl::string_view query = query_pos == absl::string_view::npos
+                                      ? absl::string_view()
+                                      : path.substr(query_pos);
+  const absl::string_view raw = path.substr(0, query_pos);
+
+  // Decode percent-escaped unreserved characters first, so "%2e%2e" takes
+  // part in the dot-segment resolution below like a literal ".." would.
+  std::string decoded;
+  decoded.reserve(raw.size());
+  for (size_t i = 0; i < raw.size(); ++i) {
+    if (raw[i] == '%' && i + 2 < raw.size()) {
+      const int hi = hexDigit(raw[i + 1]);
+      const int lo = hexDigit(raw[i + 2]);
+      if (hi >= 0 && lo >= 0) {
+        const char c = static_cast<char>((hi << 4) | lo);
+        if (isUnreservedChar(c)) {
+          decoded.push_back(c);
+          i += 2;
+          continue;
+        }
+      }
+    }
+    decoded.push_back(raw[i]);
+  }
+
+  const bool trailing_slash = decoded.size() > 1 && decoded.back() == '/';
+  std::string out;
+  out.reserve(decoded.size());
+  // Offsets where each emitted segment starts, so ".." truncates the last
+  // one in O(1).
+  std::vector<size_t> segment_starts;
+  size_t i = 0;
+  while (i < decoded.size()) {
+    while (i < decoded.size() && decoded[i] == '/') {
+      ++i;
+    }
+    const size_t start = i;
+    while (i < decoded.size() && decoded[i] != '/') {
+      ++i;
+    }
+    const absl::string_view segment(decoded.data() + start, i - start);
+    if (segment.empty() || segment == ".") {
+      continue;
+    }
+    if (segment == "..") {
+      // ".." above the root is dropped, as upstream servers resolve it.
+      if (!segment_starts.empty()) {
+        out.resize(segment_starts.back());
+        segment_starts.pop_back();
+      }
+      continue;
+    }
+    segment_starts.push_back(out.size());
+    out.push_back('/');
+    out.append(segment.data(), segment.size());
+  }
+  if (out.empty()) {
+    out.push_back('/');
+  } else if (trailing_slash) {
+    out.push_back('/');
+  }
+  out.append(query.data(), query.size());
+  return out;
+}
+
 }  // namespace
 
 Http::FilterHeadersStatus Filter::decodeHeaders(Http::HeaderMap& headers,
@@ -44,7 +178,24 @@ Http::FilterHeadersStatus Filter::decodeHeaders(Http::HeaderMap& headers,
   std::string method(Utils::getRequestHTTPMethodWithOverride(
       headers.Method()->value().getStringView(), headers));
   std::string path(headers.Path()->value().getStringView());
+  // Normalize duplicate slashes, dot segments and percent-escaped
+  // unreserved characters before the lookup. The trie lookup collapses
+  // slashes itself, but dot segments and mixed escaping used to miss, and
+  // the un-normalized path was forwarded upstream and logged as-is. Clean
+  // paths only pay the read-only scan.
+  if (pathNeedsNormalization(path)) {
+    path = normalizePath(path);
+    const auto& path_field = Http::Headers::get().Path;
+    headers.remove(path_field);
+    headers.addCopy(path_field, path);
+  }
+  const bool timing = Utils::phaseTimingEnabled();
+  const int64_t match_start = timing ? Utils::phaseTimingNow() : 0;
   const std::string* operation = config_->findOperation(method, path);
+  if (timing) {
+    config_->stats().phase_path_match_ns_.recordValue(Utils::phaseTimingNow() -
+                                                      match_start);
+  }
   if (operation == nullptr) {
     rejectRequest(Http::Code(404),
                   "Path does not match any requirement URI template.");
@@ -55,16 +206,34 @@ Http::FilterHeadersStatus Filter::decodeHeaders(Http::HeaderMap& headers,
   StreamInfo::FilterState& filter_state =
       decoder_callbacks_->streamInfo().filterState();
   Utils::setStringFilterState(filter_state, Utils::kOperation, *operation);
+  Utils::setOperationIdFilterState(filter_state,
+                                   config_->operationId(operation));
+
+  // Parse the query string at most once per stream: downstream consumers
+  // (api-key extraction in service control) read the one shared map on
+  // first access, and streams where nothing reads it never pay for the
+  // parse.
+  Utils::setLazyParsedQueryParamsFilterState(filter_state, [path]() {
+    return Http::Utility::parseQueryString(path);
+  });
 
   if (config_->needParameterExtraction(*operation)) {
-    std::vector<VariableBinding> variable_bindings;
-    operation = config_->findOperation(method, path, &variable_bindings);
-    if (!variable_bindings.empty()) {
-      const std::string query_params = VariableBindingsToQueryParameters(
-          variable_bindings, config_->getSnakeToJsonMap());
-      Utils::setStringFilterState(filter_state, Utils::kQueryParams,
-                                  query_params);
-    }
+    // Binding extraction percent-decodes every variable, but only gRPC
+    // transcoding and constant-address backend routing ever read the result.
+    // Defer it: the work runs when a downstream filter first reads the query
+    // params, and plain pass-through streams never pay for it.
+    const FilterConfigSharedPtr config = config_;
+    Utils::setLazyStringFilterState(
+        filter_state, Utils::kQueryParams,
+        [config, method, path]() -> std::string {
+          std::vector<VariableBinding> variable_bindings;
+          config->findOperation(method, path, &variable_bindings);
+          if (variable_bindings.empty()) {
+            return "";
+          }
+          return VariableBindingsToQueryParameters(
+              variable_bindings, config->getSnakeToJsonMap());
+        });
   }
 
   config_->stats().allowed_.inc();
@@ -14,6 +14,10 @@
 
 #include "src/envoy/http/path_matcher/filter_config.h"
 
+#include "absl/strings/str_cat.h"
+#include "src/envoy/utils/config_build_executor.h"
+#include "src/envoy/utils/operation_interner.h"
+
 namespace Envoy {
 namespace Extensions {
 namespace HttpFilters {
@@ -24,24 +28,126 @@ FilterConfig::FilterConfig(
     const std::string& stats_prefix,
     Server::Configuration::FactoryContext& context)
     : proto_config_(proto_config),
+      alive_(std::make_shared<bool>(true)),
+      init_target_("PathMatcherFilterConfig",
+                   [this] {
+                     // The listener started initializing; release it right
+                     // away when the trie compile already finished,
+                     // otherwise the completion callback below does.
+                     if (build_complete_) {
+                       init_target_.ready();
+                     } else {
+                       init_waiting_ = true;
+                     }
+                   }),
       stats_(generateStats(stats_prefix, context.scope())) {
-  ::google::api_proxy::path_matcher::PathMatcherBuilder<const std::string*> pmb;
+  // Registration stays synchronous so an invalid or duplicated pattern
+  // still rejects the config push with an exception.
+  auto pmb = std::make_shared<
+      ::google::api_proxy::path_matcher::PathMatcherBuilder<const std::string*>>();
   for (const auto& rule : proto_config_.rules()) {
-    if (!pmb.Register(rule.pattern().http_method(),
-                      rule.pattern().uri_template(),
-                      /*body_field_path=*/"", &rule.operation())) {
+    if (!pmb->Register(rule.pattern().http_method(),
+                       rule.pattern().uri_template(),
+                       /*body_field_path=*/"", &rule.operation())) {
       throw ProtoValidationException("Duplicated pattern", rule.pattern());
     }
     if (rule.extract_path_parameters()) {
-      path_params_operations_.insert(rule.operation());
+      path_params_operations_.insert(
+          Utils::OperationInterner::instance().InternName(rule.operation()));
     }
+    operation_ids_[&rule.operation()] =
+        Utils::OperationInterner::instance().Intern(rule.operation());
   }
-  path_matcher_ = pmb.Build();
+  // The trie compile dominates config ingestion; it runs on the shared
+  // config-build executor so it overlaps the other filters' derivations of
+  // the same config push. ensureBuilt() joins before the matcher is used.
+  // When done, the task reports back to the main thread so the init target
+  // registered below can release the warming listener: readiness then
+  // tracks the build instead of blocking on it, and during a config push
+  // the previous listener serves its old matcher until this one is ready.
+  std::shared_ptr<bool> alive = alive_;
+  Event::Dispatcher* main_dispatcher = &context.dispatcher();
+  build_done_ = Utils::ConfigBuildExecutor::instance().Submit(
+      [this, pmb, alive, main_dispatcher]() {
+        path_matcher_ = pmb->Build();
+        main_dispatcher->post([this, alive]() {
+          if (!*alive) {
+            return;
+          }
+          build_complete_ = true;
+          if (init_waiting_) {
+            init_target_.ready();
+          }
+        });
+      });
+  context.initManager().add(init_target_);
 
   for (const auto& segment_name : proto_config_.segment_names()) {
     snake_to_json_map_.emplace(segment_name.snake_name(),
                                segment_name.json_name());
   }
+
+  if (proto_config_.lookup_cache_max_entries() > 0) {
+    const uint32_t max_entries = proto_config_.lookup_cache_max_entries();
+    lookup_cache_slot_ = context.threadLocal().allocateSlot();
+    lookup_cache_slot_->set(
+        [max_entries](Event::Dispatcher&) -> ThreadLocal::ThreadLocalObjectSharedPtr {
+          return std::make_shared<LookupCache>(max_entries);
+        });
+  }
+}
+
+FilterConfig::~FilterConfig() {
+  // Runs on the main thread; a completion callback still queued behind us
+  // on the dispatcher must find the config gone.
+  *alive_ = false;
+  // A config torn down before its build task ran (e.g. a rejected listener
+  // update) must not leave the task writing into freed memory.
+  if (build_done_.valid()) {
+    build_done_.wait();
+  }
+}
+
+const std::string* FilterConfig::findOperation(const std::string& http_method,
+                                               const std::string& path) const {
+  ensureBuilt();
+  if (lookup_cache_slot_ == nullptr) {
+    return path_matcher_->Lookup(http_method, path);
+  }
+  // '\0' cannot occur in a http method, so the key is unambiguous.
+  std::string key = absl::StrCat(http_method, absl::string_view("\0", 1), path);
+  LookupCache& cache = lookup_cache_slot_->getTyped<LookupCache>();
+  const std::string* operation = cache.find(key);
+  if (operation != nullptr) {
+    return operation;
+  }
+  operation = path_matcher_->Lookup(http_method, path);
+  // Operations that extract path parameters re-run the match with variable
+  // bindings, so caching the operation alone would not save their lookup.
+  // Misses (nullptr) are not cached to keep junk paths from evicting hot
+  // entries.
+  if (operation != nullptr && !needParameterExtraction(*operation)) {
+    cache.insert(key, operation);
+  }
+  return operation;
+}
+
+std::string FilterConfig::debugDump() const {
+  ensureBuilt();
+  const auto stats = path_matcher_->GetDebugStats();
+  return absl::StrCat(
+      "{\"rules\":", proto_config_.rules_size(),
+      ",\"path_params_operations\":", path_params_operations_.size(),
+      ",\"interned_operation_ids\":", operation_ids_.size(),
+      ",\"segment_name_mappings\":", snake_to_json_map_.size(),
+      ",\"path_matcher\":{\"methods\":", stats.methods,
+      ",\"exact_map_entries\":", stats.exact_map_entries,
+      ",\"arena_nodes\":", stats.arena_nodes,
+      ",\"compiled_trie\":{\"nodes\":", stats.trie.nodes,
+      ",\"edges\":", stats.trie.edges,
+      ",\"method_results\":", stats.trie.method_results,
+      ",\"interned_segments\":", stats.trie.interned_segments,
+      ",\"memory_bytes\":", stats.trie.memory_bytes, "}}}");
 }
 
 }  // namespace PathMatcher
@@ -14,13 +14,18 @@
 
 #pragma once
 
+#include <future>
+#include <list>
 #include <unordered_map>
 
 #include "api/envoy/http/path_matcher/config.pb.h"
 #include "common/common/logger.h"
+#include "common/init/target_impl.h"
 #include "envoy/runtime/runtime.h"
 #include "envoy/server/filter_config.h"
+#include "envoy/thread_local/thread_local.h"
 #include "src/api_proxy/path_matcher/path_matcher.h"
+#include "src/envoy/utils/filter_state_utils.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -32,16 +37,70 @@ namespace PathMatcher {
  */
 
 // clang-format off
-#define ALL_BACKEND_AUTH_FILTER_STATS(COUNTER)     \
-  COUNTER(allowed)                                 \
-  COUNTER(denied)
+#define ALL_PATH_MATCHER_FILTER_STATS(COUNTER, HISTOGRAM)     \
+  COUNTER(allowed)                                            \
+  COUNTER(denied)                                             \
+  HISTOGRAM(phase_path_match_ns)
 // clang-format on
 
 /**
  * Wrapper struct for path matcher filter stats. @see stats_macros.h
+ *
+ * phase_path_match_ns is part of the opt-in per-phase timing surface (see
+ * src/envoy/utils/phase_timing_utils.h); it measures the operation lookup
+ * in decodeHeaders and stays empty unless phase timing is enabled.
  */
 struct FilterStats {
-  ALL_BACKEND_AUTH_FILTER_STATS(GENERATE_COUNTER_STRUCT)
+  ALL_PATH_MATCHER_FILTER_STATS(GENERATE_COUNTER_STRUCT,
+                                GENERATE_HISTOGRAM_STRUCT)
+};
+
+// A small per-worker LRU cache from (http method, path) to the matched
+// operation. Each worker thread owns its instance through a thread local
+// slot, so no locking is involved. Only operations that do not need path
+// parameter extraction are cached; for those the operation name is the only
+// lookup output.
+class LookupCache : public ThreadLocal::ThreadLocalObject {
+ public:
+  explicit LookupCache(uint32_t max_entries) : max_entries_(max_entries) {}
+
+  // Returns the cached operation for |key|, or nullptr on a miss. A hit
+  // refreshes the entry.
+  const std::string* find(const std::string& key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.first);
+    return it->second.second;
+  }
+
+  // Caches |operation| under |key|, evicting the least recently used entry
+  // when full.
+  void insert(const std::string& key, const std::string* operation) {
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.first);
+      it->second.second = operation;
+      return;
+    }
+    if (entries_.size() >= max_entries_) {
+      entries_.erase(lru_.back());
+      lru_.pop_back();
+    }
+    lru_.emplace_front(key);
+    entries_.emplace(key, std::make_pair(lru_.begin(), operation));
+  }
+
+ private:
+  const uint32_t max_entries_;
+  // Keys in most-recently-used-first order.
+  std::list<std::string> lru_;
+  // Maps a key to its position in |lru_| and the matched operation.
+  absl::flat_hash_map<
+      std::string,
+      std::pair<std::list<std::string>::iterator, const std::string*>>
+      entries_;
 };
 
 // The Envoy filter config for ESP V2 path matcher filter.
@@ -52,15 +111,26 @@ class FilterConfig : public Logger::Loggable<Logger::Id::filter> {
                const std::string& stats_prefix,
                Server::Configuration::FactoryContext& context);
 
-  const std::string* findOperation(const std::string& http_method,
-                                   const std::string& path) const {
-    return path_matcher_->Lookup(http_method, path);
+  ~FilterConfig();
+
+  // Joins the trie compile running on the shared config-build executor.
+  // Cheap once the build finished; callers touching path_matcher_ go
+  // through this so the overlap with the other filters' config builds
+  // stays invisible to them.
+  void ensureBuilt() const {
+    if (build_done_.valid()) {
+      build_done_.get();
+    }
   }
 
+  const std::string* findOperation(const std::string& http_method,
+                                   const std::string& path) const;
+
   const std::string* findOperation(
       const std::string& http_method, const std::string& path,
       std::vector<google::api_proxy::path_matcher::VariableBinding>*
           variable_bindings) const {
+    ensureBuilt();
     return path_matcher_->Lookup(http_method, path, variable_bindings);
   }
 
@@ -72,8 +142,25 @@ class FilterConfig : public Logger::Loggable<Logger::Id::filter> {
     return operation_it != path_params_operations_.end();
   }
 
+  // Returns the dense id interned for a matched operation, keyed by the
+  // operation pointer the path matcher returned. The downstream filters
+  // index their per-operation tables with it instead of re-hashing the
+  // operation name.
+  uint32_t operationId(const std::string* operation) const {
+    const auto it = operation_ids_.find(operation);
+    if (it == operation_ids_.end()) {
+      return Utils::kInvalidOperationId;
+    }
+    return it->second;
+  }
+
   FilterStats& stats() { return stats_; }
 
+  // One JSON object describing this config's path matcher internals (rule
+  // counts, exact-map and trie sizes, trie memory footprint) for the admin
+  // debug handler.
+  std::string debugDump() const;
+
   // Returns the mapp from snake-case segment name to JSON name.
   const absl::flat_hash_map<std::string, std::string>& getSnakeToJsonMap() {
     return snake_to_json_map_;
@@ -82,17 +169,42 @@ class FilterConfig : public Logger::Loggable<Logger::Id::filter> {
  private:
   FilterStats generateStats(const std::string& prefix, Stats::Scope& scope) {
     const std::string final_prefix = prefix + "path_matcher.";
-    return {ALL_BACKEND_AUTH_FILTER_STATS(
-        POOL_COUNTER_PREFIX(scope, final_prefix))};
+    return {ALL_PATH_MATCHER_FILTER_STATS(
+        POOL_COUNTER_PREFIX(scope, final_prefix),
+        POOL_HISTOGRAM_PREFIX(scope, final_prefix))};
   }
 
   ::google::api::envoy::http::path_matcher::FilterConfig proto_config_;
   ::google::api_proxy::path_matcher::PathMatcherPtr<const std::string*>
       path_matcher_;
+  // Per-worker lookup cache; nullptr when lookup_cache_max_entries is 0.
+  ThreadLocal::SlotPtr lookup_cache_slot_;
   // Mapping between snake-case segment name to JSON name as specified in
   // `Service.types` (e.g. "foo_bar" -> "fooBar").
   absl::flat_hash_map<std::string, std::string> snake_to_json_map_;
-  absl::flat_hash_set<std::string> path_params_operations_;
+  // Operations needing path parameter extraction, keyed by the canonical
+  // selector copies owned by the process-wide operation interner.
+  absl::flat_hash_set<absl::string_view> path_params_operations_;
+  // Matched operation pointer to its interned dense id.
+  absl::flat_hash_map<const std::string*, uint32_t> operation_ids_;
+  // Ready once the executor task assigned path_matcher_; the rest of the
+  // config is built synchronously in the constructor.
+  std::shared_future<void> build_done_;
+  // Cleared in the destructor so the completion callback the build task
+  // posts to the main dispatcher cannot touch a destroyed config.
+  std::shared_ptr<bool> alive_;
+  // Main-thread view of the build; set by the posted completion callback.
+  bool build_complete_{false};
+  // Set when the listener's init manager asked for readiness before the
+  // build finished; init_target_ is released as soon as it does.
+  bool init_waiting_{false};
+  // Gates listener readiness on the background trie compile: a warming
+  // listener reports ready only once the matcher is usable without
+  // joining the build, while the previous listener keeps serving its old
+  // matcher throughout. ensureBuilt() stays as the correctness backstop
+  // for streams that reach the filter before readiness (e.g. the very
+  // first listener at boot under early traffic).
+  Envoy::Init::TargetImpl init_target_;
   FilterStats stats_;
 };
 
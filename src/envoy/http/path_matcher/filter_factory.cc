@@ -12,12 +12,18 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
 #include "api/envoy/http/path_matcher/config.pb.h"
 #include "api/envoy/http/path_matcher/config.pb.validate.h"
 #include "src/envoy/http/path_matcher/filter.h"
 #include "src/envoy/http/path_matcher/filter_config.h"
 
 #include "envoy/registry/registry.h"
+#include "envoy/server/admin.h"
 #include "extensions/filters/http/common/factory_base.h"
 
 namespace Envoy {
@@ -27,6 +33,52 @@ namespace PathMatcher {
 
 constexpr char kPathMatcherFilterName[] = "envoy.filters.http.path_matcher";
 
+namespace {
+
+// The live filter configs the admin debug handler dumps. Configs register
+// here on creation and drop out once their last listener reference goes
+// away; held weak so the registry never extends a drained config's life.
+// Leaked so handler callbacks may run during shutdown.
+std::mutex& debugRegistryMutex() {
+  static std::mutex* mutex = new std::mutex;
+  return *mutex;
+}
+
+std::vector<std::weak_ptr<FilterConfig>>& debugRegistry() {
+  static auto* registry = new std::vector<std::weak_ptr<FilterConfig>>;
+  return *registry;
+}
+
+void registerForDebugDump(const std::shared_ptr<FilterConfig>& config) {
+  std::lock_guard<std::mutex> lock(debugRegistryMutex());
+  auto& registry = debugRegistry();
+  registry.erase(std::remove_if(registry.begin(), registry.end(),
+                                [](const std::weak_ptr<FilterConfig>& entry) {
+                                  return entry.expired();
+                                }),
+                 registry.end());
+  registry.push_back(config);
+}
+
+// Dumps every live config as one JSON array entry.
+std::string debugDumpAll() {
+  std::string out = "[";
+  std::lock_guard<std::mutex> lock(debugRegistryMutex());
+  bool first = true;
+  for (const auto& entry : debugRegistry()) {
+    auto config = entry.lock();
+    if (config == nullptr) {
+      continue;
+    }
+    absl::StrAppend(&out, first ? "" : ",", config->debugDump());
+    first = false;
+  }
+  absl::StrAppend(&out, "]");
+  return out;
+}
+
+}  // namespace
+
 /**
  * Config registration for ESP V2 path matcher filter.
  */
@@ -44,8 +96,25 @@ class FilterFactory
       Server::Configuration::FactoryContext& context) override {
     auto filter_config =
         std::make_shared<FilterConfig>(proto_config, stats_prefix, context);
+    registerForDebugDump(filter_config);
+    // First config registers the handler; later configs (and config swaps)
+    // only join the registry, so the repeated addHandler calls failing is
+    // expected and ignored.
+    context.admin().addHandler(
+        "/path_matcher_debug",
+        "dump ESP V2 path matcher internals (rule counts, trie sizes and "
+        "memory footprint) as JSON",
+        [](absl::string_view, Http::HeaderMap&, Buffer::Instance& response,
+           Server::AdminStream&) -> Http::Code {
+          response.add(debugDumpAll());
+          return Http::Code::OK;
+        },
+        false, false);
     return
         [filter_config](Http::FilterChainFactoryCallbacks& callbacks) -> void {
+          // Joins the background trie compile; a no-op once it finished, so
+          // only a stream arriving before the build completed ever waits.
+          filter_config->ensureBuilt();
           auto filter = std::make_shared<Filter>(filter_config);
           callbacks.addStreamDecoderFilter(
               Http::StreamDecoderFilterSharedPtr(filter));
@@ -137,6 +137,43 @@ TEST_F(FilterTest, DecodeHeadersExtractParameters) {
                     ->value());
 }
 
+TEST_F(FilterTest, NormalizesDotSegmentsBeforeMatch) {
+  // Test: dot segments are resolved before the lookup and the :path header
+  // carries the normalized value, query string untouched.
+  Http::TestHeaderMapImpl headers{{":method", "GET"},
+                                  {":path", "/baz/../bar/.?x=//1"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+
+  EXPECT_EQ(Utils::getStringFilterState(mock_cb_.stream_info_.filter_state_,
+                                        Utils::kOperation),
+            "1.cloudesf_testing_cloud_goog.Bar");
+  EXPECT_EQ(headers.Path()->value().getStringView(), "/bar?x=//1");
+}
+
+TEST_F(FilterTest, NormalizesEscapesAndDuplicateSlashes) {
+  // Test: percent-escaped unreserved characters are decoded and duplicate
+  // slashes collapsed, so "%62ar" under "//" still matches "/bar".
+  Http::TestHeaderMapImpl headers{{":method", "GET"}, {":path", "//%62ar"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+
+  EXPECT_EQ(Utils::getStringFilterState(mock_cb_.stream_info_.filter_state_,
+                                        Utils::kOperation),
+            "1.cloudesf_testing_cloud_goog.Bar");
+  EXPECT_EQ(headers.Path()->value().getStringView(), "/bar");
+}
+
+TEST_F(FilterTest, CleanPathIsNotRewritten) {
+  // Test: a clean path never goes through the rewrite; reserved escapes
+  // (here %2F for "/") are kept as sent.
+  Http::TestHeaderMapImpl headers{{":method", "GET"},
+                                  {":path", "/foo/a%2Fb"}};
+  EXPECT_EQ(Http::FilterHeadersStatus::Continue,
+            filter_->decodeHeaders(headers, true));
+  EXPECT_EQ(headers.Path()->value().getStringView(), "/foo/a%2Fb");
+}
+
 TEST_F(FilterTest, DecodeHeadersNoMatch) {
   // Test: a request no match
   Http::TestHeaderMapImpl headers{{":method", "POST"}, {":path", "/bar"}};
@@ -0,0 +1,110 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/aggregation_handoff.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "common/common/logger.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+// Serializes appends from all workers so records never interleave
+// mid-record. Leaked since drain-time writes may race process teardown.
+std::mutex& fileMutex() {
+  static std::mutex* mutex = new std::mutex;
+  return *mutex;
+}
+
+// Little-endian fixed-width length prefix; simple to write incrementally
+// from several workers and to validate on read.
+void encodeLength(uint32_t length, char* out) {
+  out[0] = static_cast<char>(length & 0xff);
+  out[1] = static_cast<char>((length >> 8) & 0xff);
+  out[2] = static_cast<char>((length >> 16) & 0xff);
+  out[3] = static_cast<char>((length >> 24) & 0xff);
+}
+
+uint32_t decodeLength(const char* in) {
+  return static_cast<uint32_t>(static_cast<unsigned char>(in[0])) |
+         static_cast<uint32_t>(static_cast<unsigned char>(in[1])) << 8 |
+         static_cast<uint32_t>(static_cast<unsigned char>(in[2])) << 16 |
+         static_cast<uint32_t>(static_cast<unsigned char>(in[3])) << 24;
+}
+
+// A record larger than this is treated as corruption rather than
+// allocated; no sane flush or snapshot comes close.
+constexpr uint32_t kMaxRecordBytes = 64 * 1024 * 1024;
+
+}  // namespace
+
+void AggregationHandoff::AppendRecord(const std::string& path,
+                                      const std::string& bytes) {
+  std::lock_guard<std::mutex> lock(fileMutex());
+  std::ofstream file(path, std::ios::binary | std::ios::app);
+  if (!file.is_open()) {
+    ENVOY_LOG_MISC(warn, "failed to open aggregation handoff file {}", path);
+    return;
+  }
+  char length[4];
+  encodeLength(static_cast<uint32_t>(bytes.size()), length);
+  file.write(length, sizeof(length));
+  file.write(bytes.data(), bytes.size());
+  if (!file.good()) {
+    ENVOY_LOG_MISC(warn, "failed to write aggregation handoff file {}", path);
+  }
+}
+
+std::vector<std::string> AggregationHandoff::ConsumeRecords(
+    const std::string& path) {
+  std::vector<std::string> records;
+  std::lock_guard<std::mutex> lock(fileMutex());
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return records;
+  }
+  char length[4];
+  while (file.read(length, sizeof(length))) {
+    const uint32_t record_size = decodeLength(length);
+    if (record_size > kMaxRecordBytes) {
+      ENVOY_LOG_MISC(warn, "corrupt aggregation handoff file {}", path);
+      break;
+    }
+    std::string record(record_size, '\0');
+    if (!file.read(&record[0], record_size)) {
+      // A truncated tail (e.g. the old process died mid-write) costs only
+      // the incomplete record; everything read so far is kept.
+      ENVOY_LOG_MISC(warn, "truncated aggregation handoff file {}", path);
+      break;
+    }
+    records.push_back(std::move(record));
+  }
+  file.close();
+  // Consumed exactly once: the first worker to get here takes the records,
+  // the others find no file.
+  std::remove(path.c_str());
+  return records;
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,46 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Flat-file record store for carrying aggregation state across a hot
+// restart: the draining process appends serialized protos, the starting
+// process consumes them. Records are length-prefixed so files written by
+// several workers interleave whole records; a process-wide lock serializes
+// the appends.
+class AggregationHandoff {
+ public:
+  // Appends one record to |path|. Failures are logged and swallowed: a
+  // handoff that cannot be written degrades to today's behavior of
+  // dropping the state at drain.
+  static void AppendRecord(const std::string& path, const std::string& bytes);
+
+  // Reads all records of |path| and unlinks the file, so of the workers
+  // racing to restore at startup exactly one gets the records. Returns
+  // empty when the file is missing, already claimed or malformed.
+  static std::vector<std::string> ConsumeRecords(const std::string& path);
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
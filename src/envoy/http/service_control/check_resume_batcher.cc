@@ -0,0 +1,97 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/check_resume_batcher.h"
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+CheckResumeBatcher::Entry::~Entry() {
+  // Only touch the thread-local batcher when actually linked into it; an
+  // entry that was never enqueued may be destroyed on a thread that never
+  // bound a batcher.
+  if (batch_enqueued_) {
+    CheckResumeBatcher::instance().cancel(*this);
+  }
+}
+
+CheckResumeBatcher& CheckResumeBatcher::instance() {
+  static thread_local CheckResumeBatcher batcher;
+  return batcher;
+}
+
+void CheckResumeBatcher::bind(Event::Dispatcher& dispatcher) {
+  if (callback_ != nullptr) {
+    return;
+  }
+  callback_ = dispatcher.createTimer([this]() { drain(); });
+}
+
+void CheckResumeBatcher::enqueue(Entry& entry) {
+  ASSERT(callback_ != nullptr);
+  if (entry.batch_enqueued_) {
+    return;
+  }
+
+  entry.batch_prev_ = tail_;
+  entry.batch_next_ = nullptr;
+  if (tail_ != nullptr) {
+    tail_->batch_next_ = &entry;
+  } else {
+    head_ = &entry;
+    callback_->enableTimer(std::chrono::milliseconds(0));
+  }
+  tail_ = &entry;
+  entry.batch_enqueued_ = true;
+}
+
+void CheckResumeBatcher::cancel(Entry& entry) {
+  if (!entry.batch_enqueued_) {
+    return;
+  }
+  if (entry.batch_prev_ != nullptr) {
+    entry.batch_prev_->batch_next_ = entry.batch_next_;
+  } else {
+    head_ = entry.batch_next_;
+  }
+  if (entry.batch_next_ != nullptr) {
+    entry.batch_next_->batch_prev_ = entry.batch_prev_;
+  } else {
+    tail_ = entry.batch_prev_;
+  }
+  entry.batch_prev_ = nullptr;
+  entry.batch_next_ = nullptr;
+  entry.batch_enqueued_ = false;
+}
+
+void CheckResumeBatcher::drain() {
+  // Pop from the live list one entry at a time rather than detaching the
+  // batch up front: resuming a stream can tear down other streams, whose
+  // onDestroy then cancels them out of the list before the walk reaches
+  // them. Completions landing during the walk join the same batch.
+  while (head_ != nullptr) {
+    Entry* entry = head_;
+    cancel(*entry);
+    entry->onResumeBatch();
+  }
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -14,8 +14,16 @@
 
 #include "src/envoy/http/service_control/client_cache.h"
 
+#include <algorithm>
+#include <functional>
+
 #include "common/tracing/http_tracer_impl.h"
+#include "envoy/api/v2/core/grpc_service.pb.h"
+#include "google/protobuf/descriptor.h"
+#include "api/envoy/http/service_control/handoff.pb.h"
 #include "src/api_proxy/service_control/request_builder.h"
+#include "src/envoy/http/service_control/aggregation_handoff.h"
+#include "src/envoy/http/service_control/report_flush_pipeline.h"
 
 using ::google::api::envoy::http::service_control::FilterConfig;
 using ::google::protobuf::util::Status;
@@ -72,9 +80,54 @@ constexpr uint32_t kAllocateQuotaDefaultNumberOfRetries = 1;
 // The default number of retries for report calls.
 constexpr uint32_t kReportDefaultNumberOfRetries = 5;
 
+// The default upper bound in bytes on a single flushed ReportRequest.
+// Larger flushes are split into chunks of at most this size, sent across
+// separate dispatcher iterations.
+constexpr uint32_t kReportDefaultFlushChunkBytes = 256 * 1024;
+
+// How long a quota denial fast-denies its consumer before the quota path
+// runs again. Kept at the quota aggregation flush interval, so a consumer
+// whose quota refilled is denied no longer than the aggregation cache
+// would have denied them anyway.
+constexpr uint32_t kQuotaNegativeCacheTtlMs = 1000;
+// Bound on the negative cache; cleared wholesale when full, like the
+// other per-worker signature tables.
+constexpr size_t kQuotaNegativeCacheMaxEntries = 1024;
+
+// Spilled report batches older than this at replay time are expired
+// rather than sent; service control rejects operations this stale anyway.
+constexpr int64_t kReportSpillTtlSeconds = 3600;
+// Replay pacing: one spilled batch per tick, so draining a full journal
+// never competes with live traffic for the report path.
+constexpr uint32_t kReportSpillReplayIntervalMs = 1000;
+
 // The default value for network_fail_open flag.
 constexpr bool kDefaultNetworkFailOpen = true;
 
+// Number of consecutive check transport failures before a worker enters
+// outage mode and serves last-known-good decisions instead of issuing
+// remote calls that would only burn their timeout budget.
+constexpr uint32_t kOutageFailureThreshold = 5;
+// Interval between background probe checks while in outage mode.
+constexpr uint32_t kOutageProbeIntervalMs = 5000;
+
+// Initial (and maximum) number of cost units in each local quota token
+// bucket. Sized for roughly one second of burst per worker and metric; the
+// buckets are replenished as AllocateQuota responses come back.
+constexpr int64_t kLocalQuotaBucketCapacity = 1000;
+
+// Adaptive quota flush for the local-bucket path. A signature's
+// accumulated cost goes out as soon as it reaches the bucket capacity
+// divided by the hot divisor, so a hot consumer's exhaustion is
+// discovered after a bounded share of its local budget instead of after
+// a fixed interval. A signature flushed by the timer with less than
+// capacity divided by the idle divisor accumulated doubles its interval,
+// up to the max; exhaustion or a heavy flush resets it to the base
+// aggregation interval.
+constexpr int64_t kQuotaFlushHotDivisor = 5;
+constexpr int64_t kQuotaFlushIdleDivisor = 20;
+constexpr uint32_t kQuotaFlushMaxIntervalMs = 10000;
+
 // Generates CheckAggregationOptions.
 CheckAggregationOptions getCheckAggregationOptions() {
   return CheckAggregationOptions(kCheckAggregationEntries,
@@ -94,6 +147,83 @@ ReportAggregationOptions getReportAggregationOptions() {
                                   kReportAggregationFlushIntervalMs);
 }
 
+// Fully qualified method names of the service control RPCs, resolved in the
+// generated descriptor pool when the gRPC transport is enabled.
+constexpr char kCheckMethod[] =
+    "google.api.servicecontrol.v1.ServiceController.Check";
+constexpr char kQuotaMethod[] =
+    "google.api.servicecontrol.v1.QuotaController.AllocateQuota";
+constexpr char kReportMethod[] =
+    "google.api.servicecontrol.v1.ServiceController.Report";
+
+// Self-deleting adapter that bridges one async gRPC call to the service
+// control client's transport contract.
+template <class Response>
+class GrpcTransportCallbacks : public Grpc::AsyncRequestCallbacks<Response> {
+ public:
+  // auth_value is the preformatted Authorization value; copied since the
+  // worker's cached value may be refreshed while this call is in flight.
+  GrpcTransportCallbacks(const std::string& auth_value, Response* response,
+                         TransportDoneFunc on_done)
+      : token_value_(auth_value), response_(response), on_done_(on_done) {}
+
+  // Issues the call. Returns a cancel function, or nullptr when the call
+  // (and this object's self-deletion) already completed inline.
+  template <class Request>
+  CancelFunc send(Grpc::AsyncClient<Request, Response>& client,
+                  const ::google::protobuf::MethodDescriptor& method,
+                  const Request& request, Tracing::Span& parent_span,
+                  uint32_t timeout_ms) {
+    // Copied out first: on an inline failure this object is gone when send
+    // returns.
+    auto done = done_;
+    auto* call = client.send(method, request, *this, parent_span,
+                             absl::optional<std::chrono::milliseconds>(
+                                 std::chrono::milliseconds(timeout_ms)));
+    if (call == nullptr) {
+      return nullptr;
+    }
+    return [call, done]() {
+      if (!*done) {
+        call->cancel();
+      }
+    };
+  }
+
+  void onCreateInitialMetadata(Http::HeaderMap& metadata) override {
+    metadata.insertAuthorization().value(token_value_.data(),
+                                         token_value_.size());
+  }
+
+  void onSuccess(std::unique_ptr<Response>&& response,
+                 Tracing::Span&) override {
+    response_->Swap(response.get());
+    *done_ = true;
+    on_done_(Status::OK);
+    delete this;
+  }
+
+  void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                 Tracing::Span&) override {
+    *done_ = true;
+    // gRPC status codes share their numeric values with util::error::Code.
+    on_done_(Status(static_cast<Code>(status), message));
+    delete this;
+  }
+
+ private:
+  const std::string token_value_;
+  Response* response_;
+  TransportDoneFunc on_done_;
+  // Outlives this object so a caller-held cancel function can tell whether
+  // the call already finished.
+  std::shared_ptr<bool> done_{std::make_shared<bool>(false)};
+};
+
+// Upper bound on recycled per-call check states kept per worker; beyond
+// this a burst's states are freed instead of pinned.
+constexpr size_t kCheckCallStatePoolMax = 128;
+
 // A timer object to wrap PeriodicTimer
 class EnvoyPeriodicTimer
     : public ::google::service_control_client::PeriodicTimer {
@@ -131,6 +261,16 @@ void ClientCache::InitHttpRequestSetting(const FilterConfig& filter_config) {
     check_retries_ = kCheckDefaultNumberOfRetries;
     quota_retries_ = kAllocateQuotaDefaultNumberOfRetries;
     report_retries_ = kReportDefaultNumberOfRetries;
+    report_flush_chunk_bytes_ = kReportDefaultFlushChunkBytes;
+    check_budget_ms_ = 0;
+    report_aggregation_shards_ = 0;
+    report_flush_pipeline_enabled_ = false;
+    request_compression_min_bytes_ = 0;
+    check_hedge_delay_ms_ = 0;
+    trace_call_sample_every_n_ = 0;
+    aggregation_memory_budget_bytes_ = 0;
+    aggregation_handoff_directory_ = "";
+    report_spill_max_bytes_ = 0;
     return;
   }
   const auto& sc_calling_config = filter_config.sc_calling_config();
@@ -156,52 +296,191 @@ void ClientCache::InitHttpRequestSetting(const FilterConfig& filter_config) {
   report_retries_ = sc_calling_config.has_report_retries()
                         ? sc_calling_config.report_retries().value()
                         : kReportDefaultNumberOfRetries;
+  report_flush_chunk_bytes_ =
+      sc_calling_config.has_report_flush_chunk_bytes()
+          ? sc_calling_config.report_flush_chunk_bytes().value()
+          : kReportDefaultFlushChunkBytes;
+  check_budget_ms_ = sc_calling_config.has_check_budget_ms()
+                         ? sc_calling_config.check_budget_ms().value()
+                         : 0;
+  report_aggregation_shards_ =
+      sc_calling_config.has_report_aggregation_shards()
+          ? sc_calling_config.report_aggregation_shards().value()
+          : 0;
+  report_flush_pipeline_enabled_ =
+      sc_calling_config.has_enable_report_flush_pipeline() &&
+      sc_calling_config.enable_report_flush_pipeline().value();
+  request_compression_min_bytes_ =
+      sc_calling_config.has_request_compression_min_bytes()
+          ? sc_calling_config.request_compression_min_bytes().value()
+          : 0;
+  check_hedge_delay_ms_ = sc_calling_config.has_check_hedge_delay_ms()
+                              ? sc_calling_config.check_hedge_delay_ms().value()
+                              : 0;
+  trace_call_sample_every_n_ =
+      sc_calling_config.has_trace_call_sample_every_n()
+          ? sc_calling_config.trace_call_sample_every_n().value()
+          : 0;
+  aggregation_memory_budget_bytes_ =
+      sc_calling_config.has_aggregation_memory_budget_bytes()
+          ? sc_calling_config.aggregation_memory_budget_bytes().value()
+          : 0;
+  aggregation_handoff_directory_ =
+      sc_calling_config.aggregation_handoff_directory();
+  report_spill_max_bytes_ =
+      sc_calling_config.has_report_spill_max_bytes()
+          ? sc_calling_config.report_spill_max_bytes().value()
+          : 0;
 }
 
 ClientCache::ClientCache(
     const ::google::api::envoy::http::service_control::Service& config,
     const FilterConfig& filter_config, Upstream::ClusterManager& cm,
     Envoy::TimeSource& time_source, Event::Dispatcher& dispatcher,
-    std::function<const std::string&()> sc_token_fn,
-    std::function<const std::string&()> quota_token_fn)
-    : config_(config) {
+    Stats::Scope& scope, ServiceControlFilterStats& stats,
+    std::function<const std::string&()> sc_auth_value_fn,
+    std::function<const std::string&()> quota_auth_value_fn)
+    : config_(config),
+      stats_(stats),
+      time_source_(time_source),
+      dispatcher_(dispatcher),
+      sc_auth_value_fn_(sc_auth_value_fn),
+      quota_auth_value_fn_(quota_auth_value_fn),
+      alive_(std::make_shared<bool>(true)) {
   ServiceControlClientOptions options(getCheckAggregationOptions(),
                                       getQuotaAggregationOptions(),
                                       getReportAggregationOptions());
 
   InitHttpRequestSetting(filter_config);
+  // Keyed on the endpoint uri plus the call type, so every worker talking
+  // to the same backend shares one breaker per call family.
+  check_health_ = EndpointHealth::GetOrCreate(
+      filter_config.service_control_uri().uri() + ":check");
+  quota_health_ = EndpointHealth::GetOrCreate(
+      filter_config.service_control_uri().uri() + ":quota");
+  debug_state_ = std::make_shared<ClientCacheDebugState>();
+  debug_state_->service_name = config_.service_name();
+  debug_state_->check_health = check_health_;
+  debug_state_->quota_health = quota_health_;
+  ClientCacheDebugRegistry::instance().Add(debug_state_);
+  local_quota_buckets_enabled_ =
+      filter_config.has_sc_calling_config() &&
+      filter_config.sc_calling_config().has_enable_local_quota_buckets() &&
+      filter_config.sc_calling_config().enable_local_quota_buckets().value();
+  if (local_quota_buckets_enabled_) {
+    quota_flush_timer_ =
+        dispatcher_.createTimer([this]() { onQuotaFlushTimer(); });
+  }
+  if (filter_config.has_sc_calling_config() &&
+      filter_config.sc_calling_config().has_enable_shared_check_cache() &&
+      filter_config.sc_calling_config().enable_shared_check_cache().value()) {
+    shared_check_cache_ = SharedCheckCache::GetOrCreate(
+        config_.service_name() + "/" + config_.service_config_id());
+    // Every worker sets the same config value; the cache treats 0 or
+    // anything at or below its base TTL as "fixed TTL".
+    if (filter_config.sc_calling_config().has_check_adaptive_ttl_max_ms()) {
+      shared_check_cache_->set_adaptive_ttl_max_ms(
+          filter_config.sc_calling_config()
+              .check_adaptive_ttl_max_ms()
+              .value());
+    }
+  }
+  if (filter_config.has_sc_calling_config() &&
+      filter_config.sc_calling_config().has_enable_invalid_api_key_gate() &&
+      filter_config.sc_calling_config().enable_invalid_api_key_gate()
+          .value()) {
+    invalid_key_gate_ = InvalidKeyGate::GetOrCreate(
+        config_.service_name() + "/" + config_.service_config_id());
+  }
+  grpc_transport_enabled_ =
+      filter_config.has_sc_calling_config() &&
+      filter_config.sc_calling_config().has_enable_grpc_transport() &&
+      filter_config.sc_calling_config().enable_grpc_transport().value();
+  if (grpc_transport_enabled_) {
+    envoy::api::v2::core::GrpcService grpc_service;
+    grpc_service.mutable_envoy_grpc()->set_cluster_name(
+        filter_config.service_control_uri().cluster());
+    auto& manager = cm.grpcAsyncClientManager();
+    // The cluster is the same one the HTTP transport uses; skip the cluster
+    // check since this runs on worker threads where throwing is not an
+    // option.
+    grpc_check_client_ = decltype(grpc_check_client_)(
+        manager.factoryForGrpcService(grpc_service, scope, true)->create());
+    grpc_quota_client_ = decltype(grpc_quota_client_)(
+        manager.factoryForGrpcService(grpc_service, scope, true)->create());
+    grpc_report_client_ = decltype(grpc_report_client_)(
+        manager.factoryForGrpcService(grpc_service, scope, true)->create());
+    const auto* pool = ::google::protobuf::DescriptorPool::generated_pool();
+    check_method_ = pool->FindMethodByName(kCheckMethod);
+    quota_method_ = pool->FindMethodByName(kQuotaMethod);
+    report_method_ = pool->FindMethodByName(kReportMethod);
+    // The descriptors are linked in with the request messages the transports
+    // already use.
+    ASSERT(check_method_ != nullptr && quota_method_ != nullptr &&
+           report_method_ != nullptr);
+  }
   check_call_factory_ = std::make_unique<HttpCallFactory>(
       cm, dispatcher, filter_config.service_control_uri(),
-      config_.service_name() + ":check", sc_token_fn, check_timeout_ms_,
-      check_retries_, time_source, "Service Control remote call: Check");
+      config_.service_name() + ":check", sc_auth_value_fn, check_timeout_ms_,
+      check_retries_, time_source, "Service Control remote call: Check",
+      request_compression_min_bytes_, check_hedge_delay_ms_,
+      trace_call_sample_every_n_, &stats_);
   quota_call_factory_ = std::make_unique<HttpCallFactory>(
       cm, dispatcher, filter_config.service_control_uri(),
-      config_.service_name() + ":allocateQuota", quota_token_fn,
+      config_.service_name() + ":allocateQuota", quota_auth_value_fn,
       quota_timeout_ms_, quota_retries_, time_source,
       "Service Control remote call: Allocate Quota");
   report_call_factory_ = std::make_unique<HttpCallFactory>(
       cm, dispatcher, filter_config.service_control_uri(),
-      config_.service_name() + ":report", sc_token_fn, report_timeout_ms_,
-      report_retries_, time_source, "Service Control remote call: Report");
+      config_.service_name() + ":report", sc_auth_value_fn, report_timeout_ms_,
+      report_retries_, time_source, "Service Control remote call: Report",
+      request_compression_min_bytes_);
 
   options.check_transport = [this](const CheckRequest& request,
                                    CheckResponse* response,
                                    TransportDoneFunc on_done) {
     // Don't support tracing on this transport
     auto& null_span = Envoy::Tracing::NullSpan::instance();
+    if (!circuitAllows(*check_health_, stats_.check_circuit_state_)) {
+      stats_.check_circuit_fast_fail_.inc();
+      on_done(Status(Code::UNAVAILABLE,
+                     std::string("Service control check circuit open")));
+      return;
+    }
+    const auto start = time_source_.monotonicTime();
+    if (grpc_transport_enabled_) {
+      callGrpcCheck(request, response,
+                    [this, start, on_done](const Status& status) {
+                      recordCircuitResult(
+                          *check_health_, stats_.check_circuit_state_,
+                          status.ok(),
+                          std::chrono::duration_cast<std::chrono::microseconds>(
+                              time_source_.monotonicTime() - start));
+                      on_done(status);
+                    },
+                    null_span);
+      return;
+    }
     auto* call = check_call_factory_->createHttpCall(
         request, null_span,
-        [response, on_done](const Status& status, const std::string& body) {
+        [this, start, response, on_done](const Status& status,
+                                         const Buffer::Instance& body) {
+          const auto latency =
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  time_source_.monotonicTime() - start);
+          stats_.check_call_latency_us_.recordValue(latency.count());
+          recordCircuitResult(*check_health_, stats_.check_circuit_state_,
+                              status.ok(), latency);
           if (status.ok()) {
-            // Handle 200 response
-            if (!response->ParseFromString(body)) {
+            // Handle 200 response; parsed in place from the buffer slices.
+            if (!HttpCall::parseResponseBody(body, *response)) {
               on_done(Status(Code::INVALID_ARGUMENT,
                              std::string("Invalid response")));
               return;
             }
           } else {
             ENVOY_LOG(error, "Failed to call check, error: {}, str body: {}",
-                      status.ToString(), body);
+                      status.ToString(), body.toString());
           }
           on_done(status);
         });
@@ -213,12 +492,38 @@ ClientCache::ClientCache(
                                    TransportDoneFunc on_done) {
     // Don't support tracing on this transport
     auto& null_span = Envoy::Tracing::NullSpan::instance();
+    if (!circuitAllows(*quota_health_, stats_.quota_circuit_state_)) {
+      stats_.quota_circuit_fast_fail_.inc();
+      on_done(Status(Code::UNAVAILABLE,
+                     std::string("Service control quota circuit open")));
+      return;
+    }
+    const auto start = time_source_.monotonicTime();
+    if (grpc_transport_enabled_) {
+      callGrpcQuota(request, response,
+                    [this, start, on_done](const Status& status) {
+                      recordCircuitResult(
+                          *quota_health_, stats_.quota_circuit_state_,
+                          status.ok(),
+                          std::chrono::duration_cast<std::chrono::microseconds>(
+                              time_source_.monotonicTime() - start));
+                      on_done(status);
+                    });
+      return;
+    }
     auto* call = quota_call_factory_->createHttpCall(
         request, null_span,
-        [response, on_done](const Status& status, const std::string& body) {
+        [this, start, response, on_done](const Status& status,
+                                         const Buffer::Instance& body) {
+          const auto latency =
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  time_source_.monotonicTime() - start);
+          stats_.quota_call_latency_us_.recordValue(latency.count());
+          recordCircuitResult(*quota_health_, stats_.quota_circuit_state_,
+                              status.ok(), latency);
           if (status.ok()) {
-            // Handle 200 response
-            if (!response->ParseFromString(body)) {
+            // Handle 200 response; parsed in place from the buffer slices.
+            if (!HttpCall::parseResponseBody(body, *response)) {
               on_done(Status(Code::INVALID_ARGUMENT,
                              std::string("Invalid response")));
               return;
@@ -226,7 +531,7 @@ ClientCache::ClientCache(
           } else {
             ENVOY_LOG(error,
                       "Failed to call allocateQuota, error: {}, str body: {}",
-                      status.ToString(), body);
+                      status.ToString(), body.toString());
           }
           on_done(status);
         });
@@ -236,25 +541,37 @@ ClientCache::ClientCache(
   options.report_transport = [this](const ReportRequest& request,
                                     ReportResponse* response,
                                     TransportDoneFunc on_done) {
-    // Don't support tracing on this transport
-    auto& null_span = Envoy::Tracing::NullSpan::instance();
-    auto* call = report_call_factory_->createHttpCall(
-        request, null_span,
-        [response, on_done](const Status& status, const std::string& body) {
-          if (status.ok()) {
-            // Handle 200 response
-            if (!response->ParseFromString(body)) {
-              on_done(Status(Code::INVALID_ARGUMENT,
-                             std::string("Invalid response")));
-              return;
-            }
-          } else {
-            ENVOY_LOG(error, "Failed to call report, error: {}, str body: {}",
-                      status.ToString(), body);
-          }
-          on_done(status);
-        });
-    call->call();
+    stats_.report_batch_operations_.recordValue(request.operations_size());
+    releaseReportBytes(request.ByteSizeLong());
+    if (report_flush_chunk_bytes_ == 0 || request.operations_size() <= 1 ||
+        request.ByteSizeLong() <= report_flush_chunk_bytes_) {
+      sendReportRequest(request, response, on_done);
+      return;
+    }
+
+    // An oversized flush would serialize one multi-megabyte request in a
+    // single dispatcher tick. Split its operations into bounded-size
+    // chunks instead and send one chunk per dispatcher iteration; the
+    // response of the original flush is left untouched since the batched
+    // report path never reads it.
+    auto chunks = std::make_shared<std::vector<ReportRequest>>();
+    ReportRequest* chunk = nullptr;
+    size_t chunk_bytes = 0;
+    for (const auto& operation : request.operations()) {
+      const size_t operation_bytes = operation.ByteSizeLong();
+      if (chunk == nullptr ||
+          (chunk->operations_size() > 0 &&
+           chunk_bytes + operation_bytes > report_flush_chunk_bytes_)) {
+        chunks->emplace_back();
+        chunk = &chunks->back();
+        chunk->set_service_name(request.service_name());
+        chunk->set_service_config_id(request.service_config_id());
+        chunk_bytes = 0;
+      }
+      *chunk->add_operations() = operation;
+      chunk_bytes += operation_bytes;
+    }
+    sendReportChunks(chunks, 0, std::make_shared<Status>(Status::OK), on_done);
   };
 
   options.periodic_timer = [&dispatcher](int interval_ms,
@@ -266,82 +583,1363 @@ ClientCache::ClientCache(
 
   client_ = ::google::service_control_client::CreateServiceControlClient(
       config_.service_name(), config_.service_config_id(), options);
+
+  // Sharded report aggregation: operation signatures hash to report-only
+  // clients, each owning its own aggregation map and flush timer, so a
+  // flush iterating one shard never delays merging fresh operations into
+  // the others. The shard clients share the transports and timer factory
+  // wired above; their check and quota aggregation is disabled since those
+  // calls always go through |client_|.
+  if (report_aggregation_shards_ > 1) {
+    options.check_options = CheckAggregationOptions(0, 0, 0);
+    options.quota_options = QuotaAggregationOptions(0, 0);
+    options.report_options = ReportAggregationOptions(
+        std::max<uint32_t>(
+            kReportAggregationEntries / report_aggregation_shards_, 1),
+        kReportAggregationFlushIntervalMs);
+    report_shard_clients_.reserve(report_aggregation_shards_);
+    for (uint32_t i = 0; i < report_aggregation_shards_; ++i) {
+      report_shard_clients_.emplace_back(
+          ::google::service_control_client::CreateServiceControlClient(
+              config_.service_name(), config_.service_config_id(), options));
+    }
+  }
+
+  if (!aggregation_handoff_directory_.empty()) {
+    restoreAggregationHandoff();
+  }
+}
+
+ClientCache::~ClientCache() {
+  // Pipeline completions already posted to the dispatcher check this flag
+  // and bail out; the client destructors below then flush their remaining
+  // batches inline since sendReportRequest skips the pipeline once the flag
+  // is down.
+  *alive_ = false;
+  // Quota charges still waiting on their adaptive flush go out now, while
+  // the transport state is still up, so the backend sees them before
+  // teardown.
+  for (auto& entry : pending_quota_) {
+    if (entry.second.accumulated > 0) {
+      flushPendingQuota(entry.first, entry.second);
+    }
+  }
+  // Batches claimed for replay but not yet sent go back into the journal
+  // with their original spill times, so the next process can finish the
+  // replay and the TTL still counts from the original failure.
+  for (auto& record : spill_replay_records_) {
+    ReportSpillJournal::instance().Spill(reportSpillPath(),
+                                         std::move(record.bytes),
+                                         report_spill_max_bytes_,
+                                         record.spilled_at_s);
+  }
+  spill_replay_records_.clear();
+  if (!aggregation_handoff_directory_.empty()) {
+    // Flips handoff_active_, so both the eager flush here and the residual
+    // flushes from the client destructors below land in the handoff file
+    // instead of racing a network send that cannot complete during drain.
+    writeAggregationHandoff();
+  }
+}
+
+void ClientCache::sendReportViaPipeline(const ReportRequest& request,
+                                        ReportResponse* response,
+                                        TransportDoneFunc on_done) {
+  auto alive = alive_;
+  auto* dispatcher = &dispatcher_;
+  // The client library's flush request lives on its caller's stack, so the
+  // handoff pays one proto copy; the pipeline moves it from there on.
+  const bool queued = ReportFlushPipeline::instance().Enqueue(
+      ReportRequest(request),
+      [this, alive, dispatcher, response,
+       on_done](std::shared_ptr<std::string> body) {
+        // Runs on the pipeline thread. Everything that touches Envoy or the
+        // cache happens in the posted callback, back on the worker's
+        // dispatcher; |body| keeps the pooled buffer alive until the call
+        // object has copied the bytes.
+        dispatcher->post([this, alive, body, response, on_done]() {
+          if (!*alive) {
+            // The cache was destructed while this flush was queued; its
+            // transport state is gone, so the flush is abandoned. The
+            // response is deliberately leaked rather than letting on_done
+            // touch a destroyed aggregator.
+            return;
+          }
+          const auto start = time_source_.monotonicTime();
+          auto* call = report_call_factory_->createHttpCall(
+              *body, Envoy::Tracing::NullSpan::instance(),
+              [this, start, response, on_done](
+                  const Status& status, const Buffer::Instance& resp_body) {
+                stats_.report_call_latency_us_.recordValue(
+                    std::chrono::duration_cast<std::chrono::microseconds>(
+                        time_source_.monotonicTime() - start)
+                        .count());
+                if (status.ok()) {
+                  // Handle 200 response; parsed in place from the buffer
+                  // slices.
+                  if (!HttpCall::parseResponseBody(resp_body, *response)) {
+                    on_done(Status(Code::INVALID_ARGUMENT,
+                                   std::string("Invalid response")));
+                    return;
+                  }
+                } else {
+                  ENVOY_LOG(error,
+                            "Failed to call report, error: {}, str body: {}",
+                            status.ToString(), resp_body.toString());
+                }
+                on_done(status);
+              });
+          call->call();
+        });
+      });
+  if (!queued) {
+    stats_.report_flush_dropped_.inc();
+    on_done(Status(Code::UNAVAILABLE,
+                   std::string("Report flush pipeline saturated")));
+  }
+}
+
+CancelFunc ClientCache::callGrpcCheck(const CheckRequest& request,
+                                      CheckResponse* response,
+                                      TransportDoneFunc on_done,
+                                      Envoy::Tracing::Span& parent_span) {
+  const auto start = time_source_.monotonicTime();
+  auto* callbacks = new GrpcTransportCallbacks<CheckResponse>(
+      sc_auth_value_fn_(), response, [this, start, on_done](const Status& status) {
+        stats_.check_call_latency_us_.recordValue(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                time_source_.monotonicTime() - start)
+                .count());
+        if (!status.ok()) {
+          ENVOY_LOG(error, "Failed to call check over gRPC, error: {}",
+                    status.ToString());
+        }
+        on_done(status);
+      });
+  return callbacks->send(grpc_check_client_, *check_method_, request,
+                         parent_span, check_timeout_ms_);
+}
+
+void ClientCache::callGrpcQuota(const AllocateQuotaRequest& request,
+                                AllocateQuotaResponse* response,
+                                TransportDoneFunc on_done) {
+  const auto start = time_source_.monotonicTime();
+  auto* callbacks = new GrpcTransportCallbacks<AllocateQuotaResponse>(
+      quota_auth_value_fn_(), response,
+      [this, start, on_done](const Status& status) {
+        stats_.quota_call_latency_us_.recordValue(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                time_source_.monotonicTime() - start)
+                .count());
+        if (!status.ok()) {
+          ENVOY_LOG(error, "Failed to call allocateQuota over gRPC, error: {}",
+                    status.ToString());
+        }
+        on_done(status);
+      });
+  callbacks->send(grpc_quota_client_, *quota_method_, request,
+                  Envoy::Tracing::NullSpan::instance(), quota_timeout_ms_);
+}
+
+void ClientCache::callGrpcReport(const ReportRequest& request,
+                                 ReportResponse* response,
+                                 TransportDoneFunc on_done) {
+  const auto start = time_source_.monotonicTime();
+  auto* callbacks = new GrpcTransportCallbacks<ReportResponse>(
+      sc_auth_value_fn_(), response, [this, start, on_done](const Status& status) {
+        stats_.report_call_latency_us_.recordValue(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                time_source_.monotonicTime() - start)
+                .count());
+        if (!status.ok()) {
+          ENVOY_LOG(error, "Failed to call report over gRPC, error: {}",
+                    status.ToString());
+        }
+        on_done(status);
+      });
+  callbacks->send(grpc_report_client_, *report_method_, request,
+                  Envoy::Tracing::NullSpan::instance(), report_timeout_ms_);
+}
+
+void ClientCache::sendReportRequest(const ReportRequest& request,
+                                    ReportResponse* response,
+                                    TransportDoneFunc on_done) {
+  if (handoff_active_) {
+    // The proxy is draining; a network send issued now would be torn down
+    // with the worker before completing. The flush goes to the handoff
+    // file instead and is replayed by the next process.
+    AggregationHandoff::AppendRecord(reportHandoffPath(),
+                                     request.SerializeAsString());
+    on_done(Status::OK);
+    return;
+  }
+  if (reportSpillEnabled()) {
+    // The request proto lives on the flusher's stack and the transport may
+    // compress its serialized body, so the bytes to journal on failure must
+    // be retained up front. The extra serialization per flush is only paid
+    // when the spill is configured.
+    auto spill_bytes =
+        std::make_shared<std::string>(request.SerializeAsString());
+    TransportDoneFunc inner_done = std::move(on_done);
+    on_done = [this, spill_bytes, inner_done](const Status& status) {
+      if (!status.ok()) {
+        spillReportBytes(std::move(*spill_bytes));
+      } else {
+        maybeReplaySpilledReports();
+      }
+      inner_done(status);
+    };
+  }
+  // Don't support tracing on this transport
+  auto& null_span = Envoy::Tracing::NullSpan::instance();
+  if (grpc_transport_enabled_) {
+    callGrpcReport(request, response, on_done);
+    return;
+  }
+  // The pipeline path serializes on the background thread and posts only
+  // the send of the finished bytes back here. Skipped while the cache is
+  // being destructed, so the client's final flushes still go out inline.
+  if (report_flush_pipeline_enabled_ && *alive_) {
+    sendReportViaPipeline(request, response, on_done);
+    return;
+  }
+  const auto start = time_source_.monotonicTime();
+  auto* call = report_call_factory_->createHttpCall(
+      request, null_span,
+      [this, start, response, on_done](const Status& status,
+                                       const Buffer::Instance& body) {
+        stats_.report_call_latency_us_.recordValue(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                time_source_.monotonicTime() - start)
+                .count());
+        if (status.ok()) {
+          // Handle 200 response; parsed in place from the buffer slices.
+          if (!HttpCall::parseResponseBody(body, *response)) {
+            on_done(Status(Code::INVALID_ARGUMENT,
+                           std::string("Invalid response")));
+            return;
+          }
+        } else {
+          ENVOY_LOG(error, "Failed to call report, error: {}, str body: {}",
+                    status.ToString(), body.toString());
+        }
+        on_done(status);
+      });
+  call->call();
+}
+
+void ClientCache::sendReportChunks(
+    std::shared_ptr<std::vector<ReportRequest>> chunks, size_t index,
+    std::shared_ptr<Status> first_error, TransportDoneFunc on_done) {
+  auto* chunk_response = allocResponse<ReportResponse>();
+  sendReportRequest(
+      (*chunks)[index], chunk_response,
+      [this, chunks, index, first_error, on_done,
+       chunk_response](const Status& status) {
+        releaseResponse(chunk_response);
+        if (!status.ok() && first_error->ok()) {
+          *first_error = status;
+        }
+        if (index + 1 >= chunks->size()) {
+          on_done(*first_error);
+          return;
+        }
+        // The next chunk goes out on a later dispatcher iteration so other
+        // events interleave with the serialization work.
+        dispatcher_.post([this, chunks, index, first_error, on_done]() {
+          sendReportChunks(chunks, index + 1, first_error, on_done);
+        });
+      });
+}
+
+void ClientCache::releaseResponse(::google::protobuf::Message* response) {
+  if (response->GetArena() == nullptr) {
+    // Allocated on the heap while the arena was over its cap.
+    delete response;
+    return;
+  }
+  if (--live_arena_responses_ == 0) {
+    response_arena_.Reset();
+  }
+}
+
+ClientCache::CheckCallState* ClientCache::acquireCheckCallState() {
+  CheckCallState* state;
+  if (!check_call_state_pool_.empty()) {
+    state = check_call_state_pool_.back().release();
+    check_call_state_pool_.pop_back();
+  } else {
+    state = new CheckCallState;
+    state->cache = this;
+  }
+  state->refs = 1;
+  state->done = false;
+  state->cancelled = false;
+  state->is_leader = false;
+  state->remote_called = false;
+  state->circuit_fast_failed = false;
+  state->response.Clear();
+  return state;
+}
+
+void ClientCache::releaseCheckCallState(CheckCallState* state) {
+  // Invalidate any caller-held cancel function before the state can serve
+  // another call.
+  ++state->generation;
+  if (state->budget_timer != nullptr) {
+    state->budget_timer->disableTimer();
+  }
+  state->on_done = nullptr;
+  state->transport_done = nullptr;
+  state->transport_cancel = nullptr;
+  if (check_call_state_pool_.size() >= kCheckCallStatePoolMax) {
+    delete state;
+    return;
+  }
+  // The strings, the response proto and the budget timer keep their
+  // capacity for the next call.
+  check_call_state_pool_.emplace_back(state);
+}
+
+void ClientCache::unrefCheckCallState(CheckCallState* state) {
+  if (--state->refs == 0) {
+    releaseCheckCallState(state);
+  }
+}
+
+void ClientCache::deliverCheckResult(CheckCallState* state,
+                                     const Status& status,
+                                     const CheckResponseInfo& response_info) {
+  if (state->done) {
+    // The budget timer (or a cancel) already answered this request; drop
+    // the late result.
+    return;
+  }
+  state->done = true;
+  if (state->budget_timer != nullptr) {
+    state->budget_timer->disableTimer();
+  }
+  stats_.check_blocked_time_us_.recordValue(
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          time_source_.monotonicTime() - state->blocked_start)
+          .count());
+  state->on_done(status, response_info);
+}
+
+void ClientCache::cancelCheckCall(CheckCallState* state) {
+  state->cancelled = true;
+  state->done = true;
+  if (state->budget_timer != nullptr) {
+    state->budget_timer->disableTimer();
+  }
+  if (!state->is_leader) {
+    return;
+  }
+  // The leader's cancel must not tear down a call other requests ride on:
+  // with followers attached the call runs to completion for them and only
+  // the leader's callback is suppressed.
+  auto it = pending_check_calls_.find(state->decision_key);
+  if (it != pending_check_calls_.end()) {
+    if (!it->second.followers.empty()) {
+      return;
+    }
+    pending_check_calls_.erase(it);
+  }
+  if (state->transport_cancel != nullptr) {
+    state->transport_cancel();
+  }
+}
+
+bool ClientCache::tryCompleteCheckFromCache(const std::string& decision_key,
+                                            absl::string_view operation_name,
+                                            const CheckDoneFunc& on_done) {
+  if (shared_check_cache_ == nullptr) {
+    return false;
+  }
+  SharedCheckCache::CheckResult cached;
+  if (!shared_check_cache_->Lookup(decision_key, &cached)) {
+    return false;
+  }
+  // Mirror the bookkeeping of the shared-cache hit path in callCheck so the
+  // counters read the same no matter which entry point served the hit.
+  if (sc_auth_value_fn_().empty()) {
+    stats_.token_stale_requests_.inc();
+  }
+  {
+    std::lock_guard<std::mutex> lock(debug_state_->mutex);
+    ++debug_state_->check_calls_per_operation[std::string(operation_name)];
+  }
+  stats_.check_cache_hits_.inc();
+  CheckCallState* state = acquireCheckCallState();
+  state->on_done = on_done;
+  state->blocked_start = time_source_.monotonicTime();
+  deliverCheckResult(state, cached.status, cached.response_info);
+  unrefCheckCallState(state);
+  return true;
+}
+
+bool ClientCache::tryDenyFromInvalidKeyGate(absl::string_view api_key,
+                                            absl::string_view operation_name,
+                                            const CheckDoneFunc& on_done) {
+  if (invalid_key_gate_ == nullptr ||
+      !invalid_key_gate_->ProbablyInvalid(api_key)) {
+    return false;
+  }
+  stats_.check_invalid_key_gate_hits_.inc();
+  {
+    std::lock_guard<std::mutex> lock(debug_state_->mutex);
+    ++debug_state_->check_calls_per_operation[std::string(operation_name)];
+  }
+  const auto& denial = InvalidKeyGate::Denial();
+  CheckResponseInfo response_info;
+  response_info.is_api_key_valid = false;
+  response_info.denial = &denial;
+  CheckCallState* state = acquireCheckCallState();
+  state->on_done = on_done;
+  state->blocked_start = time_source_.monotonicTime();
+  deliverCheckResult(state, denial.status, response_info);
+  unrefCheckCallState(state);
+  return true;
 }
 
 CancelFunc ClientCache::callCheck(
     const CheckRequest& request, Envoy::Tracing::Span& parent_span,
-    std::function<void(const Status&, const CheckResponseInfo&)> on_done) {
-  CancelFunc cancel_fn;
-  auto check_transport = [this, &parent_span, &cancel_fn](
-                             const CheckRequest& request,
-                             CheckResponse* response,
-                             TransportDoneFunc on_done) {
-    auto* call = check_call_factory_->createHttpCall(
+    std::function<void(const Status&, const CheckResponseInfo&)> on_done,
+    const std::string* precomputed_decision_key) {
+  if (sc_auth_value_fn_().empty()) {
+    stats_.token_stale_requests_.inc();
+  }
+  {
+    std::lock_guard<std::mutex> lock(debug_state_->mutex);
+    ++debug_state_
+          ->check_calls_per_operation[request.operation().operation_name()];
+  }
+
+  // One pooled continuation object carries all per-call state; every
+  // closure below captures at most two trivially copyable words and stays
+  // within std::function's inline storage, so this path allocates no
+  // closures. Every completion path goes through deliverCheckResult so the
+  // blocked-time histogram covers all of them and the caller sees exactly
+  // one answer even when the budget timer races the real completion.
+  CheckCallState* state = acquireCheckCallState();
+  state->on_done = std::move(on_done);
+  state->blocked_start = time_source_.monotonicTime();
+  if (precomputed_decision_key != nullptr) {
+    state->decision_key.assign(*precomputed_decision_key);
+  } else {
+    state->decision_key = request.operation().consumer_id();
+    state->decision_key += '\t';
+    state->decision_key += request.operation().operation_name();
+  }
+  state->consumer_id = request.operation().consumer_id();
+
+  // A caller handing in the precomputed key has just probed the shared
+  // cache through tryCompleteCheckFromCache and missed; don't hash the key
+  // a second time for the same answer.
+  if (shared_check_cache_ != nullptr && precomputed_decision_key == nullptr) {
+    SharedCheckCache::CheckResult cached;
+    if (shared_check_cache_->Lookup(state->decision_key, &cached)) {
+      stats_.check_cache_hits_.inc();
+      deliverCheckResult(state, cached.status, cached.response_info);
+      unrefCheckCallState(state);
+      return nullptr;
+    }
+  }
+
+  if (check_outage_) {
+    const auto outage_now = std::chrono::steady_clock::now();
+    auto it = last_known_good_checks_.find(state->decision_key);
+    if (it != last_known_good_checks_.end() &&
+        outage_now < it->second.expires_at) {
+      stats_.check_outage_served_.inc();
+      if (outage_now >= next_outage_probe_) {
+        next_outage_probe_ =
+            outage_now + std::chrono::milliseconds(kOutageProbeIntervalMs);
+        probeCheckBackend(request);
+      }
+      deliverCheckResult(state, it->second.status, it->second.response_info);
+      unrefCheckCallState(state);
+      return nullptr;
+    }
+    // Keys never seen (or expired) fall through to the normal path; they
+    // get the regular fail open/closed treatment when the call times out.
+  }
+
+  // From here on an async wait is possible; arm the per-request budget so
+  // the worst case is bounded by policy instead of by retry arithmetic.
+  // The timer is created once per pooled state and only re-armed here; its
+  // callback captures the state pointer, which stays valid across reuse.
+  if (check_budget_ms_ > 0) {
+    if (state->budget_timer == nullptr) {
+      state->budget_timer = dispatcher_.createTimer([this, state]() {
+        if (state->done) {
+          return;
+        }
+        state->done = true;
+        stats_.check_budget_exceeded_.inc();
+        stats_.check_blocked_time_us_.recordValue(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                time_source_.monotonicTime() - state->blocked_start)
+                .count());
+        // The remote call keeps running in the background to warm the
+        // caches; only the answer is given out early, with the configured
+        // fail open/closed treatment.
+        CheckResponseInfo response_info;
+        if (network_fail_open_) {
+          state->on_done(Status::OK, response_info);
+        } else {
+          state->on_done(Status(Code::DEADLINE_EXCEEDED,
+                                "Service control check budget exhausted"),
+                         response_info);
+        }
+      });
+    }
+    state->budget_timer->enableTimer(
+        std::chrono::milliseconds(check_budget_ms_));
+  }
+
+  // Coalesce onto an identical remote call already in flight: park the
+  // state on the leader's call instead of issuing another one. A burst
+  // of requests with the same cold api_key+operation costs one RPC.
+  const auto pending_it = pending_check_calls_.find(state->decision_key);
+  if (pending_it != pending_check_calls_.end()) {
+    stats_.check_coalesced_.inc();
+    // The leader's completion takes over this call's pinning reference and
+    // drops it after delivering.
+    pending_it->second.followers.emplace_back(state);
+    const uint64_t generation = state->generation;
+    return [state, generation]() {
+      if (state->generation != generation) {
+        return;
+      }
+      state->cache->cancelCheckCall(state);
+    };
+  }
+
+  // The response pointer the library hands to the transport is the
+  // &state->response given to Check() below, so the completion closures
+  // reach it through the state and capture nothing extra.
+  auto check_transport = [state, &parent_span](const CheckRequest& request,
+                                               CheckResponse*,
+                                               TransportDoneFunc on_done) {
+    ClientCache* cache = state->cache;
+    // Only results of an actual remote call are published to the shared
+    // cache; per-worker aggregation hits would republish stale entries.
+    state->remote_called = true;
+    if (!cache->circuitAllows(*cache->check_health_,
+                              cache->stats_.check_circuit_state_)) {
+      // The answer reflects policy, not a fresh backend observation, so
+      // the outage bookkeeping must not count it.
+      state->circuit_fast_failed = true;
+      cache->stats_.check_circuit_fast_fail_.inc();
+      on_done(Status(Code::UNAVAILABLE,
+                     std::string("Service control check circuit open")));
+      return;
+    }
+    // Followers can now attach; the completion callback below drains them.
+    state->is_leader = true;
+    cache->pending_check_calls_.try_emplace(state->decision_key);
+    state->transport_done = std::move(on_done);
+    if (cache->grpc_transport_enabled_) {
+      const auto grpc_start = cache->time_source_.monotonicTime();
+      state->transport_cancel = cache->callGrpcCheck(
+          request, &state->response,
+          [state, grpc_start](const Status& status) {
+            ClientCache* cache = state->cache;
+            cache->recordCircuitResult(
+                *cache->check_health_, cache->stats_.check_circuit_state_,
+                status.ok(),
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    cache->time_source_.monotonicTime() - grpc_start));
+            state->transport_done(status);
+          },
+          parent_span);
+      return;
+    }
+    const auto start = cache->time_source_.monotonicTime();
+    auto* call = cache->check_call_factory_->createHttpCall(
         request, parent_span,
-        [response, on_done](const Status& status, const std::string& body) {
+        [state, start](const Status& status, const Buffer::Instance& body) {
+          ClientCache* cache = state->cache;
+          const auto latency =
+              std::chrono::duration_cast<std::chrono::microseconds>(
+                  cache->time_source_.monotonicTime() - start);
+          cache->stats_.check_call_latency_us_.recordValue(latency.count());
+          cache->recordCircuitResult(*cache->check_health_,
+                                     cache->stats_.check_circuit_state_,
+                                     status.ok(), latency);
           if (status.ok()) {
-            // Handle 200 response
-            if (!response->ParseFromString(body)) {
-              on_done(Status(Code::INVALID_ARGUMENT,
-                             std::string("Invalid response")));
+            // Handle 200 response; parsed in place from the buffer slices.
+            if (!HttpCall::parseResponseBody(body, state->response)) {
+              state->transport_done(Status(Code::INVALID_ARGUMENT,
+                                           std::string("Invalid response")));
               return;
             }
           } else {
             ENVOY_LOG(error, "Failed to call check, error: {}, str body: {}",
-                      status.ToString(), body);
+                      status.ToString(), body.toString());
           }
-          on_done(status);
+          state->transport_done(status);
         });
     call->call();
-    cancel_fn = [call]() { call->cancel(); };
+    state->transport_cancel = [call]() { call->cancel(); };
   };
 
-  auto* response = new CheckResponse;
-  client_->Check(request, response,
-                 [this, response, on_done](const Status& status) {
+  // Held by the completion below until it runs.
+  ++state->refs;
+  client_->Check(request, &state->response,
+                 [this, state](const Status& status) {
+                   if (state->remote_called) {
+                     stats_.check_cache_misses_.inc();
+                     if (!state->circuit_fast_failed) {
+                       onCheckTransportResult(status.ok());
+                     }
+                   } else {
+                     stats_.check_cache_hits_.inc();
+                   }
                    CheckResponseInfo response_info;
+                   Status final_status;
                    if (status.ok()) {
+                     // The project id of an api key is stable; serve it from
+                     // the per-key cache so a check for a known key costs one
+                     // hash probe here and the conversion below skips
+                     // re-formatting the number.
+                     const uint64_t project_number = state->response
+                                                         .check_info()
+                                                         .consumer_info()
+                                                         .project_number();
+                     if (project_number > 0) {
+                       ConsumerProjectId& cached_id =
+                           consumer_project_ids_[state->consumer_id];
+                       if (cached_id.project_number != project_number) {
+                         cached_id.project_number = project_number;
+                         cached_id.value = std::to_string(project_number);
+                       }
+                       response_info.consumer_project_id = cached_id.value;
+                     }
                      Status converted_status = ::google::api_proxy::
                          service_control::RequestBuilder::ConvertCheckResponse(
-                             *response, config_.service_name(), &response_info);
-                     on_done(converted_status, response_info);
+                             state->response, config_.service_name(),
+                             &response_info);
+                     const auto now = std::chrono::steady_clock::now();
+                     if (shared_check_cache_ != nullptr &&
+                         state->remote_called) {
+                       shared_check_cache_->Insert(state->decision_key,
+                                                   converted_status,
+                                                   response_info, now);
+                     }
+                     if (invalid_key_gate_ != nullptr &&
+                         state->remote_called &&
+                         !response_info.is_api_key_valid) {
+                       // The decision key is "api_key:<key>\t<operation>";
+                       // gate on the key alone, since key validity does
+                       // not depend on the operation.
+                       const absl::string_view key = state->decision_key;
+                       const size_t tab = key.find('\t');
+                       if (key.substr(0, 8) == "api_key:" &&
+                           tab != absl::string_view::npos) {
+                         invalid_key_gate_->Insert(key.substr(8, tab - 8));
+                       }
+                     }
+                     if (state->remote_called) {
+                       // Remember the decision for outage mode; the entry
+                       // expires when the aggregation cache would have
+                       // dropped it.
+                       if (last_known_good_checks_.size() >=
+                           kCheckAggregationEntries) {
+                         for (auto it = last_known_good_checks_.begin();
+                              it != last_known_good_checks_.end();) {
+                           auto cur = it++;
+                           if (now >= cur->second.expires_at) {
+                             releaseCheckCacheBytes(lastKnownGoodEntryBytes(
+                                 cur->first, cur->second));
+                             last_known_good_checks_.erase(cur);
+                           }
+                         }
+                       }
+                       auto& lkg_entry =
+                           last_known_good_checks_[state->decision_key];
+                       if (lkg_entry.expires_at.time_since_epoch().count() !=
+                           0) {
+                         releaseCheckCacheBytes(lastKnownGoodEntryBytes(
+                             state->decision_key, lkg_entry));
+                       }
+                       lkg_entry = LastKnownGoodCheck{
+                           converted_status, response_info,
+                           now + std::chrono::milliseconds(
+                                     kCheckAggregationExpirationMs)};
+                       const uint64_t lkg_bytes = lastKnownGoodEntryBytes(
+                           state->decision_key, lkg_entry);
+                       check_cache_bytes_ += lkg_bytes;
+                       stats_.aggregation_buffer_bytes_.add(lkg_bytes);
+                       enforceCheckCacheBudget();
+                     }
+                     final_status = converted_status;
                    } else {
-                     if (network_fail_open_) {
-                       on_done(Status::OK, response_info);
-                     } else {
-                       on_done(status, response_info);
+                     final_status = network_fail_open_ ? Status::OK : status;
+                   }
+                   if (!state->cancelled) {
+                     deliverCheckResult(state, final_status, response_info);
+                   }
+                   {
+                     std::lock_guard<std::mutex> lock(debug_state_->mutex);
+                     debug_state_->last_known_good_entries =
+                         last_known_good_checks_.size();
+                     debug_state_->pending_check_calls =
+                         pending_check_calls_.size();
+                     debug_state_->consumer_project_id_entries =
+                         consumer_project_ids_.size();
+                   }
+                   // Complete the followers that coalesced onto this call
+                   // with the same decision; the delivery guard skips the
+                   // cancelled and budget-answered ones.
+                   auto pend = pending_check_calls_.find(state->decision_key);
+                   if (pend != pending_check_calls_.end()) {
+                     auto followers = std::move(pend->second.followers);
+                     pending_check_calls_.erase(pend);
+                     for (CheckCallState* follower : followers) {
+                       deliverCheckResult(follower, final_status,
+                                          response_info);
+                       unrefCheckCallState(follower);
                      }
                    }
-                   delete response;
+                   unrefCheckCallState(state);
                  },
                  check_transport);
-  return cancel_fn;
+  if (state->transport_cancel == nullptr) {
+    unrefCheckCallState(state);
+    return nullptr;
+  }
+  const uint64_t generation = state->generation;
+  CancelFunc cancel = [state, generation]() {
+    if (state->generation != generation) {
+      return;
+    }
+    state->cache->cancelCheckCall(state);
+  };
+  unrefCheckCallState(state);
+  return cancel;
+}
+
+void ClientCache::onCheckTransportResult(bool ok) {
+  if (ok) {
+    consecutive_check_failures_ = 0;
+    if (check_outage_) {
+      check_outage_ = false;
+      ENVOY_LOG(info,
+                "service control check backend recovered, resuming full "
+                "checking");
+    }
+    return;
+  }
+  ++consecutive_check_failures_;
+  if (!check_outage_ &&
+      consecutive_check_failures_ >= kOutageFailureThreshold) {
+    check_outage_ = true;
+    next_outage_probe_ = std::chrono::steady_clock::now() +
+                         std::chrono::milliseconds(kOutageProbeIntervalMs);
+    ENVOY_LOG(warn,
+              "service control check backend unreachable after {} consecutive "
+              "failures, serving last-known-good check decisions",
+              consecutive_check_failures_);
+  }
+}
+
+bool ClientCache::circuitAllows(EndpointHealth& health,
+                                Stats::Gauge& state_gauge) {
+  const bool allowed = health.allowRequest(time_source_.monotonicTime());
+  state_gauge.set(static_cast<uint64_t>(health.circuit()));
+  return allowed;
+}
+
+void ClientCache::recordCircuitResult(EndpointHealth& health,
+                                      Stats::Gauge& state_gauge, bool ok,
+                                      std::chrono::microseconds latency) {
+  health.onResult(ok, latency, time_source_.monotonicTime());
+  state_gauge.set(static_cast<uint64_t>(health.circuit()));
+}
+
+void ClientCache::accountReportInflow(uint64_t bytes) {
+  report_buffer_bytes_ += bytes;
+  stats_.aggregation_buffer_bytes_.add(bytes);
+  if (aggregation_memory_budget_bytes_ == 0 ||
+      report_buffer_bytes_ <= aggregation_memory_budget_bytes_) {
+    return;
+  }
+  stats_.report_budget_flushes_.inc();
+  // FlushAll sends everything the aggregators hold through
+  // report_transport, which releases the flushed bytes. Whatever estimate
+  // remains afterwards is merge-savings drift (operations were counted at
+  // pre-merge size); dropped here so it cannot accumulate across flushes.
+  client_->FlushAll();
+  for (auto& shard : report_shard_clients_) {
+    shard->FlushAll();
+  }
+  stats_.aggregation_buffer_bytes_.sub(report_buffer_bytes_);
+  report_buffer_bytes_ = 0;
+}
+
+void ClientCache::releaseReportBytes(uint64_t bytes) {
+  const uint64_t released = std::min(bytes, report_buffer_bytes_);
+  report_buffer_bytes_ -= released;
+  stats_.aggregation_buffer_bytes_.sub(released);
+}
+
+uint64_t ClientCache::lastKnownGoodEntryBytes(const std::string& key,
+                                              const LastKnownGoodCheck& entry) {
+  return key.size() + sizeof(LastKnownGoodCheck) +
+         entry.status.error_message().size() +
+         entry.response_info.consumer_project_id.size();
+}
+
+void ClientCache::releaseCheckCacheBytes(uint64_t bytes) {
+  const uint64_t released = std::min(bytes, check_cache_bytes_);
+  check_cache_bytes_ -= released;
+  stats_.aggregation_buffer_bytes_.sub(released);
+}
+
+void ClientCache::enforceCheckCacheBudget() {
+  if (aggregation_memory_budget_bytes_ == 0 ||
+      check_cache_bytes_ <= aggregation_memory_budget_bytes_) {
+    return;
+  }
+  // Expired entries go first; live ones only when that was not enough. The
+  // map's iteration order is as good an eviction order as any for
+  // decisions that can be re-fetched from the backend.
+  const auto now = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < 2; ++pass) {
+    for (auto it = last_known_good_checks_.begin();
+         it != last_known_good_checks_.end() &&
+         check_cache_bytes_ > aggregation_memory_budget_bytes_;) {
+      auto cur = it++;
+      if (pass == 0 && now < cur->second.expires_at) {
+        continue;
+      }
+      releaseCheckCacheBytes(lastKnownGoodEntryBytes(cur->first, cur->second));
+      stats_.check_budget_evictions_.inc();
+      last_known_good_checks_.erase(cur);
+    }
+  }
+}
+
+std::string ClientCache::reportHandoffPath() const {
+  return aggregation_handoff_directory_ + "/" + config_.service_name() +
+         ".reports.handoff";
+}
+
+std::string ClientCache::checkHandoffPath() const {
+  return aggregation_handoff_directory_ + "/" + config_.service_name() +
+         ".checks.handoff";
+}
+
+std::string ClientCache::reportSpillPath() const {
+  return aggregation_handoff_directory_ + "/" + config_.service_name() +
+         ".reports.spill";
+}
+
+void ClientCache::spillReportBytes(std::string&& bytes) {
+  const uint64_t size = bytes.size();
+  const int64_t now_s = std::chrono::duration_cast<std::chrono::seconds>(
+                            time_source_.systemTime().time_since_epoch())
+                            .count();
+  if (ReportSpillJournal::instance().Spill(reportSpillPath(), std::move(bytes),
+                                           report_spill_max_bytes_, now_s)) {
+    stats_.report_spilled_bytes_.add(size);
+    spill_journal_may_have_data_ = true;
+  } else {
+    stats_.report_spill_dropped_bytes_.add(size);
+  }
+}
+
+void ClientCache::maybeReplaySpilledReports() {
+  if (spill_replay_in_progress_ || !spill_journal_may_have_data_) {
+    return;
+  }
+  auto records = ReportSpillJournal::instance().Consume(reportSpillPath());
+  // An empty consume means the journal stays untouched until the next
+  // spill, so successful sends stop paying the filesystem probe.
+  spill_journal_may_have_data_ = false;
+  if (records.empty()) {
+    return;
+  }
+  const int64_t now_s = std::chrono::duration_cast<std::chrono::seconds>(
+                            time_source_.systemTime().time_since_epoch())
+                            .count();
+  for (auto& record : records) {
+    if (now_s - record.spilled_at_s > kReportSpillTtlSeconds) {
+      stats_.report_spill_expired_bytes_.add(record.bytes.size());
+      continue;
+    }
+    spill_replay_records_.push_back(std::move(record));
+  }
+  if (spill_replay_records_.empty()) {
+    return;
+  }
+  spill_replay_in_progress_ = true;
+  if (spill_replay_timer_ == nullptr) {
+    spill_replay_timer_ =
+        dispatcher_.createTimer([this]() { replayNextSpilledReport(); });
+  }
+  spill_replay_timer_->enableTimer(
+      std::chrono::milliseconds(kReportSpillReplayIntervalMs));
+}
+
+void ClientCache::replayNextSpilledReport() {
+  if (spill_replay_records_.empty()) {
+    spill_replay_in_progress_ = false;
+    return;
+  }
+  ReportSpillJournal::Record record = std::move(spill_replay_records_.back());
+  spill_replay_records_.pop_back();
+  ReportRequest request;
+  if (request.ParseFromString(record.bytes)) {
+    const uint64_t size = record.bytes.size();
+    auto* response = allocResponse<ReportResponse>();
+    // The replay goes through the regular send path, so a batch that fails
+    // again re-enters the journal via the spill wrapper (with a fresh spill
+    // time, restarting its TTL).
+    sendReportRequest(request, response,
+                      [this, response, size](const Status& status) {
+                        if (status.ok()) {
+                          stats_.report_spill_replayed_bytes_.add(size);
+                        }
+                        releaseResponse(response);
+                      });
+  } else {
+    ENVOY_LOG(error, "Dropping corrupt spilled report batch of {} bytes",
+              record.bytes.size());
+  }
+  if (spill_replay_records_.empty()) {
+    spill_replay_in_progress_ = false;
+  } else {
+    spill_replay_timer_->enableTimer(
+        std::chrono::milliseconds(kReportSpillReplayIntervalMs));
+  }
+}
+
+void ClientCache::writeAggregationHandoff() {
+  handoff_active_ = true;
+  // Snapshot the check decisions first: they are owned here and the flush
+  // below does not touch them. TTLs travel as remaining durations since
+  // steady_clock epochs do not survive a process restart.
+  const auto now = time_source_.monotonicTime();
+  for (const auto& entry : last_known_good_checks_) {
+    if (now >= entry.second.expires_at) {
+      continue;
+    }
+    ::google::api::envoy::http::service_control::CheckDecisionSnapshot
+        snapshot;
+    snapshot.set_decision_key(entry.first);
+    snapshot.set_status_code(
+        static_cast<uint32_t>(entry.second.status.error_code()));
+    snapshot.set_status_message(
+        std::string(entry.second.status.error_message()));
+    snapshot.set_is_api_key_valid(entry.second.response_info.is_api_key_valid);
+    snapshot.set_service_is_activated(
+        entry.second.response_info.service_is_activated);
+    snapshot.set_consumer_project_id(
+        entry.second.response_info.consumer_project_id);
+    snapshot.set_ttl_remaining_ms(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            entry.second.expires_at - now)
+            .count());
+    AggregationHandoff::AppendRecord(checkHandoffPath(),
+                                     snapshot.SerializeAsString());
+  }
+  // With handoff_active_ up, these flushes (and the final ones the client
+  // destructors run after this) are appended to the report handoff file by
+  // sendReportRequest instead of being sent.
+  client_->FlushAll();
+  for (auto& shard : report_shard_clients_) {
+    shard->FlushAll();
+  }
+}
+
+void ClientCache::restoreAggregationHandoff() {
+  // Workers race here on startup; ConsumeRecords unlinks the file, so each
+  // record is restored by exactly one worker.
+  for (const auto& record :
+       AggregationHandoff::ConsumeRecords(reportHandoffPath())) {
+    ReportRequest request;
+    if (!request.ParseFromString(record)) {
+      ENVOY_LOG(warn, "dropping unparseable report handoff record for {}",
+                config_.service_name());
+      continue;
+    }
+    // Re-injected through the regular report path so the operations rejoin
+    // aggregation, byte accounting and the debug tallies.
+    callReport(request);
+  }
+  const auto now = std::chrono::steady_clock::now();
+  for (const auto& record :
+       AggregationHandoff::ConsumeRecords(checkHandoffPath())) {
+    ::google::api::envoy::http::service_control::CheckDecisionSnapshot
+        snapshot;
+    if (!snapshot.ParseFromString(record)) {
+      ENVOY_LOG(warn, "dropping unparseable check handoff record for {}",
+                config_.service_name());
+      continue;
+    }
+    const Status status(static_cast<Code>(snapshot.status_code()),
+                        snapshot.status_message());
+    CheckResponseInfo response_info;
+    response_info.is_api_key_valid = snapshot.is_api_key_valid();
+    response_info.service_is_activated = snapshot.service_is_activated();
+    response_info.consumer_project_id = snapshot.consumer_project_id();
+    if (shared_check_cache_ != nullptr) {
+      // The shared cache applies its own TTL from |now|; slightly longer
+      // than the remainder, which is fine for a decision that was valid a
+      // drain ago.
+      shared_check_cache_->Insert(snapshot.decision_key(), status,
+                                  response_info, now);
+    }
+    auto& lkg_entry = last_known_good_checks_[snapshot.decision_key()];
+    lkg_entry = LastKnownGoodCheck{
+        status, response_info,
+        now + std::chrono::milliseconds(snapshot.ttl_remaining_ms())};
+    const uint64_t lkg_bytes =
+        lastKnownGoodEntryBytes(snapshot.decision_key(), lkg_entry);
+    check_cache_bytes_ += lkg_bytes;
+    stats_.aggregation_buffer_bytes_.add(lkg_bytes);
+  }
+  enforceCheckCacheBudget();
+}
+
+void ClientCache::probeCheckBackend(const CheckRequest& request) {
+  auto* response = allocResponse<CheckResponse>();
+  auto on_probe_done = [this, response](const Status& status) {
+    onCheckTransportResult(status.ok());
+    releaseResponse(response);
+  };
+  auto& null_span = Envoy::Tracing::NullSpan::instance();
+  if (grpc_transport_enabled_) {
+    callGrpcCheck(request, response, on_probe_done, null_span);
+    return;
+  }
+  auto* call = check_call_factory_->createHttpCall(
+      request, null_span,
+      [on_probe_done](const Status& status, const Buffer::Instance&) {
+        on_probe_done(status);
+      });
+  call->call();
+}
+
+bool ClientCache::tryConsumeLocalQuota(
+    const std::vector<std::pair<std::string, int64_t>>& costs) {
+  for (size_t i = 0; i < costs.size(); ++i) {
+    auto& bucket = local_quota_buckets_.try_emplace(
+        costs[i].first, LocalQuotaBucket{kLocalQuotaBucketCapacity})
+        .first->second;
+    if (bucket.tokens < costs[i].second) {
+      // Refund the metrics already charged so a partially available request
+      // does not leak tokens.
+      for (size_t j = 0; j < i; ++j) {
+        local_quota_buckets_[costs[j].first].tokens += costs[j].second;
+      }
+      return false;
+    }
+    bucket.tokens -= costs[i].second;
+  }
+  return true;
+}
+
+void ClientCache::refillLocalQuota(
+    const std::vector<std::pair<std::string, int64_t>>& costs,
+    const ::google::protobuf::util::Status& converted_status) {
+  for (const auto& cost : costs) {
+    auto& bucket = local_quota_buckets_.try_emplace(
+        cost.first, LocalQuotaBucket{kLocalQuotaBucketCapacity})
+        .first->second;
+    if (converted_status.error_code() == Code::RESOURCE_EXHAUSTED) {
+      bucket.tokens = 0;
+    } else {
+      // Success, or a network failure treated as success since quota is
+      // fail open.
+      bucket.tokens =
+          std::min(bucket.tokens + cost.second, kLocalQuotaBucketCapacity);
+    }
+  }
+  std::lock_guard<std::mutex> lock(debug_state_->mutex);
+  debug_state_->local_quota_bucket_entries = local_quota_buckets_.size();
+}
+
+void ClientCache::callQuotaWithLocalBuckets(
+    const ::google::api::servicecontrol::v1::AllocateQuotaRequest& request,
+    std::function<void(const ::google::protobuf::util::Status& status)>
+        on_done) {
+  std::vector<std::pair<std::string, int64_t>> costs;
+  for (const auto& metric : request.allocate_operation().quota_metrics()) {
+    if (metric.metric_values_size() > 0) {
+      costs.emplace_back(metric.metric_name(),
+                         metric.metric_values(0).int64_value());
+    }
+  }
+
+  const bool allowed = tryConsumeLocalQuota(costs);
+
+  // Accumulate the costs under their signature; the forwarding cadence is
+  // decided per signature below, not per call, and the caller's answer
+  // never waits on it.
+  std::string signature = request.allocate_operation().consumer_id();
+  signature.push_back('\t');
+  signature.append(request.allocate_operation().method_name());
+  auto emplaced = pending_quota_.try_emplace(std::move(signature));
+  PendingQuota& pending = emplaced.first->second;
+  if (pending.interval_ms == 0) {
+    pending.interval_ms = kQuotaAggregationFlushIntervalMs;
+    pending.next_flush = time_source_.monotonicTime() +
+                         std::chrono::milliseconds(pending.interval_ms);
+  }
+  if (pending.costs.empty()) {
+    // The request proto is captured once per flush window; the flush only
+    // patches the summed costs into it.
+    pending.request = request;
+  }
+  for (const auto& cost : costs) {
+    bool merged = false;
+    for (auto& merged_cost : pending.costs) {
+      if (merged_cost.first == cost.first) {
+        merged_cost.second += cost.second;
+        merged = true;
+        break;
+      }
+    }
+    if (!merged) {
+      pending.costs.push_back(cost);
+    }
+    pending.accumulated += cost.second;
+  }
+
+  constexpr int64_t hot_threshold =
+      kLocalQuotaBucketCapacity / kQuotaFlushHotDivisor;
+  if (emplaced.second || pending.accumulated >= hot_threshold) {
+    // A signature seen for the first time flushes immediately, like the
+    // aggregator's first call used to; a hot one flushes on consumed cost
+    // rather than on the clock, so the backend learns about a burst after
+    // a bounded share of the bucket.
+    if (!emplaced.second) {
+      stats_.quota_cost_triggered_flushes_.inc();
+    }
+    pending.interval_ms = kQuotaAggregationFlushIntervalMs;
+    flushPendingQuota(emplaced.first->first, pending);
+    pending.next_flush = time_source_.monotonicTime() +
+                         std::chrono::milliseconds(pending.interval_ms);
+  }
+  armQuotaFlushTimer(pending.next_flush);
+
+  if (allowed) {
+    on_done(Status::OK);
+  } else {
+    on_done(Status(Code::RESOURCE_EXHAUSTED,
+                   "Quota exceeded for the local rate limiting bucket."));
+  }
+}
+
+void ClientCache::flushPendingQuota(const std::string& signature,
+                                    PendingQuota& pending) {
+  // Patch the summed costs into the stored request; its metric names were
+  // captured from a call of this signature, so every cost has its slot.
+  auto* operation = pending.request.mutable_allocate_operation();
+  for (auto& metric : *operation->mutable_quota_metrics()) {
+    for (const auto& cost : pending.costs) {
+      if (metric.metric_name() == cost.first &&
+          metric.metric_values_size() > 0) {
+        metric.mutable_metric_values(0)->set_int64_value(cost.second);
+        break;
+      }
+    }
+  }
+  std::vector<std::pair<std::string, int64_t>> costs;
+  costs.swap(pending.costs);
+  pending.accumulated = 0;
+
+  auto* response = allocResponse<AllocateQuotaResponse>();
+  client_->Quota(
+      pending.request, response,
+      [this, response, signature, costs](const Status& status) {
+        Status converted_status;
+        if (status.ok()) {
+          converted_status = ::google::api_proxy::service_control::
+              RequestBuilder::ConvertAllocateQuotaResponse(
+                  *response, config_.service_name());
+        } else {
+          converted_status =
+              Status(static_cast<google::protobuf::util::error::Code>(
+                         status.error_code()),
+                     status.error_message());
+        }
+        if (converted_status.error_code() == Code::RESOURCE_EXHAUSTED) {
+          // Drop the signature back to the base cadence so recovery from
+          // exhaustion is noticed within one base interval.
+          auto it = pending_quota_.find(signature);
+          if (it != pending_quota_.end()) {
+            it->second.interval_ms = kQuotaAggregationFlushIntervalMs;
+          }
+        }
+        refillLocalQuota(costs, converted_status);
+        releaseResponse(response);
+      });
+}
+
+void ClientCache::onQuotaFlushTimer() {
+  const auto now = time_source_.monotonicTime();
+  constexpr int64_t idle_threshold =
+      kLocalQuotaBucketCapacity / kQuotaFlushIdleDivisor;
+  for (auto it = pending_quota_.begin(); it != pending_quota_.end();) {
+    PendingQuota& pending = it->second;
+    if (now < pending.next_flush) {
+      ++it;
+      continue;
+    }
+    if (pending.accumulated == 0) {
+      // Nothing arrived for a whole interval; forget the signature. A
+      // later burst starts over at the base interval.
+      pending_quota_.erase(it++);
+      continue;
+    }
+    if (pending.accumulated < idle_threshold) {
+      // A trickle: coast toward the max interval.
+      pending.interval_ms =
+          std::min(pending.interval_ms * 2, kQuotaFlushMaxIntervalMs);
+    } else {
+      pending.interval_ms = kQuotaAggregationFlushIntervalMs;
+    }
+    flushPendingQuota(it->first, pending);
+    pending.next_flush = now + std::chrono::milliseconds(pending.interval_ms);
+    ++it;
+  }
+  // The timer just fired, so the cached deadline no longer pins it; re-arm
+  // for the earliest remaining deadline.
+  Envoy::MonotonicTime earliest = Envoy::MonotonicTime::max();
+  for (const auto& entry : pending_quota_) {
+    earliest = std::min(earliest, entry.second.next_flush);
+  }
+  if (earliest != Envoy::MonotonicTime::max()) {
+    quota_flush_deadline_ = earliest;
+    quota_flush_timer_->enableTimer(
+        earliest > now
+            ? std::chrono::duration_cast<std::chrono::milliseconds>(earliest -
+                                                                    now)
+            : std::chrono::milliseconds(0));
+  }
+}
+
+void ClientCache::armQuotaFlushTimer(Envoy::MonotonicTime deadline) {
+  if (quota_flush_timer_->enabled() && quota_flush_deadline_ <= deadline) {
+    return;
+  }
+  quota_flush_deadline_ = deadline;
+  const auto now = time_source_.monotonicTime();
+  quota_flush_timer_->enableTimer(
+      deadline > now
+          ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline -
+                                                                  now)
+          : std::chrono::milliseconds(0));
 }
 
 void ClientCache::callQuota(
     const ::google::api::servicecontrol::v1::AllocateQuotaRequest& request,
     std::function<void(const ::google::protobuf::util::Status& status)>
         on_done) {
-  auto* response = new AllocateQuotaResponse;
+  if (quota_auth_value_fn_().empty()) {
+    stats_.token_stale_requests_.inc();
+  }
+  if (local_quota_buckets_enabled_) {
+    callQuotaWithLocalBuckets(request, on_done);
+    return;
+  }
+
+  // Fast-deny consumers that were just denied: abusive over-quota
+  // consumers tend to be the highest-QPS ones, and while the entry is
+  // unexpired they cost one hash probe instead of an aggregator pass.
+  std::string signature = request.allocate_operation().consumer_id();
+  signature.push_back('\t');
+  signature.append(request.allocate_operation().method_name());
+  auto it = quota_negative_cache_.find(signature);
+  if (it != quota_negative_cache_.end()) {
+    if (time_source_.monotonicTime() < it->second.expires_at) {
+      stats_.quota_negative_cache_hits_.inc();
+      on_done(it->second.status);
+      return;
+    }
+    quota_negative_cache_.erase(it);
+  }
+
+  auto* response = allocResponse<AllocateQuotaResponse>();
   client_->Quota(
-      request, response, [this, response, on_done](const Status& status) {
+      request, response,
+      [this, response, signature, on_done](const Status& status) {
+        Status final_status;
         if (status.ok()) {
-          on_done(::google::api_proxy::service_control::RequestBuilder::
-                      ConvertAllocateQuotaResponse(*response,
-                                                   config_.service_name()));
+          final_status = ::google::api_proxy::service_control::RequestBuilder::
+              ConvertAllocateQuotaResponse(*response, config_.service_name());
         } else {
-          on_done(Status(static_cast<google::protobuf::util::error::Code>(
-                             status.error_code()),
-                         status.error_message()));
+          final_status =
+              Status(static_cast<google::protobuf::util::error::Code>(
+                         status.error_code()),
+                     status.error_message());
         }
-        delete response;
+        if (final_status.error_code() == Code::RESOURCE_EXHAUSTED) {
+          if (quota_negative_cache_.size() >= kQuotaNegativeCacheMaxEntries) {
+            quota_negative_cache_.clear();
+          }
+          quota_negative_cache_[signature] = QuotaNegativeEntry{
+              final_status,
+              time_source_.monotonicTime() +
+                  std::chrono::milliseconds(kQuotaNegativeCacheTtlMs)};
+        }
+        on_done(final_status);
+        releaseResponse(response);
       });
 }
 
 void ClientCache::callReport(const ReportRequest& request) {
-  auto* response = new ReportResponse;
-  client_->Report(request, response,
-                  [response](const Status&) { delete response; });
+  if (sc_auth_value_fn_().empty()) {
+    stats_.token_stale_requests_.inc();
+  }
+  {
+    std::lock_guard<std::mutex> lock(debug_state_->mutex);
+    for (const auto& operation : request.operations()) {
+      ++debug_state_->reported_ops_per_operation[operation.operation_name()];
+    }
+  }
+  const uint64_t inflow_bytes = request.ByteSizeLong();
+  if (!report_shard_clients_.empty()) {
+    callShardedReport(request);
+  } else {
+    auto* response = allocResponse<ReportResponse>();
+    client_->Report(request, response, [this, response](const Status&) {
+      releaseResponse(response);
+    });
+  }
+  // Counted after the dispatch so an over-budget forced flush already
+  // includes this request's operations.
+  accountReportInflow(inflow_bytes);
+}
+
+void ClientCache::callShardedReport(const ReportRequest& request) {
+  // Partition the batch by operation name so every signature consistently
+  // lands in the same shard and keeps aggregating there.
+  std::vector<ReportRequest> shard_requests(report_shard_clients_.size());
+  for (const auto& operation : request.operations()) {
+    const size_t shard = std::hash<std::string>()(operation.operation_name()) %
+                         shard_requests.size();
+    ReportRequest& shard_request = shard_requests[shard];
+    if (shard_request.operations_size() == 0) {
+      shard_request.set_service_name(request.service_name());
+      shard_request.set_service_config_id(request.service_config_id());
+    }
+    *shard_request.add_operations() = operation;
+  }
+  for (size_t i = 0; i < shard_requests.size(); ++i) {
+    if (shard_requests[i].operations_size() == 0) {
+      continue;
+    }
+    auto* response = allocResponse<ReportResponse>();
+    report_shard_clients_[i]->Report(
+        shard_requests[i], response,
+        [this, response](const Status&) { releaseResponse(response); });
+  }
 }
 
 }  // namespace ServiceControl
@@ -14,15 +14,32 @@
 
 #pragma once
 
+#include <chrono>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
 #include "api/envoy/http/service_control/config.pb.h"
 #include "common/common/logger.h"
+#include "common/grpc/typed_async_client.h"
 #include "envoy/event/dispatcher.h"
+#include "envoy/grpc/async_client_manager.h"
+#include "envoy/stats/scope.h"
 #include "envoy/tracing/http_tracer.h"
 #include "envoy/upstream/cluster_manager.h"
+#include "google/protobuf/arena.h"
 #include "include/service_control_client.h"
 #include "src/api_proxy/service_control/request_info.h"
+#include "src/envoy/http/service_control/client_cache_debug.h"
+#include "src/envoy/http/service_control/endpoint_health.h"
+#include "src/envoy/http/service_control/filter_stats.h"
 #include "src/envoy/http/service_control/http_call.h"
+#include "src/envoy/http/service_control/invalid_key_gate.h"
+#include "src/envoy/http/service_control/report_spill_journal.h"
 #include "src/envoy/http/service_control/service_control_callback_func.h"
+#include "src/envoy/http/service_control/shared_check_cache.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -37,13 +54,47 @@ class ClientCache : public Logger::Loggable<Logger::Id::filter> {
       const ::google::api::envoy::http::service_control::FilterConfig&
           filter_config,
       Upstream::ClusterManager& cm, Envoy::TimeSource& time_source,
-      Event::Dispatcher& dispatcher,
-      std::function<const std::string&()> sc_token_fn,
-      std::function<const std::string&()> quota_token_fn);
+      Event::Dispatcher& dispatcher, Stats::Scope& scope,
+      ServiceControlFilterStats& stats,
+      std::function<const std::string&()> sc_auth_value_fn,
+      std::function<const std::string&()> quota_auth_value_fn);
+
+  ~ClientCache();
 
+  // Make one check call. The returned cancel function may only be invoked
+  // before on_done has fired; afterwards the per-call state may already be
+  // serving another call.
+  //
+  // When |precomputed_decision_key| is set it must be the decision key of
+  // this call ("consumer_id\toperation"), the caller must already have
+  // probed the shared cache with it through tryCompleteCheckFromCache, and
+  // it only needs to stay valid for the duration of this call: the key is
+  // copied into the per-call state instead of being re-derived from the
+  // request and the shared cache is not probed a second time.
   CancelFunc callCheck(
       const ::google::api::servicecontrol::v1::CheckRequest& request,
-      Envoy::Tracing::Span& parent_span, CheckDoneFunc on_done);
+      Envoy::Tracing::Span& parent_span, CheckDoneFunc on_done,
+      const std::string* precomputed_decision_key = nullptr);
+
+  // Answers the check from the shared cache when it holds an unexpired
+  // decision for |decision_key|, running on_done (possibly inline) with the
+  // cached result; returns false on a miss without touching on_done. Lets a
+  // caller that can derive the decision key without building the
+  // CheckRequest skip the request construction entirely for repeat
+  // consumers. |operation_name| is only used for the debug counters.
+  bool tryCompleteCheckFromCache(const std::string& decision_key,
+                                 absl::string_view operation_name,
+                                 const CheckDoneFunc& on_done);
+
+  // Denies the check outright when |api_key| is in the invalid-key gate,
+  // running on_done (possibly inline) with the precomputed denial; returns
+  // false when the gate is disabled or does not hold the key. Cheaper than
+  // any cache probe: no RPC, no request proto and no cache entry, so a
+  // key-guessing bot cannot evict legitimate consumers. |operation_name|
+  // is only used for the debug counters.
+  bool tryDenyFromInvalidKeyGate(absl::string_view api_key,
+                                 absl::string_view operation_name,
+                                 const CheckDoneFunc& on_done);
 
   void callQuota(
       const ::google::api::servicecontrol::v1::AllocateQuotaRequest& request,
@@ -57,19 +108,496 @@ class ClientCache : public Logger::Loggable<Logger::Id::filter> {
       const ::google::api::envoy::http::service_control::FilterConfig&
           filter_config);
 
+  // The consumer project id for an api key, cached together with the
+  // formatted header value. A key's project id is stable, so repeated
+  // checks for a known key reuse the formatted string instead of
+  // re-materializing it from the response proto.
+  struct ConsumerProjectId {
+    uint64_t project_number = 0;
+    std::string value;
+  };
+
+  // A check decision kept to ride through service control outages. After
+  // several consecutive transport failures the worker serves these instead
+  // of issuing doomed remote calls, probing the backend at a low background
+  // rate until it recovers.
+  struct LastKnownGoodCheck {
+    ::google::protobuf::util::Status status;
+    ::google::api_proxy::service_control::CheckResponseInfo response_info;
+    std::chrono::steady_clock::time_point expires_at;
+  };
+
+  // A quota denial kept for a short TTL to fast-deny the same consumer
+  // without another pass through the quota path.
+  struct QuotaNegativeEntry {
+    ::google::protobuf::util::Status status;
+    std::chrono::steady_clock::time_point expires_at;
+  };
+
+  // Per-call continuation state for callCheck. One pooled instance carries
+  // everything the call's completion paths need — the caller's callback,
+  // the budget timer, the coalescing and circuit flags, the response
+  // proto — so the closures handed to the client library, the timer and
+  // the caller each capture only a pointer to it and stay within
+  // std::function's inline storage: a check call allocates no closures.
+  // Per-worker, dispatcher-thread only.
+  struct CheckCallState {
+    // The owning cache; stored so the transport closures can capture the
+    // state pointer alone.
+    ClientCache* cache = nullptr;
+    // The caller's completion callback.
+    CheckDoneFunc on_done;
+    // Bumped on recycle. The caller-held cancel function re-checks it and
+    // no-ops once the state serves another call.
+    uint64_t generation = 0;
+    // Pinning references: the in-flight client completion and, for a
+    // coalesced follower, the leader's follower list.
+    uint32_t refs = 0;
+    Envoy::MonotonicTime blocked_start;
+    // Set once the caller got its answer (real completion, budget timer or
+    // cancel); later completions are dropped.
+    bool done = false;
+    // Set when the caller's stream reset before the answer arrived.
+    bool cancelled = false;
+    // Set when this call leads a remote call followers may coalesce onto.
+    bool is_leader = false;
+    // Set when the transport actually issued a remote call (cache miss).
+    bool remote_called = false;
+    // Set when the circuit breaker fast-failed the remote call.
+    bool circuit_fast_failed = false;
+    std::string decision_key;
+    std::string consumer_id;
+    // Response storage handed to the client library; pooled with the rest.
+    ::google::api::servicecontrol::v1::CheckResponse response;
+    // The transport completion handed in by the client library.
+    ::google::service_control_client::TransportDoneFunc transport_done;
+    // Lazily created once per pooled state and reused across the calls it
+    // serves; disarmed, not destroyed, on delivery.
+    Event::TimerPtr budget_timer;
+    CancelFunc transport_cancel;
+  };
+
+  // Returns a (re)initialized state, reusing one from the per-worker free
+  // list when available.
+  CheckCallState* acquireCheckCallState();
+  // Returns the state to the free list (keeping string, proto and timer
+  // capacity) or frees it when the list is full.
+  void releaseCheckCallState(CheckCallState* state);
+  // Drops one pinning reference; the last one releases the state.
+  void unrefCheckCallState(CheckCallState* state);
+  // Delivers one answer to the caller exactly once: disarms the budget
+  // timer, records the blocked time and runs on_done, unless the budget
+  // timer or a cancel got there first.
+  void deliverCheckResult(
+      CheckCallState* state, const ::google::protobuf::util::Status& status,
+      const ::google::api_proxy::service_control::CheckResponseInfo&
+          response_info);
+  // The caller-held cancel path: suppresses the callback and, for a
+  // leader, tears down the remote call unless followers still ride on it.
+  void cancelCheckCall(CheckCallState* state);
+
+  // A remote check call currently in flight. Later lookups with the same
+  // decision key park their state here instead of issuing their own remote
+  // call, and everyone completes with the leader's result; each parked
+  // state is pinned by one reference until then.
+  struct PendingCheckCall {
+    std::vector<CheckCallState*> followers;
+  };
+
+  // Records whether a remote check call reached the backend; enters outage
+  // mode after repeated transport failures and leaves it on the first
+  // success.
+  void onCheckTransportResult(bool ok);
+
+  // Sends a background check to test whether the backend recovered; only
+  // the outage state is updated from its outcome.
+  void probeCheckBackend(
+      const ::google::api::servicecontrol::v1::CheckRequest& request);
+
+  // Consults the endpoint's shared circuit breaker and refreshes its state
+  // gauge. Returns false when the call should fast-fail instead of going
+  // out; while the circuit is open one call per probe interval still gets
+  // through as the half-open probe.
+  bool circuitAllows(EndpointHealth& health, Stats::Gauge& state_gauge);
+
+  // Feeds one transport outcome into the shared circuit breaker and
+  // refreshes its state gauge.
+  void recordCircuitResult(EndpointHealth& health, Stats::Gauge& state_gauge,
+                           bool ok, std::chrono::microseconds latency);
+
+  // Counts |bytes| of report operations entering the aggregators against
+  // the aggregation memory budget; when over budget, forces all
+  // aggregators to flush and resets the accounting.
+  void accountReportInflow(uint64_t bytes);
+
+  // Releases flushed report bytes from the accounting. The estimate only
+  // ever overshoots (merged operations were counted at pre-merge size), so
+  // the release clamps at zero.
+  void releaseReportBytes(uint64_t bytes);
+
+  // Approximate heap bytes of one cached last-known-good decision.
+  static uint64_t lastKnownGoodEntryBytes(const std::string& key,
+                                          const LastKnownGoodCheck& entry);
+
+  // Releases the bytes of an erased or replaced last-known-good entry from
+  // the accounting, clamped at zero.
+  void releaseCheckCacheBytes(uint64_t bytes);
+
+  // Evicts last-known-good entries (expired ones first) while their byte
+  // estimate exceeds the aggregation memory budget.
+  void enforceCheckCacheBudget();
+
+  // Snapshots the live check decisions and forces a final flush of the
+  // report aggregators into the handoff files; runs in the destructor when
+  // a handoff directory is configured. Report flushes issued from here on
+  // are written to the file instead of the network.
+  void writeAggregationHandoff();
+
+  // Consumes a previous process's handoff files: pending reports are
+  // re-injected into the aggregators like fresh traffic, check decisions
+  // go into the shared check cache (when enabled) and the last-known-good
+  // cache. The files are claimed by the first worker to start; the others
+  // find nothing.
+  void restoreAggregationHandoff();
+
+  std::string reportHandoffPath() const;
+  std::string checkHandoffPath() const;
+
+  // Whether failed report batches are journaled to disk instead of being
+  // dropped. Needs both the byte cap and a handoff directory.
+  bool reportSpillEnabled() const {
+    return report_spill_max_bytes_ > 0 &&
+           !aggregation_handoff_directory_.empty();
+  }
+  std::string reportSpillPath() const;
+
+  // Journals one serialized failed report batch, counting the spill or the
+  // drop when the journal is at its cap.
+  void spillReportBytes(std::string&& bytes);
+
+  // Claims the spill journal after a successful report send and starts the
+  // replay timer; no-op while a replay is already running or the journal is
+  // known to be empty.
+  void maybeReplaySpilledReports();
+
+  // Sends the next claimed batch through the regular report path; a failed
+  // replay re-enters the journal through the spill wrapper.
+  void replayNextSpilledReport();
+
+  // A locally enforced token bucket for one quota metric. ClientCache is
+  // per-worker and all access runs on its dispatcher thread, so plain
+  // arithmetic replaces atomics; the bucket never blocks on the aggregator.
+  struct LocalQuotaBucket {
+    int64_t tokens;
+  };
+
+  // Consumes each metric's cost from its bucket. Either all metrics are
+  // charged or none: on a depleted bucket the already-consumed costs are
+  // refunded and false is returned.
+  bool tryConsumeLocalQuota(
+      const std::vector<std::pair<std::string, int64_t>>& costs);
+
+  // Applies the outcome of the forwarded AllocateQuota call: refunds the
+  // consumed costs on success or network failure (quota is fail open), and
+  // drains the buckets when the server reports exhaustion.
+  void refillLocalQuota(
+      const std::vector<std::pair<std::string, int64_t>>& costs,
+      const ::google::protobuf::util::Status& converted_status);
+
+  // Costs of one quota signature accumulated between adaptive flushes,
+  // plus the request proto they are patched into when the flush goes out.
+  struct PendingQuota {
+    std::vector<std::pair<std::string, int64_t>> costs;
+    int64_t accumulated = 0;
+    // Current flush interval; 0 until the entry is initialized. Doubles
+    // while the signature trickles, up to the max, and resets to the base
+    // on heavy consumption or a denial.
+    uint32_t interval_ms = 0;
+    Envoy::MonotonicTime next_flush;
+    ::google::api::servicecontrol::v1::AllocateQuotaRequest request;
+  };
+
+  // Enforces quota against the local buckets and answers immediately. The
+  // accumulated costs are forwarded on an adaptive per-signature cadence,
+  // only to replenish the buckets: hot signatures flush as soon as their
+  // accumulated cost crosses a fraction of the bucket capacity, idle ones
+  // coast to a long max interval.
+  void callQuotaWithLocalBuckets(
+      const ::google::api::servicecontrol::v1::AllocateQuotaRequest& request,
+      QuotaDoneFunc on_done);
+
+  // Forwards one signature's accumulated costs as a single AllocateQuota
+  // call, patched into its stored request, and replenishes the local
+  // buckets from the outcome. A denial drops the signature's interval back
+  // to the base so recovery from exhaustion is probed quickly.
+  void flushPendingQuota(const std::string& signature, PendingQuota& pending);
+
+  // Flushes every pending signature past its deadline, ages the intervals
+  // of trickling signatures toward the max, forgets signatures that stayed
+  // idle for a whole interval, and re-arms the timer for the earliest
+  // remaining deadline.
+  void onQuotaFlushTimer();
+
+  // Arms the flush timer for |deadline| unless it is already armed for an
+  // earlier one, keeping the per-call cost of the hot path constant.
+  void armQuotaFlushTimer(Envoy::MonotonicTime deadline);
+
+  // Sends the request over the async gRPC client, recording call latency and
+  // honoring the HTTP transports' contract: the response is filled and
+  // on_done invoked exactly once. Returns a cancel function, or nullptr when
+  // the call already completed inline.
+  CancelFunc callGrpcCheck(
+      const ::google::api::servicecontrol::v1::CheckRequest& request,
+      ::google::api::servicecontrol::v1::CheckResponse* response,
+      ::google::service_control_client::TransportDoneFunc on_done,
+      Envoy::Tracing::Span& parent_span);
+
+  void callGrpcQuota(
+      const ::google::api::servicecontrol::v1::AllocateQuotaRequest& request,
+      ::google::api::servicecontrol::v1::AllocateQuotaResponse* response,
+      ::google::service_control_client::TransportDoneFunc on_done);
+
+  void callGrpcReport(
+      const ::google::api::servicecontrol::v1::ReportRequest& request,
+      ::google::api::servicecontrol::v1::ReportResponse* response,
+      ::google::service_control_client::TransportDoneFunc on_done);
+
+  // Partitions the batched request's operations by operation-name hash and
+  // hands each partition to its report shard client, so every signature
+  // keeps aggregating in the same shard.
+  void callShardedReport(
+      const ::google::api::servicecontrol::v1::ReportRequest& request);
+
+  // Hands one flushed ReportRequest to the background serialization
+  // pipeline; the pipeline posts the send of the finished bytes back to
+  // this worker's dispatcher. When the pipeline is saturated the flush is
+  // dropped, counted in report_flush_dropped, and on_done fires with
+  // UNAVAILABLE.
+  void sendReportViaPipeline(
+      const ::google::api::servicecontrol::v1::ReportRequest& request,
+      ::google::api::servicecontrol::v1::ReportResponse* response,
+      ::google::service_control_client::TransportDoneFunc on_done);
+
+  // Sends one flushed ReportRequest over the configured transport.
+  void sendReportRequest(
+      const ::google::api::servicecontrol::v1::ReportRequest& request,
+      ::google::api::servicecontrol::v1::ReportResponse* response,
+      ::google::service_control_client::TransportDoneFunc on_done);
+
+  // Sends pre-split report chunks starting at `index`, one chunk per
+  // dispatcher iteration. on_done fires once after the last chunk, with the
+  // first non-OK chunk status if any chunk failed.
+  void sendReportChunks(
+      std::shared_ptr<
+          std::vector<::google::api::servicecontrol::v1::ReportRequest>>
+          chunks,
+      size_t index,
+      std::shared_ptr<::google::protobuf::util::Status> first_error,
+      ::google::service_control_client::TransportDoneFunc on_done);
+
+  // Allocates the response proto of a fire-and-forget call on the reusable
+  // response arena, or on the heap while the arena is over its byte cap.
+  // Must be paired with exactly one releaseResponse from the call's
+  // completion.
+  template <typename ResponseType>
+  ResponseType* allocResponse() {
+    if (response_arena_.SpaceAllocated() > kResponseArenaMaxBytes) {
+      // Overlapping calls have kept the arena from resetting for a while;
+      // the dead responses it retains are reclaimed only on reset, so new
+      // allocations go to the heap instead of growing it further.
+      return new ResponseType;
+    }
+    ++live_arena_responses_;
+    return ::google::protobuf::Arena::CreateMessage<ResponseType>(
+        &response_arena_);
+  }
+
+  // Releases one allocResponse allocation; the arena is reset as soon as no
+  // allocation is live, which under typical traffic is at the end of every
+  // completion callback.
+  void releaseResponse(::google::protobuf::Message* response);
+
   const ::google::api::envoy::http::service_control::Service& config_;
+  // The filter stats; calls record latency, cache and batching metrics here.
+  ServiceControlFilterStats& stats_;
+  Envoy::TimeSource& time_source_;
+  // The worker's dispatcher; chunked report flushes are spread over it.
+  Event::Dispatcher& dispatcher_;
+  // Return the preformatted Authorization header value ("Bearer <token>"),
+  // formatted when the token callback fires; empty until a token was
+  // fetched, which also flags calls attempted before the first token.
+  std::function<const std::string&()> sc_auth_value_fn_;
+  std::function<const std::string&()> quota_auth_value_fn_;
   bool network_fail_open_;
+  bool local_quota_buckets_enabled_;
+  // Metric name to bucket; per-worker, dispatcher-thread only.
+  absl::flat_hash_map<std::string, LocalQuotaBucket> local_quota_buckets_;
+
+  // Quota signature ("consumer_id\tmethod") to its accumulated costs
+  // awaiting the next adaptive flush; per-worker, dispatcher-thread only.
+  absl::flat_hash_map<std::string, PendingQuota> pending_quota_;
+  // Fires at the earliest pending deadline; only created when local quota
+  // buckets are enabled.
+  Event::TimerPtr quota_flush_timer_;
+  // The deadline the timer is currently armed for, valid while it is
+  // enabled; an earlier deadline re-arms it, a later one leaves it alone.
+  Envoy::MonotonicTime quota_flush_deadline_;
+
+  // Check consumer id ("api_key:<key>") to its cached project id;
+  // per-worker, dispatcher-thread only.
+  absl::flat_hash_map<std::string, ConsumerProjectId> consumer_project_ids_;
+
+  // Decision key ("consumer_id\toperation") to the last successful check
+  // decision; per-worker, dispatcher-thread only. Entries expire on the
+  // check aggregation TTL, so outage mode never serves a decision longer
+  // than the aggregation cache would have.
+  absl::flat_hash_map<std::string, LastKnownGoodCheck> last_known_good_checks_;
+
+  // Quota signature ("consumer_id\tmethod") to a recent quota denial;
+  // per-worker, dispatcher-thread only. While an entry is unexpired the
+  // consumer is denied with the cached status without running the quota
+  // path, so over-quota consumers — typically the highest-QPS ones — cost
+  // one hash probe per request instead of an aggregator pass.
+  absl::flat_hash_map<std::string, QuotaNegativeEntry> quota_negative_cache_;
+
+  // Decision key to the remote check call currently in flight for it;
+  // per-worker, dispatcher-thread only. Entries live exactly as long as
+  // their remote call.
+  absl::flat_hash_map<std::string, PendingCheckCall> pending_check_calls_;
+  // Recycled per-call check states; per-worker, dispatcher-thread only.
+  std::vector<std::unique_ptr<CheckCallState>> check_call_state_pool_;
+  uint32_t consecutive_check_failures_{0};
+  bool check_outage_{false};
+  // Earliest time the next background probe may be sent in outage mode.
+  std::chrono::steady_clock::time_point next_outage_probe_;
+
+  // Process-wide health trackers for the check and quota endpoints, shared
+  // with the other workers' ClientCache instances. Their circuit breakers
+  // fast-fail remote calls while an endpoint is degraded, so the first
+  // workers to see an outage spare the rest from burning a transport
+  // timeout per call. Complements the per-worker outage mode above, which
+  // decides what to answer; the breaker decides whether to call at all.
+  std::shared_ptr<EndpointHealth> check_health_;
+  std::shared_ptr<EndpointHealth> quota_health_;
+
+  // This worker's entry in the process-wide debug registry; the admin debug
+  // handler reads it, this cache keeps its counters current.
+  std::shared_ptr<ClientCacheDebugState> debug_state_;
 
   // the configurable timeouts
   uint32_t check_timeout_ms_;
   uint32_t report_timeout_ms_;
   uint32_t quota_timeout_ms_;
 
+  // Flushed ReportRequests above this byte size are split into chunks of at
+  // most this size; 0 disables splitting.
+  uint32_t report_flush_chunk_bytes_;
+
+  // Wall-clock cap on how long a request waits for its check decision
+  // across all retries; 0 disables the budget.
+  uint32_t check_budget_ms_;
+
+  // Check/Report HTTP bodies of at least this many bytes are
+  // gzip-compressed before sending; 0 disables compression.
+  uint32_t request_compression_min_bytes_;
+
+  // A Check call unanswered after this many milliseconds launches one
+  // parallel hedge request; 0 disables hedging.
+  uint32_t check_hedge_delay_ms_;
+
+  // Spawn a child tracing span for only one of every this many Check
+  // calls; 0 traces every call of a traced request.
+  uint32_t trace_call_sample_every_n_;
+
+  // Number of independent report aggregation shards; 0 or 1 keeps the
+  // single aggregator in client_.
+  uint32_t report_aggregation_shards_;
+
+  // Approximate per-worker byte budget for buffered aggregation state;
+  // 0 disables byte accounting.
+  uint32_t aggregation_memory_budget_bytes_;
+
+  // Cap in bytes on the disk journal for failed report batches; 0 disables
+  // the spill. Only effective together with a handoff directory, which is
+  // where the journal file lives.
+  uint32_t report_spill_max_bytes_;
+  // Spilled batches claimed from the journal and not yet replayed; drained
+  // one batch per replay tick, written back to the journal on teardown.
+  std::vector<ReportSpillJournal::Record> spill_replay_records_;
+  // Lazily created; paces the replay to one batch per tick.
+  Event::TimerPtr spill_replay_timer_;
+  bool spill_replay_in_progress_{false};
+  // Skips the filesystem probe on report successes while the journal is
+  // known to be empty; starts true to pick up a previous process's spill.
+  bool spill_journal_may_have_data_{true};
+
+  // Directory for drain-time handoff files; empty disables the handoff.
+  std::string aggregation_handoff_directory_;
+  // Set once the destructor starts the handoff: report flushes are written
+  // to the handoff file instead of being sent, since the network path
+  // cannot complete while the process drains.
+  bool handoff_active_{false};
+  // Estimated bytes of aggregated-but-unflushed report operations.
+  uint64_t report_buffer_bytes_{0};
+  // Estimated bytes of the last-known-good check decision cache.
+  uint64_t check_cache_bytes_{0};
+
   // the configurable retries
   uint32_t check_retries_;
   uint32_t report_retries_;
   uint32_t quota_retries_;
 
+  // The process-wide second-level check cache, shared with the ClientCache
+  // instances of other workers. Null unless enabled in the config.
+  std::shared_ptr<SharedCheckCache> shared_check_cache_;
+
+  // The process-wide rotating filter of recently-denied api keys, shared
+  // with the ClientCache instances of other workers. Null unless enabled
+  // in the config.
+  std::shared_ptr<InvalidKeyGate> invalid_key_gate_;
+
+  // True when report flushes are serialized on the shared background
+  // pipeline thread instead of inline on the dispatcher.
+  bool report_flush_pipeline_enabled_;
+  // Cleared by the destructor before the members go away. Pipeline
+  // completions posted to the dispatcher hold a reference and bail out when
+  // it is false, so a flush in flight across destruction never touches the
+  // destroyed cache.
+  std::shared_ptr<bool> alive_;
+
+  // True when calls go over the async gRPC client instead of per-call HTTP
+  // requests.
+  bool grpc_transport_enabled_;
+  // Per-worker typed gRPC clients and resolved method descriptors; only set
+  // when the gRPC transport is enabled. One HTTP/2 connection multiplexes
+  // the in-flight calls of a worker.
+  Grpc::AsyncClient<::google::api::servicecontrol::v1::CheckRequest,
+                    ::google::api::servicecontrol::v1::CheckResponse>
+      grpc_check_client_;
+  Grpc::AsyncClient<::google::api::servicecontrol::v1::AllocateQuotaRequest,
+                    ::google::api::servicecontrol::v1::AllocateQuotaResponse>
+      grpc_quota_client_;
+  Grpc::AsyncClient<::google::api::servicecontrol::v1::ReportRequest,
+                    ::google::api::servicecontrol::v1::ReportResponse>
+      grpc_report_client_;
+  const ::google::protobuf::MethodDescriptor* check_method_{nullptr};
+  const ::google::protobuf::MethodDescriptor* quota_method_{nullptr};
+  const ::google::protobuf::MethodDescriptor* report_method_{nullptr};
+
+  // Retained arena bytes beyond which allocResponse falls back to the heap
+  // until the next reset.
+  static constexpr uint64_t kResponseArenaMaxBytes = 64 * 1024;
+  // Reusable arena for the response protos of fire-and-forget calls
+  // (report sends, outage probes, quota replenishes). Those responses are
+  // parsed at completion, read only inside the completion callback and
+  // dropped, so in the steady state one arena block is reused forever
+  // instead of a heap new/delete pair per call. Declared before the
+  // factories and clients below: their destructors run callbacks that
+  // release into it. Per-worker, dispatcher-thread only.
+  ::google::protobuf::Arena response_arena_;
+  // Live allocResponse allocations; the arena resets when this drops to 0.
+  uint32_t live_arena_responses_{0};
+
   // the http call factories
   std::unique_ptr<HttpCallFactory> check_call_factory_;
   std::unique_ptr<HttpCallFactory> quota_call_factory_;
@@ -81,6 +609,13 @@ class ClientCache : public Logger::Loggable<Logger::Id::filter> {
   // as the last one to make sure it is destroyed first.
   std::unique_ptr<::google::service_control_client::ServiceControlClient>
       client_;
+  // Report-only clients for the sharded aggregation mode; empty when
+  // report_aggregation_shards is unset or below 2. Like client_, these are
+  // last so their destructor flushes run before the transport state goes
+  // away.
+  std::vector<
+      std::unique_ptr<::google::service_control_client::ServiceControlClient>>
+      report_shard_clients_;
 };
 
 }  // namespace ServiceControl
@@ -0,0 +1,124 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/client_cache_debug.h"
+
+#include <algorithm>
+
+#include "absl/strings/str_cat.h"
+#include "src/envoy/http/service_control/report_flush_pipeline.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+// Minimal JSON string escaping; operation names and service names only
+// contain selector characters, but a config typo must not break the dump.
+std::string jsonEscape(const std::string& value) {
+  std::string out;
+  out.reserve(value.size());
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+    }
+    out.push_back(c);
+  }
+  return out;
+}
+
+void appendOperationMap(
+    std::string* out, const char* key,
+    const absl::flat_hash_map<std::string, uint64_t>& counts) {
+  absl::StrAppend(out, ",\"", key, "\":{");
+  bool first = true;
+  for (const auto& entry : counts) {
+    absl::StrAppend(out, first ? "" : ",", "\"", jsonEscape(entry.first),
+                    "\":", entry.second);
+    first = false;
+  }
+  absl::StrAppend(out, "}");
+}
+
+void appendCircuit(std::string* out, const char* key,
+                   const std::shared_ptr<EndpointHealth>& health) {
+  if (health == nullptr) {
+    return;
+  }
+  absl::StrAppend(
+      out, ",\"", key,
+      "\":{\"state\":", static_cast<uint64_t>(health->circuit()),
+      ",\"latency_ewma_us\":", static_cast<uint64_t>(health->latencyEwmaUs()),
+      "}");
+}
+
+}  // namespace
+
+ClientCacheDebugRegistry& ClientCacheDebugRegistry::instance() {
+  // Leaked so the admin handler may run during shutdown.
+  static ClientCacheDebugRegistry* registry = new ClientCacheDebugRegistry;
+  return *registry;
+}
+
+void ClientCacheDebugRegistry::Add(
+    const std::shared_ptr<ClientCacheDebugState>& state) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  states_.erase(
+      std::remove_if(states_.begin(), states_.end(),
+                     [](const std::weak_ptr<ClientCacheDebugState>& entry) {
+                       return entry.expired();
+                     }),
+      states_.end());
+  states_.push_back(state);
+}
+
+std::string ClientCacheDebugRegistry::DumpJson() {
+  std::string out =
+      absl::StrCat("{\"report_flush_pipeline_depth\":",
+                   ReportFlushPipeline::instance().QueueDepth(), ",\"workers\":[");
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool first = true;
+  for (const auto& entry : states_) {
+    auto state = entry.lock();
+    if (state == nullptr) {
+      continue;
+    }
+    std::lock_guard<std::mutex> state_lock(state->mutex);
+    absl::StrAppend(
+        &out, first ? "" : ",",
+        "{\"service\":\"", jsonEscape(state->service_name), "\"",
+        ",\"last_known_good_entries\":", state->last_known_good_entries,
+        ",\"pending_check_calls\":", state->pending_check_calls,
+        ",\"consumer_project_id_entries\":",
+        state->consumer_project_id_entries,
+        ",\"local_quota_bucket_entries\":",
+        state->local_quota_bucket_entries);
+    appendCircuit(&out, "check_circuit", state->check_health);
+    appendCircuit(&out, "quota_circuit", state->quota_health);
+    appendOperationMap(&out, "check_calls_per_operation",
+                       state->check_calls_per_operation);
+    appendOperationMap(&out, "reported_ops_per_operation",
+                       state->reported_ops_per_operation);
+    absl::StrAppend(&out, "}");
+    first = false;
+  }
+  absl::StrAppend(&out, "]}");
+  return out;
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
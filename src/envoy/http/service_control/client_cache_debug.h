@@ -0,0 +1,78 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "src/envoy/http/service_control/endpoint_health.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Occupancy counters and per-operation tallies of one worker's ClientCache,
+// kept aside so the admin debug handler can read them from the main thread.
+// The owning ClientCache updates the fields on its dispatcher thread; all
+// access goes through |mutex|.
+struct ClientCacheDebugState {
+  std::mutex mutex;
+  std::string service_name;
+  // Entry counts of the caches the ClientCache owns directly. The client
+  // library's aggregation caches are not introspectable from here; their
+  // effect shows up in the per-operation call tallies below instead.
+  uint64_t last_known_good_entries = 0;
+  uint64_t pending_check_calls = 0;
+  uint64_t consumer_project_id_entries = 0;
+  uint64_t local_quota_bucket_entries = 0;
+  // Check lookups and reported operations per operation name, counted
+  // before aggregation; comparing them with the stats counters shows how
+  // much each operation's traffic the aggregators absorb.
+  absl::flat_hash_map<std::string, uint64_t> check_calls_per_operation;
+  absl::flat_hash_map<std::string, uint64_t> reported_ops_per_operation;
+  // The endpoint circuit breakers; thread safe on their own, held here so
+  // the dump can include their state and latency EWMA.
+  std::shared_ptr<EndpointHealth> check_health;
+  std::shared_ptr<EndpointHealth> quota_health;
+};
+
+// Process-wide registry of the live per-worker debug states, walked by the
+// admin handler. States are held weak so a drained listener config's
+// ClientCache (and its state) can go away underneath it.
+class ClientCacheDebugRegistry {
+ public:
+  static ClientCacheDebugRegistry& instance();
+
+  void Add(const std::shared_ptr<ClientCacheDebugState>& state);
+
+  // One JSON object: process-wide figures plus an array entry per live
+  // worker state.
+  std::string DumpJson();
+
+ private:
+  ClientCacheDebugRegistry() = default;
+
+  std::mutex mutex_;
+  std::vector<std::weak_ptr<ClientCacheDebugState>> states_;
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -14,7 +14,10 @@
 
 #include "src/envoy/http/service_control/config_parser.h"
 
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
 #include "common/protobuf/utility.h"
+#include "src/envoy/utils/operation_interner.h"
 
 using ::google::api::envoy::http::service_control::FilterConfig;
 
@@ -26,10 +29,24 @@ namespace {
 
 // The operation name for not matched requests.
 const char kUnrecognizedOperation[] = "<Unknown Operation Name>";
+
+std::unique_ptr<PerOperationStats> generatePerOperationStats(
+    absl::string_view operation, Stats::Scope& scope,
+    const std::string& stats_prefix) {
+  const std::string final_prefix = absl::StrCat(
+      stats_prefix, "service_control.per_operation.", operation, ".");
+  return std::make_unique<PerOperationStats>(PerOperationStats{
+      ALL_PER_OPERATION_FILTER_STATS(POOL_COUNTER_PREFIX(scope, final_prefix),
+                                     POOL_HISTOGRAM_PREFIX(scope,
+                                                           final_prefix))});
+}
+
 }  // namespace
 
 FilterConfigParser::FilterConfigParser(const FilterConfig& config,
-                                       ServiceControlCallFactory& factory)
+                                       ServiceControlCallFactory& factory,
+                                       Stats::Scope* scope,
+                                       const std::string& stats_prefix)
     : config_(config) {
   ServiceContext* first_srv_ctx = nullptr;
   for (const auto& service : config_.services()) {
@@ -52,7 +69,8 @@ FilterConfigParser::FilterConfigParser(const FilterConfig& config,
     if (service_it == service_map_.end()) {
       throw ProtoValidationException("Invalid service name", requirement);
     }
-    requirements_map_.emplace(requirement.operation_name(),
+    requirements_map_.emplace(Utils::OperationInterner::instance().InternName(
+                                  requirement.operation_name()),
                               RequirementContextPtr(new RequirementContext(
                                   requirement, *service_it->second)));
   }
@@ -62,6 +80,34 @@ FilterConfigParser::FilterConfigParser(const FilterConfig& config,
     throw ProtoValidationException("Duplicated operation names", config_);
   }
 
+  // Preallocate the opt-in per-operation stat handles for the selected
+  // operations, so recording at report time is a handle dereference rather
+  // than a stats-name lookup.
+  if (scope != nullptr && config_.has_sc_calling_config() &&
+      config_.sc_calling_config().per_operation_stats_selectors_size() > 0) {
+    absl::flat_hash_set<absl::string_view> selected;
+    for (const auto& selector :
+         config_.sc_calling_config().per_operation_stats_selectors()) {
+      selected.insert(selector);
+    }
+    for (auto& it : requirements_map_) {
+      if (selected.contains(it.first)) {
+        it.second->set_per_operation_stats(
+            generatePerOperationStats(it.first, *scope, stats_prefix));
+      }
+    }
+  }
+
+  // Index the requirements by their interned operation id. Built after the
+  // map is complete so the stored pointers are final.
+  for (const auto& it : requirements_map_) {
+    const uint32_t id = Utils::OperationInterner::instance().Intern(it.first);
+    if (id >= requirements_by_id_.size()) {
+      requirements_by_id_.resize(id + 1, nullptr);
+    }
+    requirements_by_id_[id] = it.second.get();
+  }
+
   // Construct a requirement for non matched requests
   non_match_rqm_cfg_.set_service_name(first_srv_ctx->config().service_name());
   non_match_rqm_cfg_.set_operation_name(kUnrecognizedOperation);
@@ -72,6 +118,8 @@ FilterConfigParser::FilterConfigParser(const FilterConfig& config,
   default_api_keys_.add_locations()->set_query("key");
   default_api_keys_.add_locations()->set_query("api_key");
   default_api_keys_.add_locations()->set_header("x-api-key");
+  default_api_key_matcher_.reset(
+      new ApiKeyMatcher(default_api_keys_.locations()));
 }
 
 }  // namespace ServiceControl
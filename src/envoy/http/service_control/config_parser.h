@@ -19,6 +19,8 @@
 
 #include "api/envoy/http/service_control/config.pb.h"
 #include "api/envoy/http/service_control/requirement.pb.h"
+#include "src/envoy/http/service_control/filter_stats.h"
+#include "src/envoy/http/service_control/handler_utils.h"
 #include "src/envoy/http/service_control/service_control_call.h"
 
 // Default minimum interval (milliseconds) for streaming reports.
@@ -71,6 +73,9 @@ class RequirementContext {
       metric_costs_.push_back(
           std::make_pair(metric_cost.name(), metric_cost.cost()));
     }
+    if (config_.api_key().locations_size() > 0) {
+      api_key_matcher_.reset(new ApiKeyMatcher(config_.api_key().locations()));
+    }
   }
 
   const ::google::api::envoy::http::service_control::Requirement& config()
@@ -80,22 +85,44 @@ class RequirementContext {
 
   const ServiceContext& service_ctx() const { return service_ctx_; }
 
+  // The precompiled matcher for this requirement's api-key locations, or
+  // nullptr if the requirement does not configure any; callers fall back to
+  // FilterConfigParser::default_api_key_matcher().
+  const ApiKeyMatcher* api_key_matcher() const {
+    return api_key_matcher_.get();
+  }
+
   const std::vector<std::pair<std::string, int>>* metric_costs() const {
     return &metric_costs_;
   }
 
+  // The preallocated per-operation stat handles, or nullptr unless this
+  // operation is named in per_operation_stats_selectors.
+  const PerOperationStats* per_operation_stats() const {
+    return per_operation_stats_.get();
+  }
+
+  void set_per_operation_stats(std::unique_ptr<PerOperationStats> stats) {
+    per_operation_stats_ = std::move(stats);
+  }
+
  private:
   const ::google::api::envoy::http::service_control::Requirement& config_;
   const ServiceContext& service_ctx_;
   std::vector<std::pair<std::string, int>> metric_costs_;
+  std::unique_ptr<ApiKeyMatcher> api_key_matcher_;
+  std::unique_ptr<PerOperationStats> per_operation_stats_;
 };
 typedef std::unique_ptr<RequirementContext> RequirementContextPtr;
 
 class FilterConfigParser {
  public:
+  // |scope| backs the opt-in per-operation stats; when nullptr the
+  // per_operation_stats_selectors config is ignored.
   FilterConfigParser(
       const ::google::api::envoy::http::service_control::FilterConfig& config,
-      ServiceControlCallFactory& factory);
+      ServiceControlCallFactory& factory, Stats::Scope* scope = nullptr,
+      const std::string& stats_prefix = "");
 
   const ::google::api::envoy::http::service_control::FilterConfig& config()
       const {
@@ -109,11 +136,26 @@ class FilterConfigParser {
     return requirement_it->second.get();
   }
 
+  // Id-indexed variant of FindRequirement; one array access instead of
+  // hashing the operation name. Every operation of this config interned its
+  // id at load time, so an id outside the table has no requirement here.
+  const RequirementContext* FindRequirement(uint32_t operation_id) const {
+    if (operation_id >= requirements_by_id_.size()) {
+      return nullptr;
+    }
+    return requirements_by_id_[operation_id];
+  }
+
   const ::google::api::envoy::http::service_control::APIKeyRequirement&
   default_api_keys() const {
     return default_api_keys_;
   }
 
+  // The precompiled matcher for the default api-key locations.
+  const ApiKeyMatcher& default_api_key_matcher() const {
+    return *default_api_key_matcher_;
+  }
+
   const RequirementContext* non_match_rqm_ctx() const {
     return non_match_rqm_ctx_.get();
   }
@@ -121,8 +163,14 @@ class FilterConfigParser {
  private:
   // The proto config.
   const ::google::api::envoy::http::service_control::FilterConfig config_;
-  // Operation name to RequirementContext map.
-  absl::flat_hash_map<std::string, RequirementContextPtr> requirements_map_;
+  // Operation name to RequirementContext map. Keys are the canonical
+  // selector copies owned by the process-wide operation interner, so this
+  // map stores no selector strings of its own.
+  absl::flat_hash_map<absl::string_view, RequirementContextPtr>
+      requirements_map_;
+  // The same requirements indexed by interned operation id; null slots mean
+  // no requirement for that operation.
+  std::vector<const RequirementContext*> requirements_by_id_;
   // The requirement for non matched requests for sending their reports.
   ::google::api::envoy::http::service_control::Requirement non_match_rqm_cfg_;
   RequirementContextPtr non_match_rqm_ctx_;
@@ -131,6 +179,7 @@ class FilterConfigParser {
   // The default locations to extract api-key.
   ::google::api::envoy::http::service_control::APIKeyRequirement
       default_api_keys_;
+  std::unique_ptr<ApiKeyMatcher> default_api_key_matcher_;
 };
 
 }  // namespace ServiceControl
@@ -14,6 +14,7 @@
 
 #include "src/envoy/http/service_control/config_parser.h"
 #include "src/envoy/http/service_control/mocks.h"
+#include "test/mocks/stats/mocks.h"
 #include "test/test_common/utility.h"
 
 #include "gmock/gmock.h"
@@ -73,6 +74,62 @@ requirements {
   EXPECT_FALSE(parser.FindRequirement("non-existing-operation"));
 }
 
+TEST(ConfigParserTest, PerOperationStatsSelectors) {
+  FilterConfig config;
+  const char kFilterConfigWithSelectors[] = R"(
+services {
+  service_name: "echo"
+}
+requirements {
+  service_name: "echo"
+  operation_name: "get_foo"
+}
+requirements {
+  service_name: "echo"
+  operation_name: "post_bar"
+}
+sc_calling_config {
+  per_operation_stats_selectors: "get_foo"
+})";
+  ASSERT_TRUE(TextFormat::ParseFromString(kFilterConfigWithSelectors, &config));
+  testing::NiceMock<MockServiceControlCallFactory> mock_factory;
+  testing::NiceMock<Stats::MockStore> scope;
+  FilterConfigParser parser(config, mock_factory, &scope, "");
+
+  // Only the selected operation gets preallocated handles.
+  const auto* stats = parser.FindRequirement("get_foo")->per_operation_stats();
+  ASSERT_NE(stats, nullptr);
+  EXPECT_EQ(parser.FindRequirement("post_bar")->per_operation_stats(), nullptr);
+
+  stats->response_2xx_.inc();
+  EXPECT_EQ(
+      1L,
+      TestUtility::findCounter(
+          scope, "service_control.per_operation.get_foo.response_2xx")
+          ->value());
+}
+
+TEST(ConfigParserTest, PerOperationStatsWithoutScope) {
+  FilterConfig config;
+  const char kFilterConfigWithSelectors[] = R"(
+services {
+  service_name: "echo"
+}
+requirements {
+  service_name: "echo"
+  operation_name: "get_foo"
+}
+sc_calling_config {
+  per_operation_stats_selectors: "get_foo"
+})";
+  ASSERT_TRUE(TextFormat::ParseFromString(kFilterConfigWithSelectors, &config));
+  testing::NiceMock<MockServiceControlCallFactory> mock_factory;
+  FilterConfigParser parser(config, mock_factory);
+
+  // Without a scope the selectors are ignored.
+  EXPECT_EQ(parser.FindRequirement("get_foo")->per_operation_stats(), nullptr);
+}
+
 TEST(ConfigParserTest, DuplicatedServiceNames) {
   FilterConfig config;
   const char kConfigWithDupliacedService[] = R"(
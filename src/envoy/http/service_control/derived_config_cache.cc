@@ -0,0 +1,222 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/derived_config_cache.h"
+
+#include <cstdio>
+#include <fstream>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "common/common/logger.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+// First record of every snapshot; bump the version when the layout
+// changes so old files fail validation instead of being misread.
+constexpr char kMagic[] = "espv2-derived-config-v1";
+
+// No log, metric or label name comes close; anything larger is
+// corruption, not data.
+constexpr uint32_t kMaxRecordBytes = 1 * 1024 * 1024;
+constexpr size_t kMaxNames = 1 << 20;
+
+// Same little-endian fixed-width framing the aggregation handoff files
+// use; the helpers live in that translation unit's anonymous namespace.
+void encodeLength(uint32_t length, char* out) {
+  out[0] = static_cast<char>(length & 0xff);
+  out[1] = static_cast<char>((length >> 8) & 0xff);
+  out[2] = static_cast<char>((length >> 16) & 0xff);
+  out[3] = static_cast<char>((length >> 24) & 0xff);
+}
+
+uint32_t decodeLength(const char* in) {
+  return static_cast<uint32_t>(static_cast<unsigned char>(in[0])) |
+         static_cast<uint32_t>(static_cast<unsigned char>(in[1])) << 8 |
+         static_cast<uint32_t>(static_cast<unsigned char>(in[2])) << 16 |
+         static_cast<uint32_t>(static_cast<unsigned char>(in[3])) << 24;
+}
+
+void writeRecord(std::ofstream& file, absl::string_view bytes) {
+  char length[4];
+  encodeLength(static_cast<uint32_t>(bytes.size()), length);
+  file.write(length, sizeof(length));
+  file.write(bytes.data(), bytes.size());
+}
+
+bool readRecord(std::ifstream& file, std::string* out) {
+  char length[4];
+  if (!file.read(length, sizeof(length))) {
+    return false;
+  }
+  const uint32_t record_size = decodeLength(length);
+  if (record_size > kMaxRecordBytes) {
+    return false;
+  }
+  out->resize(record_size);
+  return static_cast<bool>(file.read(&(*out)[0], record_size));
+}
+
+// Service names are host-shaped ("echo.endpoints.project.cloud.goog") and
+// safe as file names once anything outside the portable set is mapped
+// away. Collisions only risk a validation miss, never a wrong load: the
+// key record below carries the unsanitized name.
+std::string snapshotPath(const std::string& directory,
+                         const std::string& service_name) {
+  std::string file_name = service_name;
+  for (char& c : file_name) {
+    const bool portable = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                          (c >= '0' && c <= '9') || c == '.' || c == '-' ||
+                          c == '_';
+    if (!portable) {
+      c = '_';
+    }
+  }
+  return absl::StrCat(directory, "/", file_name, ".derived");
+}
+
+// Everything a snapshot must match to be used: the exact service, the
+// config id and the hash of the raw config bytes.
+std::string snapshotKey(const std::string& service_name,
+                        const std::string& service_config_id,
+                        uint64_t config_hash) {
+  return absl::StrCat(service_name, "/", service_config_id, "/",
+                      absl::Hex(config_hash, absl::kZeroPad16));
+}
+
+bool readNames(std::ifstream& file, size_t count,
+               std::vector<std::string>* out) {
+  if (count > kMaxNames) {
+    return false;
+  }
+  out->reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    std::string name;
+    if (!readRecord(file, &name)) {
+      return false;
+    }
+    out->push_back(std::move(name));
+  }
+  return true;
+}
+
+}  // namespace
+
+uint64_t DerivedConfigCache::HashConfig(absl::string_view serialized_config) {
+  // FNV-1a, 64 bit.
+  uint64_t hash = 14695981039346656037ULL;
+  for (const char c : serialized_config) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+bool DerivedConfigCache::Load(const std::string& directory,
+                              const std::string& service_name,
+                              const std::string& service_config_id,
+                              uint64_t config_hash, LogsMetricsSnapshot* out) {
+  const std::string path = snapshotPath(directory, service_name);
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open()) {
+    return false;
+  }
+  std::string record;
+  if (!readRecord(file, &record) || record != kMagic) {
+    ENVOY_LOG_MISC(warn, "unrecognized derived config snapshot {}", path);
+    return false;
+  }
+  if (!readRecord(file, &record) ||
+      record != snapshotKey(service_name, service_config_id, config_hash)) {
+    // A snapshot of an older config revision; it is overwritten after the
+    // re-derivation.
+    return false;
+  }
+  if (!readRecord(file, &record)) {
+    return false;
+  }
+  const std::vector<absl::string_view> counts = absl::StrSplit(record, ' ');
+  size_t num_logs, num_metrics, num_labels;
+  if (counts.size() != 3 || !absl::SimpleAtoi(counts[0], &num_logs) ||
+      !absl::SimpleAtoi(counts[1], &num_metrics) ||
+      !absl::SimpleAtoi(counts[2], &num_labels)) {
+    ENVOY_LOG_MISC(warn, "corrupt derived config snapshot {}", path);
+    return false;
+  }
+  if (!readNames(file, num_logs, &out->logs) ||
+      !readNames(file, num_metrics, &out->metrics) ||
+      !readNames(file, num_labels, &out->labels)) {
+    ENVOY_LOG_MISC(warn, "truncated derived config snapshot {}", path);
+    out->logs.clear();
+    out->metrics.clear();
+    out->labels.clear();
+    return false;
+  }
+  return true;
+}
+
+void DerivedConfigCache::Store(const std::string& directory,
+                               const std::string& service_name,
+                               const std::string& service_config_id,
+                               uint64_t config_hash,
+                               const LogsMetricsSnapshot& snapshot) {
+  const std::string path = snapshotPath(directory, service_name);
+  // Written to the side and renamed into place, so a reader (or a crash
+  // mid-write) only ever sees a complete previous snapshot or none.
+  const std::string tmp_path = absl::StrCat(path, ".tmp");
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      ENVOY_LOG_MISC(warn, "failed to open derived config snapshot {}",
+                     tmp_path);
+      return;
+    }
+    writeRecord(file, kMagic);
+    writeRecord(file,
+                snapshotKey(service_name, service_config_id, config_hash));
+    writeRecord(file, absl::StrCat(snapshot.logs.size(), " ",
+                                   snapshot.metrics.size(), " ",
+                                   snapshot.labels.size()));
+    for (const auto& name : snapshot.logs) {
+      writeRecord(file, name);
+    }
+    for (const auto& name : snapshot.metrics) {
+      writeRecord(file, name);
+    }
+    for (const auto& name : snapshot.labels) {
+      writeRecord(file, name);
+    }
+    if (!file.good()) {
+      ENVOY_LOG_MISC(warn, "failed to write derived config snapshot {}",
+                     tmp_path);
+      file.close();
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    ENVOY_LOG_MISC(warn, "failed to install derived config snapshot {}", path);
+    std::remove(tmp_path.c_str());
+  }
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,74 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Disk cache for config artifacts that are expensive to derive but cheap
+// to serialize. Building a service's request builder starts by unpacking
+// the google.api.Service proto out of its Any wrapper and scanning it for
+// the supported log, metric and label names; for large service configs
+// that is the dominant cost of config ingestion. The snapshot written
+// here lets the next process skip both steps when the raw config bytes
+// are unchanged: a file is validated against a hash of the serialized
+// config and the sets are simply re-derived (a snapshot is never trusted)
+// on any mismatch, truncation or format change. One file per service,
+// replaced in place when the config changes.
+class DerivedConfigCache {
+ public:
+  // The logs/metrics/labels name sets LogsMetricsLoader derives from a
+  // service config, in the frozen sorted form RequestBuilder consumes.
+  struct LogsMetricsSnapshot {
+    std::vector<std::string> logs;
+    std::vector<std::string> metrics;
+    std::vector<std::string> labels;
+  };
+
+  // Hashes the serialized service config bytes. Deterministic across
+  // processes and builds (unlike std::hash), since the value outlives the
+  // process that wrote it.
+  static uint64_t HashConfig(absl::string_view serialized_config);
+
+  // Fills |out| from the snapshot of |service_name| under |directory| and
+  // returns true, or returns false when there is no snapshot or it was
+  // written for different config bytes, a different config id or an older
+  // format. Failures are never errors: the caller re-derives.
+  static bool Load(const std::string& directory,
+                   const std::string& service_name,
+                   const std::string& service_config_id, uint64_t config_hash,
+                   LogsMetricsSnapshot* out);
+
+  // Writes the snapshot of |service_name| under |directory|, atomically
+  // replacing any previous one. Failures are logged and swallowed: a
+  // snapshot that cannot be written only costs the next startup the
+  // derivation it costs today.
+  static void Store(const std::string& directory,
+                    const std::string& service_name,
+                    const std::string& service_config_id, uint64_t config_hash,
+                    const LogsMetricsSnapshot& snapshot);
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
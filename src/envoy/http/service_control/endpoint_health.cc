@@ -0,0 +1,104 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/endpoint_health.h"
+
+#include "absl/container/flat_hash_map.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+std::shared_ptr<EndpointHealth> EndpointHealth::GetOrCreate(
+    const std::string& endpoint_key) {
+  // Leaked on purpose: trackers may be looked up during shutdown.
+  static std::mutex* registry_mutex = new std::mutex;
+  static auto* registry =
+      new absl::flat_hash_map<std::string, std::weak_ptr<EndpointHealth>>;
+
+  std::lock_guard<std::mutex> lock(*registry_mutex);
+  auto& weak_entry = (*registry)[endpoint_key];
+  std::shared_ptr<EndpointHealth> health = weak_entry.lock();
+  if (health == nullptr) {
+    health = std::shared_ptr<EndpointHealth>(new EndpointHealth);
+    weak_entry = health;
+
+    // Purge entries whose last owner has gone away (e.g. config drains).
+    for (auto it = registry->begin(); it != registry->end();) {
+      if (it->second.expired()) {
+        registry->erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  return health;
+}
+
+bool EndpointHealth::allowRequest(std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  switch (circuit_) {
+    case Circuit::Closed:
+      return true;
+    case Circuit::Open:
+      if (now >= next_probe_) {
+        circuit_ = Circuit::HalfOpen;
+        return true;
+      }
+      return false;
+    case Circuit::HalfOpen:
+      // A probe is already in flight; fast-fail everything else until it
+      // reports back.
+      return false;
+  }
+  return true;
+}
+
+void EndpointHealth::onResult(bool ok, std::chrono::microseconds latency,
+                              std::chrono::steady_clock::time_point now) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ok) {
+    consecutive_failures_ = 0;
+    circuit_ = Circuit::Closed;
+    const double sample = static_cast<double>(latency.count());
+    latency_ewma_us_ = latency_ewma_us_ == 0
+                           ? sample
+                           : kEwmaAlpha * sample +
+                                 (1 - kEwmaAlpha) * latency_ewma_us_;
+    return;
+  }
+
+  ++consecutive_failures_;
+  if (circuit_ == Circuit::HalfOpen ||
+      consecutive_failures_ >= kOpenAfterConsecutiveFailures) {
+    circuit_ = Circuit::Open;
+    next_probe_ = now + std::chrono::milliseconds(kProbeIntervalMs);
+  }
+}
+
+EndpointHealth::Circuit EndpointHealth::circuit() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return circuit_;
+}
+
+double EndpointHealth::latencyEwmaUs() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return latency_ewma_us_;
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,87 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Process-wide health state of one remote service control endpoint, shared
+// by the per-worker ClientCache instances. When the backend degrades, the
+// first workers to see it open the circuit for everyone, so the remaining
+// workers fast-fail into their fail-open/fail-closed policy instead of
+// each independently burning a full transport timeout per call.
+//
+// The circuit opens after a run of consecutive transport failures. While
+// open, one probe call is let through per probe interval (half-open); a
+// successful probe closes the circuit, a failed one re-arms the interval.
+// Success latency is folded into an EWMA for observability.
+//
+// All methods lock a plain mutex; they run at remote-call cadence
+// (aggregation flushes and cache misses), not per request.
+class EndpointHealth {
+ public:
+  // Numbered for export as a gauge: severity grows with the value.
+  enum class Circuit { Closed = 0, HalfOpen = 1, Open = 2 };
+
+  // Returns the tracker shared by all workers for |endpoint_key| (the
+  // service control uri plus the call type), creating it on first use.
+  static std::shared_ptr<EndpointHealth> GetOrCreate(
+      const std::string& endpoint_key);
+
+  // Whether a remote call may be sent now. False means the circuit is open
+  // and the caller should fail fast; while open, one call per probe
+  // interval gets true and acts as the half-open probe.
+  bool allowRequest(std::chrono::steady_clock::time_point now);
+
+  // Records the outcome of a remote call that allowRequest admitted.
+  // |ok| is transport-level: a response was received, whatever it decided.
+  void onResult(bool ok, std::chrono::microseconds latency,
+                std::chrono::steady_clock::time_point now);
+
+  Circuit circuit() const;
+
+  // EWMA over successful call latencies, in microseconds; 0 until the
+  // first success.
+  double latencyEwmaUs() const;
+
+ private:
+  EndpointHealth() = default;
+
+  // The circuit opens after this many consecutive transport failures.
+  static constexpr uint32_t kOpenAfterConsecutiveFailures = 5;
+  // Spacing of half-open probes while the circuit is open.
+  static constexpr int kProbeIntervalMs = 5000;
+  // Weight of the newest sample in the latency EWMA.
+  static constexpr double kEwmaAlpha = 0.2;
+
+  mutable std::mutex mutex_;
+  Circuit circuit_{Circuit::Closed};
+  uint32_t consecutive_failures_{0};
+  double latency_ewma_us_{0};
+  // Earliest time the next half-open probe may be admitted.
+  std::chrono::steady_clock::time_point next_probe_;
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
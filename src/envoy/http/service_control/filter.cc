@@ -18,6 +18,7 @@
 #include "envoy/http/header_map.h"
 #include "src/envoy/http/service_control/filter.h"
 #include "src/envoy/http/service_control/handler.h"
+#include "src/envoy/utils/phase_timing_utils.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -36,6 +37,10 @@ typedef ConstSingleton<RcDetailsValues> RcDetails;
 
 void ServiceControlFilter::onDestroy() {
   ENVOY_LOG(debug, "Called ServiceControl Filter : {}", __func__);
+  // onDestroy runs synchronously on reset while our destruction is
+  // deferred; leave the resumption batch now so a pending resume cannot
+  // touch the dead stream callbacks.
+  CheckResumeBatcher::instance().cancel(*this);
   if (handler_) {
     handler_->onDestroy();
   }
@@ -47,6 +52,11 @@ Http::FilterHeadersStatus ServiceControlFilter::decodeHeaders(
 
   Envoy::Tracing::Span& parent_span = decoder_callbacks_->activeSpan();
 
+  // Phase timing stamps are taken at the handler boundaries: prepare runs
+  // until callCheck returns, the wait until onCheckDone.
+  const bool timing = Utils::phaseTimingEnabled();
+  const int64_t prepare_start = timing ? Utils::phaseTimingNow() : 0;
+
   handler_ = factory_.createHandler(headers, decoder_callbacks_->streamInfo());
 
   state_ = Calling;
@@ -54,6 +64,16 @@ Http::FilterHeadersStatus ServiceControlFilter::decodeHeaders(
 
   handler_->callCheck(headers, parent_span, *this);
 
+  if (timing) {
+    const int64_t now = Utils::phaseTimingNow();
+    stats_.phase_check_prepare_ns_.recordValue(now - prepare_start);
+    // A request still waiting measures the wait from here; synchronously
+    // answered checks (and denials) leave the stamp unset.
+    if (state_ == Calling) {
+      check_wait_start_ns_ = now;
+    }
+  }
+
   // If success happens synchronously, continue now.
   if (state_ == Complete) {
     return Http::FilterHeadersStatus::Continue;
@@ -67,22 +87,50 @@ Http::FilterHeadersStatus ServiceControlFilter::decodeHeaders(
 
 void ServiceControlFilter::onCheckDone(
     const ::google::protobuf::util::Status& status) {
+  if (check_wait_start_ns_ != 0) {
+    stats_.phase_check_wait_ns_.recordValue(Utils::phaseTimingNow() -
+                                            check_wait_start_ns_);
+    check_wait_start_ns_ = 0;
+  }
   if (!status.ok()) {
     // protobuf::util::Status.error_code is the same as Envoy GrpcStatus
     // This cast is safe.
     auto http_code = Grpc::Utility::grpcToHttpStatus(
         static_cast<Grpc::Status::GrpcStatus>(status.error_code()));
-    rejectRequest(static_cast<Http::Code>(http_code), status.ToString());
+    // Denials with a precomputed table entry serve its preformatted body;
+    // reasons without one (quota denials, transport errors) still format
+    // the status here.
+    const auto* denial = handler_->checkDenial();
+    if (denial != nullptr) {
+      rejectRequest(static_cast<Http::Code>(http_code), denial->body);
+    } else {
+      rejectRequest(static_cast<Http::Code>(http_code), status.ToString());
+    }
     return;
   }
 
   stats_.allowed_.inc();
   state_ = Complete;
   if (stopped_) {
-    decoder_callbacks_->continueDecoding();
+    // Bursts of close-together check completions (coalesced and
+    // aggregated checks answer whole groups at once) resume through the
+    // worker's batcher: one deferred callback walks the resumed streams
+    // back to back instead of interleaving each continueDecoding with
+    // the next response. Threads that never bound a batcher (direct
+    // construction in tests) resume inline.
+    auto& batcher = CheckResumeBatcher::instance();
+    if (batcher.bound()) {
+      batcher.enqueue(*this);
+    } else {
+      decoder_callbacks_->continueDecoding();
+    }
   }
 }
 
+void ServiceControlFilter::onResumeBatch() {
+  decoder_callbacks_->continueDecoding();
+}
+
 void ServiceControlFilter::rejectRequest(Http::Code code,
                                          absl::string_view error_msg) {
   stats_.denied_.inc();
@@ -138,6 +186,17 @@ Http::FilterDataStatus ServiceControlFilter::encodeData(Buffer::Instance& data,
   return Http::FilterDataStatus::Continue;
 }
 
+Http::FilterTrailersStatus ServiceControlFilter::encodeTrailers(
+    Http::HeaderMap& trailers) {
+  ENVOY_LOG(debug, "Called ServiceControl Filter : {}", __func__);
+  // Capture the trailer size here so the final report does not re-traverse
+  // the trailer map.
+  if (handler_ != nullptr) {
+    handler_->processResponseTrailers(trailers);
+  }
+  return Http::FilterTrailersStatus::Continue;
+}
+
 void ServiceControlFilter::log(const Http::HeaderMap* request_headers,
                                const Http::HeaderMap* response_headers,
                                const Http::HeaderMap* response_trailers,
@@ -148,6 +207,13 @@ void ServiceControlFilter::log(const Http::HeaderMap* request_headers,
     handler_ = factory_.createHandler(*request_headers, stream_info);
   }
 
+  if (Utils::phaseTimingEnabled()) {
+    const int64_t report_start = Utils::phaseTimingNow();
+    handler_->callReport(request_headers, response_headers, response_trailers);
+    stats_.phase_report_build_ns_.recordValue(Utils::phaseTimingNow() -
+                                              report_start);
+    return;
+  }
   handler_->callReport(request_headers, response_headers, response_trailers);
 }
 
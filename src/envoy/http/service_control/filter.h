@@ -19,6 +19,7 @@
 #include "envoy/http/filter.h"
 #include "envoy/http/header_map.h"
 #include "extensions/filters/http/common/pass_through_filter.h"
+#include "src/envoy/http/service_control/check_resume_batcher.h"
 #include "src/envoy/http/service_control/filter_stats.h"
 #include "src/envoy/http/service_control/handler.h"
 
@@ -33,6 +34,7 @@ namespace ServiceControl {
 class ServiceControlFilter : public Http::PassThroughFilter,
                              public AccessLog::Instance,
                              public ServiceControlHandler::CheckDoneCallback,
+                             public CheckResumeBatcher::Entry,
                              public Logger::Loggable<Logger::Id::filter> {
  public:
   ServiceControlFilter(ServiceControlFilterStats& stats,
@@ -53,6 +55,7 @@ class ServiceControlFilter : public Http::PassThroughFilter,
                                           bool) override;
   Http::FilterDataStatus encodeData(Buffer::Instance& data,
                                     bool end_stream) override;
+  Http::FilterTrailersStatus encodeTrailers(Http::HeaderMap& trailers) override;
 
   // Called when the request is completed.
   void log(const Http::HeaderMap* request_headers,
@@ -63,6 +66,10 @@ class ServiceControlFilter : public Http::PassThroughFilter,
   // For Handler::CheckDoneCallback, called when callCheck() is done
   void onCheckDone(const ::google::protobuf::util::Status& status) override;
 
+  // For CheckResumeBatcher::Entry: resumes the stream as part of the
+  // worker's deferred resumption batch.
+  void onResumeBatch() override;
+
  private:
   void rejectRequest(Http::Code code, absl::string_view error_msg);
 
@@ -70,13 +77,16 @@ class ServiceControlFilter : public Http::PassThroughFilter,
   const ServiceControlHandlerFactory& factory_;
 
   // The service control request handler
-  std::unique_ptr<ServiceControlHandler> handler_;
+  ServiceControlHandlerPtr handler_;
 
   // The state of the request.
   enum State { Init, Calling, Responded, Complete };
   State state_ = Init;
   // Mark if request has been stopped.
   bool stopped_ = false;
+  // Stamp of an asynchronous check wait in progress, or 0. Only set when
+  // phase timing is enabled.
+  int64_t check_wait_start_ns_ = 0;
 };
 
 }  // namespace ServiceControl
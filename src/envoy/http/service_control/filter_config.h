@@ -38,8 +38,9 @@ class ServiceControlFilterConfig : public Logger::Loggable<Logger::Id::filter>,
       const std::string& stats_prefix,
       Server::Configuration::FactoryContext& context)
       : ServiceControlFilterStatBase(stats_prefix, context.scope()),
-        call_factory_(context),
-        config_parser_(proto_config, call_factory_),
+        call_factory_(context, stats()),
+        config_parser_(proto_config, call_factory_, &context.scope(),
+                       stats_prefix),
         handler_factory_(context.random(), config_parser_) {}
 
   const ServiceControlHandlerFactory& handler_factory() const {
@@ -14,10 +14,13 @@
 
 #include "api/envoy/http/service_control/config.pb.h"
 #include "api/envoy/http/service_control/config.pb.validate.h"
+#include "src/envoy/http/service_control/client_cache_debug.h"
 #include "src/envoy/http/service_control/filter.h"
+#include "src/envoy/http/service_control/heavy_hitter_tracker.h"
 #include "src/envoy/http/service_control/filter_config.h"
 
 #include "envoy/registry/registry.h"
+#include "envoy/server/admin.h"
 #include "extensions/filters/http/common/factory_base.h"
 
 namespace Envoy {
@@ -44,6 +47,29 @@ class FilterFactory
       Server::Configuration::FactoryContext& context) override {
     auto filter_config = std::make_shared<ServiceControlFilterConfig>(
         proto_config, stats_prefix, context);
+    // The per-worker ClientCaches register their debug states themselves;
+    // only the handler needs registering here. The first config wins; the
+    // repeated addHandler calls on config swaps failing is expected.
+    context.admin().addHandler(
+        "/service_control_debug",
+        "dump ESP V2 service control cache occupancy, per-operation call "
+        "tallies, circuit breaker state and report flush backlog as JSON",
+        [](absl::string_view, Http::HeaderMap&, Buffer::Instance& response,
+           Server::AdminStream&) -> Http::Code {
+          response.add(ClientCacheDebugRegistry::instance().DumpJson());
+          return Http::Code::OK;
+        },
+        false, false);
+    context.admin().addHandler(
+        "/service_control_heavy_hitters",
+        "dump the merged per-service top api keys by request count from the "
+        "opt-in heavy-hitter trackers as JSON",
+        [](absl::string_view, Http::HeaderMap&, Buffer::Instance& response,
+           Server::AdminStream&) -> Http::Code {
+          response.add(HeavyHitterRegistry::instance().DumpJson());
+          return Http::Code::OK;
+        },
+        false, false);
     return
         [filter_config](Http::FilterChainFactoryCallbacks& callbacks) -> void {
           auto filter = std::make_shared<ServiceControlFilter>(
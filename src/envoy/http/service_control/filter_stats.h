@@ -27,16 +27,137 @@ namespace ServiceControl {
  */
 
 // clang-format off
-#define ALL_SERVICE_CONTROL_FILTER_STATS(COUNTER)     \
-  COUNTER(allowed)                                    \
-  COUNTER(denied)
+#define ALL_SERVICE_CONTROL_FILTER_STATS(COUNTER, GAUGE, HISTOGRAM) \
+  COUNTER(allowed)                                                  \
+  COUNTER(denied)                                                   \
+  COUNTER(check_cache_hits)                                         \
+  COUNTER(check_cache_misses)                                       \
+  COUNTER(token_stale_requests)                                     \
+  COUNTER(check_outage_served)                                      \
+  COUNTER(check_coalesced)                                          \
+  COUNTER(check_budget_exceeded)                                    \
+  COUNTER(report_flush_dropped)                                     \
+  COUNTER(hedged_attempts)                                          \
+  COUNTER(hedge_wins)                                               \
+  COUNTER(check_circuit_fast_fail)                                  \
+  COUNTER(quota_circuit_fast_fail)                                  \
+  COUNTER(report_budget_flushes)                                    \
+  COUNTER(check_budget_evictions)                                   \
+  COUNTER(report_spilled_bytes)                                     \
+  COUNTER(report_spill_dropped_bytes)                               \
+  COUNTER(report_spill_expired_bytes)                               \
+  COUNTER(report_spill_replayed_bytes)                              \
+  COUNTER(quota_negative_cache_hits)                                \
+  COUNTER(quota_cost_triggered_flushes)                             \
+  COUNTER(report_overload_sampled)                                  \
+  COUNTER(report_overload_shed)                                     \
+  COUNTER(check_invalid_key_gate_hits)                              \
+  COUNTER(check_cancelled_in_flight)                                \
+  COUNTER(check_pre_token_parked)                                   \
+  GAUGE(check_circuit_state)                                        \
+  GAUGE(quota_circuit_state)                                        \
+  GAUGE(aggregation_buffer_bytes)                                   \
+  HISTOGRAM(check_call_latency_us)                                  \
+  HISTOGRAM(check_blocked_time_us)                                  \
+  HISTOGRAM(quota_call_latency_us)                                  \
+  HISTOGRAM(report_call_latency_us)                                 \
+  HISTOGRAM(report_batch_operations)                                \
+  HISTOGRAM(phase_check_prepare_ns)                                 \
+  HISTOGRAM(phase_check_wait_ns)                                    \
+  HISTOGRAM(phase_report_build_ns)
 // clang-format on
 
 /**
  * Wrapper struct for service control filter stats. @see stats_macros.h
+ *
+ * Latency histograms cover one remote call each, measured from sending the
+ * request to receiving its response. check_cache_hits/misses count whether a
+ * Check was answered from a cache (per-worker aggregation or the shared
+ * cache) or needed a remote call. report_batch_operations records how many
+ * operations each flushed ReportRequest carried. token_stale_requests counts
+ * calls attempted while no access token was available yet.
+ * check_outage_served counts Checks answered from the last-known-good
+ * decision cache while the service control backend was unreachable.
+ * check_coalesced counts Checks that parked on an identical remote call
+ * already in flight instead of issuing their own.
+ * check_blocked_time_us measures how long each request waited for its
+ * check decision, whatever path answered it; check_budget_exceeded counts
+ * requests answered early by the check budget instead of the remote call.
+ * report_flush_dropped counts report flushes shed because the background
+ * serialization pipeline was saturated.
+ * hedged_attempts counts parallel duplicate requests launched because the
+ * primary was still unanswered after the hedge delay; hedge_wins counts
+ * those whose response arrived first.
+ * check_circuit_fast_fail/quota_circuit_fast_fail count remote calls
+ * answered immediately because the endpoint's circuit breaker was open;
+ * the _circuit_state gauges expose the breaker (0 closed, 1 half-open,
+ * 2 open).
+ * aggregation_buffer_bytes estimates the bytes of aggregation state
+ * buffered across workers; report_budget_flushes counts forced flushes
+ * and check_budget_evictions counts last-known-good entries evicted
+ * because the aggregation memory budget was exceeded.
+ * The report_spill* counters track the disk journal for failed report
+ * sends in bytes of serialized batches: spilled into the journal, dropped
+ * because the journal was at its cap, expired as too old at replay time,
+ * and successfully replayed after recovery.
+ * quota_negative_cache_hits counts quota calls denied straight from the
+ * short-TTL negative cache of recent quota denials, without running the
+ * quota path.
+ * quota_cost_triggered_flushes counts adaptive quota flushes sent early
+ * because a signature's accumulated cost crossed the hot threshold,
+ * rather than on its timer.
+ * report_overload_sampled counts report operations dropped by sampling
+ * while the degrade overload action was active; report_overload_shed
+ * counts operations without an api key dropped outright while the shed
+ * overload action was active. Together they are the reports to reconcile
+ * against billing after an overload episode.
+ * check_invalid_key_gate_hits counts checks denied up front by the
+ * rotating filter of recently-invalid api keys, without an RPC or a
+ * cache entry.
+ * check_cancelled_in_flight counts check calls cancelled (typically by
+ * the client disconnecting) while their remote call was still in
+ * flight; a spike marks a connection-churn storm.
+ * check_pre_token_parked counts checks parked behind the boot-time
+ * pre-token gate instead of going out before the worker's first access
+ * token arrived.
+ * The phase_*_ns histograms are the opt-in per-phase timing surface (see
+ * src/envoy/utils/phase_timing_utils.h) and stay empty unless it is
+ * enabled: check_prepare covers decodeHeaders from entry to callCheck
+ * returning (handler setup, api key extraction, any synchronously answered
+ * check), check_wait covers the asynchronous wait for the check decision,
+ * and report_build covers assembling the report on stream completion.
  */
 struct ServiceControlFilterStats {
-  ALL_SERVICE_CONTROL_FILTER_STATS(GENERATE_COUNTER_STRUCT)
+  ALL_SERVICE_CONTROL_FILTER_STATS(GENERATE_COUNTER_STRUCT,
+                                   GENERATE_GAUGE_STRUCT,
+                                   GENERATE_HISTOGRAM_STRUCT)
+};
+
+/**
+ * Opt-in per-operation stats. @see stats_macros.h
+ */
+
+// clang-format off
+#define ALL_PER_OPERATION_FILTER_STATS(COUNTER, HISTOGRAM) \
+  COUNTER(response_2xx)                                    \
+  COUNTER(response_3xx)                                    \
+  COUNTER(response_4xx)                                    \
+  COUNTER(response_5xx)                                    \
+  HISTOGRAM(request_latency_ms)                            \
+  HISTOGRAM(backend_latency_ms)
+// clang-format on
+
+/**
+ * Per-operation stats, recorded once per completed request for operations
+ * named in per_operation_stats_selectors. The handles live on the
+ * operation's RequirementContext, preallocated at config load, so the
+ * per-request cost is a handle dereference and a few increments.
+ * request_latency_ms covers the whole request as the report's latency
+ * does; backend_latency_ms covers the upstream portion of it.
+ */
+struct PerOperationStats {
+  ALL_PER_OPERATION_FILTER_STATS(GENERATE_COUNTER_STRUCT,
+                                 GENERATE_HISTOGRAM_STRUCT)
 };
 
 class ServiceControlFilterStatBase {
@@ -51,7 +172,9 @@ class ServiceControlFilterStatBase {
                                           Stats::Scope& scope) {
     const std::string final_prefix = prefix + "service_control.";
     return {ALL_SERVICE_CONTROL_FILTER_STATS(
-        POOL_COUNTER_PREFIX(scope, final_prefix))};
+        POOL_COUNTER_PREFIX(scope, final_prefix),
+        POOL_GAUGE_PREFIX(scope, final_prefix),
+        POOL_HISTOGRAM_PREFIX(scope, final_prefix))};
   }
 
   // The stats for the filter.
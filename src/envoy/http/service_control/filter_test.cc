@@ -114,6 +114,34 @@ TEST_F(FilterTest, DecodeHeadersSyncBadStatus) {
             filter_->decodeHeaders(headers_, true));
 }
 
+TEST_F(FilterTest, DecodeHeadersSyncBadStatusWithDenialEntry) {
+  // Test: A denial with a precomputed table entry is rejected through the
+  // entry's preformatted body.
+  auto* mock_handler = new testing::NiceMock<MockServiceControlHandler>();
+  EXPECT_CALL(mock_handler_factory_, createHandler_(_, _))
+      .WillOnce(Return(mock_handler));
+
+  ::google::api_proxy::service_control::CheckDenialInfo denial;
+  denial.status = kBadStatus;
+  denial.body = kBadStatus.ToString();
+  EXPECT_CALL(*mock_handler, checkDenial()).WillOnce(Return(&denial));
+
+  // Call onCheckDone synchronously
+  EXPECT_CALL(*mock_handler, callCheck(_, _, _))
+      .WillOnce(Invoke([](Http::HeaderMap&, Envoy::Tracing::Span&,
+                          ServiceControlHandler::CheckDoneCallback& callback) {
+        callback.onCheckDone(kBadStatus);
+      }));
+
+  // TODO(toddbeckman) Figure out how to EXPECT_CALL sendLocalReply directly
+  EXPECT_CALL(
+      mock_decoder_callbacks_.stream_info_,
+      setResponseFlag(StreamInfo::ResponseFlag::UnauthorizedExternalService));
+
+  EXPECT_EQ(Http::FilterHeadersStatus::StopIteration,
+            filter_->decodeHeaders(headers_, true));
+}
+
 TEST_F(FilterTest, DecodeHeadersAsyncGoodStatus) {
   // Test: While Filter is Calling/stopped, onCheckDone calls
   // continueDecoding
@@ -18,6 +18,7 @@
 #include "envoy/common/pure.h"
 #include "envoy/http/header_map.h"
 #include "envoy/stream_info/stream_info.h"
+#include "src/api_proxy/service_control/coarse_clock.h"
 #include "src/api_proxy/service_control/request_info.h"
 
 namespace Envoy {
@@ -41,34 +42,63 @@ class ServiceControlHandler {
                          Envoy::Tracing::Span& parent_span,
                          CheckDoneCallback& callback) PURE;
 
+  // Returns the precomputed denial entry behind the last failed check, or
+  // nullptr when the failure has no table entry (quota denials, transport
+  // errors). The filter's rejection path serves the entry's preformatted
+  // body instead of formatting the status per request.
+  virtual const ::google::api_proxy::service_control::CheckDenialInfo*
+  checkDenial() const {
+    return nullptr;
+  }
+
   // Make a report call.
   virtual void callReport(const Http::HeaderMap* request_headers,
                           const Http::HeaderMap* response_headers,
                           const Http::HeaderMap* response_trailers,
                           std::chrono::system_clock::time_point now =
-                              std::chrono::system_clock::now()) PURE;
+                              ::google::api_proxy::service_control::
+                                  CoarseClock::Now()) PURE;
 
   // Collect decode data, if the stream report interval has passed,
   // make an intermediate report call for long-lived gRPC streaming.
   virtual void collectDecodeData(Buffer::Instance& request_data,
                                  std::chrono::system_clock::time_point now =
-                                     std::chrono::system_clock::now()) PURE;
+                                     ::google::api_proxy::service_control::
+                                         CoarseClock::Now()) PURE;
 
   // Collect encode data, if the stream report interval has passed,
   // make an intermediate report call for long-lived gRPC streaming.
   virtual void collectEncodeData(Buffer::Instance& response_data,
                                  std::chrono::system_clock::time_point now =
-                                     std::chrono::system_clock::now()) PURE;
+                                     ::google::api_proxy::service_control::
+                                         CoarseClock::Now()) PURE;
 
   // Process the response header to get the information needed for sending
   // intermediate reports.
   virtual void processResponseHeaders(
       const Http::HeaderMap& response_headers) PURE;
 
+  // Record the response trailer size as the trailers are encoded, so the
+  // final report does not re-traverse the trailer map.
+  virtual void processResponseTrailers(
+      const Http::HeaderMap& response_trailers) PURE;
+
   // The request is about to be destroyed need to cancel all async requests.
   virtual void onDestroy() PURE;
+
+  // Releases the handler once its stream is finished. The default frees the
+  // instance; implementations may override it to return the instance to a
+  // pool instead.
+  virtual void recycle() { delete this; }
+};
+
+// Deleter for ServiceControlHandlerPtr: routes destruction through
+// recycle() so implementations can pool instances.
+struct ServiceControlHandlerDeleter {
+  void operator()(ServiceControlHandler* handler) const { handler->recycle(); }
 };
-typedef std::unique_ptr<ServiceControlHandler> ServiceControlHandlerPtr;
+typedef std::unique_ptr<ServiceControlHandler, ServiceControlHandlerDeleter>
+    ServiceControlHandlerPtr;
 
 class ServiceControlHandlerFactory {
  public:
@@ -12,9 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "common/http/utility.h"
 #include "src/envoy/http/service_control/handler_impl.h"
 #include "src/envoy/http/service_control/handler_utils.h"
@@ -35,65 +41,234 @@ namespace ServiceControl {
 const Http::LowerCaseString kConsumerProjectId("x-endpoint-api-project-id");
 
 // CheckRequest headers
-const Http::LowerCaseString kIosBundleIdHeader{"x-ios-bundle-identifier"};
-const Http::LowerCaseString kAndroidPackageHeader{"x-android-package"};
-const Http::LowerCaseString kAndroidCertHeader{"x-android-cert"};
-const Http::LowerCaseString kRefererHeader{"referer"};
 
 constexpr char JwtPayloadIssuerPath[] = "iss";
 constexpr char JwtPayloadAuidencePath[] = "aud";
 
+namespace {
+
+// Per-worker pool of recycled handler instances. Pooled handlers keep the
+// capacity of their string buffers, so steady-state request handling does
+// not allocate for handler state. Bounded so a burst does not pin memory
+// forever.
+constexpr size_t kHandlerPoolMaxSize = 128;
+
+std::vector<std::unique_ptr<ServiceControlHandlerImpl>>& handlerPool() {
+  thread_local std::vector<std::unique_ptr<ServiceControlHandlerImpl>> pool;
+  return pool;
+}
+
+// Number of live streaming handlers on this worker; used to scale the
+// intermediate report interval so aggregate report throughput stays flat
+// as stream concurrency grows.
+thread_local int64_t active_streaming_handlers = 0;
+
+// For every this many concurrent streams per worker, the intermediate
+// report interval is stretched by another multiple of the configured
+// minimum.
+constexpr int64_t kStreamsPerReportInterval = 1000;
+
+// Ordinal of this worker among all threads that created handlers; it keeps
+// the per-worker stream counters in operation ids from colliding.
+uint32_t workerOrdinal() {
+  static std::atomic<uint32_t> next_worker{0};
+  thread_local uint32_t ordinal = next_worker.fetch_add(1);
+  return ordinal;
+}
+
+// Sequence number of the next stream handled on this worker.
+thread_local uint64_t next_stream_ordinal = 0;
+
+// Minimum spacing between incremental quota charges of one stream. Matches
+// the quota aggregator's flush interval (client_cache.cc): charging more
+// often than the aggregator flushes would only build request protos that
+// sit in the same aggregation window.
+constexpr int64_t kIncrementalQuotaIntervalMs = 1000;
+
+// Builds a process-lifetime denial entry for the rejections the handler
+// itself issues (unknown method, missing api key), matching the
+// precomputed entries ConvertCheckResponse hands out for denied checks.
+const ::google::api_proxy::service_control::CheckDenialInfo* makeDenial(
+    Code code, const std::string& message) {
+  auto* denial = new ::google::api_proxy::service_control::CheckDenialInfo;
+  denial->status = Status(code, message);
+  denial->body = denial->status.ToString();
+  return denial;
+}
+
+}  // namespace
+
 ServiceControlHandlerImpl::ServiceControlHandlerImpl(
     const Http::HeaderMap& headers, const StreamInfo::StreamInfo& stream_info,
-    const std::string& uuid, const FilterConfigParser& cfg_parser,
-    std::chrono::system_clock::time_point now)
-    : cfg_parser_(cfg_parser),
-      stream_info_(stream_info),
-      uuid_(uuid),
-      request_header_size_(0),
-      response_header_size_(0),
-      last_reported_(now) {
-  http_method_ = std::string(Utils::getRequestHTTPMethodWithOverride(
-      headers.Method()->value().getStringView(), headers));
+    const std::string& operation_id_prefix, const FilterConfigParser& cfg_parser,
+    std::chrono::system_clock::time_point now) {
+  reset(headers, stream_info, operation_id_prefix, cfg_parser, now);
+}
+
+ServiceControlHandlerImpl::~ServiceControlHandlerImpl() {}
+
+ServiceControlHandlerPtr ServiceControlHandlerImpl::Create(
+    const Http::HeaderMap& headers, const StreamInfo::StreamInfo& stream_info,
+    const std::string& operation_id_prefix,
+    const FilterConfigParser& cfg_parser) {
+  auto& pool = handlerPool();
+  if (!pool.empty()) {
+    ServiceControlHandlerImpl* handler = pool.back().release();
+    pool.pop_back();
+    handler->reset(headers, stream_info, operation_id_prefix, cfg_parser,
+                   ::google::api_proxy::service_control::CoarseClock::Now());
+    return ServiceControlHandlerPtr(handler);
+  }
+  return ServiceControlHandlerPtr(new ServiceControlHandlerImpl(
+      headers, stream_info, operation_id_prefix, cfg_parser));
+}
+
+void ServiceControlHandlerImpl::recycle() {
+  if (wheel_driven_) {
+    ReportTimingWheel::instance().cancel(*this);
+    wheel_driven_ = false;
+  }
+  if (counted_streaming_) {
+    --active_streaming_handlers;
+    counted_streaming_ = false;
+  }
+  auto& pool = handlerPool();
+  if (pool.size() >= kHandlerPoolMaxSize) {
+    delete this;
+    return;
+  }
+  // Drop everything referring to the finished stream; the string buffers
+  // keep their capacity for reuse by reset().
+  stream_info_ = nullptr;
+  cfg_parser_ = nullptr;
+  require_ctx_ = nullptr;
+  check_callback_ = nullptr;
+  cancel_fn_ = nullptr;
+  pool.emplace_back(this);
+}
+
+void ServiceControlHandlerImpl::reset(
+    const Http::HeaderMap& headers, const StreamInfo::StreamInfo& stream_info,
+    const std::string& operation_id_prefix, const FilterConfigParser& cfg_parser,
+    std::chrono::system_clock::time_point now) {
+  cfg_parser_ = &cfg_parser;
+  stream_info_ = &stream_info;
+  require_ctx_ = nullptr;
+  operation_id_prefix_ = operation_id_prefix;
+  stream_ordinal_ = next_stream_ordinal++;
+  operation_id_.clear();
+  api_key_.clear();
+  check_callback_ = nullptr;
+  check_response_info_ = CheckResponseInfo();
+  check_status_ = Status();
+  check_denial_ = nullptr;
+  cancel_fn_ = nullptr;
+  on_check_done_called_ = false;
+  request_header_size_ = 0;
+  response_header_size_ = 0;
+  response_trailer_size_ = 0;
+  frontend_protocol_ = ::google::api_proxy::service_control::protocol::UNKNOWN;
+  grpc_request_counter_ = Utils::GrpcMessageCounter();
+  grpc_response_counter_ = Utils::GrpcMessageCounter();
+  quota_charged_messages_ = 1;
+  last_quota_charged_ = now;
+  streaming_info_ = ::google::api_proxy::service_control::
+      StreamingRequestInfo();
+  last_reported_ = now;
+  streaming_request_bytes_ = 0;
+  streaming_response_bytes_ = 0;
+  // Only streams that actually sent an intermediate report carry state here;
+  // clearing unconditionally would throw away the pooled string capacity.
+  if (intermediate_report_prepared_) {
+    intermediate_report_info_ =
+        ::google::api_proxy::service_control::ReportRequestInfo();
+  }
+  intermediate_report_prepared_ = false;
+
+  // All ESPv2-specific headers are collected in one iteration over the map
+  // instead of one full lookup each.
+  Utils::CheckRequestHeaders espv2_headers;
+  Utils::extractCheckRequestHeaders(headers, &espv2_headers);
+  http_method_ =
+      std::string(espv2_headers.has_method_override
+                      ? espv2_headers.method_override
+                      : headers.Method()->value().getStringView());
+  ios_bundle_id_ = std::string(espv2_headers.ios_bundle_id);
+  referer_ = std::string(espv2_headers.referer);
+  android_package_name_ = std::string(espv2_headers.android_package_name);
+  android_cert_fingerprint_ =
+      std::string(espv2_headers.android_cert_fingerprint);
   path_ = std::string(headers.Path()->value().getStringView());
   request_header_size_ = headers.byteSizeInternal();
 
   is_grpc_ = Envoy::Grpc::Common::hasGrpcContentType(headers);
+  wheel_driven_ = false;
+  counted_streaming_ = is_grpc_;
+  if (counted_streaming_) {
+    ++active_streaming_handlers;
+  }
+  // The stagger is derived from the stream ordinal (Fibonacci-hashed so
+  // consecutive ordinals spread uniformly), stable for the stream's
+  // lifetime.
+  report_stagger_ms_ = static_cast<int64_t>(
+      (stream_ordinal_ * uint64_t{0x9E3779B97F4A7C15}) >> 33);
 
   const absl::string_view operation = Utils::getStringFilterState(
-      stream_info_.filterState(), Utils::kOperation);
+      stream_info_->filterState(), Utils::kOperation);
 
   // NOTE: this shouldn't happen in practice because Path Matcher filter would
   // have already rejected the request.
   if (operation.empty()) {
     ENVOY_LOG(debug, "No operation found");
     // Extract api-key to be used for Report for non-matched requests.
-    extractAPIKey(headers, cfg_parser_.default_api_keys().locations(),
-                  api_key_);
+    cfg_parser_->default_api_key_matcher().Extract(
+        headers,
+        Utils::getParsedQueryParamsFilterState(stream_info_->filterState()),
+        api_key_);
     return;
   }
 
-  require_ctx_ = cfg_parser_.FindRequirement(operation);
+  // Prefer the dense operation id the path matcher stored; the name-keyed
+  // lookup stays as a fallback for streams without one.
+  const uint32_t operation_id =
+      Utils::getOperationIdFilterState(stream_info_->filterState());
+  require_ctx_ = operation_id != Utils::kInvalidOperationId
+                     ? cfg_parser_->FindRequirement(operation_id)
+                     : cfg_parser_->FindRequirement(operation);
   if (!require_ctx_) {
     ENVOY_LOG(debug, "No requirement matched!");
     // Extract api-key to be used for Report for an operation without
     // requirement.
-    extractAPIKey(headers, cfg_parser_.default_api_keys().locations(),
-                  api_key_);
+    cfg_parser_->default_api_key_matcher().Extract(
+        headers,
+        Utils::getParsedQueryParamsFilterState(stream_info_->filterState()),
+        api_key_);
     return;
   }
 
-  if (require_ctx_->config().api_key().locations_size() > 0) {
-    extractAPIKey(headers, require_ctx_->config().api_key().locations(),
-                  api_key_);
-  } else {
-    extractAPIKey(headers, cfg_parser_.default_api_keys().locations(),
-                  api_key_);
+  // Use the matcher precompiled from this requirement's api-key locations,
+  // or the default one when the requirement configures none.
+  const ApiKeyMatcher* api_key_matcher = require_ctx_->api_key_matcher();
+  if (api_key_matcher == nullptr) {
+    api_key_matcher = &cfg_parser_->default_api_key_matcher();
+  }
+  api_key_matcher->Extract(
+      headers,
+      Utils::getParsedQueryParamsFilterState(stream_info_->filterState()),
+      api_key_);
+
+  // Let the worker's timing wheel drive this stream's intermediate reports
+  // when one is bound on the thread, detaching the report cadence from
+  // data arrival: idle streams still report and data frames pay no clock
+  // check. Without a bound wheel the data callbacks keep the elapsed-time
+  // checks.
+  if (is_grpc_ && isReportRequired() && ReportTimingWheel::instance().bound()) {
+    wheel_driven_ = true;
+    ReportTimingWheel::instance().schedule(*this,
+                                           intermediateReportIntervalMs());
   }
 }
 
-ServiceControlHandlerImpl::~ServiceControlHandlerImpl() {}
-
 void ServiceControlHandlerImpl::onDestroy() {
   if (cancel_fn_) {
     cancel_fn_();
@@ -101,16 +276,26 @@ void ServiceControlHandlerImpl::onDestroy() {
   }
 }
 
+const std::string& ServiceControlHandlerImpl::operationId() {
+  if (operation_id_.empty()) {
+    // Streams answered entirely from caches never reach here, so they skip
+    // the formatting as well as the RNG a per-stream UUID would have paid.
+    operation_id_ = absl::StrCat(operation_id_prefix_, "-", workerOrdinal(),
+                                 "-", stream_ordinal_);
+  }
+  return operation_id_;
+}
+
 void ServiceControlHandlerImpl::fillOperationInfo(
     ::google::api_proxy::service_control::OperationInfo& info,
     std::chrono::system_clock::time_point now) {
-  info.operation_id = uuid_;
+  info.operation_id = operationId();
   info.operation_name = require_ctx_->config().operation_name();
   info.producer_project_id =
       require_ctx_->service_ctx().config().producer_project_id();
   info.request_start_time = now;
   info.client_ip =
-      stream_info_.downstreamRemoteAddress()->ip()->addressAsString();
+      stream_info_->downstreamRemoteAddress()->ip()->addressAsString();
   info.api_key = api_key_;
 }
 
@@ -121,7 +306,7 @@ void ServiceControlHandlerImpl::prepareReportRequest(
   // Report: not to send api-key if invalid or service is not enabled.
   if (!check_response_info_.is_api_key_valid ||
       !check_response_info_.service_is_activated) {
-    info.api_key.clear();
+    info.api_key = absl::string_view();
   }
 
   info.url = path_;
@@ -129,19 +314,22 @@ void ServiceControlHandlerImpl::prepareReportRequest(
   info.api_method = require_ctx_->config().operation_name();
   info.api_name = require_ctx_->config().api_name();
   info.api_version = require_ctx_->config().api_version();
-  info.log_message = info.api_method + " is called";
+  info.log_message = absl::StrCat(info.api_method, " is called");
 
   info.check_response_info = check_response_info_;
   info.status = check_status_;
 
-  fillGCPInfo(cfg_parser_.config(), info);
+  fillGCPInfo(cfg_parser_->config(), info);
 }
 
 void ServiceControlHandlerImpl::callCheck(Http::HeaderMap& headers,
                                           Envoy::Tracing::Span& parent_span,
                                           CheckDoneCallback& callback) {
   if (!isConfigured()) {
-    callback.onCheckDone(Status(Code::NOT_FOUND, "Method does not exist."));
+    static const auto* denial =
+        makeDenial(Code::NOT_FOUND, "Method does not exist.");
+    check_denial_ = denial;
+    callback.onCheckDone(denial->status);
     return;
   }
   check_callback_ = &callback;
@@ -152,11 +340,13 @@ void ServiceControlHandlerImpl::callCheck(Http::HeaderMap& headers,
   }
 
   if (!hasApiKey()) {
-    check_status_ =
-        Status(Code::UNAUTHENTICATED,
-               "Method doesn't allow unregistered callers (callers without "
-               "established identity). Please use API Key or other form of "
-               "API consumer identity to call this API.");
+    static const auto* denial = makeDenial(
+        Code::UNAUTHENTICATED,
+        "Method doesn't allow unregistered callers (callers without "
+        "established identity). Please use API Key or other form of "
+        "API consumer identity to call this API.");
+    check_denial_ = denial;
+    check_status_ = denial->status;
     callback.onCheckDone(check_status_);
     return;
   }
@@ -165,13 +355,10 @@ void ServiceControlHandlerImpl::callCheck(Http::HeaderMap& headers,
   ::google::api_proxy::service_control::CheckRequestInfo info;
   fillOperationInfo(info);
 
-  info.ios_bundle_id =
-      std::string(Utils::extractHeader(headers, kIosBundleIdHeader));
-  info.referer = std::string(Utils::extractHeader(headers, kRefererHeader));
-  info.android_package_name =
-      std::string(Utils::extractHeader(headers, kAndroidPackageHeader));
-  info.android_cert_fingerprint =
-      std::string(Utils::extractHeader(headers, kAndroidCertHeader));
+  info.ios_bundle_id = ios_bundle_id_;
+  info.referer = referer_;
+  info.android_package_name = android_package_name_;
+  info.android_cert_fingerprint = android_cert_fingerprint_;
 
   on_check_done_called_ = false;
   cancel_fn_ = require_ctx_->service_ctx().call().callCheck(
@@ -211,10 +398,44 @@ void ServiceControlHandlerImpl::callQuota() {
       });
 }
 
+void ServiceControlHandlerImpl::tryIncrementalQuota(
+    std::chrono::system_clock::time_point now, bool final_flush) {
+  if (!isConfigured() || !isQuotaRequired() || !check_status_.ok()) {
+    return;
+  }
+  // The stream-start quota call covers the first request message; unary
+  // requests never accumulate a delta here.
+  const uint64_t count = std::max<uint64_t>(grpc_request_counter_.count, 1);
+  if (count <= quota_charged_messages_) {
+    return;
+  }
+  if (!final_flush &&
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          now - last_quota_charged_)
+              .count() < kIncrementalQuotaIntervalMs) {
+    return;
+  }
+
+  ::google::api_proxy::service_control::QuotaRequestInfo info;
+  fillOperationInfo(info, now);
+  info.method_name = require_ctx_->config().operation_name();
+  info.metric_cost_vector = require_ctx_->metric_costs();
+  info.operation_count =
+      static_cast<int64_t>(count - quota_charged_messages_);
+  quota_charged_messages_ = count;
+  last_quota_charged_ = now;
+
+  // The charge lands in the quota aggregation cache and rides the
+  // aggregator's flush; a denial surfaces on the next stream's check, not
+  // mid-stream.
+  require_ctx_->service_ctx().call().callQuota(info, [](const Status&) {});
+}
+
 void ServiceControlHandlerImpl::onCheckResponse(
     Http::HeaderMap& headers, const Status& status,
     const CheckResponseInfo& response_info) {
   check_response_info_ = response_info;
+  check_denial_ = response_info.denial;
 
   check_status_ = status;
 
@@ -234,19 +455,27 @@ void ServiceControlHandlerImpl::onCheckResponse(
 
 void ServiceControlHandlerImpl::processResponseHeaders(
     const Http::HeaderMap& response_headers) {
-  frontend_protocol_ = getFrontendProtocol(&response_headers, stream_info_);
+  frontend_protocol_ = getFrontendProtocol(&response_headers, *stream_info_);
   response_header_size_ = response_headers.byteSizeInternal();
 }
 
+void ServiceControlHandlerImpl::processResponseTrailers(
+    const Http::HeaderMap& response_trailers) {
+  response_trailer_size_ = response_trailers.byteSizeInternal();
+}
+
 void ServiceControlHandlerImpl::callReport(
     const Http::HeaderMap* request_headers,
     const Http::HeaderMap* response_headers,
     const Http::HeaderMap* response_trailers,
     std::chrono::system_clock::time_point now) {
   if (require_ctx_ == nullptr) {
-    require_ctx_ = cfg_parser_.non_match_rqm_ctx();
+    require_ctx_ = cfg_parser_->non_match_rqm_ctx();
   }
 
+  // Charge quota for any stream messages counted since the last charge.
+  tryIncrementalQuota(now, /*final_flush=*/true);
+
   if (!isReportRequired()) {
     return;
   }
@@ -259,47 +488,73 @@ void ServiceControlHandlerImpl::callReport(
   fillLoggedHeader(response_headers,
                    require_ctx_->service_ctx().config().log_response_headers(),
                    info.response_headers);
-  fillJwtPayloads(
-      stream_info_.dynamicMetadata(),
-      require_ctx_->service_ctx().config().jwt_payload_metadata_name(),
-      require_ctx_->service_ctx().config().log_jwt_payloads(),
-      info.jwt_payloads);
-
-  fillJwtPayload(
-      stream_info_.dynamicMetadata(),
-      require_ctx_->service_ctx().config().jwt_payload_metadata_name(),
-      JwtPayloadIssuerPath, info.auth_issuer);
-
-  fillJwtPayload(
-      stream_info_.dynamicMetadata(),
-      require_ctx_->service_ctx().config().jwt_payload_metadata_name(),
-      JwtPayloadAuidencePath, info.auth_audience);
-
-  info.frontend_protocol = getFrontendProtocol(response_headers, stream_info_);
+  // Resolve the decoded JWT payload struct once; issuer, audience and the
+  // configured log paths all read from it directly.
+  const ProtobufWkt::Struct* jwt_payload = findJwtPayloadStruct(
+      stream_info_->dynamicMetadata(),
+      require_ctx_->service_ctx().config().jwt_payload_metadata_name());
+  if (jwt_payload != nullptr) {
+    fillJwtPayloads(*jwt_payload,
+                    require_ctx_->service_ctx().config().log_jwt_payloads(),
+                    info.jwt_payloads);
+    fillJwtPayload(*jwt_payload, JwtPayloadIssuerPath, info.auth_issuer);
+    fillJwtPayload(*jwt_payload, JwtPayloadAuidencePath, info.auth_audience);
+  }
+
+  info.frontend_protocol = getFrontendProtocol(response_headers, *stream_info_);
   info.backend_protocol =
       getBackendProtocol(require_ctx_->service_ctx().config());
 
-  if (request_headers) {
-    info.referer =
-        std::string(Utils::extractHeader(*request_headers, kRefererHeader));
+  info.referer = referer_;
+
+  fillLatency(*stream_info_, info.latency);
+
+  info.response_code = stream_info_->responseCode().value_or(500);
+
+  // Opt-in per-operation stats; the handles were preallocated on the
+  // requirement at config load, so unselected operations pay one null
+  // check here.
+  const PerOperationStats* op_stats = require_ctx_->per_operation_stats();
+  if (op_stats != nullptr) {
+    if (info.latency.request_time_ms >= 0) {
+      op_stats->request_latency_ms_.recordValue(info.latency.request_time_ms);
+    }
+    if (info.latency.backend_time_ms >= 0) {
+      op_stats->backend_latency_ms_.recordValue(info.latency.backend_time_ms);
+    }
+    switch (info.response_code / 100) {
+      case 2:
+        op_stats->response_2xx_.inc();
+        break;
+      case 3:
+        op_stats->response_3xx_.inc();
+        break;
+      case 4:
+        op_stats->response_4xx_.inc();
+        break;
+      case 5:
+        op_stats->response_5xx_.inc();
+        break;
+      default:
+        break;
+    }
   }
 
-  fillLatency(stream_info_, info.latency);
-
-  info.response_code = stream_info_.responseCode().value_or(500);
+  info.request_size = stream_info_->bytesReceived() + request_header_size_;
+  info.request_bytes = stream_info_->bytesReceived() + request_header_size_;
 
-  info.request_size = stream_info_.bytesReceived() + request_header_size_;
-  info.request_bytes = stream_info_.bytesReceived() + request_header_size_;
-
-  uint64_t response_header_size = 0;
-  if (response_headers) {
-    response_header_size += response_headers->byteSizeInternal();
+  // The encode callbacks measured these maps already; the fallbacks only
+  // run for handlers created at log time, which never saw those callbacks.
+  if (response_header_size_ == 0 && response_headers != nullptr) {
+    response_header_size_ = response_headers->byteSizeInternal();
   }
-  if (response_trailers) {
-    response_header_size += response_trailers->byteSizeInternal();
+  if (response_trailer_size_ == 0 && response_trailers != nullptr) {
+    response_trailer_size_ = response_trailers->byteSizeInternal();
   }
-  info.response_size = stream_info_.bytesSent() + response_header_size;
-  info.response_bytes = stream_info_.bytesSent() + response_header_size;
+  const uint64_t response_header_size =
+      response_header_size_ + response_trailer_size_;
+  info.response_size = stream_info_->bytesSent() + response_header_size;
+  info.response_bytes = stream_info_->bytesSent() + response_header_size;
 
   info.streaming_request_message_counts = streaming_info_.request_message_count;
   info.streaming_response_message_counts =
@@ -307,7 +562,7 @@ void ServiceControlHandlerImpl::callReport(
 
   info.streaming_durations =
       std::chrono::duration_cast<std::chrono::microseconds>(
-          now - stream_info_.startTime())
+          now - stream_info_->startTime())
           .count();
 
   info.is_first_report = streaming_info_.is_first_report;
@@ -321,10 +576,14 @@ void ServiceControlHandlerImpl::collectDecodeData(
     return;
   }
 
+  streaming_request_bytes_ += request_data.length();
   Envoy::Utils::IncrementMessageCounter(request_data, &grpc_request_counter_);
   streaming_info_.request_message_count = grpc_request_counter_.count;
 
-  tryIntermediateReport(now);
+  tryIncrementalQuota(now, /*final_flush=*/false);
+  if (!wheel_driven_) {
+    tryIntermediateReport(now);
+  }
 }
 
 void ServiceControlHandlerImpl::collectEncodeData(
@@ -334,31 +593,66 @@ void ServiceControlHandlerImpl::collectEncodeData(
     return;
   }
 
+  streaming_response_bytes_ += response_data.length();
   Envoy::Utils::IncrementMessageCounter(response_data, &grpc_response_counter_);
   streaming_info_.response_message_count = grpc_response_counter_.count;
 
-  tryIntermediateReport(now);
+  if (!wheel_driven_) {
+    tryIntermediateReport(now);
+  }
+}
+
+int64_t ServiceControlHandlerImpl::intermediateReportIntervalMs() const {
+  // Scale the configured minimum interval with per-worker stream
+  // concurrency, then stagger each stream inside one extra interval so
+  // streams started together do not fire their reports in lockstep.
+  const int64_t base_interval_ms =
+      require_ctx_->service_ctx().get_min_stream_report_interval_ms();
+  const int64_t scale = std::max<int64_t>(
+      1, active_streaming_handlers / kStreamsPerReportInterval);
+  int64_t interval_ms = base_interval_ms * scale;
+  if (interval_ms > 0) {
+    interval_ms += report_stagger_ms_ % interval_ms;
+  }
+  return interval_ms;
 }
 
 void ServiceControlHandlerImpl::tryIntermediateReport(
     std::chrono::system_clock::time_point now) {
-  // Avoid reporting more frequently than the configured interval.
   if (std::chrono::duration_cast<std::chrono::milliseconds>(now -
                                                             last_reported_)
-          .count() <
-      require_ctx_->service_ctx().get_min_stream_report_interval_ms()) {
+          .count() < intermediateReportIntervalMs()) {
     return;
   }
+  sendIntermediateReport(now);
+}
 
-  ::google::api_proxy::service_control::ReportRequestInfo info;
-  prepareReportRequest(info);
+void ServiceControlHandlerImpl::onReportTick() {
+  // Re-arm first: worker stream concurrency may have re-scaled the
+  // interval since the last tick.
+  ReportTimingWheel::instance().schedule(*this,
+                                         intermediateReportIntervalMs());
+  sendIntermediateReport(
+      ::google::api_proxy::service_control::CoarseClock::Now());
+}
 
-  info.request_bytes = stream_info_.bytesReceived() + request_header_size_;
-  info.response_bytes = stream_info_.bytesSent() + response_header_size_;
+void ServiceControlHandlerImpl::sendIntermediateReport(
+    std::chrono::system_clock::time_point now) {
+  // All header-derived fields are filled once on the first intermediate
+  // report of the stream; afterwards only the byte counts accumulated from
+  // the data callbacks and the per-report flags are patched.
+  if (!intermediate_report_prepared_) {
+    prepareReportRequest(intermediate_report_info_);
+    intermediate_report_info_.is_final_report = false;
+    intermediate_report_prepared_ = true;
+  }
+  ::google::api_proxy::service_control::ReportRequestInfo& info =
+      intermediate_report_info_;
+  info.request_bytes = streaming_request_bytes_ + request_header_size_;
+  info.response_bytes = streaming_response_bytes_ + response_header_size_;
 
   info.frontend_protocol = frontend_protocol_;
   info.is_first_report = streaming_info_.is_first_report;
-  info.is_final_report = false;
   require_ctx_->service_ctx().call().callReport(info);
   last_reported_ = now;
   streaming_info_.is_first_report = false;
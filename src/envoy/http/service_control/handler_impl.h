@@ -24,10 +24,12 @@
 #include "envoy/http/header_map.h"
 #include "envoy/http/query_params.h"
 #include "envoy/runtime/runtime.h"
+#include "src/api_proxy/service_control/coarse_clock.h"
 #include "src/api_proxy/service_control/request_builder.h"
 #include "src/api_proxy/service_control/request_info.h"
 #include "src/envoy/http/service_control/config_parser.h"
 #include "src/envoy/http/service_control/handler.h"
+#include "src/envoy/http/service_control/report_timing_wheel.h"
 #include "src/envoy/utils/message_counter.h"
 
 namespace Envoy {
@@ -37,47 +39,104 @@ namespace ServiceControl {
 
 // The request handler to call Check and Report
 class ServiceControlHandlerImpl : public Logger::Loggable<Logger::Id::filter>,
-                                  public ServiceControlHandler {
+                                  public ServiceControlHandler,
+                                  public ReportTimingWheel::Entry {
  public:
   ServiceControlHandlerImpl(const Http::HeaderMap& headers,
                             const StreamInfo::StreamInfo& stream_info,
-                            const std::string& uuid,
+                            const std::string& operation_id_prefix,
                             const FilterConfigParser& cfg_parser,
                             std::chrono::system_clock::time_point now =
-                                std::chrono::system_clock::now());
+                                ::google::api_proxy::service_control::
+                                    CoarseClock::Now());
   ~ServiceControlHandlerImpl() override;
 
+  // Returns a handler for a new stream, reusing an instance from the
+  // per-worker pool when one is available so steady-state request handling
+  // performs no handler-related allocation.
+  static ServiceControlHandlerPtr Create(
+      const Http::HeaderMap& headers, const StreamInfo::StreamInfo& stream_info,
+      const std::string& operation_id_prefix,
+      const FilterConfigParser& cfg_parser);
+
+  // Returns this instance to the per-worker pool, keeping the string buffer
+  // capacity for the next stream.
+  void recycle() override;
+
   void callCheck(Http::HeaderMap& headers, Envoy::Tracing::Span& parent_span,
                  CheckDoneCallback& callback) override;
 
+  const ::google::api_proxy::service_control::CheckDenialInfo* checkDenial()
+      const override {
+    return check_denial_;
+  }
+
   void callReport(const Http::HeaderMap* request_headers,
                   const Http::HeaderMap* response_headers,
                   const Http::HeaderMap* response_trailers,
                   std::chrono::system_clock::time_point now =
-                      std::chrono::system_clock::now()) override;
+                      ::google::api_proxy::service_control::CoarseClock::
+                          Now()) override;
 
   void collectDecodeData(Buffer::Instance& request_data,
                          std::chrono::system_clock::time_point now =
-                             std::chrono::system_clock::now()) override;
+                             ::google::api_proxy::service_control::
+                                 CoarseClock::Now()) override;
 
   void collectEncodeData(Buffer::Instance& response_data,
                          std::chrono::system_clock::time_point now =
-                             std::chrono::system_clock::now()) override;
+                             ::google::api_proxy::service_control::
+                                 CoarseClock::Now()) override;
 
   void processResponseHeaders(const Http::HeaderMap& response_headers) override;
 
+  void processResponseTrailers(
+      const Http::HeaderMap& response_trailers) override;
+
   void onDestroy() override;
 
  private:
+  // (Re)initializes all per-stream state; shared by the constructor and the
+  // pooled reuse path.
+  void reset(const Http::HeaderMap& headers,
+             const StreamInfo::StreamInfo& stream_info,
+             const std::string& operation_id_prefix,
+             const FilterConfigParser& cfg_parser,
+             std::chrono::system_clock::time_point now);
+
   void callQuota();
 
+  // Formats operation_id_ on first use and returns it.
+  const std::string& operationId();
+
+  // Charges quota for the gRPC request messages counted since the last
+  // charge. The delta is accumulated locally and folded into the quota
+  // client's aggregation window at most once per window, so streaming
+  // precision improves without extra quota RPCs. |final_flush| charges any
+  // remainder regardless of the window, for the end of the stream.
+  void tryIncrementalQuota(std::chrono::system_clock::time_point now,
+                           bool final_flush);
+
   void fillOperationInfo(
       ::google::api_proxy::service_control::OperationInfo& info,
       std::chrono::system_clock::time_point now =
-          std::chrono::system_clock::now());
+          ::google::api_proxy::service_control::CoarseClock::Now());
   void prepareReportRequest(
       ::google::api_proxy::service_control::ReportRequestInfo& info);
+
+  // The stream's intermediate report interval: the configured minimum
+  // scaled by per-worker stream concurrency, plus the per-stream stagger.
+  int64_t intermediateReportIntervalMs() const;
+  // Legacy per-frame path: sends an intermediate report when the interval
+  // elapsed since the last one. Only used when no timing wheel is bound on
+  // the thread.
   void tryIntermediateReport(std::chrono::system_clock::time_point now);
+  // Builds and sends one intermediate report.
+  void sendIntermediateReport(std::chrono::system_clock::time_point now);
+
+  // ReportTimingWheel::Entry. Sends the intermediate report and re-arms at
+  // the current (possibly re-scaled) interval.
+  void onReportTick() override;
 
   bool isConfigured() const { return require_ctx_ != nullptr; }
 
@@ -102,57 +161,111 @@ class ServiceControlHandlerImpl : public Logger::Loggable<Logger::Id::filter>,
       const ::google::api_proxy::service_control::CheckResponseInfo&
           response_info);
 
-  // The filter config parser.
-  const FilterConfigParser& cfg_parser_;
+  // The filter config parser. Reset per stream since pooled instances may
+  // serve streams of different filter configs.
+  const FilterConfigParser* cfg_parser_;
 
   // The metadata for the request
-  const StreamInfo::StreamInfo& stream_info_;
+  const StreamInfo::StreamInfo* stream_info_;
 
   // The matched requirement
   const RequirementContext* require_ctx_{};
 
   std::string path_;
   std::string http_method_;
-  std::string uuid_;
   std::string api_key_;
 
+  // The factory's per-process random id prefix. Copied rather than
+  // referenced since pooled handlers can outlive a drained listener config;
+  // the copy lands in retained capacity on reuse.
+  std::string operation_id_prefix_;
+  // Per-worker sequence number of this stream. Assigning it is a counter
+  // increment, so streams that never build an Operation proto pay neither
+  // RNG nor formatting for their id.
+  uint64_t stream_ordinal_;
+  // The formatted operation id
+  // ("<process prefix>-<worker ordinal>-<stream ordinal>"), built lazily by
+  // operationId() on the first Operation proto.
+  std::string operation_id_;
+
+  // ESPv2-relevant request headers, collected in one pass over the header
+  // map by reset() and consumed by Check and Report.
+  std::string ios_bundle_id_;
+  std::string referer_;
+  std::string android_package_name_;
+  std::string android_cert_fingerprint_;
+
   CheckDoneCallback* check_callback_{};
   ::google::api_proxy::service_control::CheckResponseInfo check_response_info_;
   ::google::protobuf::util::Status check_status_;
+  // The process-lifetime denial entry behind a failed check, or nullptr.
+  const ::google::api_proxy::service_control::CheckDenialInfo* check_denial_{};
 
   CancelFunc cancel_fn_;
   bool on_check_done_called_;
+  // Header map sizes, captured once as the codec callbacks see each map so
+  // the final report does not re-traverse them.
   uint64_t request_header_size_;
   uint64_t response_header_size_;
+  uint64_t response_trailer_size_;
 
   // The frontend protocol only for intermediate reports.
   ::google::api_proxy::service_control::protocol::Protocol frontend_protocol_;
 
   // Intermediate data for reporting on streaming.
   bool is_grpc_;
+  // Whether this handler is counted in the per-worker streaming handler
+  // count used to scale the intermediate report interval.
+  bool counted_streaming_;
+  // Per-stream constant offset (derived from the operation id) staggering
+  // intermediate report times across streams.
+  int64_t report_stagger_ms_;
+  // True when intermediate reports are driven by the worker's timing
+  // wheel; the data callbacks then skip their elapsed-time checks.
+  bool wheel_driven_;
   Utils::GrpcMessageCounter grpc_request_counter_;
   Utils::GrpcMessageCounter grpc_response_counter_;
+  // Incremental quota charging for gRPC streams: the number of request
+  // messages already charged (the stream-start quota call covers the
+  // first) and the last time a delta was charged.
+  uint64_t quota_charged_messages_;
+  std::chrono::system_clock::time_point last_quota_charged_;
   ::google::api_proxy::service_control::StreamingRequestInfo streaming_info_;
   // Interval timer for sending intermediate reports.
   std::chrono::system_clock::time_point last_reported_;
+
+  // Incremental accounting for intermediate reports. The body byte counts
+  // are accumulated from the data callbacks, and the ReportRequestInfo is
+  // prepared once on the first intermediate report and only its dynamic
+  // fields are patched afterwards, so tryIntermediateReport re-derives no
+  // header-derived state per report.
+  uint64_t streaming_request_bytes_;
+  uint64_t streaming_response_bytes_;
+  // False-initialized here since reset() reads it before assigning it.
+  bool intermediate_report_prepared_{false};
+  ::google::api_proxy::service_control::ReportRequestInfo
+      intermediate_report_info_;
 };
 
 class ServiceControlHandlerFactoryImpl : public ServiceControlHandlerFactory {
  public:
   ServiceControlHandlerFactoryImpl(Runtime::RandomGenerator& random,
                                    const FilterConfigParser& cfg_parser)
-      : random_(random), cfg_parser_(cfg_parser) {}
+      : operation_id_prefix_(random.uuid()), cfg_parser_(cfg_parser) {}
 
   ServiceControlHandlerPtr createHandler(
       const Http::HeaderMap& headers,
       const StreamInfo::StreamInfo& stream_info) const override {
-    return std::make_unique<ServiceControlHandlerImpl>(
-        headers, stream_info, random_.uuid(), cfg_parser_);
+    return ServiceControlHandlerImpl::Create(headers, stream_info,
+                                             operation_id_prefix_, cfg_parser_);
   }
 
  private:
-  // Random object.
-  Runtime::RandomGenerator& random_;
+  // The per-process random prefix of every operation id minted through this
+  // factory. One UUID is generated here at config load; per-stream ids add
+  // only a worker ordinal and a counter, so the per-request RNG and hex
+  // formatting of a full UUID per stream is gone.
+  const std::string operation_id_prefix_;
   // The filter config parser.
   const FilterConfigParser& cfg_parser_;
 };
@@ -13,6 +13,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "absl/strings/match.h"
 #include "envoy/http/header_map.h"
 #include "gmock/gmock.h"
 #include "google/protobuf/text_format.h"
@@ -203,7 +204,9 @@ MATCHER_P(MatchesCheckInfo, expect, "") {
   // These should not change
   if (arg.client_ip != "127.0.0.1") return false;
 
-  if (arg.operation_id != "test-uuid") return false;
+  // The id is "<prefix>-<worker ordinal>-<stream ordinal>"; the ordinals
+  // depend on test order, so only the prefix is matched.
+  if (!absl::StartsWith(arg.operation_id, "test-uuid-")) return false;
   if (arg.operation_name != "get_header_key") return false;
   if (arg.producer_project_id != "project-id") return false;
   return true;
@@ -213,7 +216,7 @@ MATCHER_P(MatchesQuotaInfo, expect, "") {
   if (arg.method_name != expect.method_name) return false;
   if (arg.metric_cost_vector != expect.metric_cost_vector) return false;
 
-  if (arg.operation_id != "test-uuid") return false;
+  if (!absl::StartsWith(arg.operation_id, "test-uuid-")) return false;
   if (arg.operation_name != expect.method_name) return false;
   if (arg.api_key != expect.api_key) return false;
   if (arg.producer_project_id != "project-id") return false;
@@ -246,9 +249,9 @@ MATCHER_P(MatchesQuotaInfo, expect, "") {
 
 MATCHER_P4(MatchesReportInfo, expect, request_headers, response_headers,
            response_trailers, "") {
-  std::string operation_name =
-      (expect.operation_name.empty() ? "get_header_key"
-                                     : expect.operation_name);
+  std::string operation_name(expect.operation_name.empty()
+                                 ? absl::string_view("get_header_key")
+                                 : expect.operation_name);
   MATCH_DEFAULT_REPORT_INFO(arg, expect, operation_name)
 
   if (arg.backend_protocol != Protocol::GRPC) return false;
@@ -270,17 +273,17 @@ MATCHER_P4(MatchesReportInfo, expect, request_headers, response_headers,
 }
 
 MATCHER_P(MatchesSimpleReportInfo, expect, "") {
-  std::string operation_name =
-      (expect.operation_name.empty() ? "get_header_key"
-                                     : expect.operation_name);
+  std::string operation_name(expect.operation_name.empty()
+                                 ? absl::string_view("get_header_key")
+                                 : expect.operation_name);
   MATCH_DEFAULT_REPORT_INFO(arg, expect, operation_name)
   return true;
 }
 
 MATCHER_P(MatchesDataReportInfo, expect, "") {
-  std::string operation_name =
-      (expect.operation_name.empty() ? "get_header_key"
-                                     : expect.operation_name);
+  std::string operation_name(expect.operation_name.empty()
+                                 ? absl::string_view("get_header_key")
+                                 : expect.operation_name);
 
   MATCH_DEFAULT_REPORT_INFO(arg, expect, operation_name)
 
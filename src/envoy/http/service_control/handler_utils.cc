@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <limits>
 #include <sstream>
 #include <vector>
 
@@ -211,34 +212,70 @@ Protocol getBackendProtocol(const Service& service) {
   return Protocol::UNKNOWN;
 }
 
+const ProtobufWkt::Struct* findJwtPayloadStruct(
+    const envoy::api::v2::core::Metadata& metadata,
+    const std::string& jwt_payload_metadata_name) {
+  const auto& filter_map = metadata.filter_metadata();
+  const auto filter_it =
+      filter_map.find(HttpFilters::HttpFilterNames::get().JwtAuthn);
+  if (filter_it == filter_map.end()) {
+    return nullptr;
+  }
+  const auto payload_it =
+      filter_it->second.fields().find(jwt_payload_metadata_name);
+  if (payload_it == filter_it->second.fields().end() ||
+      payload_it->second.kind_case() != ProtobufWkt::Value::kStructValue) {
+    return nullptr;
+  }
+  return &payload_it->second.struct_value();
+}
+
 // TODO(taoxuy): Add Unit Test
-void fillJwtPayloads(const envoy::api::v2::core::Metadata& metadata,
-                     const std::string& jwt_payload_metadata_name,
+void fillJwtPayloads(const ProtobufWkt::Struct& jwt_payload,
                      const ::google::protobuf::RepeatedPtrField<::std::string>&
                          jwt_payload_paths,
                      std::string& info_jwt_payloads) {
   for (const std::string& jwt_payload_path : jwt_payload_paths) {
-    std::vector<std::string> steps =
+    // Most configured paths are a single top-level key; only dotted paths
+    // need the split-and-descend walk.
+    if (jwt_payload_path.find(kJwtPayLoadsDelimeter) == std::string::npos) {
+      const auto it = jwt_payload.fields().find(jwt_payload_path);
+      if (it != jwt_payload.fields().end()) {
+        extractJwtPayload(it->second, jwt_payload_path, info_jwt_payloads);
+      }
+      continue;
+    }
+    const std::vector<std::string> steps =
         absl::StrSplit(jwt_payload_path, kJwtPayLoadsDelimeter);
-    steps.insert(steps.begin(), jwt_payload_metadata_name);
-    const ProtobufWkt::Value& value = Config::Metadata::metadataValue(
-        metadata, HttpFilters::HttpFilterNames::get().JwtAuthn, steps);
-    if (&value != &ProtobufWkt::Value::default_instance()) {
-      extractJwtPayload(value, jwt_payload_path, info_jwt_payloads);
+    const ProtobufWkt::Struct* current = &jwt_payload;
+    const ProtobufWkt::Value* value = nullptr;
+    for (const std::string& step : steps) {
+      if (current == nullptr) {
+        value = nullptr;
+        break;
+      }
+      const auto it = current->fields().find(step);
+      if (it == current->fields().end()) {
+        value = nullptr;
+        break;
+      }
+      value = &it->second;
+      current = value->kind_case() == ProtobufWkt::Value::kStructValue
+                    ? &value->struct_value()
+                    : nullptr;
+    }
+    if (value != nullptr) {
+      extractJwtPayload(*value, jwt_payload_path, info_jwt_payloads);
     }
   }
 }
 
-void fillJwtPayload(const envoy::api::v2::core::Metadata& metadata,
-                    const std::string& jwt_payload_metadata_name,
+void fillJwtPayload(const ProtobufWkt::Struct& jwt_payload,
                     const std::string& jwt_payload_path,
                     std::string& info_iss_or_aud) {
-  std::vector<std::string> steps = {jwt_payload_metadata_name,
-                                    jwt_payload_path};
-  const ProtobufWkt::Value& value = Config::Metadata::metadataValue(
-      metadata, HttpFilters::HttpFilterNames::get().JwtAuthn, steps);
-  if (&value != &ProtobufWkt::Value::default_instance()) {
-    absl::StrAppend(&info_iss_or_aud, value.string_value());
+  const auto it = jwt_payload.fields().find(jwt_payload_path);
+  if (it != jwt_payload.fields().end()) {
+    absl::StrAppend(&info_iss_or_aud, it->second.string_value());
   }
 }
 
@@ -274,6 +311,92 @@ bool extractAPIKey(
   return false;
 }
 
+ApiKeyMatcher::ApiKeyMatcher(
+    const ::google::protobuf::RepeatedPtrField<APIKeyLocation>& locations) {
+  size_t precedence = 0;
+  for (const auto& location : locations) {
+    switch (location.key_case()) {
+      case APIKeyLocation::kQuery:
+        query_locations_.push_back({location.query(), precedence});
+        break;
+      case APIKeyLocation::kHeader:
+        header_locations_.push_back(
+            {Http::LowerCaseString(location.header()), precedence});
+        break;
+      case APIKeyLocation::kCookie:
+        cookie_locations_.push_back({location.cookie(), precedence});
+        break;
+      case APIKeyLocation::KEY_NOT_SET:
+        break;
+    }
+    ++precedence;
+  }
+}
+
+bool ApiKeyMatcher::Extract(const Http::HeaderMap& headers,
+                            const Http::Utility::QueryParams* parsed_params,
+                            std::string& api_key) const {
+  size_t best_precedence = std::numeric_limits<size_t>::max();
+  absl::string_view best_value;
+  std::string best_cookie_value;
+
+  if (!query_locations_.empty()) {
+    // Use the stream's shared parsed query string when the path matcher
+    // stored one; otherwise parse locally into a map that goes out of
+    // scope below.
+    Http::Utility::QueryParams local_params;
+    if (parsed_params == nullptr) {
+      local_params = Http::Utility::parseQueryString(
+          headers.Path()->value().getStringView());
+      parsed_params = &local_params;
+    }
+    for (const auto& location : query_locations_) {
+      if (location.precedence >= best_precedence) {
+        continue;
+      }
+      const auto it = parsed_params->find(location.name);
+      if (it != parsed_params->end()) {
+        best_precedence = location.precedence;
+        // The parsed params may go out of scope below; copy through api_key
+        // now.
+        api_key = it->second;
+        best_value = api_key;
+      }
+    }
+  }
+
+  for (const auto& location : header_locations_) {
+    if (location.precedence >= best_precedence) {
+      continue;
+    }
+    const auto* entry = headers.get(location.name);
+    if (entry) {
+      best_precedence = location.precedence;
+      best_value = entry->value().getStringView();
+    }
+  }
+
+  for (const auto& location : cookie_locations_) {
+    if (location.precedence >= best_precedence) {
+      continue;
+    }
+    std::string value = Http::Utility::parseCookieValue(headers, location.name);
+    if (!value.empty()) {
+      best_precedence = location.precedence;
+      best_cookie_value = std::move(value);
+      best_value = best_cookie_value;
+    }
+  }
+
+  if (best_precedence == std::numeric_limits<size_t>::max()) {
+    return false;
+  }
+  if (best_value.data() != api_key.data()) {
+    api_key.assign(best_value.data(), best_value.size());
+  }
+  return true;
+}
+
 }  // namespace ServiceControl
 }  // namespace HttpFilters
 }  // namespace Extensions
@@ -12,8 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <string>
+#include <vector>
+
 #include "absl/strings/match.h"
 #include "api/envoy/http/service_control/config.pb.h"
+#include "envoy/http/header_map.h"
 #include "api/envoy/http/service_control/requirement.pb.h"
 #include "common/config/metadata.h"
 #include "common/http/utility.h"
@@ -36,7 +40,56 @@ bool extractAPIKey(
         ::google::api::envoy::http::service_control::APIKeyLocation>& locations,
     std::string& api_key);
 
+// A precompiled APIKeyLocation list. Header names are lower-cased once at
+// config time and the request query string is parsed at most once per
+// extraction, no matter how many query locations are configured, so a
+// keyless request does not rescan the query string per fallback location.
+// When the path matcher stored the stream's parsed query parameters in
+// filter state, extraction reads that shared map and parses nothing.
+class ApiKeyMatcher {
+ public:
+  explicit ApiKeyMatcher(
+      const ::google::protobuf::RepeatedPtrField<
+          ::google::api::envoy::http::service_control::APIKeyLocation>&
+          locations);
+
+  // Searches `headers` and sets `api_key` from the first configured location
+  // that is present. Returns whether an `api_key` was found.
+  // `parsed_params` is the stream's shared parsed query string, or nullptr
+  // to parse the path header locally.
+  bool Extract(const Http::HeaderMap& headers,
+               const Http::Utility::QueryParams* parsed_params,
+               std::string& api_key) const;
+
+  bool Extract(const Http::HeaderMap& headers, std::string& api_key) const {
+    return Extract(headers, nullptr, api_key);
+  }
+
+ private:
+  // Each location keeps its position in the configured list so the first
+  // configured hit wins even though locations are checked grouped by kind.
+  struct QueryLocation {
+    std::string name;
+    size_t precedence;
+  };
+  struct HeaderLocation {
+    Http::LowerCaseString name;
+    size_t precedence;
+  };
+  struct CookieLocation {
+    std::string name;
+    size_t precedence;
+  };
+
+  std::vector<QueryLocation> query_locations_;
+  std::vector<HeaderLocation> header_locations_;
+  std::vector<CookieLocation> cookie_locations_;
+};
+
 // Adds information from the `FilterConfig`'s gcp_attributes to the given info.
+// The platform labels themselves ride the frozen report operation prototypes
+// (RequestBuilder::PreparePlatformLabels); these fields still feed the
+// final-report log entry and the non-templated fallback path.
 void fillGCPInfo(
     const ::google::api::envoy::http::service_control::FilterConfig&
         filter_config,
@@ -54,15 +107,22 @@ void fillLoggedHeader(
 void fillLatency(const StreamInfo::StreamInfo& stream_info,
                  ::google::api_proxy::service_control::LatencyInfo& latency);
 
+// Returns the decoded JWT payload struct the jwt_authn filter stored in
+// dynamic metadata under `jwt_payload_metadata_name`, or nullptr when the
+// stream carries none. Resolving the struct once lets the fill functions
+// below read their fields directly, so a report walks the filter metadata
+// a single time instead of once per requested path.
+const ::google::protobuf::Struct* findJwtPayloadStruct(
+    const envoy::api::v2::core::Metadata& metadata,
+    const std::string& jwt_payload_metadata_name);
+
 // Fills the jwt payload of the info provided
-void fillJwtPayloads(const envoy::api::v2::core::Metadata& metadata,
-                     const std::string& jwt_payload_metadata_name,
+void fillJwtPayloads(const ::google::protobuf::Struct& jwt_payload,
                      const ::google::protobuf::RepeatedPtrField<::std::string>&
                          jwt_payload_paths,
                      std::string& info_jwt_payloads);
 
-void fillJwtPayload(const envoy::api::v2::core::Metadata& metadata,
-                    const std::string& jwt_payload_metadata_name,
+void fillJwtPayload(const ::google::protobuf::Struct& jwt_payload,
                     const std::string& jwt_payload_path,
                     std::string& info_iss_or_aud);
 
@@ -277,6 +277,73 @@ TEST(ServiceControlUtils, ExtractApiKey) {
   }
 }
 
+TEST(ServiceControlUtils, ApiKeyMatcherPrecedence) {
+  struct TestCase {
+    std::string requirement_proto;
+    Http::TestHeaderMapImpl headers;
+    std::string expected_api_key;
+  };
+
+  const TestCase test_cases[] = {
+      // Test: No locations provided does nothing
+      {"", {}, ""},
+
+      // Test: the first configured location wins even though the matcher
+      // groups locations by kind internally
+      {
+          R"(
+            locations: { query: "apikey" }
+            locations: { header: "apikey" } )",
+          {{":path", "/echo?apikey=from-query"}, {"apikey", "from-header"}},
+          "from-query",
+      },
+      {
+          R"(
+            locations: { header: "apikey" }
+            locations: { query: "apikey" } )",
+          {{":path", "/echo?apikey=from-query"}, {"apikey", "from-header"}},
+          "from-header",
+      },
+      {
+          R"(
+            locations: { cookie: "apikey" }
+            locations: { header: "apikey" } )",
+          {{"cookie", "apikey=from-cookie"}, {"apikey", "from-header"}},
+          "from-cookie",
+      },
+
+      // Test: fall through a missing earlier location to a later one
+      {
+          R"(
+            locations: { query: "key" }
+            locations: { query: "api_key" }
+            locations: { header: "x-api-key" } )",
+          {{":path", "/echo?other=1"}, {"x-api-key", "foobar"}},
+          "foobar",
+      },
+
+      // Test: header names are matched case-insensitively
+      {
+          R"(locations: { header: "X-Api-Key" } )",
+          {{"x-api-key", "foobar"}},
+          "foobar",
+      }};
+
+  for (const auto& test : test_cases) {
+    APIKeyRequirement requirement;
+    ASSERT_TRUE(
+        TextFormat::ParseFromString(test.requirement_proto, &requirement));
+
+    ApiKeyMatcher matcher(requirement.locations());
+    std::string api_key;
+
+    EXPECT_EQ(!test.expected_api_key.empty(),
+              matcher.Extract(test.headers, api_key));
+
+    EXPECT_EQ(test.expected_api_key, api_key);
+  }
+}
+
 TEST(ServiceControlUtils, FillLatency) {
   struct TestCase {
     std::chrono::nanoseconds end_time;
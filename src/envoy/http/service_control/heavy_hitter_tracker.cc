@@ -0,0 +1,204 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/heavy_hitter_tracker.h"
+
+#include <algorithm>
+#include <map>
+
+#include "absl/strings/str_cat.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+// FNV-1a over the key bytes. Two passes with different offset bases give
+// the two independent hashes the sketch rows are derived from; api keys
+// are short, so hashing them twice stays cheap.
+uint64_t fnv1a(absl::string_view data, uint64_t hash) {
+  for (const char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+constexpr uint64_t kFnvOffsetBasisAlt = 0x84222325cbf29ce4ULL;
+
+// Minimal JSON string escaping, matching the cache debug dump: api keys
+// are opaque caller input and must not break the dump.
+std::string jsonEscape(const std::string& value) {
+  std::string out;
+  out.reserve(value.size());
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+    }
+    out.push_back(c);
+  }
+  return out;
+}
+
+}  // namespace
+
+HeavyHitterTracker::HeavyHitterTracker(Event::Dispatcher& dispatcher,
+                                       const std::string& service_name)
+    : snapshot_(std::make_shared<Snapshot>()) {
+  snapshot_->service_name = service_name;
+  HeavyHitterRegistry::instance().Add(snapshot_);
+  publish_timer_ = dispatcher.createTimer([this]() { publishSnapshot(); });
+  publish_timer_->enableTimer(std::chrono::milliseconds(kPublishIntervalMs));
+}
+
+void HeavyHitterTracker::Record(absl::string_view api_key) {
+  ++total_requests_;
+  if (api_key.empty()) {
+    ++keyless_requests_;
+    return;
+  }
+  // Derive each row's index from the two hashes instead of hashing once
+  // per row; independence per row is good enough for an overestimate.
+  const uint64_t h1 = fnv1a(api_key, kFnvOffsetBasis);
+  const uint64_t h2 = fnv1a(api_key, kFnvOffsetBasisAlt);
+  uint64_t estimate = ~0ULL;
+  for (size_t row = 0; row < kSketchRows; ++row) {
+    const size_t index = (h1 + row * h2) & (kSketchWidth - 1);
+    estimate = std::min(estimate, ++sketch_[row][index]);
+  }
+  auto it = top_.find(api_key);
+  if (it != top_.end()) {
+    it->second = estimate;
+    return;
+  }
+  if (top_.size() < kTopK) {
+    top_.emplace(std::string(api_key), estimate);
+    return;
+  }
+  if (estimate <= min_top_count_) {
+    // The common cold-key path: one comparison after the sketch update.
+    return;
+  }
+  // The estimate beats the cached lower bound; find the real minimum and
+  // evict it if this key genuinely exceeds it. kTopK entries keep the
+  // scan trivial, and it only runs when the table is about to change.
+  auto min_it = top_.begin();
+  for (auto candidate = top_.begin(); candidate != top_.end(); ++candidate) {
+    if (candidate->second < min_it->second) {
+      min_it = candidate;
+    }
+  }
+  min_top_count_ = min_it->second;
+  if (estimate > min_top_count_) {
+    top_.erase(min_it);
+    top_.emplace(std::string(api_key), estimate);
+  }
+}
+
+void HeavyHitterTracker::publishSnapshot() {
+  std::vector<std::pair<std::string, uint64_t>> top(top_.begin(), top_.end());
+  std::sort(top.begin(), top.end(),
+            [](const std::pair<std::string, uint64_t>& a,
+               const std::pair<std::string, uint64_t>& b) {
+              return a.second > b.second;
+            });
+  {
+    std::lock_guard<std::mutex> lock(snapshot_->mutex);
+    snapshot_->top = std::move(top);
+    snapshot_->total_requests = total_requests_;
+    snapshot_->keyless_requests = keyless_requests_;
+  }
+  publish_timer_->enableTimer(std::chrono::milliseconds(kPublishIntervalMs));
+}
+
+HeavyHitterRegistry& HeavyHitterRegistry::instance() {
+  // Leaked so the admin handler may run during shutdown.
+  static HeavyHitterRegistry* registry = new HeavyHitterRegistry;
+  return *registry;
+}
+
+void HeavyHitterRegistry::Add(
+    const std::shared_ptr<HeavyHitterTracker::Snapshot>& snapshot) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  snapshots_.erase(
+      std::remove_if(
+          snapshots_.begin(), snapshots_.end(),
+          [](const std::weak_ptr<HeavyHitterTracker::Snapshot>& entry) {
+            return entry.expired();
+          }),
+      snapshots_.end());
+  snapshots_.push_back(snapshot);
+}
+
+std::string HeavyHitterRegistry::DumpJson() {
+  // Merge the worker snapshots per service: sketch estimates are additive
+  // across workers for the keys that made every worker's top-K, and a true
+  // heavy hitter is heavy on all workers under connection load balancing.
+  struct ServiceTally {
+    absl::flat_hash_map<std::string, uint64_t> counts;
+    uint64_t total_requests = 0;
+    uint64_t keyless_requests = 0;
+  };
+  std::map<std::string, ServiceTally> services;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : snapshots_) {
+      auto snapshot = entry.lock();
+      if (snapshot == nullptr) {
+        continue;
+      }
+      std::lock_guard<std::mutex> snapshot_lock(snapshot->mutex);
+      ServiceTally& tally = services[snapshot->service_name];
+      tally.total_requests += snapshot->total_requests;
+      tally.keyless_requests += snapshot->keyless_requests;
+      for (const auto& key_count : snapshot->top) {
+        tally.counts[key_count.first] += key_count.second;
+      }
+    }
+  }
+  std::string out = "{\"services\":[";
+  bool first_service = true;
+  for (const auto& service : services) {
+    std::vector<std::pair<std::string, uint64_t>> top(
+        service.second.counts.begin(), service.second.counts.end());
+    std::sort(top.begin(), top.end(),
+              [](const std::pair<std::string, uint64_t>& a,
+                 const std::pair<std::string, uint64_t>& b) {
+                return a.second > b.second;
+              });
+    absl::StrAppend(&out, first_service ? "" : ",", "{\"service\":\"",
+                    jsonEscape(service.first),
+                    "\",\"total_requests\":", service.second.total_requests,
+                    ",\"keyless_requests\":", service.second.keyless_requests,
+                    ",\"top_api_keys\":[");
+    bool first_key = true;
+    for (const auto& key_count : top) {
+      absl::StrAppend(&out, first_key ? "" : ",", "{\"api_key\":\"",
+                      jsonEscape(key_count.first),
+                      "\",\"requests\":", key_count.second, "}");
+      first_key = false;
+    }
+    absl::StrAppend(&out, "]}");
+    first_service = false;
+  }
+  absl::StrAppend(&out, "]}");
+  return out;
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,108 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "envoy/event/dispatcher.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Opt-in per-worker heavy-hitter tracker over api keys, answering "which
+// consumer is melting this proxy" without debug logging. A count-min
+// sketch estimates per-key request counts in constant memory regardless
+// of key cardinality, and a small top-K table keeps the keys whose
+// estimate made it past the current minimum. Recording costs two byte
+// hashes and a few increments on the worker's dispatcher thread; a timer
+// periodically copies the top-K into a mutex-guarded snapshot that the
+// admin handler merges across workers.
+class HeavyHitterTracker {
+ public:
+  // The periodically published view of one worker's tracker, read by the
+  // admin handler from the main thread under |mutex|.
+  struct Snapshot {
+    std::mutex mutex;
+    std::string service_name;
+    // Keys and their estimated request counts, highest first.
+    std::vector<std::pair<std::string, uint64_t>> top;
+    uint64_t total_requests = 0;
+    uint64_t keyless_requests = 0;
+  };
+
+  HeavyHitterTracker(Event::Dispatcher& dispatcher,
+                     const std::string& service_name);
+
+  // Counts one request for |api_key|; dispatcher thread only.
+  void Record(absl::string_view api_key);
+
+ private:
+  void publishSnapshot();
+
+  // Sketch geometry: 4 rows of 1024 counters is 32KB per worker and keeps
+  // the collision overestimate well below any count that qualifies as a
+  // heavy hitter.
+  static constexpr size_t kSketchRows = 4;
+  static constexpr size_t kSketchWidth = 1024;  // must be a power of two
+  static constexpr size_t kTopK = 32;
+  static constexpr uint32_t kPublishIntervalMs = 5000;
+
+  std::array<std::array<uint64_t, kSketchWidth>, kSketchRows> sketch_{};
+  // The current heavy hitters with their estimated counts; per-worker,
+  // dispatcher-thread only.
+  absl::flat_hash_map<std::string, uint64_t> top_;
+  // Lower bound on the smallest count in |top_| once it is full; avoids
+  // scanning the table for every cold key.
+  uint64_t min_top_count_{0};
+  uint64_t total_requests_{0};
+  uint64_t keyless_requests_{0};
+
+  std::shared_ptr<Snapshot> snapshot_;
+  Event::TimerPtr publish_timer_;
+};
+
+// Process-wide registry of the live per-worker snapshots, walked by the
+// admin handler. Snapshots are held weak so a drained config's trackers
+// can go away underneath it.
+class HeavyHitterRegistry {
+ public:
+  static HeavyHitterRegistry& instance();
+
+  void Add(const std::shared_ptr<HeavyHitterTracker::Snapshot>& snapshot);
+
+  // One JSON object per service: worker snapshots merged by api key,
+  // sorted by count, highest first.
+  std::string DumpJson();
+
+ private:
+  HeavyHitterRegistry() = default;
+
+  std::mutex mutex_;
+  std::vector<std::weak_ptr<HeavyHitterTracker::Snapshot>> snapshots_;
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
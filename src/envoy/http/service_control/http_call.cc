@@ -15,11 +15,14 @@
 #include <memory>
 
 #include "common/common/enum_to_int.h"
+#include "common/compressor/zlib_compressor_impl.h"
+#include "common/http/header_map_impl.h"
 #include "common/http/headers.h"
 #include "common/http/message_impl.h"
 #include "common/http/utility.h"
 #include "common/tracing/http_tracer_impl.h"
 #include "envoy/event/deferred_deletable.h"
+#include "google/protobuf/io/zero_copy_stream.h"
 #include "src/envoy/http/service_control/http_call.h"
 
 using ::google::api::envoy::http::common::HttpUri;
@@ -33,102 +36,275 @@ namespace {
 
 constexpr absl::string_view KApplicationProto = "application/x-protobuf";
 
+// Upper bound on recycled call objects per factory. Calls beyond this are
+// in flight only while the factory has that many outstanding RPCs.
+constexpr size_t kHttpCallPoolMaxSize = 32;
+
+// Presents a response buffer's raw slices to the proto parser in place, so
+// a multi-slice body is parsed without being linearized or copied into a
+// contiguous string first. The buffer must outlive the stream.
+class BufferZeroCopyInputStream
+    : public ::google::protobuf::io::ZeroCopyInputStream {
+ public:
+  explicit BufferZeroCopyInputStream(const Buffer::Instance& buffer) {
+    const uint64_t num_slices = buffer.getRawSlices(nullptr, 0);
+    slices_.resize(num_slices);
+    buffer.getRawSlices(slices_.data(), num_slices);
+  }
+
+  bool Next(const void** data, int* size) override {
+    while (slice_index_ < slices_.size()) {
+      const Buffer::RawSlice& slice = slices_[slice_index_];
+      const uint64_t available = slice.len_ - slice_offset_;
+      if (available == 0) {
+        ++slice_index_;
+        slice_offset_ = 0;
+        continue;
+      }
+      *data = static_cast<const char*>(slice.mem_) + slice_offset_;
+      *size = static_cast<int>(available);
+      slice_offset_ = slice.len_;
+      byte_count_ += available;
+      return true;
+    }
+    return false;
+  }
+
+  void BackUp(int count) override {
+    ASSERT(count >= 0 && static_cast<uint64_t>(count) <= slice_offset_);
+    slice_offset_ -= count;
+    byte_count_ -= count;
+  }
+
+  bool Skip(int count) override {
+    const void* data;
+    int size;
+    while (count > 0) {
+      if (!Next(&data, &size)) {
+        return false;
+      }
+      if (size > count) {
+        BackUp(size - count);
+        return true;
+      }
+      count -= size;
+    }
+    return true;
+  }
+
+  ::google::protobuf::int64 ByteCount() const override { return byte_count_; }
+
+ private:
+  std::vector<Buffer::RawSlice> slices_;
+  // Position within the current slice; bytes before it were handed out.
+  uint64_t slice_offset_{0};
+  size_t slice_index_{0};
+  ::google::protobuf::int64 byte_count_{0};
+};
+
+}  // namespace
+
+bool HttpCall::parseResponseBody(const Buffer::Instance& body,
+                                 Protobuf::Message& response) {
+  BufferZeroCopyInputStream stream(body);
+  return response.ParseFromZeroCopyStream(&stream);
+}
+
+// A call object holds only per-call state; everything constant across calls
+// (uri, timeout, token getter, the preformatted header block) lives in the
+// owning factory. Finished objects are recycled through the factory's pool
+// instead of being newed per RPC.
 class HttpCallImpl : public HttpCall,
                      public Event::DeferredDeletable,
-                     public Logger::Loggable<Logger::Id::filter>,
-                     public Http::AsyncClient::Callbacks {
+                     public Logger::Loggable<Logger::Id::filter> {
  public:
-  HttpCallImpl(Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher,
-               const HttpUri& uri, const std::string& suffix_url,
-               std::function<const std::string&()> token_fn,
-               const Protobuf::Message& body, uint32_t timeout_ms,
-               uint32_t retries, Envoy::Tracing::Span& parent_span,
-               Envoy::TimeSource& time_source,
-               const std::string& trace_operation_name)
-      : cm_(cm),
-        dispatcher_(dispatcher),
-        http_uri_(uri),
-        retries_(retries),
-        request_count_(0),
-        timeout_ms_(timeout_ms),
-        cancelled(false),
-        token_fn_(token_fn),
-        parent_span_(parent_span),
-        time_source_(time_source),
-        trace_operation_name_(trace_operation_name) {
-    uri_ = http_uri_.uri() + suffix_url;
-
-    Http::Utility::extractHostPathFromUri(uri_, host_, path_);
-    body.SerializeToString(&str_body_);
-
-    ASSERT(!on_done_);
+  explicit HttpCallImpl(HttpCallFactory& factory) : factory_(factory) {
     ENVOY_LOG(trace, "{}", __func__);
+    attempts_[0].parent = this;
+    attempts_[1].parent = this;
+  }
+
+  // Reinitializes the per-call state for a (new or recycled) call.
+  void resetForCall(const Protobuf::Message& body,
+                    Envoy::Tracing::Span& parent_span) {
+    resetCallState(parent_span);
+
+    // Serialize the proto once, directly into a reserved buffer slice, so
+    // no intermediate std::string copy of a multi-kilobyte request is made.
+    const uint64_t size = body.ByteSizeLong();
+    Buffer::RawSlice iovec;
+    body_.reserve(size, &iovec, 1);
+    ASSERT(iovec.len_ >= size);
+    iovec.len_ = size;
+    body.SerializeWithCachedSizesToArray(static_cast<uint8_t*>(iovec.mem_));
+    body_.commit(&iovec, 1);
+    maybeCompressBody();
+  }
+
+  // Variant for callers that already hold the serialized request bytes
+  // (e.g. the report flush pipeline). The bytes are copied into the call's
+  // buffer and need not outlive this method.
+  void resetForCall(absl::string_view serialized_body,
+                    Envoy::Tracing::Span& parent_span) {
+    resetCallState(parent_span);
+    body_.add(serialized_body.data(), serialized_body.size());
+    maybeCompressBody();
   }
 
   void setDoneFunc(HttpCall::DoneFunc on_done) { on_done_ = on_done; }
 
   void call() override { makeOneCall(); }
 
-  // HTTP async receive methods
-  void onSuccess(Http::MessagePtr&& response) override {
+ private:
+  // One outbound request of this call. Hedged mode can have two racing, so
+  // each carries its own async-client callbacks and span; completions route
+  // back to the owning call with the attempt identified.
+  struct Attempt : public Http::AsyncClient::Callbacks {
+    void onSuccess(Http::MessagePtr&& response) override {
+      parent->onAttemptSuccess(*this, std::move(response));
+    }
+    void onFailure(Http::AsyncClient::FailureReason reason) override {
+      parent->onAttemptFailure(*this, reason);
+    }
+    bool inFlight() const { return request != nullptr; }
+
+    HttpCallImpl* parent{};
+    Http::AsyncClient::Request* request{};
+    Envoy::Tracing::SpanPtr span;
+  };
+
+  void onAttemptSuccess(Attempt& attempt, Http::MessagePtr&& response) {
     ENVOY_LOG(trace, "{}", __func__);
     const uint64_t status_code =
         Http::Utility::getResponseStatus(response->headers());
 
-    request_span_->setTag(Tracing::Tags::get().HttpStatusCode,
-                          std::to_string(status_code));
-    request_span_->finishSpan();
-
-    std::string body;
-    if (response->body()) {
-      const auto len = response->body()->length();
-      body = std::string(static_cast<char*>(response->body()->linearize(len)),
-                         len);
-    }
+    attempt.span->setTag(Tracing::Tags::get().HttpStatusCode,
+                         std::to_string(status_code));
+    attempt.span->finishSpan();
+    attempt.span.reset();
+    attempt.request = nullptr;
+
+    // The body stays in the async client's buffer; callers parse it in
+    // place via parseResponseBody, and only the logging paths stringify it.
+    const Buffer::OwnedImpl empty_body;
+    const Buffer::Instance& body =
+        response->body() != nullptr ? *response->body() : empty_body;
     if (status_code == enumToInt(Http::Code::OK)) {
-      ENVOY_LOG(debug, "http call [uri = {}]: success with body {}", uri_,
-                body);
+      ENVOY_LOG(debug, "http call [uri = {}]: success with body {}",
+                factory_.full_uri_, body.toString());
+      if (&attempt == &attempts_[1] && factory_.stats_ != nullptr) {
+        factory_.stats_->hedge_wins_.inc();
+      }
+      cancelOther(attempt);
       on_done_(Status::OK, body);
     } else {
+      // While the other attempt is still racing, its response may yet win;
+      // this loss is only final once both are done.
+      if (otherInFlight(attempt)) {
+        ENVOY_LOG(debug, "http call attempt lost with status code: {}",
+                  status_code);
+        return;
+      }
       if (attemptRetry(status_code)) {
         return;
       }
 
       ENVOY_LOG(debug, "http call response status code: {}, body: {}",
-                status_code, body);
+                status_code, body.toString());
       on_done_(Status(Code::INTERNAL, "Failed to call service control"), body);
     }
     reset();
-    deferredDelete();
+    finish();
   }
 
-  void onFailure(Http::AsyncClient::FailureReason reason) override {
+  void onAttemptFailure(Attempt& attempt, Http::AsyncClient::FailureReason reason) {
     // The status code in reason is always 0.
     ENVOY_LOG(debug, "http call network error");
 
     switch (reason) {
       case Http::AsyncClient::FailureReason::Reset:
-        request_span_->setTag(Tracing::Tags::get().Error,
-                              "the stream has been reset");
+        attempt.span->setTag(Tracing::Tags::get().Error,
+                             "the stream has been reset");
         break;
       default:
-        request_span_->setTag(Tracing::Tags::get().Error,
-                              "unknown network error");
+        attempt.span->setTag(Tracing::Tags::get().Error,
+                             "unknown network error");
         break;
     }
-    request_span_->finishSpan();
+    attempt.span->finishSpan();
+    attempt.span.reset();
+    attempt.request = nullptr;
 
+    if (otherInFlight(attempt)) {
+      return;
+    }
     if (attemptRetry(0)) {
       return;
     }
 
     on_done_(Status(Code::INTERNAL, "Failed to call service control"),
-             std::string());
+             Buffer::OwnedImpl());
     reset();
-    deferredDelete();
+    finish();
+  }
+  // The body-independent part of resetForCall.
+  void resetCallState(Envoy::Tracing::Span& parent_span) {
+    attempts_[0].request = nullptr;
+    attempts_[1].request = nullptr;
+    retries_ = factory_.retries_;
+    request_count_ = 0;
+    cancelled_ = false;
+    hedge_launched_ = false;
+    parent_span_ = &parent_span;
+    // Span elision: a null parent means the caller is not tracing at all
+    // (background flushes, probes), and the sampling knob thins out the
+    // rest. Decided once per call so retries and hedges follow suit.
+    trace_this_call_ = &parent_span != &Tracing::NullSpan::instance() &&
+                       factory_.traceThisCall();
+    ASSERT(!on_done_);
+  }
+
+  bool otherInFlight(const Attempt& attempt) const {
+    return (&attempt == &attempts_[0] ? attempts_[1] : attempts_[0])
+        .inFlight();
+  }
+
+  // Cancels and closes out the attempt that lost the race; a cancelled
+  // async-client request never invokes its callbacks.
+  void cancelOther(Attempt& winner) {
+    Attempt& other = &winner == &attempts_[0] ? attempts_[1] : attempts_[0];
+    if (other.inFlight()) {
+      other.request->cancel();
+      other.request = nullptr;
+    }
+    if (other.span) {
+      other.span->setTag(Tracing::Tags::get().Error,
+                         Tracing::Tags::get().Canceled);
+      other.span->finishSpan();
+      other.span.reset();
+    }
+  }
+
+  // Replaces body_ with its gzip encoding when the factory enables
+  // compression and the body meets the size threshold. Runs once per call;
+  // retries resend the already-compressed bytes.
+  void maybeCompressBody() {
+    body_compressed_ = false;
+    if (factory_.compression_min_bytes_ == 0 ||
+        body_.length() < factory_.compression_min_bytes_) {
+      return;
+    }
+    Compressor::ZlibCompressorImpl compressor;
+    // Window bits 15 plus 16 selects the gzip wrapper; the rest are zlib's
+    // defaults.
+    compressor.init(Compressor::ZlibCompressorImpl::CompressionLevel::Standard,
+                    Compressor::ZlibCompressorImpl::CompressionStrategy::
+                        Standard,
+                    /*window_bits=*/31, /*memory_level=*/8);
+    compressor.compress(body_, Compressor::State::Finish);
+    body_compressed_ = true;
   }
 
- private:
   bool attemptRetry(const uint64_t& status_code) {
     // skip if it is the client side problem.
     if (status_code >= 400 && status_code < 500) {
@@ -141,7 +317,7 @@ class HttpCallImpl : public HttpCall,
     ENVOY_LOG(debug,
               "after {} times failures, retrying http call [uri = {}], with "
               "{} remaining chances",
-              request_count_, uri_, retries_);
+              request_count_, factory_.full_uri_, retries_);
 
     reset();
     makeOneCall();
@@ -150,157 +326,267 @@ class HttpCallImpl : public HttpCall,
 
   void makeOneCall() {
     request_count_++;
-    std::string token = token_fn_();
-    if (token.empty()) {
+    const std::string& auth_value = factory_.auth_value_fn_();
+    if (auth_value.empty()) {
       on_done_(Status(Code::INTERNAL,
                       "Missing access token for service control call"),
-               "");
-      deferredDelete();
+               Buffer::OwnedImpl());
+      finish();
       return;
     }
 
-    // Trace the request
     auto span_name = request_count_ == 1
-                         ? trace_operation_name_
-                         : absl::StrCat(trace_operation_name_, " - Retry ",
-                                        request_count_ - 1);
-    request_span_ =
-        parent_span_.spawnChild(Envoy::Tracing::EgressConfig::get(), span_name,
-                                time_source_.systemTime());
-    request_span_->setTag(Tracing::Tags::get().Component,
-                          Tracing::Tags::get().Proxy);
-    request_span_->setTag(Tracing::Tags::get().UpstreamCluster,
-                          http_uri_.cluster());
-    request_span_->setTag(Tracing::Tags::get().HttpUrl, uri_);
-    request_span_->setTag(Tracing::Tags::get().HttpMethod, "POST");
-
-    Http::MessagePtr message = prepareHeaders(token);
-    ENVOY_LOG(debug, "http call from [uri = {}]: start", uri_);
-    request_ = cm_.httpAsyncClientForCluster(http_uri_.cluster())
-                   .send(std::move(message), *this,
-                         Http::AsyncClient::RequestOptions().setTimeout(
-                             std::chrono::milliseconds(timeout_ms_)));
+                         ? factory_.trace_operation_name_
+                         : absl::StrCat(factory_.trace_operation_name_,
+                                        " - Retry ", request_count_ - 1);
+    startAttempt(attempts_[0], auth_value, span_name);
+    maybeArmHedgeTimer();
   }
 
-  void cancel() override {
-    if (cancelled) {
+  void startAttempt(Attempt& attempt, const std::string& auth_value,
+                    const std::string& span_name) {
+    if (trace_this_call_) {
+      // Trace the request
+      attempt.span = parent_span_->spawnChild(
+          Envoy::Tracing::EgressConfig::get(), span_name,
+          factory_.time_source_.systemTime());
+      attempt.span->setTag(Tracing::Tags::get().Component,
+                           Tracing::Tags::get().Proxy);
+      attempt.span->setTag(Tracing::Tags::get().UpstreamCluster,
+                           factory_.uri_.cluster());
+      attempt.span->setTag(Tracing::Tags::get().HttpUrl, factory_.full_uri_);
+      attempt.span->setTag(Tracing::Tags::get().HttpMethod, "POST");
+    } else {
+      // An elided call still carries a span object so the completion paths'
+      // tag writes stay unconditional; on a null span they are no-ops.
+      attempt.span = std::make_unique<Tracing::NullSpan>();
+    }
+
+    Http::MessagePtr message = prepareHeaders(auth_value);
+    ENVOY_LOG(debug, "http call from [uri = {}]: start", factory_.full_uri_);
+    attempt.request =
+        factory_.cm_.httpAsyncClientForCluster(factory_.uri_.cluster())
+            .send(std::move(message), attempt,
+                  Http::AsyncClient::RequestOptions().setTimeout(
+                      std::chrono::milliseconds(factory_.timeout_ms_)));
+  }
+
+  // Arms the hedge timer for the first attempt of a call. At most one hedge
+  // is launched per call; retries run unhedged since they already start
+  // after a full timeout's worth of evidence.
+  void maybeArmHedgeTimer() {
+    // The first attempt may have completed inline (and finished the call)
+    // before this runs, hence the inFlight check.
+    if (factory_.hedge_delay_ms_ == 0 || hedge_launched_ ||
+        !attempts_[0].inFlight()) {
       return;
     }
-    cancelled = true;
-    ENVOY_LOG(debug, "Http call [uri = {}]: canceled", uri_);
-    if (request_span_) {
-      request_span_->setTag(Tracing::Tags::get().Error,
-                            Tracing::Tags::get().Canceled);
-      request_span_->finishSpan();
+    if (hedge_timer_ == nullptr) {
+      hedge_timer_ =
+          factory_.dispatcher_.createTimer([this]() { launchHedge(); });
     }
+    hedge_timer_->enableTimer(
+        std::chrono::milliseconds(factory_.hedge_delay_ms_));
+  }
 
-    if (request_) {
-      request_->cancel();
-      ENVOY_LOG(debug, "Http call [uri = {}]: canceled", uri_);
-      reset();
+  void launchHedge() {
+    if (cancelled_ || hedge_launched_ || !attempts_[0].inFlight()) {
+      return;
     }
-    on_done_(Status(Code::CANCELLED, std::string("Request cancelled")), "");
-    deferredDelete();
+    const std::string& auth_value = factory_.auth_value_fn_();
+    if (auth_value.empty()) {
+      return;
+    }
+    hedge_launched_ = true;
+    if (factory_.stats_ != nullptr) {
+      factory_.stats_->hedged_attempts_.inc();
+    }
+    request_count_++;
+    startAttempt(attempts_[1], auth_value,
+                 absl::StrCat(factory_.trace_operation_name_, " - Hedge"));
   }
 
-  void reset() { request_ = nullptr; }
+  void cancel() override {
+    if (cancelled_) {
+      return;
+    }
+    cancelled_ = true;
+    ENVOY_LOG(debug, "Http call [uri = {}]: canceled", factory_.full_uri_);
+    bool was_in_flight = false;
+    for (auto& attempt : attempts_) {
+      if (attempt.span) {
+        attempt.span->setTag(Tracing::Tags::get().Error,
+                             Tracing::Tags::get().Canceled);
+        attempt.span->finishSpan();
+        attempt.span.reset();
+      }
+      if (attempt.inFlight()) {
+        was_in_flight = true;
+        attempt.request->cancel();
+      }
+    }
+    if (was_in_flight && factory_.stats_ != nullptr) {
+      factory_.stats_->check_cancelled_in_flight_.inc();
+    }
+    reset();
+    // Reclaim the serialized body before the completion chain runs rather
+    // than in finish() after it: under connection churn many cancellations
+    // land in one dispatcher iteration, and the retained multi-kilobyte
+    // request bodies would otherwise pile up across the chains.
+    body_.drain(body_.length());
+    on_done_(Status(Code::CANCELLED, std::string("Request cancelled")),
+             Buffer::OwnedImpl());
+    finish();
+  }
 
-  Http::MessagePtr prepareHeaders(const std::string& token) {
-    Http::MessagePtr message(new Http::RequestMessageImpl());
-    message->headers().insertPath().value(path_.data(), path_.size());
-    message->headers().insertHost().value(host_.data(), host_.size());
+  void reset() {
+    attempts_[0].request = nullptr;
+    attempts_[1].request = nullptr;
+    if (hedge_timer_ != nullptr) {
+      hedge_timer_->disableTimer();
+    }
+  }
 
-    message->headers().insertMethod().value().setReference(
-        Http::Headers::get().MethodValues.Post);
+  Http::MessagePtr prepareHeaders(const std::string& auth_value) {
+    // Copy the factory's preformatted constant header block instead of
+    // rebuilding path, host, method and content-type per call.
+    Http::MessagePtr message(new Http::RequestMessageImpl(
+        std::make_unique<Http::HeaderMapImpl>(*factory_.constant_headers_)));
 
-    message->body() =
-        std::make_unique<Buffer::OwnedImpl>(str_body_.data(), str_body_.size());
+    // body_ is kept intact for potential retries; the async client consumes
+    // the per-attempt copy.
+    message->body() = std::make_unique<Buffer::OwnedImpl>();
+    message->body()->add(body_);
     message->headers().insertContentLength().value(message->body()->length());
+    if (body_compressed_) {
+      message->headers().insertContentEncoding().value().setReference(
+          Http::Headers::get().ContentEncodingValues.Gzip);
+    }
 
-    // assume token is not empty
-    std::string token_value = "Bearer " + token;
-    message->headers().insertAuthorization().value(token_value.data(),
-                                                   token_value.size());
-    message->headers().insertContentType().value(KApplicationProto.data(),
-                                                 KApplicationProto.size());
+    // The value is already formatted as "Bearer <token>" when the token
+    // callback fires, so no per-call concatenation is needed.
+    message->headers().insertAuthorization().value(auth_value.data(),
+                                                   auth_value.size());
     return message;
   }
 
-  void deferredDelete() {
-    dispatcher_.deferredDelete(std::unique_ptr<HttpCallImpl>(this));
+  // Drops this call's per-call state and hands the object back to the
+  // factory for recycling (or deferred deletion).
+  void finish() {
+    reset();
+    on_done_ = nullptr;
+    attempts_[0].span.reset();
+    attempts_[1].span.reset();
+    parent_span_ = nullptr;
+    body_.drain(body_.length());
+    factory_.releaseHttpCall(this);
   }
 
  private:
-  // The upstream cluster manager
-  Upstream::ClusterManager& cm_;
-  // The dispatcher for this thread
-  Event::Dispatcher& dispatcher_;
+  // The owning factory; holds the state constant across calls.
+  HttpCallFactory& factory_;
 
-  // The request
-  Http::AsyncClient::Request* request_{};
+  // The primary attempt ([0]) and its hedge ([1]); at most both in flight.
+  Attempt attempts_[2];
+  // Fires the hedge when the primary attempt is still unanswered after the
+  // factory's hedge delay; created lazily, reused across pooled calls.
+  Event::TimerPtr hedge_timer_;
+  // Whether this call already launched its one allowed hedge.
+  bool hedge_launched_{};
 
   // The callback function when request finished
   HttpCall::DoneFunc on_done_;
 
-  // The serialized request body
-  std::string str_body_;
-
-  // The request uri
-  std::string uri_;
-  // The host of the request uri
-  const HttpUri http_uri_;
-  // The host of the request uri with buffer owned by uri_
-  absl::string_view host_;
-  // The path of the request uri with buffer owned by uri_
-  absl::string_view path_;
+  // The serialized request body; retained across retries.
+  Buffer::OwnedImpl body_;
+  // Whether body_ holds gzip-compressed bytes.
+  bool body_compressed_{};
 
   // The remaining retry times
-  uint32_t retries_;
+  uint32_t retries_{};
   // The sent request count
-  uint32_t request_count_;
-  // The timeout
-  uint32_t timeout_ms_;
+  uint32_t request_count_{};
   // whether this call has been cancelled
-  bool cancelled;
-
-  // The function for getting token
-  std::function<const std::string&()> token_fn_;
+  bool cancelled_{};
 
   // Tracing data
-  Envoy::Tracing::Span& parent_span_;
-  Envoy::TimeSource& time_source_;
-  Envoy::Tracing::SpanPtr request_span_;
-  const std::string trace_operation_name_;
+  Envoy::Tracing::Span* parent_span_{};
+  // Whether this call spawns real child spans; false when the parent is the
+  // null span or the call was sampled out.
+  bool trace_this_call_{};
 };
 
-}  // namespace
-
 HttpCallFactory::HttpCallFactory(
     Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher,
     const ::google::api::envoy::http::common::HttpUri& uri,
-    const std::string& suffix_url, std::function<const std::string&()> token_fn,
+    const std::string& suffix_url,
+    std::function<const std::string&()> auth_value_fn,
     uint32_t timeout_ms, uint32_t retries, Envoy::TimeSource& time_source,
-    const std::string& trace_operation_name)
+    const std::string& trace_operation_name, uint32_t compression_min_bytes,
+    uint32_t hedge_delay_ms, uint32_t trace_call_sample_every_n,
+    ServiceControlFilterStats* stats)
     : cm_(cm),
       dispatcher_(dispatcher),
       uri_(uri),
       suffix_url_(suffix_url),
-      token_fn_(token_fn),
+      auth_value_fn_(auth_value_fn),
       timeout_ms_(timeout_ms),
       retries_(retries),
+      compression_min_bytes_(compression_min_bytes),
+      hedge_delay_ms_(hedge_delay_ms),
+      trace_call_sample_every_n_(trace_call_sample_every_n),
+      stats_(stats),
       destruct_mode_(false),
       time_source_(time_source),
-      trace_operation_name_(trace_operation_name){};
+      trace_operation_name_(trace_operation_name) {
+  full_uri_ = uri_.uri() + suffix_url_;
+  absl::string_view host, path;
+  Http::Utility::extractHostPathFromUri(full_uri_, host, path);
+
+  // Preformat the headers that never change between calls of this factory.
+  auto headers = std::make_unique<Http::HeaderMapImpl>();
+  headers->insertPath().value(path.data(), path.size());
+  headers->insertHost().value(host.data(), host.size());
+  headers->insertMethod().value().setReference(
+      Http::Headers::get().MethodValues.Post);
+  headers->insertContentType().value(KApplicationProto.data(),
+                                     KApplicationProto.size());
+  constant_headers_ = std::move(headers);
+}
 
 HttpCall* HttpCallFactory::createHttpCall(const Protobuf::Message& body,
                                           Envoy::Tracing::Span& parent_span,
                                           HttpCall::DoneFunc on_done) {
+  HttpCallImpl* http_call = acquireCallObject();
+  http_call->resetForCall(body, parent_span);
+  registerCall(http_call, on_done);
+  return http_call;
+}
+
+HttpCall* HttpCallFactory::createHttpCall(absl::string_view serialized_body,
+                                          Envoy::Tracing::Span& parent_span,
+                                          HttpCall::DoneFunc on_done) {
+  HttpCallImpl* http_call = acquireCallObject();
+  http_call->resetForCall(serialized_body, parent_span);
+  registerCall(http_call, on_done);
+  return http_call;
+}
+
+HttpCallImpl* HttpCallFactory::acquireCallObject() {
   ENVOY_LOG(debug, "{} is created", trace_operation_name_);
-  HttpCallImpl* http_call = new HttpCallImpl(
-      cm_, dispatcher_, uri_, suffix_url_, token_fn_, body, timeout_ms_,
-      retries_, parent_span, time_source_, trace_operation_name_);
-  http_call->setDoneFunc([this, on_done, http_call](const Status& status,
-                                                    const std::string& body) {
+  if (!call_pool_.empty()) {
+    HttpCallImpl* http_call = call_pool_.back().release();
+    call_pool_.pop_back();
+    return http_call;
+  }
+  return new HttpCallImpl(*this);
+}
+
+void HttpCallFactory::registerCall(HttpCallImpl* http_call,
+                                   HttpCall::DoneFunc on_done) {
+  http_call->setDoneFunc([this, on_done, http_call](
+                             const Status& status,
+                             const Buffer::Instance& body) {
     // When the call is finished, it should be removed from active_calls_ .
     // However, when the factory object is being destructed, all active_calls_
     // will be cancelled in one time so no need to remove them from
@@ -311,7 +597,16 @@ HttpCall* HttpCallFactory::createHttpCall(const Protobuf::Message& body,
     on_done(status, body);
   });
   active_calls_.insert(http_call);
-  return http_call;
+}
+
+void HttpCallFactory::releaseHttpCall(HttpCallImpl* call) {
+  if (!destruct_mode_ && call_pool_.size() < kHttpCallPoolMaxSize) {
+    call_pool_.emplace_back(call);
+    return;
+  }
+  // The release may run from inside the call's own async client callback, so
+  // the object must not be deleted inline.
+  dispatcher_.deferredDelete(std::unique_ptr<HttpCallImpl>(call));
 }
 
 HttpCallFactory::~HttpCallFactory() {
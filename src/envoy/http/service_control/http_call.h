@@ -14,11 +14,18 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
+#include "absl/strings/string_view.h"
 #include "api/envoy/http/common/base.pb.h"
+#include "envoy/buffer/buffer.h"
 #include "envoy/common/pure.h"
+#include "envoy/http/header_map.h"
 #include "envoy/tracing/http_tracer.h"
 #include "envoy/upstream/cluster_manager.h"
 #include "google/protobuf/stubs/status.h"
+#include "src/envoy/http/service_control/filter_stats.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -27,9 +34,19 @@ namespace ServiceControl {
 
 class HttpCall {
  public:
+  // The response body is handed over as the async client's buffer, not a
+  // string, so a successful response is parsed in place with
+  // parseResponseBody and the copy into a contiguous string is only paid
+  // on the failure paths that stringify the body for logging.
   using DoneFunc =
       std::function<void(const ::google::protobuf::util::Status& status,
-                         const std::string& response_body)>;
+                         const Buffer::Instance& response_body)>;
+
+  // Parses |response| directly from the body buffer's slices through a
+  // ZeroCopyInputStream, without linearizing the buffer or copying it into
+  // a string first. Returns false when the bytes do not parse.
+  static bool parseResponseBody(const Buffer::Instance& body,
+                                Protobuf::Message& response);
 
   virtual ~HttpCall() {}
   /*
@@ -40,26 +57,72 @@ class HttpCall {
   virtual void call() PURE;
 };
 
+class HttpCallImpl;
+
 class HttpCallFactory : public Logger::Loggable<Logger::Id::filter> {
  public:
+  // When compression_min_bytes is nonzero, request bodies of at least that
+  // many bytes are gzip-compressed and sent with "Content-Encoding: gzip".
+  // When hedge_delay_ms is nonzero, a call still unanswered after that many
+  // milliseconds launches one parallel duplicate request; the first response
+  // wins and the loser is cancelled. Hedge counters are recorded on |stats|
+  // when provided. When trace_call_sample_every_n is greater than one, only
+  // one of every that many calls spawns a child tracing span; the others
+  // run with a null span.
   HttpCallFactory(Upstream::ClusterManager& cm, Event::Dispatcher& dispatcher,
                   const ::google::api::envoy::http::common::HttpUri& uri,
                   const std::string& suffix_url,
-                  std::function<const std::string&()> token_fn,
+                  std::function<const std::string&()> auth_value_fn,
                   uint32_t timeout_ms, uint32_t retries,
                   Envoy::TimeSource& time_source,
-                  const std::string& trace_operation_name);
+                  const std::string& trace_operation_name,
+                  uint32_t compression_min_bytes = 0,
+                  uint32_t hedge_delay_ms = 0,
+                  uint32_t trace_call_sample_every_n = 0,
+                  ServiceControlFilterStats* stats = nullptr);
 
   HttpCall* createHttpCall(const Protobuf::Message& body,
                            Envoy::Tracing::Span& parent_span,
                            HttpCall::DoneFunc on_done);
 
+  // Variant for callers that already hold the serialized request bytes
+  // (e.g. the report flush pipeline). The bytes are copied into the call's
+  // buffer and need not outlive this method.
+  HttpCall* createHttpCall(absl::string_view serialized_body,
+                           Envoy::Tracing::Span& parent_span,
+                           HttpCall::DoneFunc on_done);
+
   virtual ~HttpCallFactory();
 
  private:
+  friend class HttpCallImpl;
+
+  // Pops a recycled call object from the pool, or news one.
+  HttpCallImpl* acquireCallObject();
+
+  // Installs the completion hook and tracks the call in active_calls_.
+  void registerCall(HttpCallImpl* call, HttpCall::DoneFunc on_done);
+
+  // Returns a finished call object to the pool, or defer-deletes it when the
+  // pool is full or the factory is being destructed.
+  void releaseHttpCall(HttpCallImpl* call);
+
+  // Deterministic 1-in-N sampling decision for a call's child spans. The
+  // factory is per-worker, so the counter needs no locking.
+  bool traceThisCall() {
+    if (trace_call_sample_every_n_ <= 1) {
+      return true;
+    }
+    return call_sample_counter_++ % trace_call_sample_every_n_ == 0;
+  }
+
   // all active calls generated by this factory
   absl::flat_hash_set<HttpCall*> active_calls_;
 
+  // Finished call objects kept for reuse; the factory is per-worker, so the
+  // pool needs no locking. Bounded; overflow is defer-deleted.
+  std::vector<std::unique_ptr<HttpCallImpl>> call_pool_;
+
   // envoy upstream
   Upstream::ClusterManager& cm_;
   Event::Dispatcher& dispatcher_;
@@ -68,12 +131,32 @@ class HttpCallFactory : public Logger::Loggable<Logger::Id::filter> {
   const ::google::api::envoy::http::common::HttpUri uri_;
   const std::string suffix_url_;
 
-  // token getter
-  std::function<const std::string&()> token_fn_;
+  // The full request uri, computed once instead of per call.
+  std::string full_uri_;
+  // The constant request headers (path, host, method, content-type),
+  // preformatted once; each call copies this block instead of rebuilding the
+  // headers field by field. Authorization and content-length vary per call.
+  Http::HeaderMapPtr constant_headers_;
+
+  // Returns the preformatted Authorization header value ("Bearer <token>");
+  // empty until a token is available.
+  std::function<const std::string&()> auth_value_fn_;
 
   // call setting
   uint32_t timeout_ms_;
   uint32_t retries_;
+  // Bodies of at least this many bytes are gzip-compressed; 0 disables
+  // compression.
+  uint32_t compression_min_bytes_;
+  // Delay before a still-unanswered call launches its hedge request; 0
+  // disables hedging.
+  uint32_t hedge_delay_ms_;
+  // Spawn a child span for only one of every this many calls; 0 and 1 both
+  // mean every call.
+  uint32_t trace_call_sample_every_n_;
+  uint64_t call_sample_counter_{0};
+  // Where hedge counters are recorded; may be null (e.g. in tests).
+  ServiceControlFilterStats* stats_;
 
   // whether the factory is being destructed
   bool destruct_mode_;
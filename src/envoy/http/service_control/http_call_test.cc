@@ -54,7 +54,7 @@ class HttpCallTest : public testing::Test {
  protected:
   HttpCallTest()
       : async_callbacks_(),
-        fake_token_("fake-token-value"),
+        fake_auth_value_("Bearer fake-token-value"),
         fake_trace_operation_name_("fake-trace-operation-name"),
         fake_suffix_url_("fake-suffix-url"),
         timeout_ms_(5000),
@@ -74,8 +74,7 @@ class HttpCallTest : public testing::Test {
           // Check token is correctly set
           auto token_header =
               message_ptr->headers().get(Http::Headers::get().Authorization);
-          EXPECT_EQ(token_header->value().getStringView(),
-                    "Bearer " + fake_token_);
+          EXPECT_EQ(token_header->value().getStringView(), fake_auth_value_);
 
           // Make callback and request
           async_callbacks_.push_back(&callbacks);
@@ -85,11 +84,13 @@ class HttpCallTest : public testing::Test {
           return request;
         }));
 
-    fake_token_fn_ = [this]() -> const std::string& { return fake_token_; };
+    fake_auth_value_fn_ = [this]() -> const std::string& {
+      return fake_auth_value_;
+    };
 
     fake_request_ = CheckRequest{};
     http_call_factory_ = std::make_unique<HttpCallFactory>(
-        cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_token_fn_,
+        cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
         timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_);
   }
 
@@ -127,7 +128,7 @@ class HttpCallTest : public testing::Test {
 
   // Callback for HttpCall. Expectations must be set by each test
   MockFunction<void(const ::google::protobuf::util::Status& status,
-                    const std::string& response_body)>
+                    const Buffer::Instance& response_body)>
       mock_done_fn_;
 
   // Underlying http client mocks
@@ -140,9 +141,9 @@ class HttpCallTest : public testing::Test {
   std::vector<Http::AsyncClient::Callbacks*> async_callbacks_;
   std::vector<Http::MockAsyncClientRequest*> http_requests_;
 
-  // Token
-  std::string fake_token_;
-  std::function<const std::string&()> fake_token_fn_;
+  // The preformatted Authorization header value
+  std::string fake_auth_value_;
+  std::function<const std::string&()> fake_auth_value_fn_;
 
   // Tracing
   std::string fake_trace_operation_name_;
@@ -226,7 +227,7 @@ TEST_F(HttpCallTest, TestEmptyTokenCallFailure) {
                    _))
       .Times(1);
 
-  fake_token_.clear();
+  fake_auth_value_.clear();
   HttpCall* call = http_call_factory_->createHttpCall(
       fake_request_, mock_parent_span_, mock_done_fn_.AsStdFunction());
   call->call();
@@ -238,7 +239,7 @@ TEST_F(HttpCallTest, TestRetryCallSuccess) {
   // Set request to retry 2 more times
   retries_ = 2;
   http_call_factory_ = std::make_unique<HttpCallFactory>(
-      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_token_fn_,
+      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
       timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_);
   // Phase 1: Create HttpCall and send the request
   auto mock_child_span_1 = makeMockChildSpan();
@@ -274,7 +275,7 @@ TEST_F(HttpCallTest, TestThreeRetriesWithLastSuccess) {
   // Set request to retry 2 more times
   retries_ = 2;
   http_call_factory_ = std::make_unique<HttpCallFactory>(
-      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_token_fn_,
+      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
       timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_);
 
   // Phase 1: Create HttpCall and send the request
@@ -312,7 +313,7 @@ TEST_F(HttpCallTest, TestThreeRetriesWithLastFailure) {
   // Set request to retry 2 more times
   retries_ = 2;
   http_call_factory_ = std::make_unique<HttpCallFactory>(
-      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_token_fn_,
+      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
       timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_);
 
   // Phase 1: Create HttpCall and send the request
@@ -390,6 +391,134 @@ TEST_F(HttpCallTest, TestSingleCallCancel) {
   http_call_factory_.reset();
 }
 
+TEST_F(HttpCallTest, TestHedgeWinsRace) {
+  auto* hedge_timer = new NiceMock<Event::MockTimer>(&dispatcher_);
+  http_call_factory_ = std::make_unique<HttpCallFactory>(
+      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
+      timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_,
+      /*compression_min_bytes=*/0, /*hedge_delay_ms=*/100);
+
+  auto* primary_span = new NiceMock<Tracing::MockSpan>();
+  auto* hedge_span = new NiceMock<Tracing::MockSpan>();
+  EXPECT_CALL(mock_parent_span_, spawnChild_(_, fake_trace_operation_name_, _))
+      .WillOnce(Return(primary_span));
+  EXPECT_CALL(mock_parent_span_,
+              spawnChild_(_, absl::StrCat(fake_trace_operation_name_, " - Hedge"),
+                          _))
+      .WillOnce(Return(hedge_span));
+
+  HttpCall* call = http_call_factory_->createHttpCall(
+      fake_request_, mock_parent_span_, mock_done_fn_.AsStdFunction());
+  call->call();
+  EXPECT_EQ(1, http_requests_.size());
+
+  // The hedge delay elapses with no response; the duplicate goes out.
+  hedge_timer->invokeCallback();
+  EXPECT_EQ(2, http_requests_.size());
+
+  // The hedge answers first: the primary is cancelled and the callback
+  // fires exactly once.
+  EXPECT_CALL(*http_requests_[0], cancel()).Times(1);
+  EXPECT_CALL(mock_done_fn_, Call(Status::OK, _)).Times(1);
+  async_callbacks_[1]->onSuccess(makeResponseWithStatus(200));
+}
+
+TEST_F(HttpCallTest, TestBodyCompressedOverThreshold) {
+  // Recreate the factory so any non-empty body meets the threshold.
+  http_call_factory_ = std::make_unique<HttpCallFactory>(
+      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
+      timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_,
+      /*compression_min_bytes=*/1);
+  fake_request_.set_service_name("a service name long enough to compress");
+
+  auto mock_child_span = makeMockChildSpan();
+  EXPECT_CALL(http_client_, send_(_, _, _))
+      .WillOnce(Invoke([this](Http::MessagePtr& message_ptr,
+                              Http::AsyncClient::Callbacks& callbacks,
+                              const Http::AsyncClient::RequestOptions)
+                           -> Http::AsyncClient::Request* {
+        auto* encoding =
+            message_ptr->headers().get(Http::Headers::get().ContentEncoding);
+        EXPECT_NE(encoding, nullptr);
+        if (encoding != nullptr) {
+          EXPECT_EQ(encoding->value().getStringView(), "gzip");
+        }
+        // The body is the gzip encoding, not the raw serialization.
+        EXPECT_NE(message_ptr->bodyAsString(),
+                  fake_request_.SerializeAsString());
+        async_callbacks_.push_back(&callbacks);
+        auto request = new NiceMock<Http::MockAsyncClientRequest>(&http_client_);
+        http_requests_.push_back(request);
+        return request;
+      }));
+  HttpCall* call = http_call_factory_->createHttpCall(
+      fake_request_, mock_parent_span_, mock_done_fn_.AsStdFunction());
+  call->call();
+
+  EXPECT_CALL(*mock_child_span, finishSpan()).Times(1);
+  EXPECT_CALL(mock_done_fn_, Call(Status::OK, _)).Times(1);
+  async_callbacks_[0]->onSuccess(makeResponseWithStatus(200));
+}
+
+TEST_F(HttpCallTest, TestBodyBelowThresholdNotCompressed) {
+  http_call_factory_ = std::make_unique<HttpCallFactory>(
+      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
+      timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_,
+      /*compression_min_bytes=*/1024 * 1024);
+  fake_request_.set_service_name("small");
+
+  auto mock_child_span = makeMockChildSpan();
+  EXPECT_CALL(http_client_, send_(_, _, _))
+      .WillOnce(Invoke([this](Http::MessagePtr& message_ptr,
+                              Http::AsyncClient::Callbacks& callbacks,
+                              const Http::AsyncClient::RequestOptions)
+                           -> Http::AsyncClient::Request* {
+        EXPECT_EQ(
+            message_ptr->headers().get(Http::Headers::get().ContentEncoding),
+            nullptr);
+        EXPECT_EQ(message_ptr->bodyAsString(),
+                  fake_request_.SerializeAsString());
+        async_callbacks_.push_back(&callbacks);
+        auto request = new NiceMock<Http::MockAsyncClientRequest>(&http_client_);
+        http_requests_.push_back(request);
+        return request;
+      }));
+  HttpCall* call = http_call_factory_->createHttpCall(
+      fake_request_, mock_parent_span_, mock_done_fn_.AsStdFunction());
+  call->call();
+
+  EXPECT_CALL(*mock_child_span, finishSpan()).Times(1);
+  EXPECT_CALL(mock_done_fn_, Call(Status::OK, _)).Times(1);
+  async_callbacks_[0]->onSuccess(makeResponseWithStatus(200));
+}
+
+TEST_F(HttpCallTest, TestSpanElisionSamplesEveryN) {
+  // Trace one of every two calls; the second runs with a null span.
+  http_call_factory_ = std::make_unique<HttpCallFactory>(
+      cm_, dispatcher_, http_uri_, fake_suffix_url_, fake_auth_value_fn_,
+      timeout_ms_, retries_, mock_time_source_, fake_trace_operation_name_,
+      /*compression_min_bytes=*/0, /*hedge_delay_ms=*/0,
+      /*trace_call_sample_every_n=*/2);
+
+  auto* mock_child_span = new NiceMock<Tracing::MockSpan>();
+  EXPECT_CALL(mock_parent_span_, spawnChild_(_, fake_trace_operation_name_, _))
+      .WillOnce(Return(mock_child_span));
+  EXPECT_CALL(*mock_child_span, finishSpan()).Times(1);
+  EXPECT_CALL(mock_done_fn_, Call(Status::OK, _)).Times(2);
+
+  HttpCall* traced_call = http_call_factory_->createHttpCall(
+      fake_request_, mock_parent_span_, mock_done_fn_.AsStdFunction());
+  traced_call->call();
+  async_callbacks_[0]->onSuccess(makeResponseWithStatus(200));
+
+  // The sampled-out call spawns no child span; the saturated spawnChild_
+  // expectation above would flag one.
+  HttpCall* elided_call = http_call_factory_->createHttpCall(
+      fake_request_, mock_parent_span_, mock_done_fn_.AsStdFunction());
+  elided_call->call();
+  async_callbacks_[1]->onSuccess(makeResponseWithStatus(200));
+}
+
 }  // namespace
 }  // namespace ServiceControl
 }  // namespace HttpFilters
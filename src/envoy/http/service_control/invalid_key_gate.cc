@@ -0,0 +1,144 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/invalid_key_gate.h"
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+
+using ::google::api_proxy::service_control::CheckDenialInfo;
+using ::google::protobuf::util::Status;
+using ::google::protobuf::util::error::Code;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+int64_t rotationInterval() {
+  constexpr int64_t interval_ms = InvalidKeyGate::kRotationIntervalMs;
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+             std::chrono::milliseconds(interval_ms))
+      .count();
+}
+
+}  // namespace
+
+std::shared_ptr<InvalidKeyGate> InvalidKeyGate::GetOrCreate(
+    const std::string& service_key) {
+  // The registry outlives config updates; expired services are purged when
+  // a new gate is created.
+  static std::mutex* registry_mutex = new std::mutex;
+  static absl::flat_hash_map<std::string, std::weak_ptr<InvalidKeyGate>>*
+      registry =
+          new absl::flat_hash_map<std::string, std::weak_ptr<InvalidKeyGate>>;
+
+  std::lock_guard<std::mutex> lock(*registry_mutex);
+  auto& weak_entry = (*registry)[service_key];
+  std::shared_ptr<InvalidKeyGate> gate = weak_entry.lock();
+  if (gate == nullptr) {
+    gate.reset(new InvalidKeyGate);
+    weak_entry = gate;
+    for (auto it = registry->begin(); it != registry->end();) {
+      if (it->second.expired()) {
+        registry->erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  return gate;
+}
+
+InvalidKeyGate::InvalidKeyGate()
+    : next_rotation_(
+          std::chrono::steady_clock::now().time_since_epoch().count() +
+          rotationInterval()) {}
+
+void InvalidKeyGate::Insert(absl::string_view api_key) {
+  const uint64_t hash = absl::Hash<absl::string_view>()(api_key);
+  const uint64_t step = (hash >> 32) | 1;
+  const uint32_t current = current_.load(std::memory_order_acquire);
+  for (int i = 0; i < kProbes; ++i) {
+    const size_t bit = (hash + i * step) & (kBits - 1);
+    generations_[current][bit >> 6].fetch_or(uint64_t(1) << (bit & 63),
+                                             std::memory_order_relaxed);
+  }
+}
+
+bool InvalidKeyGate::ProbablyInvalid(absl::string_view api_key) {
+  const auto now = std::chrono::steady_clock::now();
+  if (now.time_since_epoch().count() >=
+      next_rotation_.load(std::memory_order_relaxed)) {
+    maybeRotate(now);
+  }
+  const uint64_t hash = absl::Hash<absl::string_view>()(api_key);
+  const uint64_t step = (hash >> 32) | 1;
+  const uint32_t current = current_.load(std::memory_order_acquire);
+  bool in_current = true;
+  bool in_previous = true;
+  for (int i = 0; i < kProbes; ++i) {
+    const size_t bit = (hash + i * step) & (kBits - 1);
+    const uint64_t mask = uint64_t(1) << (bit & 63);
+    const size_t word = bit >> 6;
+    in_current = in_current && (generations_[current][word].load(
+                                    std::memory_order_relaxed) &
+                                mask) != 0;
+    in_previous = in_previous && (generations_[1 - current][word].load(
+                                      std::memory_order_relaxed) &
+                                  mask) != 0;
+    if (!in_current && !in_previous) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void InvalidKeyGate::maybeRotate(std::chrono::steady_clock::time_point now) {
+  std::unique_lock<std::mutex> lock(rotation_mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return;
+  }
+  const int64_t now_count = now.time_since_epoch().count();
+  if (now_count < next_rotation_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // Clear what was the previous generation, then make it current; the old
+  // current becomes previous with the last interval's keys intact.
+  const uint32_t stale = 1 - current_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < kWords; ++i) {
+    generations_[stale][i].store(0, std::memory_order_relaxed);
+  }
+  current_.store(stale, std::memory_order_release);
+  next_rotation_.store(now_count + rotationInterval(),
+                       std::memory_order_relaxed);
+}
+
+const CheckDenialInfo& InvalidKeyGate::Denial() {
+  static const CheckDenialInfo* denial = []() {
+    auto* entry = new CheckDenialInfo;
+    entry->status = Status(
+        Code::INVALID_ARGUMENT,
+        "API key not valid. Please pass a valid API key.");
+    entry->body = entry->status.ToString();
+    return entry;
+  }();
+  return *denial;
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
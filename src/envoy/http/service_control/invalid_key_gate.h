@@ -0,0 +1,96 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "src/api_proxy/service_control/request_info.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Rotating Bloom filter of api keys the backend recently declared invalid,
+// shared process-wide by the per-worker ClientCache instances of one
+// service. Garbage and revoked keys - the traffic key-guessing bots
+// generate - each cost a full Check RPC and a check cache entry before
+// denial, and enough of them evict legitimate consumers from the bounded
+// caches. A gate hit short-circuits to a precomputed denial with no RPC
+// and no cache pressure.
+//
+// Two generations are rotated on a fixed interval: inserts go to the
+// current one, lookups consult both, so a key stays gated between one and
+// two intervals after its last denial and a re-activated key is honored
+// within that bound. All operations are lock-free atomic bit ops; the
+// rotation clears the stale generation under a try-lock and a lookup
+// racing the clear can only lose bits, costing the Check RPC the request
+// would have made anyway.
+class InvalidKeyGate {
+ public:
+  // Returns the gate shared by all workers for |service_key| (service name
+  // plus config id), creating it on first use.
+  static std::shared_ptr<InvalidKeyGate> GetOrCreate(
+      const std::string& service_key);
+
+  // Records a key the backend just declared invalid.
+  void Insert(absl::string_view api_key);
+
+  // Returns true when |api_key| was recorded within the last one to two
+  // rotation intervals, at the filter's designed false positive rate.
+  bool ProbablyInvalid(absl::string_view api_key);
+
+  // The process-lifetime denial a gate hit is answered with; the wording
+  // matches the backend's API_KEY_INVALID denial.
+  static const ::google::api_proxy::service_control::CheckDenialInfo&
+  Denial();
+
+  // Re-activated keys are gated for at most twice this.
+  static constexpr int kRotationIntervalMs = 5 * 60 * 1000;
+
+ private:
+  InvalidKeyGate();
+
+  // 2^20 bits (128 KiB) per generation with 4 probes keeps the false
+  // positive rate around 1e-5 at ten thousand distinct denied keys per
+  // interval; a false positive denies one valid key for a rotation, so
+  // the filter is sized generously.
+  static constexpr size_t kBitsLog2 = 20;
+  static constexpr size_t kBits = size_t(1) << kBitsLog2;
+  static constexpr size_t kWords = kBits / 64;
+  static constexpr int kProbes = 4;
+
+  // Clears the stale generation and makes it current once the interval
+  // elapsed; skips out when another thread is already rotating.
+  void maybeRotate(std::chrono::steady_clock::time_point now);
+
+  std::atomic<uint64_t> generations_[2][kWords] = {};
+  // Index of the generation inserts go to.
+  std::atomic<uint32_t> current_{0};
+  // steady_clock duration count of the next rotation.
+  std::atomic<int64_t> next_rotation_;
+  // Serializes rotations only.
+  std::mutex rotation_mutex_;
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -30,6 +30,10 @@ class MockServiceControlHandler : public ServiceControlHandler {
                void(Http::HeaderMap& headers, Envoy::Tracing::Span& parent_span,
                     CheckDoneCallback& callback));
 
+  MOCK_CONST_METHOD0(
+      checkDenial,
+      const ::google::api_proxy::service_control::CheckDenialInfo*());
+
   MOCK_METHOD4(callReport, void(const Http::HeaderMap* request_headers,
                                 const Http::HeaderMap* response_headers,
                                 const Http::HeaderMap* response_trailers,
@@ -46,6 +50,9 @@ class MockServiceControlHandler : public ServiceControlHandler {
   MOCK_METHOD1(processResponseHeaders,
                void(const Http::HeaderMap& response_headers));
 
+  MOCK_METHOD1(processResponseTrailers,
+               void(const Http::HeaderMap& response_trailers));
+
   MOCK_METHOD0(onDestroy, void());
 };
 
@@ -0,0 +1,108 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/report_flush_pipeline.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+// Upper bound on queued flushes across all workers. At the 1s flush cadence
+// this is far more headroom than steady state ever uses; hitting it means
+// serialization cannot keep up and shedding is the right answer.
+constexpr size_t kMaxQueuedFlushes = 256;
+
+// Upper bound on retained serialization buffers. More concurrent holders
+// than this simply allocate fresh buffers that are freed on release.
+constexpr size_t kMaxPooledBuffers = 8;
+
+}  // namespace
+
+ReportFlushPipeline& ReportFlushPipeline::instance() {
+  // Leaked so neither the thread nor the queue is torn down at process
+  // exit while a worker may still be enqueueing.
+  static ReportFlushPipeline* pipeline = new ReportFlushPipeline;
+  return *pipeline;
+}
+
+ReportFlushPipeline::ReportFlushPipeline() {
+  std::thread([this]() { run(); }).detach();
+}
+
+bool ReportFlushPipeline::Enqueue(
+    ::google::api::servicecontrol::v1::ReportRequest&& request,
+    SendFunc send) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() >= kMaxQueuedFlushes) {
+      return false;
+    }
+    queue_.push_back(Job{std::move(request), std::move(send)});
+  }
+  wakeup_.notify_one();
+  return true;
+}
+
+size_t ReportFlushPipeline::QueueDepth() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+std::shared_ptr<std::string> ReportFlushPipeline::acquireBuffer() {
+  std::unique_ptr<std::string> buffer;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!buffer_pool_.empty()) {
+      buffer = std::move(buffer_pool_.back());
+      buffer_pool_.pop_back();
+    }
+  }
+  if (buffer == nullptr) {
+    buffer.reset(new std::string);
+  }
+  // The deleter runs on whichever thread drops the last reference (usually
+  // the worker dispatcher after the send); it hands the storage back to the
+  // pool with its capacity intact.
+  return std::shared_ptr<std::string>(
+      buffer.release(), [this](std::string* released) {
+        std::unique_ptr<std::string> returned(released);
+        returned->clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (buffer_pool_.size() < kMaxPooledBuffers) {
+          buffer_pool_.push_back(std::move(returned));
+        }
+      });
+}
+
+void ReportFlushPipeline::run() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wakeup_.wait(lock, [this]() { return !queue_.empty(); });
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    std::shared_ptr<std::string> body = acquireBuffer();
+    job.request.SerializeToString(body.get());
+    job.send(std::move(body));
+  }
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
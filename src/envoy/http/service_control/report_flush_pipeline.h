@@ -0,0 +1,84 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "google/api/servicecontrol/v1/service_controller.pb.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Process-wide pipeline that serializes flushed ReportRequests on one
+// dedicated background thread, so a large flush does not steal dispatcher
+// time from request processing. A worker enqueues the flushed request
+// (moved, not copied) together with a completion; the background thread
+// serializes into a reusable pooled buffer and invokes the completion with
+// the bytes, and the completion posts the actual send back to the worker's
+// dispatcher. The queue is bounded: a saturated pipeline refuses the job
+// and the caller falls back or drops the flush with a stat, so a slow
+// serializer can never pile up unbounded memory.
+class ReportFlushPipeline {
+ public:
+  // Receives the serialized request. Runs on the background thread; the
+  // buffer returns to the pipeline's pool when the last reference drops.
+  using SendFunc = std::function<void(std::shared_ptr<std::string> body)>;
+
+  static ReportFlushPipeline& instance();
+
+  // Queues |request| for background serialization. Returns false without
+  // queueing when the pipeline is saturated.
+  bool Enqueue(::google::api::servicecontrol::v1::ReportRequest&& request,
+               SendFunc send);
+
+  // Number of flushes waiting for the background thread; a debugging
+  // window into the serialization backlog.
+  size_t QueueDepth();
+
+ private:
+  ReportFlushPipeline();
+
+  struct Job {
+    ::google::api::servicecontrol::v1::ReportRequest request;
+    SendFunc send;
+  };
+
+  // Returns a pooled serialization buffer, wrapped so its storage (and
+  // capacity) go back to the pool when the last holder releases it.
+  std::shared_ptr<std::string> acquireBuffer();
+
+  // The background thread's loop; never returns.
+  void run();
+
+  // Guards |queue_| and |buffer_pool_|; touched only at flush cadence.
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<Job> queue_;
+  std::vector<std::unique_ptr<std::string>> buffer_pool_;
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,170 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/report_spill_journal.h"
+
+#include <fstream>
+#include <thread>
+
+#include "src/envoy/http/service_control/aggregation_handoff.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+// Upper bound on queued spill writes across all workers. Spills happen at
+// the rate report sends fail, so a full queue means the disk cannot keep
+// up even with failures and shedding is the right answer.
+constexpr size_t kMaxQueuedSpills = 64;
+
+// Each on-disk record carries its spill time in this many leading bytes.
+constexpr size_t kSpillTimeBytes = 8;
+// The handoff record format adds a length prefix of this many bytes; it is
+// counted against the journal cap so the cap bounds actual file size.
+constexpr size_t kRecordLengthBytes = 4;
+
+// Little-endian fixed-width spill time, matching the byte order of the
+// handoff length prefix.
+void appendSpillTime(int64_t time_s, std::string* out) {
+  const uint64_t value = static_cast<uint64_t>(time_s);
+  for (size_t i = 0; i < kSpillTimeBytes; ++i) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+int64_t decodeSpillTime(const char* in) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < kSpillTimeBytes; ++i) {
+    value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i]))
+             << (8 * i);
+  }
+  return static_cast<int64_t>(value);
+}
+
+}  // namespace
+
+ReportSpillJournal& ReportSpillJournal::instance() {
+  // Leaked so neither the thread nor the queue is torn down at process
+  // exit while a worker may still be spilling.
+  static ReportSpillJournal* journal = new ReportSpillJournal;
+  return *journal;
+}
+
+ReportSpillJournal::ReportSpillJournal() {
+  std::thread([this]() { run(); }).detach();
+}
+
+bool ReportSpillJournal::Spill(const std::string& path, std::string&& bytes,
+                               uint64_t max_journal_bytes,
+                               int64_t now_unix_s) {
+  std::string record;
+  record.reserve(kSpillTimeBytes + bytes.size());
+  appendSpillTime(now_unix_s, &record);
+  record.append(bytes);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.size() >= kMaxQueuedSpills) {
+      return false;
+    }
+    uint64_t& used = journalBytes(path);
+    const uint64_t record_cost = kRecordLengthBytes + record.size();
+    if (used + record_cost > max_journal_bytes) {
+      return false;
+    }
+    used += record_cost;
+    queue_.push_back(Job{path, std::move(record)});
+  }
+  wakeup_.notify_one();
+  return true;
+}
+
+std::vector<ReportSpillJournal::Record> ReportSpillJournal::Consume(
+    const std::string& path) {
+  // Records queued but not yet written are claimed straight from the
+  // queue; a write the background thread dequeued but has not finished is
+  // the only one that can slip past, and it lands in the recreated journal
+  // file for the next consume (overrunning the cap by at most one record).
+  std::vector<std::string> queued;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    journal_bytes_[path] = 0;
+    for (auto it = queue_.begin(); it != queue_.end();) {
+      if (it->path == path) {
+        queued.push_back(std::move(it->record));
+        it = queue_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  std::vector<Record> records;
+  // File records first: they were spilled before anything still queued.
+  for (std::string& raw : AggregationHandoff::ConsumeRecords(path)) {
+    if (raw.size() < kSpillTimeBytes) {
+      continue;
+    }
+    Record record;
+    record.spilled_at_s = decodeSpillTime(raw.data());
+    record.bytes.assign(raw.data() + kSpillTimeBytes,
+                        raw.size() - kSpillTimeBytes);
+    records.push_back(std::move(record));
+  }
+  for (std::string& raw : queued) {
+    if (raw.size() < kSpillTimeBytes) {
+      continue;
+    }
+    Record record;
+    record.spilled_at_s = decodeSpillTime(raw.data());
+    record.bytes.assign(raw.data() + kSpillTimeBytes,
+                        raw.size() - kSpillTimeBytes);
+    records.push_back(std::move(record));
+  }
+  return records;
+}
+
+uint64_t& ReportSpillJournal::journalBytes(const std::string& path) {
+  auto it = journal_bytes_.find(path);
+  if (it == journal_bytes_.end()) {
+    // First spill for this path in this process; pick up whatever a
+    // previous process left in the journal so the cap holds across
+    // restarts.
+    uint64_t existing = 0;
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (file.is_open() && file.tellg() > 0) {
+      existing = static_cast<uint64_t>(file.tellg());
+    }
+    it = journal_bytes_.emplace(path, existing).first;
+  }
+  return it->second;
+}
+
+void ReportSpillJournal::run() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wakeup_.wait(lock, [this]() { return !queue_.empty(); });
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    AggregationHandoff::AppendRecord(job.path, job.record);
+  }
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
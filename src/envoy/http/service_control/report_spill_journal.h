@@ -0,0 +1,88 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// Process-wide journal for report batches whose transport send failed after
+// all retries. Workers queue the serialized batch here and one background
+// thread appends it to a size-capped journal file, so a worker only pays a
+// queue insertion and the sequential write runs off the dispatcher. The
+// file reuses the length-prefixed handoff record format, with the spill
+// time prepended to each record so stale batches can be expired at replay.
+class ReportSpillJournal {
+ public:
+  struct Record {
+    // Unix seconds at which the batch was spilled.
+    int64_t spilled_at_s = 0;
+    // The serialized ReportRequest.
+    std::string bytes;
+  };
+
+  static ReportSpillJournal& instance();
+
+  // Queues one serialized batch for appending to the journal at |path|.
+  // Returns false without queueing when the journal (counting writes still
+  // queued) would exceed |max_journal_bytes| or the write queue is full;
+  // the caller counts the drop.
+  bool Spill(const std::string& path, std::string&& bytes,
+             uint64_t max_journal_bytes, int64_t now_unix_s);
+
+  // Claims the journal at |path| and returns its records, including ones
+  // still queued for writing. The file is unlinked, so of the workers
+  // racing to replay exactly one gets the records.
+  std::vector<Record> Consume(const std::string& path);
+
+ private:
+  ReportSpillJournal();
+
+  struct Job {
+    std::string path;
+    // One full journal record: the encoded spill time plus the batch.
+    std::string record;
+  };
+
+  // Current journal bytes for |path|, counting queued-but-unwritten
+  // records; read from disk on first use and reset by Consume. Callers
+  // hold |mutex_|.
+  uint64_t& journalBytes(const std::string& path);
+
+  // The background thread's loop; never returns.
+  void run();
+
+  // Guards |queue_| and |journal_bytes_|; touched only on spill, replay
+  // and the background dequeue.
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<Job> queue_;
+  absl::flat_hash_map<std::string, uint64_t> journal_bytes_;
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
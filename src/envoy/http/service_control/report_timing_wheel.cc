@@ -0,0 +1,122 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/report_timing_wheel.h"
+
+#include "common/common/assert.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+ReportTimingWheel::Entry::~Entry() {
+  // Only touch the thread-local wheel when actually linked into it; an
+  // entry that was never scheduled may be destroyed on a thread that
+  // never bound a wheel.
+  if (wheel_scheduled_) {
+    ReportTimingWheel::instance().cancel(*this);
+  }
+}
+
+ReportTimingWheel& ReportTimingWheel::instance() {
+  // The wheel is bound before any handler is pooled on the thread (config
+  // load precedes traffic), so it outlives the handlers it schedules.
+  static thread_local ReportTimingWheel wheel;
+  return wheel;
+}
+
+void ReportTimingWheel::bind(Event::Dispatcher& dispatcher) {
+  if (timer_ != nullptr) {
+    return;
+  }
+  timer_ = dispatcher.createTimer([this]() { onTick(); });
+}
+
+void ReportTimingWheel::schedule(Entry& entry, int64_t delay_ms) {
+  ASSERT(timer_ != nullptr);
+  if (entry.wheel_scheduled_) {
+    cancel(entry);
+  }
+
+  // Round the delay up to whole ticks; anything due sooner than one tick
+  // fires on the next one.
+  int64_t ticks = (delay_ms + kTickMs - 1) / kTickMs;
+  if (ticks < 1) {
+    ticks = 1;
+  }
+  const size_t slot =
+      (current_slot_ + static_cast<size_t>(ticks)) & (kWheelSlots - 1);
+  entry.wheel_rounds_ = static_cast<uint32_t>((ticks - 1) / kWheelSlots);
+  entry.wheel_slot_ = slot;
+
+  // Push onto the slot's list head.
+  entry.wheel_prev_ = nullptr;
+  entry.wheel_next_ = slots_[slot];
+  if (slots_[slot] != nullptr) {
+    slots_[slot]->wheel_prev_ = &entry;
+  }
+  slots_[slot] = &entry;
+  entry.wheel_scheduled_ = true;
+
+  if (scheduled_entries_++ == 0) {
+    timer_->enableTimer(std::chrono::milliseconds(kTickMs));
+  }
+}
+
+void ReportTimingWheel::cancel(Entry& entry) {
+  if (!entry.wheel_scheduled_) {
+    return;
+  }
+  if (entry.wheel_prev_ != nullptr) {
+    entry.wheel_prev_->wheel_next_ = entry.wheel_next_;
+  } else {
+    slots_[entry.wheel_slot_] = entry.wheel_next_;
+  }
+  if (entry.wheel_next_ != nullptr) {
+    entry.wheel_next_->wheel_prev_ = entry.wheel_prev_;
+  }
+  entry.wheel_prev_ = nullptr;
+  entry.wheel_next_ = nullptr;
+  entry.wheel_scheduled_ = false;
+  --scheduled_entries_;
+}
+
+void ReportTimingWheel::onTick() {
+  current_slot_ = (current_slot_ + 1) & (kWheelSlots - 1);
+
+  // Fire the entries due this revolution; the rest wait out their
+  // remaining rounds. Entries re-scheduled from onReportTick() land at
+  // least one tick ahead, never back into this walk.
+  Entry* entry = slots_[current_slot_];
+  while (entry != nullptr) {
+    Entry* next = entry->wheel_next_;
+    if (entry->wheel_rounds_ > 0) {
+      --entry->wheel_rounds_;
+    } else {
+      cancel(*entry);
+      entry->onReportTick();
+    }
+    entry = next;
+  }
+
+  if (scheduled_entries_ > 0) {
+    timer_->enableTimer(std::chrono::milliseconds(kTickMs));
+  }
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
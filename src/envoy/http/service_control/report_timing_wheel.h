@@ -0,0 +1,104 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "envoy/common/pure.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/event/timer.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// A per-worker hashed timing wheel driving the intermediate reports of
+// long-lived streams. A streaming handler schedules itself once per report
+// interval and is called back when its slot comes due, so the report
+// cadence is detached from data arrival: idle-but-open streams still
+// report on time, and busy streams pay no per-frame clock check. One
+// shared timer tick serves every stream of the worker.
+//
+// The wheel is bound to the worker's dispatcher by the first
+// ThreadLocalCache constructed on the thread. Handlers on threads where
+// nothing bound a dispatcher (direct construction in tests) fall back to
+// the legacy elapsed-time checks in the data callbacks.
+class ReportTimingWheel {
+ public:
+  // Wheel tick granularity; report intervals are rounded up to it. Ten
+  // wakeups per second per worker while streams are active; the timer
+  // stops when the wheel empties.
+  static constexpr int64_t kTickMs = 100;
+  // Number of wheel slots; must be a power of two. Delays beyond one
+  // revolution wait out full turns via a per-entry round counter, so one
+  // level covers arbitrary intervals.
+  static constexpr size_t kWheelSlots = 256;
+
+  // A schedulable callback. Entries are intrusive list nodes, so
+  // scheduling allocates nothing; a scheduled entry unlinks itself when
+  // destroyed.
+  class Entry {
+   public:
+    virtual ~Entry();
+
+    // Fired on the tick the entry's delay lands on. The entry is unlinked
+    // before the call; re-schedule from inside it to keep a periodic
+    // cadence.
+    virtual void onReportTick() PURE;
+
+   private:
+    friend class ReportTimingWheel;
+    Entry* wheel_prev_{nullptr};
+    Entry* wheel_next_{nullptr};
+    // Slot the entry is linked into, so cancellation can patch the slot
+    // head without a search.
+    size_t wheel_slot_{0};
+    // Full wheel revolutions left before the entry fires.
+    uint32_t wheel_rounds_{0};
+    bool wheel_scheduled_{false};
+  };
+
+  // This worker's wheel. Dispatcher-thread only, like everything else on
+  // it.
+  static ReportTimingWheel& instance();
+
+  // Binds the wheel to the worker's dispatcher; the first binder wins and
+  // later calls are no-ops. Until a bind, schedule() must not be called.
+  void bind(Event::Dispatcher& dispatcher);
+  bool bound() const { return timer_ != nullptr; }
+
+  // Schedules the entry to fire after roughly |delay_ms| (rounded up to a
+  // whole tick); an already scheduled entry is moved to the new deadline.
+  void schedule(Entry& entry, int64_t delay_ms);
+
+  // Unlinks the entry when scheduled; safe to call regardless.
+  void cancel(Entry& entry);
+
+ private:
+  void onTick();
+
+  // Slot heads of intrusive doubly-linked entry lists.
+  std::array<Entry*, kWheelSlots> slots_{};
+  size_t current_slot_{0};
+  size_t scheduled_entries_{0};
+  Event::TimerPtr timer_;
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
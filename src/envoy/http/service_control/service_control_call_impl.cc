@@ -1,4 +1,6 @@
 #include <memory>
+#include <mutex>
+#include <set>
 
 // Copyright 2019 Google LLC
 //
@@ -14,8 +16,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "google/protobuf/io/coded_stream.h"
 #include "src/api_proxy/service_control/logs_metrics_loader.h"
+#include "src/envoy/http/service_control/derived_config_cache.h"
 #include "src/envoy/http/service_control/service_control_call_impl.h"
+#include "src/envoy/utils/config_build_executor.h"
+#include "src/envoy/utils/token_subscriber_factory_impl.h"
 
 using Envoy::Extensions::Utils::ServiceAccountToken;
 using Envoy::Extensions::Utils::TokenSubscriber;
@@ -39,19 +47,317 @@ constexpr char kServiceControlService[] =
 constexpr char kQuotaControlService[] =
     "/google.api.servicecontrol.v1.QuotaController";
 
+// Caps for the structured debug summaries below. The debug log sites used
+// to print proto DebugString(), whose text form for a batched ReportRequest
+// runs to many kilobytes per line; with these summaries, turning on debug
+// logs during an incident stays cheap regardless of batch size.
+constexpr int kMaxLoggedOperations = 5;
+constexpr int kMaxLoggedLabels = 5;
+
+void appendLabelNames(
+    const ::google::protobuf::Map<std::string, std::string>& labels,
+    std::string* out) {
+  int logged = 0;
+  for (const auto& label : labels) {
+    if (logged == kMaxLoggedLabels) {
+      absl::StrAppend(out, ",...");
+      break;
+    }
+    absl::StrAppend(out, logged > 0 ? "," : "", label.first);
+    ++logged;
+  }
+}
+
+std::string summarizeForLog(
+    const ::google::api::servicecontrol::v1::CheckRequest& request) {
+  std::string out = absl::StrCat(
+      "service=", request.service_name(),
+      " operation=", request.operation().operation_name(),
+      " consumer=", request.operation().consumer_id(), " labels=[");
+  appendLabelNames(request.operation().labels(), &out);
+  absl::StrAppend(&out, "] bytes=", request.ByteSizeLong());
+  return out;
+}
+
+std::string summarizeForLog(
+    const ::google::api::servicecontrol::v1::AllocateQuotaRequest& request) {
+  return absl::StrCat(
+      "service=", request.service_name(),
+      " operation=", request.allocate_operation().method_name(),
+      " consumer=", request.allocate_operation().consumer_id(),
+      " metrics=", request.allocate_operation().quota_metrics_size(),
+      " bytes=", request.ByteSizeLong());
+}
+
+std::string summarizeForLog(
+    const ::google::api::servicecontrol::v1::ReportRequest& request) {
+  std::string names;
+  const int operations = request.operations_size();
+  for (int i = 0; i < operations && i < kMaxLoggedOperations; ++i) {
+    absl::StrAppend(&names, i > 0 ? "," : "",
+                    request.operations(i).operation_name());
+  }
+  if (operations > kMaxLoggedOperations) {
+    absl::StrAppend(&names, ",...");
+  }
+  return absl::StrCat("service=", request.service_name(),
+                      " operations=", operations, " names=[", names,
+                      "] bytes=", request.ByteSizeLong());
+}
+
+// google.api.Service field numbers of the sections LogsMetricsLoader
+// reads. Everything else in the (often multi-megabyte) config -
+// documentation, types, enums, http rules, source info - is skipped on
+// the wire instead of being parsed and then thrown away.
+constexpr int kServiceLogsField = 23;
+constexpr int kServiceMetricsField = 24;
+constexpr int kServiceMonitoredResourcesField = 25;
+constexpr int kServiceLoggingField = 27;
+constexpr int kServiceMonitoringField = 28;
+
+// Skips one field of any scalar or length-delimited wire type. Groups do
+// not appear in the proto3 service config; their tags fail the parse and
+// the caller falls back to the full unpack.
+bool skipServiceField(::google::protobuf::io::CodedInputStream* input,
+                      uint32_t tag) {
+  switch (tag & 7) {
+    case 0: {
+      uint64_t value;
+      return input->ReadVarint64(&value);
+    }
+    case 1: {
+      uint64_t value;
+      return input->ReadLittleEndian64(&value);
+    }
+    case 2: {
+      uint32_t length;
+      return input->ReadVarint32(&length) && input->Skip(length);
+    }
+    case 5: {
+      uint32_t value;
+      return input->ReadLittleEndian32(&value);
+    }
+    default:
+      return false;
+  }
+}
+
+// Reads one length-delimited sub-message into |target|, merging so a
+// singular message field split across several occurrences concatenates
+// the way a full parse would.
+bool readServiceSubMessage(::google::protobuf::io::CodedInputStream* input,
+                           ::google::protobuf::Message* target) {
+  uint32_t length;
+  if (!input->ReadVarint32(&length)) {
+    return false;
+  }
+  const auto limit = input->PushLimit(length);
+  const bool ok = target->MergePartialFromCodedStream(input) &&
+                  input->ConsumedEntireMessage();
+  input->PopLimit(limit);
+  return ok;
+}
+
+// Field-selective unpack of the service config Any: walks the serialized
+// google.api.Service payload top-level tag by tag, materializes only the
+// sections named above and skips the rest over the wire format, so a
+// multi-megabyte config costs neither the parse time nor the transient
+// heap of its documentation and type sections. Returns false on anything
+// unexpected in the bytes; the caller then falls back to the full
+// UnpackTo.
+bool partialUnpackServiceConfig(const ::google::protobuf::Any& any,
+                                ::google::api::Service* service) {
+  if (!any.Is<::google::api::Service>()) {
+    return false;
+  }
+  const std::string& bytes = any.value();
+  ::google::protobuf::io::CodedInputStream input(
+      reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+  uint32_t tag;
+  while ((tag = input.ReadTag()) != 0) {
+    ::google::protobuf::Message* target = nullptr;
+    switch (tag >> 3) {
+      case kServiceLogsField:
+        target = service->add_logs();
+        break;
+      case kServiceMetricsField:
+        target = service->add_metrics();
+        break;
+      case kServiceMonitoredResourcesField:
+        target = service->add_monitored_resources();
+        break;
+      case kServiceLoggingField:
+        target = service->mutable_logging();
+        break;
+      case kServiceMonitoringField:
+        target = service->mutable_monitoring();
+        break;
+      default:
+        break;
+    }
+    if (target == nullptr) {
+      if (!skipServiceField(&input, tag)) {
+        return false;
+      }
+      continue;
+    }
+    if ((tag & 7) != 2 || !readServiceSubMessage(&input, target)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Builds the request builder snapshot for one service: unpacks the service
+// config, derives the logs/metrics/labels sets and freezes the report
+// operation templates. This is the expensive part of config ingestion and
+// runs off the main thread, on the first worker that needs the snapshot.
+// When a derived config cache directory is configured, the unpack and the
+// derivation are skipped entirely on restarts with unchanged config bytes.
+std::shared_ptr<const RequestBuilder> buildRequestBuilder(
+    const Service& config, const FilterConfig& filter_config) {
+  std::shared_ptr<RequestBuilder> builder;
+  if (config.has_service_config()) {
+    const std::string& cache_dir =
+        filter_config.sc_calling_config().derived_config_cache_directory();
+    const uint64_t config_hash =
+        cache_dir.empty()
+            ? 0
+            : DerivedConfigCache::HashConfig(config.service_config().value());
+    DerivedConfigCache::LogsMetricsSnapshot snapshot;
+    if (!cache_dir.empty() &&
+        DerivedConfigCache::Load(cache_dir, config.service_name(),
+                                 config.service_config_id(), config_hash,
+                                 &snapshot)) {
+      // Snapshot hit: the raw config bytes are unchanged since a previous
+      // process derived these sets, so the Any unpack and the
+      // LogsMetricsLoader scan are both skipped.
+      builder = std::make_shared<RequestBuilder>(
+          snapshot.logs, snapshot.metrics, snapshot.labels,
+          config.service_name(), config.service_config_id());
+    } else {
+      ::google::api::Service origin_service;
+      // The selective parse materializes only the sections the loader
+      // reads; a failed partial parse (origin_service possibly half
+      // filled) falls back to the full unpack, which clears it first.
+      if (partialUnpackServiceConfig(config.service_config(),
+                                     &origin_service) ||
+          config.service_config().UnpackTo(&origin_service)) {
+        (void)LogsMetricsLoader::Load(origin_service, &snapshot.logs,
+                                      &snapshot.metrics, &snapshot.labels);
+        builder = std::make_shared<RequestBuilder>(
+            snapshot.logs, snapshot.metrics, snapshot.labels,
+            config.service_name(), config.service_config_id());
+        if (!cache_dir.empty()) {
+          DerivedConfigCache::Store(cache_dir, config.service_name(),
+                                    config.service_config_id(), config_hash,
+                                    snapshot);
+        }
+      }
+      // A type-mismatched Any was already rejected at config time; an
+      // unparseable payload of the right type falls back to the default
+      // builder below.
+    }
+  }
+  if (builder == nullptr) {
+    builder = std::make_shared<RequestBuilder>(
+        std::vector<std::string>{"endpoints_log"}, config.service_name(),
+        config.service_config_id());
+  }
+
+  // Cap the variable-size request strings the report path copies into
+  // labels and log entries, so one request with pathological headers
+  // cannot inflate report aggregation memory and egress.
+  if (filter_config.sc_calling_config().has_report_field_byte_budget()) {
+    builder->SetReportFieldByteBudget(
+        filter_config.sc_calling_config().report_field_byte_budget().value());
+  }
+
+  // The GCP platform labels are constant for the life of the process;
+  // resolve them once here so every frozen report Operation prototype
+  // carries them and the per-report label loop never assembles them.
+  if (filter_config.has_gcp_attributes()) {
+    builder->PreparePlatformLabels(filter_config.gcp_attributes().zone(),
+                                   filter_config.gcp_attributes().platform());
+  }
+
+  // Freeze a report Operation prototype per operation of this service so the
+  // per-request report path only patches dynamic fields, and an
+  // AllocateQuotaRequest prototype per operation with metric costs so the
+  // per-request quota path does the same.
+  for (const auto& requirement : filter_config.requirements()) {
+    if (requirement.service_name() == config.service_name()) {
+      builder->PrepareReportOperationTemplate(requirement.operation_name(),
+                                              requirement.api_name(),
+                                              requirement.api_version());
+      if (!requirement.metric_costs().empty()) {
+        std::vector<std::pair<std::string, int>> metric_costs;
+        metric_costs.reserve(requirement.metric_costs().size());
+        for (const auto& metric_cost : requirement.metric_costs()) {
+          metric_costs.emplace_back(metric_cost.name(), metric_cost.cost());
+        }
+        builder->PrepareQuotaOperationTemplate(requirement.operation_name(),
+                                               metric_costs);
+      }
+    }
+  }
+  return builder;
+}
+
+// Returns the immutable request builder snapshot for |config|, building it
+// on first use. Snapshots are shared process-wide by service name and
+// config id, so a config push that re-installs an unchanged service config
+// reuses the previous derivation instead of redoing it.
+std::shared_ptr<const RequestBuilder> getOrBuildRequestBuilder(
+    const Service& config, const FilterConfig& filter_config) {
+  // The registry outlives config updates; expired services are purged when
+  // a new snapshot is built.
+  static std::mutex* registry_mutex = new std::mutex;
+  static absl::flat_hash_map<std::string,
+                             std::weak_ptr<const RequestBuilder>>* registry =
+      new absl::flat_hash_map<std::string,
+                              std::weak_ptr<const RequestBuilder>>;
+
+  const std::string service_key =
+      config.service_name() + "/" + config.service_config_id();
+  std::lock_guard<std::mutex> lock(*registry_mutex);
+  auto& weak_entry = (*registry)[service_key];
+  std::shared_ptr<const RequestBuilder> builder = weak_entry.lock();
+  if (builder == nullptr) {
+    builder = buildRequestBuilder(config, filter_config);
+    weak_entry = builder;
+    for (auto it = registry->begin(); it != registry->end();) {
+      if (it->second.expired()) {
+        registry->erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  return builder;
+}
+
 }  // namespace
 
 ServiceControlCallImpl::ServiceControlCallImpl(
     const Service& config, const FilterConfig& filter_config,
-    Server::Configuration::FactoryContext& context)
+    Server::Configuration::FactoryContext& context,
+    ServiceControlFilterStats& stats)
     : config_(config),
       filter_config_(filter_config),
       tls_(context.threadLocal().allocateSlot()) {
+  // Each worker gets a lazy holder; the real ThreadLocalCache (client
+  // cache, report batch arena, prewarmed connection) is only built on the
+  // worker's first request for this service, so the many services of a
+  // multi-tenant config that a pod never serves stay cheap.
   tls_->set([this, &cm = context.clusterManager(),
-             &time_source = context.timeSource()](Event::Dispatcher& dispatcher)
+             &time_source = context.timeSource(), &scope = context.scope(),
+             &overload_manager = context.overloadManager(),
+             &stats](Event::Dispatcher& dispatcher)
                 -> ThreadLocal::ThreadLocalObjectSharedPtr {
-    return std::make_shared<ThreadLocalCache>(config_, filter_config_, cm,
-                                              time_source, dispatcher);
+    return std::make_shared<LazyThreadLocalCache>(
+        config_, filter_config_, cm, time_source, dispatcher, scope, stats,
+        overload_manager);
   });
 
   switch (filter_config.access_token().token_type_case()) {
@@ -60,15 +366,20 @@ ServiceControlCallImpl::ServiceControlCallImpl(
           filter_config.access_token().remote_token().uri();
       const std::string& token_cluster =
           filter_config.access_token().remote_token().cluster();
-      token_sub_ptr_ = std::make_unique<TokenSubscriber>(
-          context, token_cluster, token_uri,
-          /*json_response=*/true, [this](const std::string& token) {
-            TokenSharedPtr new_token = std::make_shared<std::string>(token);
-            tls_->runOnAllThreads([this, new_token]() {
-              tls_->getTyped<ThreadLocalCache>().set_sc_token(new_token);
-              tls_->getTyped<ThreadLocalCache>().set_quota_token(new_token);
-            });
-          });
+      // Subscribed through the shared registry: several service configs
+      // fetching the same token share one metadata server poll.
+      token_sub_ptr_ =
+          Utils::SharedTokenSubscriberRegistry::instance().subscribe(
+              context, token_cluster, token_uri,
+              /*json_response=*/true, [this](const std::string& token) {
+                // The token is copied into each worker's cache on its own
+                // dispatcher, so per-call reads need no atomics.
+                tls_->runOnAllThreads([this, token]() {
+                  auto& cache = tls_->getTyped<LazyThreadLocalCache>();
+                  cache.set_sc_token(token);
+                  cache.set_quota_token(token);
+                });
+              });
     } break;
     case AccessToken::kServiceAccountSecret: {
       const std::string service_control_auidence =
@@ -77,9 +388,8 @@ ServiceControlCallImpl::ServiceControlCallImpl(
           context,
           filter_config.access_token().service_account_secret().inline_string(),
           service_control_auidence, [this](const std::string& token) {
-            TokenSharedPtr new_token = std::make_shared<std::string>(token);
-            tls_->runOnAllThreads([this, new_token]() {
-              tls_->getTyped<ThreadLocalCache>().set_sc_token(new_token);
+            tls_->runOnAllThreads([this, token]() {
+              tls_->getTyped<LazyThreadLocalCache>().set_sc_token(token);
             });
           });
 
@@ -89,9 +399,8 @@ ServiceControlCallImpl::ServiceControlCallImpl(
           context,
           filter_config.access_token().service_account_secret().inline_string(),
           quota_audience, [this](const std::string& token) {
-            TokenSharedPtr new_token = std::make_shared<std::string>(token);
-            tls_->runOnAllThreads([this, new_token]() {
-              tls_->getTyped<ThreadLocalCache>().set_quota_token(new_token);
+            tls_->runOnAllThreads([this, token]() {
+              tls_->getTyped<LazyThreadLocalCache>().set_quota_token(token);
             });
           });
     } break;
@@ -100,48 +409,132 @@ ServiceControlCallImpl::ServiceControlCallImpl(
       break;
   }
 
-  if (config.has_service_config()) {
-    ::google::api::Service origin_service;
-    if (!config.service_config().UnpackTo(&origin_service)) {
-      throw ProtoValidationException("Invalid service config", config);
-    }
+  // Only the cheap type check runs during the config push; the unpack and
+  // the logs/metrics/labels derivation are deferred to ensureRequestBuilder
+  // so listener updates do not stall on them.
+  if (config.has_service_config() &&
+      !config.service_config().Is<::google::api::Service>()) {
+    throw ProtoValidationException("Invalid service config", config);
+  }
 
-    std::set<std::string> logs, metrics, labels;
-    (void)LogsMetricsLoader::Load(origin_service, &logs, &metrics, &labels);
-    request_builder_.reset(new RequestBuilder(logs, metrics, labels,
-                                              config.service_name(),
-                                              config.service_config_id()));
-  } else {
-    request_builder_.reset(new RequestBuilder(
-        {"endpoints_log"}, config.service_name(), config.service_config_id()));
+  // For the common single-service config, start the derivation now on the
+  // shared config-build executor so it overlaps the rest of the config
+  // push; a request arriving before it finished joins through the once
+  // flag in ensureRequestBuilder. Multi-tenant configs carry many services
+  // a given pod never serves, so their builders are left to materialize on
+  // each service's first request instead of being derived up front.
+  if (filter_config.services_size() == 1) {
+    request_builder_warm_ = Utils::ConfigBuildExecutor::instance().Submit(
+        [this]() { ensureRequestBuilder(); });
   }
 }  // namespace ServiceControl
 
+ServiceControlCallImpl::~ServiceControlCallImpl() {
+  if (request_builder_warm_.valid()) {
+    request_builder_warm_.wait();
+  }
+}
+
+void ServiceControlCallImpl::ensureRequestBuilder() {
+  std::call_once(request_builder_once_, [this]() {
+    request_builder_ = getOrBuildRequestBuilder(config_, filter_config_);
+  });
+}
+
 CancelFunc ServiceControlCallImpl::callCheck(
     const ::google::api_proxy::service_control::CheckRequestInfo& request_info,
     Envoy::Tracing::Span& parent_span, CheckDoneFunc on_done) {
-  ::google::api::servicecontrol::v1::CheckRequest request;
-  (void)request_builder_->FillCheckRequest(request_info, &request);
-  ENVOY_LOG(debug, "Sending check : {}", request.DebugString());
-  return getTLCache().client_cache().callCheck(request, parent_span, on_done);
+  ensureRequestBuilder();
+  ThreadLocalCache& tls_cache = getTLCache();
+  // The invalid-key gate runs before anything else: a hit costs a few bit
+  // probes and spends neither an RPC, a request proto nor a cache entry on
+  // a key the backend recently declared invalid.
+  if (!request_info.api_key.empty() &&
+      tls_cache.client_cache().tryDenyFromInvalidKeyGate(
+          request_info.api_key, request_info.operation_name, on_done)) {
+    return nullptr;
+  }
+  // The check decision key is fully determined by (operation, api_key), so
+  // a repeat consumer reuses the per-worker copy instead of deriving it
+  // from a freshly built request — and when the shared cache already holds
+  // the decision, the request proto is never built at all.
+  const std::string* decision_key = nullptr;
+  if (!request_info.api_key.empty()) {
+    decision_key = &tls_cache.checkDecisionKey(request_info.operation_name,
+                                               request_info.api_key);
+    if (tls_cache.client_cache().tryCompleteCheckFromCache(
+            *decision_key, request_info.operation_name, on_done)) {
+      return nullptr;
+    }
+  }
+  // Pre-token gate: a check that would go remote before this worker has
+  // its first access token parks briefly instead of burning a doomed RPC
+  // attempt; the queue resumes through this method once the token lands.
+  // The gate sits after the cache probes, which answer without a token.
+  if (tls_cache.preTokenGateActive()) {
+    CancelFunc cancel_fn;
+    if (tls_cache.tryParkPreTokenCheck(
+            request_info, parent_span, on_done,
+            [this](const ::google::api_proxy::service_control::
+                       CheckRequestInfo& info,
+                   Envoy::Tracing::Span& span, CheckDoneFunc done) {
+              callCheck(info, span, done);
+            },
+            &cancel_fn)) {
+      return cancel_fn;
+    }
+  }
+  auto* request = ::google::protobuf::Arena::CreateMessage<
+      ::google::api::servicecontrol::v1::CheckRequest>(
+      &tls_cache.request_arena());
+  (void)request_builder_->FillCheckRequest(request_info, request);
+  ENVOY_LOG(debug, "Sending check : {}", summarizeForLog(*request));
+  CancelFunc cancel_fn = tls_cache.client_cache().callCheck(
+      *request, parent_span, on_done, decision_key);
+  // The client has copied the request into its cache (and the transport has
+  // serialized it) by the time callCheck returns.
+  tls_cache.resetRequestArena();
+  return cancel_fn;
 }
 
 void ServiceControlCallImpl::callQuota(
     const ::google::api_proxy::service_control::QuotaRequestInfo& request_info,
     QuotaDoneFunc on_done) {
-  ::google::api::servicecontrol::v1::AllocateQuotaRequest request;
-  (void)request_builder_->FillAllocateQuotaRequest(request_info, &request);
-  ENVOY_LOG(debug, "Sending allocateQuota : {}", request.DebugString());
-  getTLCache().client_cache().callQuota(request, on_done);
+  ensureRequestBuilder();
+  ThreadLocalCache& tls_cache = getTLCache();
+  auto* request = ::google::protobuf::Arena::CreateMessage<
+      ::google::api::servicecontrol::v1::AllocateQuotaRequest>(
+      &tls_cache.request_arena());
+  (void)request_builder_->FillAllocateQuotaRequest(request_info, request);
+  ENVOY_LOG(debug, "Sending allocateQuota : {}", summarizeForLog(*request));
+  tls_cache.client_cache().callQuota(*request, on_done);
+  tls_cache.resetRequestArena();
 }
 
 void ServiceControlCallImpl::callReport(
     const ::google::api_proxy::service_control::ReportRequestInfo&
         request_info) {
-  ::google::api::servicecontrol::v1::ReportRequest request;
-  (void)request_builder_->FillReportRequest(request_info, &request);
-  ENVOY_LOG(debug, "Sending report : {}", request.DebugString());
-  getTLCache().client_cache().callReport(request);
+  // Append this stream's operation directly into the worker-local batched
+  // ReportRequest; FillReportRequest adds one operation per call. The batch
+  // is flushed to ClientCache on an operation count or time threshold.
+  ensureRequestBuilder();
+  ThreadLocalCache& tls_cache = getTLCache();
+  if (tls_cache.heavy_hitter_tracker() != nullptr) {
+    // Every completed stream reports exactly once, so this counts requests
+    // per api key.
+    tls_cache.heavy_hitter_tracker()->Record(request_info.api_key);
+  }
+  // Overload shedding applies to Report only; Check gates serving and is
+  // never touched. The tracker above still records shed operations so the
+  // heavy-hitter view stays usable during the overload it exists for.
+  if (tls_cache.shouldShedReport(!request_info.api_key.empty())) {
+    return;
+  }
+  (void)request_builder_->FillReportRequest(request_info,
+                                            &tls_cache.report_batch());
+  ENVOY_LOG(debug, "Batched report : {}",
+            summarizeForLog(tls_cache.report_batch()));
+  tls_cache.onReportBatched();
 }
 
 }  // namespace ServiceControl
@@ -14,15 +14,28 @@
 
 #pragma once
 
+#include <future>
+#include <mutex>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "api/envoy/http/service_control/config.pb.h"
 #include "common/common/logger.h"
 #include "envoy/server/filter_config.h"
+#include "envoy/server/overload_manager.h"
 #include "envoy/thread_local/thread_local.h"
 #include "envoy/upstream/cluster_manager.h"
 #include "google/api/service.pb.h"
+#include "google/protobuf/arena.h"
 #include "src/api_proxy/service_control/request_builder.h"
+#include "src/envoy/http/service_control/check_resume_batcher.h"
 #include "src/envoy/http/service_control/client_cache.h"
+#include "src/envoy/http/service_control/filter_stats.h"
+#include "src/envoy/http/service_control/heavy_hitter_tracker.h"
+#include "src/envoy/http/service_control/report_timing_wheel.h"
 #include "src/envoy/http/service_control/service_control_call.h"
+#include "src/envoy/utils/cluster_prewarm.h"
 #include "src/envoy/utils/service_account_token.h"
 #include "src/envoy/utils/token_subscriber.h"
 
@@ -31,46 +44,484 @@ namespace Extensions {
 namespace HttpFilters {
 namespace ServiceControl {
 
-// Use shared_ptr to do atomic token update.
-typedef std::shared_ptr<std::string> TokenSharedPtr;
+// Overload manager action names this filter observes. Wiring either name
+// to a resource monitor in the bootstrap overload manager config turns
+// the corresponding degradation on; an unconfigured action reads as
+// permanently inactive. Both act on Report only - Check gates serving and
+// is never degraded.
+constexpr char kDegradeReportsOverloadAction[] =
+    "espv2.overload_actions.degrade_service_control_reports";
+constexpr char kShedReportsOverloadAction[] =
+    "espv2.overload_actions.shed_service_control_reports";
 
 class ThreadLocalCache : public ThreadLocal::ThreadLocalObject {
  public:
+  // Flush the batched report when this many operations have accumulated, or
+  // when the flush timer fires, whichever comes first. The service control
+  // client aggregates operations further; this batching only amortizes the
+  // per-stream ReportRequest construction and serialization.
+  static constexpr int kReportBatchMaxOperations = 16;
+  static constexpr int kReportBatchFlushIntervalMs = 1000;
+  // Multiplier on the flush interval while the degrade overload action is
+  // active; the operation-count threshold still bounds batch memory.
+  static constexpr int kOverloadFlushStretch = 10;
+  // Pre-token gate: checks arriving before this worker's first access
+  // token park in a bounded queue instead of burning doomed RPC attempts,
+  // and resume in one batch when the token callback fires. When the
+  // deadline expires first the queue proceeds without a token (failing
+  // over to the network_fail_open policy as before) and the gate stays
+  // off - it is one boot-time window per worker.
+  static constexpr size_t kPreTokenQueueMaxCalls = 256;
+  static constexpr int kPreTokenQueueDeadlineMs = 5000;
+
+  // Re-runs one parked check through the full call path once a token is
+  // available (or the deadline gave up on one arriving).
+  using PreTokenResumeFn = std::function<void(
+      const ::google::api_proxy::service_control::CheckRequestInfo&,
+      Envoy::Tracing::Span&, CheckDoneFunc)>;
+
   ThreadLocalCache(
       const ::google::api::envoy::http::service_control::Service& config,
       const ::google::api::envoy::http::service_control::FilterConfig&
           filter_config,
       Upstream::ClusterManager& cm, Envoy::TimeSource& time_source,
-      Event::Dispatcher& dispatcher)
-      : client_cache_(
-            config, filter_config, cm, time_source, dispatcher,
-            [this]() -> const std::string& { return sc_token(); },
-            [this]() -> const std::string& { return quota_token(); }) {}
+      Event::Dispatcher& dispatcher, Stats::Scope& scope,
+      ServiceControlFilterStats& stats,
+      Server::OverloadManager& overload_manager)
+      : stats_(stats),
+        degrade_reports_state_(
+            overload_manager.getThreadLocalOverloadState().getState(
+                kDegradeReportsOverloadAction)),
+        shed_reports_state_(
+            overload_manager.getThreadLocalOverloadState().getState(
+                kShedReportsOverloadAction)),
+        client_cache_(
+            config, filter_config, cm, time_source, dispatcher, scope, stats,
+            [this]() -> const std::string& { return sc_auth_value(); },
+            [this]() -> const std::string& { return quota_auth_value(); }) {
+    if (filter_config.has_sc_calling_config() &&
+        filter_config.sc_calling_config().has_enable_heavy_hitter_tracking() &&
+        filter_config.sc_calling_config().enable_heavy_hitter_tracking()
+            .value()) {
+      heavy_hitter_tracker_ = std::make_unique<HeavyHitterTracker>(
+          dispatcher, config.service_name());
+    }
+    if (filter_config.has_sc_calling_config() &&
+        filter_config.sc_calling_config()
+            .has_overload_report_sample_every_n()) {
+      overload_sample_every_n_ = filter_config.sc_calling_config()
+                                     .overload_report_sample_every_n()
+                                     .value();
+    }
+    allocateReportBatch();
+    report_flush_timer_ =
+        dispatcher.createTimer([this]() { flushReportBatch(); });
+    pre_token_deadline_timer_ = dispatcher.createTimer([this]() {
+      // The one boot window is over: whatever the queue holds proceeds
+      // without a token, and later checks are no longer gated.
+      pre_token_gate_active_ = false;
+      drainPreTokenChecks();
+    });
+    // This constructor runs on each worker with that worker's dispatcher;
+    // hand it to the thread's report timing wheel so streaming handlers
+    // can drive their intermediate reports off one shared timer.
+    ReportTimingWheel::instance().bind(dispatcher);
+    // Likewise for the thread's check resumption batcher, so bursts of
+    // check completions resume their streams in one deferred walk.
+    CheckResumeBatcher::instance().bind(dispatcher);
+    // Open this worker's connection to service control before the first
+    // request needs it; without this the first Check after boot pays the
+    // TCP+TLS handshake on top of its own latency.
+    Utils::prewarmCluster(cm, filter_config.service_control_uri().cluster(),
+                          filter_config.service_control_uri().uri());
+  }
 
-  void set_sc_token(TokenSharedPtr sc_token) { sc_token_ = sc_token; }
-  const std::string& sc_token() const {
-    return (sc_token_) ? *sc_token_ : empty_token();
+  ~ThreadLocalCache() override {
+    // Parked pre-token checks can no longer go out; complete them as
+    // cancelled the way the transport teardown does for in-flight calls.
+    for (const auto& check : pre_token_checks_) {
+      if (!check->cancelled && check->on_done != nullptr) {
+        ::google::api_proxy::service_control::CheckResponseInfo response_info;
+        check->on_done(::google::protobuf::util::Status(
+                           ::google::protobuf::util::error::CANCELLED,
+                           "Request cancelled"),
+                       response_info);
+      }
+    }
+    pre_token_checks_.clear();
+    flushReportBatch();
   }
 
-  void set_quota_token(TokenSharedPtr quota_token) {
+  // Tokens are plain per-worker strings: they are written only from this
+  // worker's dispatcher via runOnAllThreads, so the per-call read involves
+  // no atomic operations and no shared_ptr refcount traffic across workers.
+  // The Authorization header value is formatted once per token update, so
+  // calls append it instead of concatenating "Bearer " + token each time.
+  void set_sc_token(const std::string& sc_token) {
+    sc_token_ = sc_token;
+    sc_auth_value_ = sc_token.empty() ? "" : "Bearer " + sc_token;
+    if (!sc_auth_value_.empty() && pre_token_gate_active_) {
+      // The first token arrived: one cheap wakeup resumes every check that
+      // parked during boot instead of each burning a doomed RPC.
+      pre_token_gate_active_ = false;
+      drainPreTokenChecks();
+    }
+  }
+  const std::string& sc_token() const { return sc_token_; }
+  const std::string& sc_auth_value() const { return sc_auth_value_; }
+
+  void set_quota_token(const std::string& quota_token) {
     quota_token_ = quota_token;
+    quota_auth_value_ = quota_token.empty() ? "" : "Bearer " + quota_token;
   }
-  const std::string& quota_token() const {
-    return (quota_token_) ? *quota_token_ : empty_token();
+  const std::string& quota_token() const { return quota_token_; }
+  const std::string& quota_auth_value() const { return quota_auth_value_; }
+
+  ClientCache& client_cache() { return client_cache_; }
+
+  // Whether checks that would go remote should park for the first token.
+  // Cache-answered checks never park; they need no token.
+  bool preTokenGateActive() const {
+    return pre_token_gate_active_ && sc_auth_value_.empty();
   }
 
-  const std::string& empty_token() const {
-    static const std::string* const kEmptyToken = new std::string;
-    return *kEmptyToken;
+  // Parks one check until the first token arrives (or the deadline fires).
+  // Returns false when the queue cap is hit; the caller then proceeds as
+  // before. On success *cancel_fn detaches the entry, for streams that
+  // reset while parked. The string_view fields of |info| are copied: they
+  // point into per-stream storage this queue must not depend on.
+  bool tryParkPreTokenCheck(
+      const ::google::api_proxy::service_control::CheckRequestInfo& info,
+      Envoy::Tracing::Span& parent_span, CheckDoneFunc on_done,
+      PreTokenResumeFn resume, CancelFunc* cancel_fn) {
+    if (pre_token_checks_.size() >= kPreTokenQueueMaxCalls) {
+      return false;
+    }
+    auto parked = std::make_shared<ParkedCheck>();
+    parked->operation_id = std::string(info.operation_id);
+    parked->operation_name = std::string(info.operation_name);
+    parked->producer_project_id = std::string(info.producer_project_id);
+    parked->api_key = std::string(info.api_key);
+    parked->referer = std::string(info.referer);
+    parked->client_ip = std::string(info.client_ip);
+    parked->client_host = std::string(info.client_host);
+    parked->android_package_name = std::string(info.android_package_name);
+    parked->android_cert_fingerprint =
+        std::string(info.android_cert_fingerprint);
+    parked->ios_bundle_id = std::string(info.ios_bundle_id);
+    parked->request_start_time = info.request_start_time;
+    parked->parent_span = &parent_span;
+    parked->on_done = on_done;
+    parked->resume = std::move(resume);
+    if (pre_token_checks_.empty()) {
+      pre_token_deadline_timer_->enableTimer(
+          std::chrono::milliseconds(kPreTokenQueueDeadlineMs));
+    }
+    pre_token_checks_.push_back(parked);
+    stats_.check_pre_token_parked_.inc();
+    *cancel_fn = [parked]() {
+      parked->cancelled = true;
+      parked->on_done = nullptr;
+    };
+    return true;
   }
 
-  ClientCache& client_cache() { return client_cache_; }
+  // Null unless heavy-hitter tracking is enabled in the config.
+  HeavyHitterTracker* heavy_hitter_tracker() {
+    return heavy_hitter_tracker_.get();
+  }
+
+  // Returns this worker's cached check decision key
+  // ("api_key:<key>\t<operation>") for one (operation, api_key) pair,
+  // deriving and caching it on first use. The key is fully determined by
+  // the pair, so a repeat consumer reuses the stored copy instead of
+  // concatenating it per request; together with
+  // ClientCache::tryCompleteCheckFromCache this lets a shared-cache hit
+  // skip building the CheckRequest proto altogether. The prefix matches the
+  // consumer id RequestBuilder::FillCheckRequest puts on the wire for a
+  // non-empty api key; callers must not pass an empty one. The returned
+  // reference is only stable until the next call. Per-worker,
+  // dispatcher-thread only.
+  const std::string& checkDecisionKey(absl::string_view operation_name,
+                                      absl::string_view api_key) {
+    // The table is dropped wholesale when full; refilling an entry costs
+    // one concatenation, and per-entry LRU bookkeeping would cost more than
+    // it saves at this size.
+    if (check_signatures_.size() >= kCheckSignatureCacheMaxKeys) {
+      check_signatures_.clear();
+    }
+    auto it = check_signatures_.find(api_key);
+    if (it == check_signatures_.end()) {
+      it = check_signatures_
+               .emplace(std::string(api_key), std::vector<CheckSignature>())
+               .first;
+    }
+    // One api key is typically used with a handful of operations; a linear
+    // scan beats a second hash lookup.
+    for (const CheckSignature& signature : it->second) {
+      if (signature.operation_name == operation_name) {
+        return signature.decision_key;
+      }
+    }
+    it->second.emplace_back();
+    CheckSignature& signature = it->second.back();
+    signature.operation_name = std::string(operation_name);
+    signature.decision_key =
+        absl::StrCat("api_key:", api_key, "\t", operation_name);
+    return signature.decision_key;
+  }
+
+  // Arena for short-lived Check/AllocateQuota request protos. Nested
+  // Operation messages inherit the arena of the top-level request, so one
+  // arena allocation replaces dozens of small heap allocations per request.
+  // Callers must resetRequestArena() once the client has consumed the
+  // request.
+  ::google::protobuf::Arena& request_arena() { return request_arena_; }
+  void resetRequestArena() { request_arena_.Reset(); }
+
+  // The worker-local ReportRequest that operations of many streams are
+  // appended into. Callers fill an operation directly into this request and
+  // then call onReportBatched().
+  ::google::api::servicecontrol::v1::ReportRequest& report_batch() {
+    return *report_batch_;
+  }
+
+  // Decides whether this operation's report is dropped under overload.
+  // The shed action drops operations without an api key outright (no
+  // consumer attribution, so nothing billed is lost); the degrade action
+  // keeps one of every overload_report_sample_every_n operations. Every
+  // dropped operation is counted, so billing can be reconciled against
+  // the proxy after the episode. Inactive actions cost two enum loads
+  // per report.
+  bool shouldShedReport(bool has_api_key) {
+    if (!has_api_key &&
+        shed_reports_state_ == Server::OverloadActionState::Active) {
+      stats_.report_overload_shed_.inc();
+      return true;
+    }
+    if (overload_sample_every_n_ > 1 &&
+        degrade_reports_state_ == Server::OverloadActionState::Active &&
+        ++report_sample_counter_ % overload_sample_every_n_ != 0) {
+      stats_.report_overload_sampled_.inc();
+      return true;
+    }
+    return false;
+  }
+
+  // Flushes on the operation threshold, otherwise arms the flush timer so a
+  // trickle of traffic is not held back longer than the flush interval.
+  // While the degrade overload action is active the interval is stretched,
+  // trading report freshness for fewer flush serializations.
+  void onReportBatched() {
+    if (report_batch_->operations_size() >= kReportBatchMaxOperations) {
+      flushReportBatch();
+      return;
+    }
+    if (report_flush_timer_ && !report_flush_timer_->enabled()) {
+      const int interval_ms =
+          degrade_reports_state_ == Server::OverloadActionState::Active
+              ? kReportBatchFlushIntervalMs * kOverloadFlushStretch
+              : kReportBatchFlushIntervalMs;
+      report_flush_timer_->enableTimer(
+          std::chrono::milliseconds(interval_ms));
+    }
+  }
+
+  void flushReportBatch() {
+    if (report_batch_->operations_size() == 0) {
+      return;
+    }
+    client_cache_.callReport(*report_batch_);
+    // The client has copied the batch into its aggregation cache by the time
+    // callReport returns; drop the arena storage in one step.
+    report_arena_.Reset();
+    allocateReportBatch();
+  }
 
  private:
-  TokenSharedPtr token_;
-  TokenSharedPtr sc_token_;
-  TokenSharedPtr quota_token_;
+  // One check parked behind the pre-token gate. Owns copies of the
+  // string_view fields of its CheckRequestInfo and rebuilds the view
+  // struct at resume time.
+  struct ParkedCheck {
+    std::string operation_id;
+    std::string operation_name;
+    std::string producer_project_id;
+    std::string api_key;
+    std::string referer;
+    std::string client_ip;
+    std::string client_host;
+    std::string android_package_name;
+    std::string android_cert_fingerprint;
+    std::string ios_bundle_id;
+    std::chrono::system_clock::time_point request_start_time;
+    Envoy::Tracing::Span* parent_span = nullptr;
+    CheckDoneFunc on_done;
+    PreTokenResumeFn resume;
+    // Set by the caller-held cancel function when the stream reset while
+    // parked; the drain then skips the entry.
+    bool cancelled = false;
+
+    ::google::api_proxy::service_control::CheckRequestInfo requestInfo()
+        const {
+      ::google::api_proxy::service_control::CheckRequestInfo info;
+      info.operation_id = operation_id;
+      info.operation_name = operation_name;
+      info.producer_project_id = producer_project_id;
+      info.api_key = api_key;
+      info.referer = referer;
+      info.client_ip = client_ip;
+      info.client_host = client_host;
+      info.android_package_name = android_package_name;
+      info.android_cert_fingerprint = android_cert_fingerprint;
+      info.ios_bundle_id = ios_bundle_id;
+      info.request_start_time = request_start_time;
+      return info;
+    }
+  };
+
+  // Resumes every parked check in arrival order; runs once, either when
+  // the first token lands or when the deadline fires.
+  void drainPreTokenChecks() {
+    pre_token_deadline_timer_->disableTimer();
+    if (pre_token_checks_.empty()) {
+      return;
+    }
+    // Swapped out first: a resumed check runs the full call path, which
+    // must not observe the queue mid-drain.
+    std::vector<std::shared_ptr<ParkedCheck>> parked;
+    parked.swap(pre_token_checks_);
+    for (const auto& check : parked) {
+      if (check->cancelled) {
+        continue;
+      }
+      const auto info = check->requestInfo();
+      check->resume(info, *check->parent_span, check->on_done);
+    }
+  }
+
+  // One cached check decision key; the operation name is kept alongside so
+  // an api key used with several operations stores one entry per pair.
+  struct CheckSignature {
+    std::string operation_name;
+    std::string decision_key;
+  };
+
+  // Bound on distinct api keys in check_signatures_. Sized like the
+  // last-known-good check cache: enough for every consumer a worker
+  // realistically sees inside one aggregation window.
+  static constexpr size_t kCheckSignatureCacheMaxKeys = 2048;
+
+  void allocateReportBatch() {
+    report_batch_ =
+        ::google::protobuf::Arena::CreateMessage<
+            ::google::api::servicecontrol::v1::ReportRequest>(&report_arena_);
+    report_batch_->mutable_operations()->Reserve(kReportBatchMaxOperations);
+  }
+
+  ServiceControlFilterStats& stats_;
+  // Per-worker views of the two report overload actions; the overload
+  // manager updates them on this worker's dispatcher, reports read them
+  // without synchronization.
+  const Server::OverloadActionState& degrade_reports_state_;
+  const Server::OverloadActionState& shed_reports_state_;
+  // Keep 1 of N report operations under the degrade action; 0 and 1
+  // disable sampling.
+  uint32_t overload_sample_every_n_{};
+  uint64_t report_sample_counter_{};
+  std::string sc_token_;
+  std::string quota_token_;
+  // Preformatted "Bearer <token>" values; empty until a token is available.
+  std::string sc_auth_value_;
+  std::string quota_auth_value_;
   ClientCache client_cache_;
+  // Created only when the config opts into heavy-hitter tracking.
+  std::unique_ptr<HeavyHitterTracker> heavy_hitter_tracker_;
+  // Check decision keys by api key; per-worker, dispatcher-thread only.
+  // The cache lives exactly as long as this config's ClientCache, so the
+  // operation names it stores can never go stale across a config update.
+  absl::flat_hash_map<std::string, std::vector<CheckSignature>>
+      check_signatures_;
+  // Arena for per-request Check/AllocateQuota protos; reset per request.
+  ::google::protobuf::Arena request_arena_;
+  // Arena owning report_batch_; reset per batch flush.
+  ::google::protobuf::Arena report_arena_;
+  ::google::api::servicecontrol::v1::ReportRequest* report_batch_;
+  Event::TimerPtr report_flush_timer_;
+  // Checks parked while this worker waits for its first access token;
+  // worker-confined. The gate flag starts true and clears on the first
+  // token or the deadline, whichever comes first.
+  std::vector<std::shared_ptr<ParkedCheck>> pre_token_checks_;
+  Event::TimerPtr pre_token_deadline_timer_;
+  bool pre_token_gate_active_{true};
+};
+
+// Per-worker holder that defers ThreadLocalCache construction until the
+// first request for its service actually lands on this worker. Multi-tenant
+// configs carry dozens of services of which one pod serves a handful; the
+// holder keeps untouched services down to a few stored references per
+// worker instead of a full ClientCache, report batch arena and prewarmed
+// connection each. Worker-confined, so no locking is involved.
+class LazyThreadLocalCache : public ThreadLocal::ThreadLocalObject {
+ public:
+  LazyThreadLocalCache(
+      const ::google::api::envoy::http::service_control::Service& config,
+      const ::google::api::envoy::http::service_control::FilterConfig&
+          filter_config,
+      Upstream::ClusterManager& cm, Envoy::TimeSource& time_source,
+      Event::Dispatcher& dispatcher, Stats::Scope& scope,
+      ServiceControlFilterStats& stats,
+      Server::OverloadManager& overload_manager)
+      : config_(config),
+        filter_config_(filter_config),
+        cm_(cm),
+        time_source_(time_source),
+        dispatcher_(dispatcher),
+        scope_(scope),
+        stats_(stats),
+        overload_manager_(overload_manager) {}
+
+  // Returns the real cache, materializing it on first use.
+  ThreadLocalCache& cache() {
+    if (cache_ == nullptr) {
+      cache_ = std::make_unique<ThreadLocalCache>(
+          config_, filter_config_, cm_, time_source_, dispatcher_, scope_,
+          stats_, overload_manager_);
+      // Replay the latest tokens delivered while the cache did not exist.
+      cache_->set_sc_token(sc_token_);
+      cache_->set_quota_token(quota_token_);
+    }
+    return *cache_;
+  }
+
+  // Token updates are buffered here while the cache is not built, so a
+  // token refresh never forces an idle service to materialize.
+  void set_sc_token(const std::string& sc_token) {
+    sc_token_ = sc_token;
+    if (cache_ != nullptr) {
+      cache_->set_sc_token(sc_token);
+    }
+  }
+  void set_quota_token(const std::string& quota_token) {
+    quota_token_ = quota_token;
+    if (cache_ != nullptr) {
+      cache_->set_quota_token(quota_token);
+    }
+  }
+
+ private:
+  const ::google::api::envoy::http::service_control::Service& config_;
+  const ::google::api::envoy::http::service_control::FilterConfig&
+      filter_config_;
+  Upstream::ClusterManager& cm_;
+  Envoy::TimeSource& time_source_;
+  Event::Dispatcher& dispatcher_;
+  Stats::Scope& scope_;
+  ServiceControlFilterStats& stats_;
+  Server::OverloadManager& overload_manager_;
+  // The latest tokens seen; replayed into the cache when it materializes.
+  std::string sc_token_;
+  std::string quota_token_;
+  std::unique_ptr<ThreadLocalCache> cache_;
 };
 
 class ServiceControlCallImpl : public ServiceControlCall,
@@ -80,7 +531,10 @@ class ServiceControlCallImpl : public ServiceControlCall,
       const ::google::api::envoy::http::service_control::Service& config,
       const ::google::api::envoy::http::service_control::FilterConfig&
           filter_config,
-      Server::Configuration::FactoryContext& context);
+      Server::Configuration::FactoryContext& context,
+      ServiceControlFilterStats& stats);
+
+  ~ServiceControlCallImpl() override;
 
   CancelFunc callCheck(
       const ::google::api_proxy::service_control::CheckRequestInfo&
@@ -95,16 +549,28 @@ class ServiceControlCallImpl : public ServiceControlCall,
                       request_info) override;
 
  private:
-  // Get thread local cache object.
+  // Get thread local cache object, materializing this worker's cache on
+  // its first request for this service.
   ThreadLocalCache& getTLCache() const {
-    return tls_->getTyped<ThreadLocalCache>();
+    return tls_->getTyped<LazyThreadLocalCache>().cache();
   }
 
+  // Materializes request_builder_ on first use. The expensive derivations
+  // (service config Any unpack, LogsMetricsLoader over the full service,
+  // report operation templates) run on the first worker that needs them
+  // instead of on the main thread during the config push, and identical
+  // service configs across config updates share one immutable snapshot.
+  void ensureRequestBuilder();
+
   const ::google::api::envoy::http::service_control::Service& config_;
   const ::google::api::envoy::http::service_control::FilterConfig&
       filter_config_;
-  std::unique_ptr<::google::api_proxy::service_control::RequestBuilder>
+  std::once_flag request_builder_once_;
+  std::shared_ptr<const ::google::api_proxy::service_control::RequestBuilder>
       request_builder_;
+  // Ready once the config-build executor warmed request_builder_; joined in
+  // the destructor so an early teardown never races the warm task.
+  std::shared_future<void> request_builder_warm_;
   Utils::TokenSubscriberPtr token_sub_ptr_;
   Utils::ServiceAccountTokenPtr sc_token_gen_ptr_;
   Utils::ServiceAccountTokenPtr quota_token_gen_ptr_;
@@ -113,20 +579,22 @@ class ServiceControlCallImpl : public ServiceControlCall,
 
 class ServiceControlCallFactoryImpl : public ServiceControlCallFactory {
  public:
-  explicit ServiceControlCallFactoryImpl(
-      Server::Configuration::FactoryContext& context)
-      : context_(context) {}
+  ServiceControlCallFactoryImpl(Server::Configuration::FactoryContext& context,
+                                ServiceControlFilterStats& stats)
+      : context_(context), stats_(stats) {}
 
   ServiceControlCallPtr create(
       const ::google::api::envoy::http::service_control::Service& config,
       const ::google::api::envoy::http::service_control::FilterConfig&
           filter_config) override {
     return std::make_unique<ServiceControlCallImpl>(config, filter_config,
-                                                    context_);
+                                                    context_, stats_);
   }
 
  private:
   Server::Configuration::FactoryContext& context_;
+  // The filter stats, shared by all services of this filter config.
+  ServiceControlFilterStats& stats_;
 };
 
 }  // namespace ServiceControl
@@ -0,0 +1,142 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/http/service_control/shared_check_cache.h"
+
+#include <algorithm>
+
+#include "absl/hash/hash.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+namespace {
+
+// Two refreshes count as stable only when the whole verdict matches.
+// The denial field points into a process-lifetime table, so pointer
+// equality is the intended comparison.
+bool sameVerdict(
+    const SharedCheckCache::CheckResult& cached,
+    const ::google::protobuf::util::Status& status,
+    const ::google::api_proxy::service_control::CheckResponseInfo&
+        response_info) {
+  return cached.status == status &&
+         cached.response_info.is_api_key_valid ==
+             response_info.is_api_key_valid &&
+         cached.response_info.service_is_activated ==
+             response_info.service_is_activated &&
+         cached.response_info.consumer_project_id ==
+             response_info.consumer_project_id &&
+         cached.response_info.denial == response_info.denial;
+}
+
+}  // namespace
+
+std::shared_ptr<SharedCheckCache> SharedCheckCache::GetOrCreate(
+    const std::string& service_key) {
+  // The registry outlives config updates; expired services are purged when
+  // a new cache is created.
+  static std::mutex* registry_mutex = new std::mutex;
+  static absl::flat_hash_map<std::string, std::weak_ptr<SharedCheckCache>>*
+      registry =
+          new absl::flat_hash_map<std::string, std::weak_ptr<SharedCheckCache>>;
+
+  std::lock_guard<std::mutex> lock(*registry_mutex);
+  auto& weak_entry = (*registry)[service_key];
+  std::shared_ptr<SharedCheckCache> cache = weak_entry.lock();
+  if (cache == nullptr) {
+    cache.reset(new SharedCheckCache);
+    weak_entry = cache;
+    for (auto it = registry->begin(); it != registry->end();) {
+      if (it->second.expired()) {
+        registry->erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  return cache;
+}
+
+SharedCheckCache::Shard& SharedCheckCache::shardFor(
+    absl::string_view key) const {
+  return shards_[absl::Hash<absl::string_view>()(key) % kShardCount];
+}
+
+bool SharedCheckCache::Lookup(absl::string_view key,
+                              CheckResult* result) const {
+  const Shard& shard = shardFor(key);
+  const Snapshot snapshot = std::atomic_load(&shard.snapshot);
+  if (snapshot == nullptr) {
+    return false;
+  }
+  const auto it = snapshot->find(key);
+  if (it == snapshot->end() ||
+      it->second.expires_at <= std::chrono::steady_clock::now()) {
+    return false;
+  }
+  *result = it->second;
+  return true;
+}
+
+void SharedCheckCache::Insert(
+    absl::string_view key, const ::google::protobuf::util::Status& status,
+    const ::google::api_proxy::service_control::CheckResponseInfo&
+        response_info,
+    std::chrono::steady_clock::time_point now) {
+  Shard& shard = shardFor(key);
+  std::lock_guard<std::mutex> lock(shard.write_mutex);
+  const Snapshot current = std::atomic_load(&shard.snapshot);
+  // Stability is read from the prior entry before the expired-entry sweep
+  // below: a refresh lands right after its entry expired, so the prior
+  // verdict is still in the snapshot at this point.
+  uint32_t stable_refreshes = 0;
+  const uint32_t ttl_max_ms =
+      adaptive_ttl_max_ms_.load(std::memory_order_relaxed);
+  if (ttl_max_ms > kEntryTtlMs && current != nullptr) {
+    const auto prior = current->find(key);
+    if (prior != current->end() &&
+        sameVerdict(prior->second, status, response_info)) {
+      stable_refreshes =
+          std::min(prior->second.stable_refreshes + 1, kMaxTtlDoublings);
+    }
+  }
+  const uint64_t ttl_ms =
+      std::min<uint64_t>(static_cast<uint64_t>(kEntryTtlMs)
+                             << stable_refreshes,
+                         std::max<uint32_t>(ttl_max_ms, kEntryTtlMs));
+  auto updated =
+      std::make_shared<absl::flat_hash_map<std::string, CheckResult>>();
+  if (current != nullptr && current->size() < kMaxEntriesPerShard) {
+    *updated = *current;
+  }
+  // Drop entries that already expired while copying forward.
+  for (auto it = updated->begin(); it != updated->end();) {
+    if (it->second.expires_at <= now) {
+      updated->erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  (*updated)[std::string(key)] =
+      CheckResult{status, response_info,
+                  now + std::chrono::milliseconds(ttl_ms), stable_refreshes};
+  std::atomic_store(&shard.snapshot, Snapshot(std::move(updated)));
+}
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,119 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "google/protobuf/stubs/status.h"
+#include "src/api_proxy/service_control/request_info.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace ServiceControl {
+
+// A process-wide cache of converted Check results shared by the per-worker
+// ClientCache instances of one service. The per-worker check aggregation
+// cache stays in place as the first level; this second level makes a cold
+// api_key+operation pair pay one Check RPC per process instead of one per
+// worker.
+//
+// Reads are lock-free: each shard publishes an immutable snapshot map
+// through an atomically loaded shared_ptr. Writers copy the shard map and
+// swap in the new snapshot under a per-shard mutex; writes only happen on
+// cold misses, which are rare by construction.
+//
+// Entry TTLs are adaptive when a cap is configured: every re-verification
+// that returns the same verdict as the cached one doubles the entry's TTL
+// up to the cap, and any change in the verdict drops it back to the base.
+// A consumer that has checked the same for days then costs one Check per
+// cap interval instead of one per minute, while a revoked key is honored
+// within at most the cap.
+class SharedCheckCache {
+ public:
+  struct CheckResult {
+    ::google::protobuf::util::Status status;
+    ::google::api_proxy::service_control::CheckResponseInfo response_info;
+    // Entries are not served past this point.
+    std::chrono::steady_clock::time_point expires_at;
+    // Consecutive refreshes that returned the same verdict; drives the
+    // TTL doubling above.
+    uint32_t stable_refreshes = 0;
+  };
+
+  // Returns the cache shared by all workers for |service_key| (service name
+  // plus config id), creating it on first use.
+  static std::shared_ptr<SharedCheckCache> GetOrCreate(
+      const std::string& service_key);
+
+  // Returns true and fills |result| if an unexpired entry exists for |key|.
+  bool Lookup(absl::string_view key, CheckResult* result) const;
+
+  // Publishes the result of a remote Check call. |now| is taken explicitly
+  // so callers use their dispatcher's time source in tests.
+  void Insert(absl::string_view key,
+              const ::google::protobuf::util::Status& status,
+              const ::google::api_proxy::service_control::CheckResponseInfo&
+                  response_info,
+              std::chrono::steady_clock::time_point now);
+
+  // Caps the adaptive TTL in milliseconds; values at or below the base
+  // TTL (including 0, the default) keep every entry at the fixed base.
+  // Set once per config by each worker's ClientCache, with the same value.
+  void set_adaptive_ttl_max_ms(uint32_t max_ms) {
+    adaptive_ttl_max_ms_.store(max_ms, std::memory_order_relaxed);
+  }
+
+ private:
+  // Base TTL: entries are served for this long after the remote call (and
+  // after any refresh that changed the verdict); matches the flush
+  // interval of the per-worker check aggregation cache so results are
+  // refreshed at the same cadence.
+  static constexpr int kEntryTtlMs = 60000;
+  // Doubling stops here; with the 60s base that is already past any sane
+  // cap, and it keeps the shift below well-defined.
+  static constexpr uint32_t kMaxTtlDoublings = 16;
+  // Per-shard bound; a full shard is dropped wholesale rather than evicted
+  // entry by entry, since refilling costs one RPC per key.
+  static constexpr size_t kMaxEntriesPerShard = 4096;
+  static constexpr size_t kShardCount = 16;
+
+  using Snapshot =
+      std::shared_ptr<const absl::flat_hash_map<std::string, CheckResult>>;
+
+  struct Shard {
+    // Loaded with std::atomic_load on the read path.
+    Snapshot snapshot;
+    // Serializes writers only.
+    std::mutex write_mutex;
+  };
+
+  Shard& shardFor(absl::string_view key) const;
+
+  mutable Shard shards_[kShardCount];
+  // 0 disables adaptive TTLs.
+  std::atomic<uint32_t> adaptive_ttl_max_ms_{0};
+};
+
+}  // namespace ServiceControl
+}  // namespace HttpFilters
+}  // namespace Extensions
+}  // namespace Envoy
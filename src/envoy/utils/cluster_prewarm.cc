@@ -0,0 +1,62 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/utils/cluster_prewarm.h"
+
+#include "common/http/headers.h"
+#include "common/http/message_impl.h"
+#include "common/http/utility.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+namespace {
+
+// Generous; the request only exists to drive the handshakes, and the
+// connection is warm as soon as they complete regardless of the response.
+constexpr uint32_t kPrewarmTimeoutMs = 5000;
+
+// Owns nothing and reports to nobody: the priming request's outcome is
+// irrelevant, so the callbacks object just deletes itself either way.
+class PrewarmCallbacks : public Http::AsyncClient::Callbacks {
+ public:
+  void onSuccess(Http::MessagePtr&&) override { delete this; }
+  void onFailure(Http::AsyncClient::FailureReason) override { delete this; }
+};
+
+}  // namespace
+
+void prewarmCluster(Upstream::ClusterManager& cm, const std::string& cluster,
+                    const std::string& uri) {
+  absl::string_view host, path;
+  Http::Utility::extractHostPathFromUri(uri, host, path);
+
+  auto message = std::make_unique<Http::RequestMessageImpl>();
+  message->headers().insertMethod().value().setReference(
+      Http::Headers::get().MethodValues.Get);
+  message->headers().insertHost().value(host.data(), host.size());
+  message->headers().insertPath().value("/", 1);
+
+  // The callbacks may fire inline (e.g. no healthy host) and delete
+  // themselves before send() returns; the returned request handle is not
+  // needed since the call is never cancelled.
+  cm.httpAsyncClientForCluster(cluster).send(
+      std::move(message), *new PrewarmCallbacks(),
+      Http::AsyncClient::RequestOptions().setTimeout(
+          std::chrono::milliseconds(kPrewarmTimeoutMs)));
+}
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,35 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+
+#include "envoy/upstream/cluster_manager.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+// Issues one lightweight "GET /" to |cluster| on the calling thread's async
+// HTTP client, so the TCP and TLS handshakes complete before real traffic
+// needs the connection. The response status does not matter and is
+// discarded; the point is the warm pooled connection left behind. Best
+// effort: failures are ignored. |uri| supplies the Host header.
+void prewarmCluster(Upstream::ClusterManager& cm, const std::string& cluster,
+                    const std::string& uri);
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,73 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/utils/config_build_executor.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+namespace {
+
+// Enough to overlap the filters' derivations of one config push; small
+// machines are capped at their core count below.
+constexpr uint32_t kMaxThreads = 4;
+
+}  // namespace
+
+ConfigBuildExecutor& ConfigBuildExecutor::instance() {
+  // Leaked so the worker threads never outlive their queue at process exit.
+  static ConfigBuildExecutor* executor = new ConfigBuildExecutor;
+  return *executor;
+}
+
+std::shared_future<void> ConfigBuildExecutor::Submit(
+    std::function<void()> task) {
+  std::packaged_task<void()> job(std::move(task));
+  std::shared_future<void> done = job.get_future().share();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(job));
+    // hardware_concurrency may report 0; always keep at least one worker.
+    const uint32_t thread_cap = std::max<uint32_t>(
+        1, std::min(kMaxThreads, std::thread::hardware_concurrency()));
+    if (idle_threads_ == 0 && started_threads_ < thread_cap) {
+      ++started_threads_;
+      std::thread([this]() { run(); }).detach();
+    }
+  }
+  wakeup_.notify_one();
+  return done;
+}
+
+void ConfigBuildExecutor::run() {
+  while (true) {
+    std::packaged_task<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ++idle_threads_;
+      wakeup_.wait(lock, [this]() { return !queue_.empty(); });
+      --idle_threads_;
+      job = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    job();
+  }
+}
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,62 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+// Process-wide executor the filter configs hand their expensive derivations
+// to during a config push. The listener configures the ESPv2 filters one
+// after another on the main thread; each filter submits its heavy build
+// (trie compile, program compile, service config derivation) here and
+// returns immediately, so the builds of one push overlap instead of forming
+// a serial chain. The owner joins the returned future before the derived
+// state is first used, and in its destructor so a config torn down early
+// never leaves a task writing into freed memory.
+class ConfigBuildExecutor {
+ public:
+  static ConfigBuildExecutor& instance();
+
+  // Queues |task| and returns a future that becomes ready when it finished.
+  // An exception thrown by the task is rethrown from the future's get().
+  std::shared_future<void> Submit(std::function<void()> task);
+
+ private:
+  ConfigBuildExecutor() = default;
+
+  // A worker thread's loop; never returns.
+  void run();
+
+  // Guards the queue and the thread counts; only contended during config
+  // pushes.
+  std::mutex mutex_;
+  std::condition_variable wakeup_;
+  std::deque<std::packaged_task<void()>> queue_;
+  // Threads are started on demand when a task arrives and no worker is
+  // idle, up to the cap; they then live for the process lifetime.
+  uint32_t started_threads_{0};
+  uint32_t idle_threads_{0};
+};
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -26,6 +26,60 @@ using ::Envoy::StreamInfo::FilterState;
 
 namespace {
 constexpr char kEmpty[] = "";
+
+// A StringAccessor whose value is produced by a callback on the first read
+// and cached afterwards.
+class LazyStringAccessor : public StringAccessor {
+ public:
+  explicit LazyStringAccessor(std::function<std::string()> compute)
+      : compute_(std::move(compute)) {}
+
+  absl::string_view asString() const override {
+    if (compute_ != nullptr) {
+      value_ = compute_();
+      compute_ = nullptr;
+    }
+    return value_;
+  }
+
+ private:
+  mutable std::function<std::string()> compute_;
+  mutable std::string value_;
+};
+
+// Filter state object holding the request's query parameters, parsed by a
+// callback on the first read and cached afterwards.
+class LazyParsedQueryParamsObject : public FilterState::Object {
+ public:
+  explicit LazyParsedQueryParamsObject(
+      std::function<Http::Utility::QueryParams()> compute)
+      : compute_(std::move(compute)) {}
+
+  const Http::Utility::QueryParams& params() const {
+    if (compute_ != nullptr) {
+      params_ = compute_();
+      compute_ = nullptr;
+    }
+    return params_;
+  }
+
+ private:
+  mutable std::function<Http::Utility::QueryParams()> compute_;
+  mutable Http::Utility::QueryParams params_;
+};
+
+// POD filter state object carrying the dense operation id.
+class OperationIdObject : public FilterState::Object {
+ public:
+  explicit OperationIdObject(uint32_t operation_id)
+      : operation_id_(operation_id) {}
+
+  uint32_t operation_id() const { return operation_id_; }
+
+ private:
+  const uint32_t operation_id_;
+};
+
 }  // namespace
 
 void setStringFilterState(FilterState& filter_state,
@@ -37,6 +91,14 @@ void setStringFilterState(FilterState& filter_state,
       Envoy::StreamInfo::FilterState::StateType::ReadOnly);
 }
 
+void setLazyStringFilterState(FilterState& filter_state,
+                              absl::string_view data_name,
+                              std::function<std::string()> compute) {
+  filter_state.setData(
+      data_name, std::make_unique<LazyStringAccessor>(std::move(compute)),
+      Envoy::StreamInfo::FilterState::StateType::ReadOnly);
+}
+
 absl::string_view getStringFilterState(
     const Envoy::StreamInfo::FilterState& filter_state,
     absl::string_view data_name) {
@@ -47,6 +109,40 @@ absl::string_view getStringFilterState(
   return filter_state.getDataReadOnly<StringAccessor>(data_name).asString();
 }
 
+void setLazyParsedQueryParamsFilterState(
+    FilterState& filter_state,
+    std::function<Http::Utility::QueryParams()> compute) {
+  filter_state.setData(
+      kParsedQueryParams,
+      std::make_unique<LazyParsedQueryParamsObject>(std::move(compute)),
+      Envoy::StreamInfo::FilterState::StateType::ReadOnly);
+}
+
+const Http::Utility::QueryParams* getParsedQueryParamsFilterState(
+    const FilterState& filter_state) {
+  if (!filter_state.hasData<LazyParsedQueryParamsObject>(kParsedQueryParams)) {
+    return nullptr;
+  }
+  return &filter_state
+              .getDataReadOnly<LazyParsedQueryParamsObject>(kParsedQueryParams)
+              .params();
+}
+
+void setOperationIdFilterState(FilterState& filter_state,
+                               uint32_t operation_id) {
+  filter_state.setData(kOperationId,
+                       std::make_unique<OperationIdObject>(operation_id),
+                       Envoy::StreamInfo::FilterState::StateType::ReadOnly);
+}
+
+uint32_t getOperationIdFilterState(const FilterState& filter_state) {
+  if (!filter_state.hasData<OperationIdObject>(kOperationId)) {
+    return kInvalidOperationId;
+  }
+  return filter_state.getDataReadOnly<OperationIdObject>(kOperationId)
+      .operation_id();
+}
+
 }  // namespace Utils
 }  // namespace Extensions
 }  // namespace Envoy
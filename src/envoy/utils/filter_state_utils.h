@@ -13,8 +13,10 @@
 // limitations under the License.
 
 #pragma once
+#include <functional>
 #include <string>
 
+#include "common/http/utility.h"
 #include "envoy/stream_info/filter_state.h"
 
 namespace Envoy {
@@ -23,18 +25,58 @@ namespace Utils {
 
 // Data names in `FilterState` set by Path Matcher filter:
 constexpr char kOperation[] = "envoy.filters.http.path_matcher.operation";
+constexpr char kOperationId[] =
+    "envoy.filters.http.path_matcher.operation_id";
 constexpr char kQueryParams[] = "envoy.filters.http.path_matcher.query_params";
+constexpr char kParsedQueryParams[] =
+    "envoy.filters.http.path_matcher.parsed_query_params";
+
+// Returned by getOperationIdFilterState when no operation id was stored;
+// callers fall back to the name-keyed lookups.
+constexpr uint32_t kInvalidOperationId = 0xffffffff;
 
 // Sets a read only string value in the filter state.
 void setStringFilterState(Envoy::StreamInfo::FilterState& filter_state,
                           absl::string_view data_name, absl::string_view value);
 
+// Sets a read only string value that is computed on first access. |compute|
+// runs at most once, when the value is first read through
+// getStringFilterState; streams where no downstream filter reads the value
+// never pay for computing it.
+void setLazyStringFilterState(Envoy::StreamInfo::FilterState& filter_state,
+                              absl::string_view data_name,
+                              std::function<std::string()> compute);
+
 // Returns a string_view from filter state.
 // Returns an empty string_view if the value is not found.
 absl::string_view getStringFilterState(
     const Envoy::StreamInfo::FilterState& filter_state,
     absl::string_view data_name);
 
+// Stores the request's query parameters under kParsedQueryParams, parsed
+// on first access. |compute| runs at most once, when the map is first read
+// through getParsedQueryParamsFilterState, so every downstream consumer
+// shares one parse and streams where nothing reads it never pay for it.
+void setLazyParsedQueryParamsFilterState(
+    Envoy::StreamInfo::FilterState& filter_state,
+    std::function<Http::Utility::QueryParams()> compute);
+
+// Returns the parsed query parameters stored by the path matcher, or
+// nullptr when none were stored; callers then parse locally.
+const Http::Utility::QueryParams* getParsedQueryParamsFilterState(
+    const Envoy::StreamInfo::FilterState& filter_state);
+
+// Stores the dense operation id resolved by the path matcher under
+// kOperationId, so downstream filters index their per-operation tables
+// without re-hashing the operation name.
+void setOperationIdFilterState(Envoy::StreamInfo::FilterState& filter_state,
+                               uint32_t operation_id);
+
+// Returns the stored operation id, or kInvalidOperationId when none was
+// set.
+uint32_t getOperationIdFilterState(
+    const Envoy::StreamInfo::FilterState& filter_state);
+
 }  // namespace Utils
 }  // namespace Extensions
 }  // namespace Envoy
@@ -39,6 +39,34 @@ TEST(FilterStateUtilsTest, ReturnEmptyStringViewForNonExistingDataName) {
   EXPECT_EQ(getStringFilterState(filter_state, "non_existing_data_name"), "");
 }
 
+TEST(FilterStateUtilsTest, ParsedQueryParamsAreComputedOnceOnFirstRead) {
+  Envoy::StreamInfo::FilterStateImpl filter_state;
+
+  int compute_calls = 0;
+  setLazyParsedQueryParamsFilterState(
+      filter_state, [&compute_calls]() -> Http::Utility::QueryParams {
+        ++compute_calls;
+        return Http::Utility::parseQueryString("/echo?key=api-key&foo=bar");
+      });
+  EXPECT_EQ(compute_calls, 0);
+
+  const Http::Utility::QueryParams* params =
+      getParsedQueryParamsFilterState(filter_state);
+  ASSERT_NE(params, nullptr);
+  EXPECT_EQ(compute_calls, 1);
+  EXPECT_EQ(params->at("key"), "api-key");
+  EXPECT_EQ(params->at("foo"), "bar");
+
+  // Re-reading returns the same cached map without recomputing.
+  EXPECT_EQ(getParsedQueryParamsFilterState(filter_state), params);
+  EXPECT_EQ(compute_calls, 1);
+}
+
+TEST(FilterStateUtilsTest, ReturnNullForMissingParsedQueryParams) {
+  Envoy::StreamInfo::FilterStateImpl filter_state;
+  EXPECT_EQ(getParsedQueryParamsFilterState(filter_state), nullptr);
+}
+
 }  // namespace
 }  // namespace Utils
 }  // namespace Extensions
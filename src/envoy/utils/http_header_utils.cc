@@ -21,6 +21,14 @@ namespace Utils {
 namespace {
 // TODO(kyuc): refactor it to be safe, move it to a class or make the type char*
 const Http::LowerCaseString kHttpMethodOverrideHeader{"x-http-method-override"};
+
+// Names matched by extractCheckRequestHeaders; header map keys are already
+// lower case.
+constexpr char kMethodOverride[] = "x-http-method-override";
+constexpr char kIosBundleId[] = "x-ios-bundle-identifier";
+constexpr char kAndroidPackage[] = "x-android-package";
+constexpr char kAndroidCert[] = "x-android-cert";
+constexpr char kReferer[] = "referer";
 }  // namespace
 
 absl::string_view extractHeader(const Envoy::Http::HeaderMap& headers,
@@ -41,6 +49,30 @@ absl::string_view getRequestHTTPMethodWithOverride(
   return originalMethod;
 }
 
+void extractCheckRequestHeaders(const Envoy::Http::HeaderMap& headers,
+                                CheckRequestHeaders* out) {
+  headers.iterate(
+      [](const Http::HeaderEntry& header,
+         void* context) -> Http::HeaderMap::Iterate {
+        auto* out = static_cast<CheckRequestHeaders*>(context);
+        const absl::string_view key = header.key().getStringView();
+        if (key == kReferer) {
+          out->referer = header.value().getStringView();
+        } else if (key == kMethodOverride) {
+          out->has_method_override = true;
+          out->method_override = header.value().getStringView();
+        } else if (key == kIosBundleId) {
+          out->ios_bundle_id = header.value().getStringView();
+        } else if (key == kAndroidPackage) {
+          out->android_package_name = header.value().getStringView();
+        } else if (key == kAndroidCert) {
+          out->android_cert_fingerprint = header.value().getStringView();
+        }
+        return Http::HeaderMap::Iterate::Continue;
+      },
+      out);
+}
+
 }  // namespace Utils
 }  // namespace Extensions
 }  // namespace Envoy
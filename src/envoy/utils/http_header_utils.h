@@ -33,6 +33,25 @@ absl::string_view extractHeader(const Envoy::Http::HeaderMap& headers,
 absl::string_view getRequestHTTPMethodWithOverride(
     absl::string_view originalMethod, const Envoy::Http::HeaderMap& headers);
 
+// The ESPv2-specific request headers consumed on the check path, collected
+// in one pass over the header map instead of one full map lookup per
+// header. The views point into the header map and stay valid only while it
+// is not modified; copy what outlives the current filter callback.
+struct CheckRequestHeaders {
+  // Distinguishes a present-but-empty x-http-method-override header from an
+  // absent one, matching getRequestHTTPMethodWithOverride.
+  bool has_method_override = false;
+  absl::string_view method_override;
+  absl::string_view ios_bundle_id;
+  absl::string_view referer;
+  absl::string_view android_package_name;
+  absl::string_view android_cert_fingerprint;
+};
+
+// Fills |out| from |headers| with a single iteration over the map.
+void extractCheckRequestHeaders(const Envoy::Http::HeaderMap& headers,
+                                CheckRequestHeaders* out);
+
 }  // namespace Utils
 }  // namespace Extensions
 }  // namespace Envoy
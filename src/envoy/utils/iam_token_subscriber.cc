@@ -13,12 +13,18 @@
 // limitations under the License.
 
 #include "src/envoy/utils/iam_token_subscriber.h"
+
+#include <deque>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
 #include "absl/strings/str_cat.h"
 #include "common/common/enum_to_int.h"
 #include "common/http/headers.h"
 #include "common/http/message_impl.h"
 #include "common/http/utility.h"
-#include "src/envoy/utils/json_struct.h"
+#include "src/envoy/utils/token_response_parser.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -56,118 +62,264 @@ Envoy::Http::MessagePtr prepareHeaders(const std::string& token_uri,
 
 }  // namespace
 
-IamTokenSubscriber::IamTokenSubscriber(
-    Envoy::Server::Configuration::FactoryContext& context,
-    TokenGetFunc access_token_fn, const std::string& iam_service_cluster,
-    const std::string& iam_service_uri, TokenUpdateFunc callback)
-    : cm_(context.clusterManager()),
-      access_token_fn_(access_token_fn),
-      iam_service_cluster_(iam_service_cluster),
-      iam_service_uri_(iam_service_uri),
-      callback_(callback),
-      active_request_(nullptr),
-      init_target_("IamTokenSubscriber", [this] { refresh(); }) {
-  refresh_timer_ =
-      context.dispatcher().createTimer([this]() -> void { refresh(); });
-  context.initManager().add(init_target_);
-}
+// The fetch pipeline for one (IAM endpoint, cluster) pair. Every audience of
+// that endpoint registers an entry here; the session fetches their id tokens
+// one request at a time and reschedules all of them on a single refresh
+// timer, so N audiences behind one service account cost one refresh cycle
+// rather than N concurrent ones. The IAM endpoint only mints one audience per
+// call, so a cycle still issues N requests, but they are serialized and
+// driven by one timer and one access-token wait loop.
+//
+// Everything here runs on the main thread; no locking is needed past the
+// registry that hands out sessions.
+class IamTokenSession
+    : public Envoy::Http::AsyncClient::Callbacks,
+      public Envoy::Logger::Loggable<Envoy::Logger::Id::filter> {
+ public:
+  IamTokenSession(Envoy::Server::Configuration::FactoryContext& context,
+                  const std::string& iam_service_cluster)
+      : cm_(context.clusterManager()), iam_service_cluster_(iam_service_cluster) {
+    timer_ = context.dispatcher().createTimer([this]() -> void { pump(); });
+  }
 
-IamTokenSubscriber::~IamTokenSubscriber() {
-  if (active_request_) {
-    active_request_->cancel();
+  ~IamTokenSession() override {
+    if (active_request_) {
+      active_request_->cancel();
+    }
   }
-}
 
-void IamTokenSubscriber::refresh() {
-  std::string access_token = access_token_fn_();
-
-  // Wait the access token to be set.
-  if (access_token.empty()) {
-    // This codes depends on access_token. This periodical pulling is not ideal.
-    // But when both imds_token_subscriber and iam_token_subscriber register to
-    // init_manager,  it will trigger both at the same time. For
-    // easy implementation,  just using periodical pulling for now
-    ENVOY_LOG(debug, "sleep since access token is not ready");
-    resetTimer(kAccessTokenWaitPeriod);
-    return;
+  // Registers an audience. |uri| is the full per-audience request uri,
+  // |fetch_done| is invoked after the first fetch attempt for the entry
+  // completes, successfully or not.
+  uint64_t addEntry(const std::string& uri,
+                    IamTokenSubscriber::TokenGetFunc access_token_fn,
+                    IamTokenSubscriber::TokenUpdateFunc callback,
+                    std::function<void()> fetch_done) {
+    entries_.push_back(Entry{next_entry_id_++, uri, access_token_fn, callback,
+                             fetch_done, false});
+    return entries_.back().id;
   }
 
-  if (active_request_) {
-    active_request_->cancel();
+  void removeEntry(uint64_t id) {
+    for (auto it = pending_.begin(); it != pending_.end();) {
+      it = (*it == id) ? pending_.erase(it) : it + 1;
+    }
+    entries_.remove_if([id](const Entry& entry) { return entry.id == id; });
+    if (active_request_ && active_entry_id_ == id) {
+      // cancel() never invokes the callbacks, so advance the pipeline here.
+      active_request_->cancel();
+      active_request_ = nullptr;
+      startNext();
+    }
   }
 
-  ENVOY_LOG(debug, "Sending getIdentityToken request");
+  // Queues a fetch for one entry; used by the entry's init target so a
+  // listener only warms once its audiences have tokens.
+  void requestFetch(uint64_t id) {
+    pending_.push_back(id);
+    if (!active_request_) {
+      startNext();
+    }
+  }
 
-  Envoy::Http::MessagePtr message =
-      prepareHeaders(iam_service_uri_, access_token);
+ private:
+  struct Entry {
+    uint64_t id;
+    std::string uri;
+    IamTokenSubscriber::TokenGetFunc access_token_fn;
+    IamTokenSubscriber::TokenUpdateFunc callback;
+    std::function<void()> fetch_done;
+    bool fetch_done_called;
+  };
 
-  const struct Envoy::Http::AsyncClient::RequestOptions options =
-      Envoy::Http::AsyncClient::RequestOptions().setTimeout(kRequestTimeoutMs);
+  // Timer callback: retries the queued fetches, or starts a full refresh
+  // cycle when the queue drained since the last expiry.
+  void pump() {
+    if (pending_.empty()) {
+      for (const auto& entry : entries_) {
+        pending_.push_back(entry.id);
+      }
+    }
+    if (!active_request_) {
+      startNext();
+    }
+  }
 
-  active_request_ = cm_.httpAsyncClientForCluster(iam_service_cluster_)
-                        .send(std::move(message), *this, options);
-}
+  Entry* findEntry(uint64_t id) {
+    for (auto& entry : entries_) {
+      if (entry.id == id) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
 
-void IamTokenSubscriber::onSuccess(Envoy::Http::MessagePtr&& response) {
-  ENVOY_LOG(debug, "GetAccessToken got response: {}", response->bodyAsString());
-  active_request_ = nullptr;
+  void startNext() {
+    Entry* entry = nullptr;
+    while (!pending_.empty() &&
+           (entry = findEntry(pending_.front())) == nullptr) {
+      pending_.pop_front();
+    }
+    if (entry == nullptr) {
+      return;
+    }
 
-  processResponse(std::move(response));
-  init_target_.ready();
-}
+    const std::string access_token = entry->access_token_fn();
+    // Wait the access token to be set.
+    if (access_token.empty()) {
+      // This codes depends on access_token. This periodical pulling is not
+      // ideal. But when both imds_token_subscriber and iam_token_subscriber
+      // register to init_manager, it will trigger both at the same time. For
+      // easy implementation, just using periodical pulling for now
+      ENVOY_LOG(debug, "sleep since access token is not ready");
+      timer_->enableTimer(kAccessTokenWaitPeriod);
+      return;
+    }
+
+    ENVOY_LOG(debug, "Sending getIdentityToken request");
+    Envoy::Http::MessagePtr message =
+        prepareHeaders(entry->uri, access_token);
+
+    const struct Envoy::Http::AsyncClient::RequestOptions options =
+        Envoy::Http::AsyncClient::RequestOptions().setTimeout(
+            kRequestTimeoutMs);
+
+    active_entry_id_ = entry->id;
+    active_request_ = cm_.httpAsyncClientForCluster(iam_service_cluster_)
+                          .send(std::move(message), *this, options);
+  }
 
-void IamTokenSubscriber::processResponse(Envoy::Http::MessagePtr&& response) {
-  const uint64_t status_code =
-      Envoy::Http::Utility::getResponseStatus(response->headers());
-  if (status_code != enumToInt(Envoy::Http::Code::OK)) {
-    ENVOY_LOG(error, "getIdentityToken failed: {}", status_code);
-    return;
+  // Pops the finished entry off the queue, unblocks its init target on the
+  // first attempt and moves on to the next audience; once the queue drains,
+  // the next timer run refreshes the whole set.
+  void finishActive(const std::chrono::milliseconds& next_refresh) {
+    Entry* entry = findEntry(active_entry_id_);
+    if (entry != nullptr && !entry->fetch_done_called) {
+      entry->fetch_done_called = true;
+      entry->fetch_done();
+    }
+    if (!pending_.empty() && pending_.front() == active_entry_id_) {
+      pending_.pop_front();
+    }
+    if (pending_.empty()) {
+      timer_->enableTimer(next_refresh);
+      return;
+    }
+    startNext();
   }
-  ENVOY_LOG(debug, "getIdentityToken success");
 
-  // identity token response is a JSON payload
-  /*
-  {
-    "token": "string",
+  // Envoy::Http::AsyncClient::Callbacks
+  void onSuccess(Envoy::Http::MessagePtr&& response) override {
+    ENVOY_LOG(debug, "GetAccessToken got response: {}",
+              response->bodyAsString());
+    active_request_ = nullptr;
+
+    processResponse(std::move(response));
+    // Use the default 1hr token expiry.
+    finishActive(kSubscriberDefaultTokenExpiry - std::chrono::seconds(5));
   }
-  */
-  std::string token;
-  ::google::protobuf::util::JsonParseOptions options;
-  ::google::protobuf::Struct response_pb;
-  const auto parse_status = ::google::protobuf::util::JsonStringToMessage(
-      response->bodyAsString(), &response_pb, options);
-  if (!parse_status.ok()) {
-    ENVOY_LOG(error, "Parsing response failed: {}", parse_status.ToString());
-    return;
+
+  void onFailure(Envoy::Http::AsyncClient::FailureReason reason) override {
+    active_request_ = nullptr;
+    ENVOY_LOG(error, "getIdentityToken failed with code: {}, {}",
+              enumToInt(reason));
+    // The failed audience is retried with everybody else on the next cycle.
+    finishActive(kFailedRequestTimeout);
   }
 
-  JsonStruct json_struct(response_pb);
-  if (!json_struct.getString("token", &token).ok()) {
-    ENVOY_LOG(error, "Parsing response failed. Could not find `token`");
-    return;
+  void processResponse(Envoy::Http::MessagePtr&& response) {
+    const uint64_t status_code =
+        Envoy::Http::Utility::getResponseStatus(response->headers());
+    if (status_code != enumToInt(Envoy::Http::Code::OK)) {
+      ENVOY_LOG(error, "getIdentityToken failed: {}", status_code);
+      return;
+    }
+    ENVOY_LOG(debug, "getIdentityToken success");
+
+    // identity token response is a JSON payload
+    /*
+    {
+      "token": "string",
+    }
+    */
+    std::string token;
+    if (!parseIdentityTokenResponse(response->bodyAsString(), &token)) {
+      ENVOY_LOG(error, "Parsing response failed. Could not find `token`");
+      return;
+    }
+
+    Entry* entry = findEntry(active_entry_id_);
+    if (entry == nullptr) {
+      return;
+    }
+    ENVOY_LOG(debug, "Got identity token: {}", token);
+    entry->callback(token);
   }
 
-  // Use the default 1hr token expiry.
-  resetTimer(kSubscriberDefaultTokenExpiry - std::chrono::seconds(5));
+  Upstream::ClusterManager& cm_;
+  const std::string iam_service_cluster_;
 
-  ENVOY_LOG(debug, "Got identity token: {}", token);
-  callback_(token);
-}
+  // Registered audiences, in subscription order; small, so lookups by id
+  // just scan.
+  std::list<Entry> entries_;
+  // Ids waiting for a fetch in the current cycle.
+  std::deque<uint64_t> pending_;
+  uint64_t next_entry_id_{1};
+  uint64_t active_entry_id_{0};
+  Envoy::Http::AsyncClient::Request* active_request_{};
+  Envoy::Event::TimerPtr timer_;
+};
 
-void IamTokenSubscriber::onFailure(
-    Envoy::Http::AsyncClient::FailureReason reason) {
-  active_request_ = nullptr;
-  ENVOY_LOG(error, "getIdentityToken failed with code: {}, {}",
-            enumToInt(reason));
+namespace {
 
-  resetTimer(kFailedRequestTimeout);
-  init_target_.ready();
+// Hands out the session shared by all subscribers of one (IAM uri, cluster)
+// pair. Sessions die with their last subscriber; the weak entries they leave
+// behind are purged on the next lookup. The config load path is the only
+// caller, so the lock is uncontended.
+std::shared_ptr<IamTokenSession> getOrCreateSession(
+    Envoy::Server::Configuration::FactoryContext& context,
+    const std::string& iam_service_cluster, const std::string& base_uri) {
+  static std::mutex* mutex = new std::mutex;
+  static auto* sessions =
+      new std::unordered_map<std::string, std::weak_ptr<IamTokenSession>>;
+
+  const std::string key = absl::StrCat(iam_service_cluster, "|", base_uri);
+  std::lock_guard<std::mutex> lock(*mutex);
+  for (auto it = sessions->begin(); it != sessions->end();) {
+    it = it->second.expired() ? sessions->erase(it) : std::next(it);
+  }
+  auto it = sessions->find(key);
+  if (it != sessions->end()) {
+    auto existing = it->second.lock();
+    if (existing) {
+      return existing;
+    }
+  }
+  auto session = std::make_shared<IamTokenSession>(context, iam_service_cluster);
+  (*sessions)[key] = session;
+  return session;
 }
 
-void IamTokenSubscriber::resetTimer(const std::chrono::milliseconds& ms) {
-  refresh_timer_->enableTimer(ms);
+}  // namespace
+
+IamTokenSubscriber::IamTokenSubscriber(
+    Envoy::Server::Configuration::FactoryContext& context,
+    TokenGetFunc access_token_fn, const std::string& iam_service_cluster,
+    const std::string& iam_service_uri, TokenUpdateFunc callback)
+    : session_(getOrCreateSession(
+          context, iam_service_cluster,
+          // The audience rides in the query string; the endpoint itself is
+          // the session key.
+          iam_service_uri.substr(0, iam_service_uri.find('?')))),
+      init_target_("IamTokenSubscriber",
+                   [this] { session_->requestFetch(entry_id_); }) {
+  entry_id_ = session_->addEntry(iam_service_uri, access_token_fn, callback,
+                                 [this] { init_target_.ready(); });
+  context.initManager().add(init_target_);
 }
 
+IamTokenSubscriber::~IamTokenSubscriber() { session_->removeEntry(entry_id_); }
+
 }  // namespace Utils
 }  // namespace Extensions
 }  // namespace Envoy
@@ -28,11 +28,17 @@ namespace Envoy {
 namespace Extensions {
 namespace Utils {
 
-// `IamTokenSubscriber` class fetches id token from IAM server, and it depends
-// on access_token_.
+// The fetch pipeline shared by all audiences of one IAM endpoint; defined in
+// the .cc, callers only see IamTokenSubscriber handles.
+class IamTokenSession;
+
+// `IamTokenSubscriber` subscribes one audience to the id token fetched from
+// the IAM server; the fetch itself depends on an access token. Subscribers
+// for the same (IAM uri, cluster) pair share an IamTokenSession, which runs
+// one refresh timer and fetches their audiences one after another instead of
+// each audience keeping its own refresh cycle against the same identity.
 class IamTokenSubscriber
-    : public Envoy::Http::AsyncClient::Callbacks,
-      public Envoy::Logger::Loggable<Envoy::Logger::Id::filter> {
+    : public Envoy::Logger::Loggable<Envoy::Logger::Id::filter> {
  public:
   using TokenUpdateFunc = std::function<void(const std::string& token)>;
   using TokenGetFunc = std::function<std::string()>;
@@ -44,24 +50,11 @@ class IamTokenSubscriber
   virtual ~IamTokenSubscriber();
 
  private:
-  // Envoy::Http::AsyncClient::Callbacks
-  void onSuccess(Envoy::Http::MessagePtr&& response) override;
-  void onFailure(Envoy::Http::AsyncClient::FailureReason reason) override;
-
-  void refresh();
-  void processResponse(Envoy::Http::MessagePtr&& response);
-  void resetTimer(const std::chrono::milliseconds& ms);
-
-  Upstream::ClusterManager& cm_;
-  TokenGetFunc access_token_fn_;
-  const std::string& iam_service_cluster_;
-  const std::string iam_service_uri_;
-
-  TokenUpdateFunc callback_;
-  Envoy::Http::AsyncClient::Request* active_request_{};
-
-  Envoy::Event::TimerPtr refresh_timer_;
-  // init_target_.ready() need be called at the end of request callbacks.
+  std::shared_ptr<IamTokenSession> session_;
+  // This subscriber's audience entry in the session; removed on destruction.
+  uint64_t entry_id_{0};
+  // init_target_.ready() is called when the session completes the first
+  // fetch attempt for this audience.
   Envoy::Init::TargetImpl init_target_;
 };
 typedef std::unique_ptr<IamTokenSubscriber> IamTokenSubscriberPtr;
@@ -18,43 +18,84 @@
 
 #include "src/envoy/utils/message_counter.h"
 
+#include "common/common/stack_array.h"
+
 namespace Envoy {
 namespace Utils {
 
 void IncrementMessageCounter(Buffer::Instance& data,
                              GrpcMessageCounter* counter) {
-  uint64_t pos = 0;
-  uint8_t byte = 0;
-  while (pos < data.length()) {
-    switch (counter->state) {
-      case GrpcMessageCounter::ExpectByte0:
-        // skip compress flag, increment message count
-        counter->count += 1;
-        counter->current_size = 0;
-        pos += 1;
-        counter->state = GrpcMessageCounter::ExpectByte1;
-        break;
-      case GrpcMessageCounter::ExpectByte1:
-      case GrpcMessageCounter::ExpectByte2:
-      case GrpcMessageCounter::ExpectByte3:
-      case GrpcMessageCounter::ExpectByte4:
-        data.copyOut(pos, 1, &byte);
-        counter->current_size = counter->current_size << 8;
-        counter->current_size = counter->current_size | byte;
-        pos += 1;
-        counter->state =
-            static_cast<GrpcMessageCounter::GrpcReadState>(counter->state + 1);
-        break;
-      case GrpcMessageCounter::ExpectMessage:
-        uint64_t available = data.length() - pos;
+  const uint64_t length = data.length();
+  // Empty frames (flow-control wakeups, trailers-only streams whose data
+  // callback still fires) cannot move the state machine; return before the
+  // slice walk.
+  if (length == 0) {
+    return;
+  }
+
+  // A frame that lies entirely inside the current message payload needs no
+  // byte inspection: advance the remaining size by the frame length alone.
+  // Streams whose messages are split across many data frames take this
+  // path for every continuation frame, so within one dispatcher tick the
+  // whole run of them costs one subtraction each instead of a slice walk.
+  if (counter->state == GrpcMessageCounter::ExpectMessage &&
+      counter->current_size >= length) {
+    counter->current_size -= length;
+    if (counter->current_size == 0) {
+      counter->state = GrpcMessageCounter::ExpectByte0;
+    }
+    return;
+  }
+
+  // Walk the raw slices directly instead of issuing a copyOut per byte;
+  // message payloads are skipped with pointer arithmetic, so a data chunk
+  // costs a handful of operations per contained message rather than per
+  // byte.
+  const uint64_t num_slices = data.getRawSlices(nullptr, 0);
+  STACK_ARRAY(slices, Buffer::RawSlice, num_slices);
+  data.getRawSlices(slices.begin(), num_slices);
+
+  for (const Buffer::RawSlice& slice : slices) {
+    const uint8_t* ptr = static_cast<const uint8_t*>(slice.mem_);
+    const uint8_t* end = ptr + slice.len_;
+    while (ptr < end) {
+      if (counter->state == GrpcMessageCounter::ExpectMessage) {
+        const uint64_t available = end - ptr;
         if (counter->current_size <= available) {
-          pos += counter->current_size;
+          ptr += counter->current_size;
           counter->state = GrpcMessageCounter::ExpectByte0;
         } else {
-          pos = data.length();
-          counter->current_size = counter->current_size - available;
+          counter->current_size -= available;
+          ptr = end;
         }
-        break;
+        continue;
+      }
+      if (counter->state == GrpcMessageCounter::ExpectByte0) {
+        // skip compress flag, increment message count
+        counter->count += 1;
+        counter->current_size = 0;
+        ptr += 1;
+        counter->state = GrpcMessageCounter::ExpectByte1;
+        continue;
+      }
+      if (counter->state == GrpcMessageCounter::ExpectByte1 &&
+          end - ptr >= 4) {
+        // The whole big-endian length is in this slice; the compiler turns
+        // this into a single unaligned load plus byte swap.
+        counter->current_size = (static_cast<uint64_t>(ptr[0]) << 24) |
+                                (static_cast<uint64_t>(ptr[1]) << 16) |
+                                (static_cast<uint64_t>(ptr[2]) << 8) |
+                                static_cast<uint64_t>(ptr[3]);
+        ptr += 4;
+        counter->state = GrpcMessageCounter::ExpectMessage;
+        continue;
+      }
+      // The length prefix straddles a slice boundary (or an earlier data
+      // chunk ended inside it); consume it bytewise.
+      counter->current_size = (counter->current_size << 8) | *ptr;
+      ptr += 1;
+      counter->state =
+          static_cast<GrpcMessageCounter::GrpcReadState>(counter->state + 1);
     }
   }
 }
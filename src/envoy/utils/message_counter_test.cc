@@ -99,6 +99,41 @@ TEST(MessageCounterTest, IncrementMessageCounter) {
     IncrementMessageCounter(buffer, &counter);
     EXPECT_EQ(counter.count, 2);
   }
+
+  {
+    // empty frame in the middle of a message leaves the state untouched
+    Buffer::OwnedImpl buffer1;
+    Buffer::OwnedImpl empty;
+    Buffer::OwnedImpl buffer2;
+    GrpcMessageCounter counter;
+    Buffer::addSeq(buffer1, {1, 0, 0, 0, 2, 0xFF});
+    Buffer::addSeq(buffer2, {0xFF});
+    IncrementMessageCounter(buffer1, &counter);
+    IncrementMessageCounter(empty, &counter);
+    EXPECT_EQ(counter.state, GrpcMessageCounter::GrpcReadState::ExpectMessage);
+    EXPECT_EQ(counter.count, 1);
+    IncrementMessageCounter(buffer2, &counter);
+    EXPECT_EQ(counter.state, GrpcMessageCounter::GrpcReadState::ExpectByte0);
+    EXPECT_EQ(counter.count, 1);
+  }
+
+  {
+    // message payload split across several pure-continuation frames; the
+    // length-only fast path must account them and close the message on the
+    // exact boundary
+    Buffer::OwnedImpl header;
+    GrpcMessageCounter counter;
+    Buffer::addSeq(header, {1, 0, 0, 1, 0});
+    IncrementMessageCounter(header, &counter);
+    EXPECT_EQ(counter.state, GrpcMessageCounter::GrpcReadState::ExpectMessage);
+    for (int i = 0; i < 4; ++i) {
+      Buffer::OwnedImpl chunk;
+      Buffer::addRepeated(chunk, 1 << 6, 0xFF);
+      IncrementMessageCounter(chunk, &counter);
+    }
+    EXPECT_EQ(counter.state, GrpcMessageCounter::GrpcReadState::ExpectByte0);
+    EXPECT_EQ(counter.count, 1);
+  }
 }
 
 }  // namespace
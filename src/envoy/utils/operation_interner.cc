@@ -0,0 +1,50 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/utils/operation_interner.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+OperationInterner& OperationInterner::instance() {
+  // Leaked so no destructor runs at process exit.
+  static OperationInterner* interner = new OperationInterner;
+  return *interner;
+}
+
+uint32_t OperationInterner::Intern(absl::string_view operation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return InternLocked(operation);
+}
+
+absl::string_view OperationInterner::InternName(absl::string_view operation) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return names_[InternLocked(operation)];
+}
+
+uint32_t OperationInterner::InternLocked(absl::string_view operation) {
+  const auto it = ids_.find(operation);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  const uint32_t id = static_cast<uint32_t>(names_.size());
+  names_.emplace_back(operation);
+  ids_.emplace(absl::string_view(names_.back()), id);
+  return id;
+}
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,66 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+// Process-wide registry assigning each operation name a dense integer id.
+// The filter configs of path matcher, service control, backend auth and
+// backend routing all intern their operations through this singleton at
+// config load, so an id resolved by one filter indexes the per-operation
+// tables of the others directly. Interning only happens while configs are
+// built; the request path just carries ids around and never touches the
+// registry.
+class OperationInterner {
+ public:
+  static OperationInterner& instance();
+
+  // Returns the id for |operation|, assigning the next dense id on first
+  // use. Ids are stable for the process lifetime; config reloads reuse the
+  // ids of operations they share with earlier configs.
+  uint32_t Intern(absl::string_view operation);
+
+  // Returns the canonical stored copy of |operation|, interning it on first
+  // use. The view points into the registry's own storage, which lives for
+  // the process lifetime, so the filter config parsers key their
+  // per-operation maps by it instead of each owning yet another copy of the
+  // selector string.
+  absl::string_view InternName(absl::string_view operation);
+
+ private:
+  // The body of Intern/InternName; must be called with |mutex_| held.
+  uint32_t InternLocked(absl::string_view operation);
+
+  // Guards the registry; only contended during config load.
+  std::mutex mutex_;
+  // Canonical selector storage, indexed by id. A deque so interning never
+  // moves an already published string.
+  std::deque<std::string> names_;
+  // Keys are views into |names_|.
+  absl::flat_hash_map<absl::string_view, uint32_t> ids_;
+};
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,52 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+// Opt-in per-phase latency instrumentation for the ESPv2 filters.
+//
+// The probes attribute proxy-added latency between the request phases
+// (path match, check preparation, check wait, report build) through
+// nanosecond histograms in the filters' stats. They are off by default;
+// setting ESPV2_PHASE_TIMING=1 in the proxy's environment turns them on
+// for the process. The flag is read once, so a disabled probe costs one
+// predictable branch on a process-wide bool.
+
+inline bool phaseTimingEnabled() {
+  static const bool enabled = []() {
+    const char* value = std::getenv("ESPV2_PHASE_TIMING");
+    return value != nullptr && value[0] == '1';
+  }();
+  return enabled;
+}
+
+// The current steady-clock time in nanoseconds. Only differences between
+// two stamps are meaningful.
+inline int64_t phaseTimingNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -14,6 +14,7 @@
 
 #include "src/envoy/utils/service_account_token.h"
 #include "src/api_proxy/auth/auth_token.h"
+#include "src/envoy/utils/token_acquisition_manager.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -22,28 +23,64 @@ namespace {
 // Token expired in 1 hour, reduce 5 seconds for grace buffer.
 const std::chrono::seconds kRefresherDefaultTokenExpiry(3600 - 5);
 
+// Delay before retrying a failed generation.
+const std::chrono::seconds kFailedRefreshTimeout(60);
+
 }  // namespace
 
 ServiceAccountToken::ServiceAccountToken(
     Envoy::Server::Configuration::FactoryContext& context,
     const std::string& service_account_key, const std::string& audience,
     TokenUpdateFunc callback)
-    : service_account_key_(service_account_key),
+    : dispatcher_(context.dispatcher()),
+      service_account_key_(service_account_key),
       audience_(audience),
-      callback_(callback) {
+      callback_(callback),
+      alive_(std::make_shared<bool>(true)),
+      init_target_("ServiceAccountToken", [this] { refresh(); }) {
   refresh_timer_ =
       context.dispatcher().createTimer([this]() -> void { refresh(); });
-  // call this in a delayed fashion so that the callback is ready to accept new
-  // token.
-  context.dispatcher().post([this]() -> void { refresh(); });
+  // The init manager issues the initial generation concurrently with the
+  // other registered token targets and gates readiness on its completion.
+  context.initManager().add(init_target_);
 }
 
+ServiceAccountToken::~ServiceAccountToken() { *alive_ = false; }
+
 void ServiceAccountToken::refresh() {
-  char* token = ::google::api_proxy::auth::get_auth_token(
-      service_account_key_.c_str(), audience_.c_str());
+  auto alive = alive_;
+  TokenAcquisitionManager::instance().acquireAsync(
+      dispatcher_,
+      [key = std::string(service_account_key_), audience = audience_]() {
+        char* token = ::google::api_proxy::auth::get_auth_token(
+            key.c_str(), audience.c_str());
+        if (token == nullptr) {
+          return std::string();
+        }
+        std::string result = token;
+        ::google::api_proxy::auth::grpc_free(token);
+        return result;
+      },
+      [this, alive](const std::string& token) {
+        if (!*alive) {
+          return;
+        }
+        onTokenReady(token);
+      });
+}
+
+void ServiceAccountToken::onTokenReady(const std::string& token) {
+  if (token.empty()) {
+    ENVOY_LOG(error, "Failed to generate token for audience: {}", audience_);
+    // Unblock readiness; the retry runs on its own timer.
+    init_target_.ready();
+    refresh_timer_->enableTimer(kFailedRefreshTimeout);
+    return;
+  }
+
   callback_(token);
   ENVOY_LOG(debug, "Generated token: {}", token);
-  ::google::api_proxy::auth::grpc_free(token);
+  init_target_.ready();
 
   // Update the token every 1 hour.
   refresh_timer_->enableTimer(kRefresherDefaultTokenExpiry);
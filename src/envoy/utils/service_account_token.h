@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <memory>
+
 #include "common/common/logger.h"
 #include "common/init/target_impl.h"
 #include "envoy/event/dispatcher.h"
@@ -26,6 +28,13 @@ namespace Utils {
 
 // The class generates an access_token with 1 hour expiration from a service
 // account json for an audience and re-generating it before it is expired.
+//
+// The RSA signature behind the token takes milliseconds, so generation runs
+// on a background thread through `TokenAcquisitionManager`; deployments with
+// many audiences acquire their initial tokens concurrently instead of
+// serializing on the main thread. Each instance registers an `Init::Target`,
+// so listener readiness waits for the initial token together with the other
+// token subscribers.
 class ServiceAccountToken
     : public Envoy::Logger::Loggable<Envoy::Logger::Id::filter> {
  public:
@@ -33,15 +42,24 @@ class ServiceAccountToken
   ServiceAccountToken(Envoy::Server::Configuration::FactoryContext& context,
                       const std::string& service_account_key,
                       const std::string& audience, TokenUpdateFunc callback);
+  ~ServiceAccountToken();
 
  private:
   void refresh();
+  // Runs on the dispatcher thread once a background generation finished.
+  void onTokenReady(const std::string& token);
 
+  Envoy::Event::Dispatcher& dispatcher_;
   const std::string& service_account_key_;
   const std::string audience_;
 
   TokenUpdateFunc callback_;
   Envoy::Event::TimerPtr refresh_timer_;
+  // Cleared on destruction so the completion of an in-flight background
+  // generation is dropped.
+  std::shared_ptr<bool> alive_;
+  // init_target_.ready() is called when the initial token arrives.
+  Envoy::Init::TargetImpl init_target_;
 };
 typedef std::unique_ptr<ServiceAccountToken> ServiceAccountTokenPtr;
 
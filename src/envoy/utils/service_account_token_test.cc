@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <future>
 #include <memory>
 
 #include "src/envoy/utils/json_struct.h"
@@ -33,6 +34,7 @@ namespace {
 using ::Envoy::Server::Configuration::MockFactoryContext;
 
 using ::testing::_;
+using ::testing::Invoke;
 using ::testing::MockFunction;
 
 const std::string kTestServiceAccountKey = R"({
@@ -51,16 +53,33 @@ const std::string kTestServiceAccountKey = R"({
 class ServiceAccountTokenTest : public testing::Test {
  protected:
   NiceMock<MockFactoryContext> context_;
+  NiceMock<Init::ExpectableWatcherImpl> init_watcher_;
+  Init::TargetHandlePtr init_target_handle_;
   MockFunction<int(std::string)> token_callback_;
   ServiceAccountTokenPtr sc_token_;
 
 };  // namespace
 
 TEST_F(ServiceAccountTokenTest, MakeCallbackOnRefresh) {
+  EXPECT_CALL(context_.init_manager_, add(_))
+      .WillOnce(Invoke([this](const Init::Target& target) {
+        init_target_handle_ = target.createHandle("test");
+      }));
+
   EXPECT_CALL(token_callback_, Call(_)).Times(1);
   sc_token_ = std::make_unique<ServiceAccountToken>(
       context_, kTestServiceAccountKey, "audience",
       token_callback_.AsStdFunction());
+
+  // The generation runs on a background thread; ready() is signaled on the
+  // dispatcher thread after the token callback fired.
+  std::promise<void> ready_promise;
+  EXPECT_CALL(init_watcher_, ready()).WillOnce(Invoke([&ready_promise]() {
+    ready_promise.set_value();
+  }));
+  init_target_handle_->initialize(init_watcher_);
+  ASSERT_EQ(ready_promise.get_future().wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
 }
 }  // namespace
 }  // namespace Utils
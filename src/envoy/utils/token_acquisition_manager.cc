@@ -0,0 +1,45 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/utils/token_acquisition_manager.h"
+
+#include <thread>
+#include <utility>
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+TokenAcquisitionManager& TokenAcquisitionManager::instance() {
+  // Leaked so no destructor runs at process exit.
+  static TokenAcquisitionManager* manager = new TokenAcquisitionManager;
+  return *manager;
+}
+
+void TokenAcquisitionManager::acquireAsync(Event::Dispatcher& dispatcher,
+                                           AcquireFunc acquire,
+                                           DoneFunc done) {
+  // Acquisitions are rare (startup and roughly hourly refreshes), so a
+  // short-lived thread per acquisition is cheaper than keeping a pool
+  // around, and concurrent acquisitions use separate cores.
+  std::thread([&dispatcher, acquire = std::move(acquire),
+               done = std::move(done)]() mutable {
+    const std::string token = acquire();
+    dispatcher.post([done = std::move(done), token]() { done(token); });
+  }).detach();
+}
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
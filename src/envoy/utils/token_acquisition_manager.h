@@ -0,0 +1,52 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "envoy/event/dispatcher.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+// Runs token acquisitions on background threads, so CPU-bound work such as
+// the RSA signature behind a service account token neither blocks the main
+// thread during config initialization nor runs one-after-another across
+// subscribers. Concurrent acquisitions proceed on separate threads, so the
+// initial token fetches of all subscribers complete in the time of the
+// slowest single one; the init manager the subscribers register their
+// targets with acts as the shared completion barrier.
+class TokenAcquisitionManager {
+ public:
+  // Runs on a background thread; returns the token, or an empty string on
+  // failure.
+  using AcquireFunc = std::function<std::string()>;
+  // Runs on the caller's dispatcher thread with the acquired token.
+  using DoneFunc = std::function<void(const std::string& token)>;
+
+  static TokenAcquisitionManager& instance();
+
+  // Runs |acquire| on a background thread and posts its result to
+  // |dispatcher|, where |done| is invoked. The dispatcher must outlive the
+  // acquisition; callers guard |done| against their own destruction.
+  void acquireAsync(Event::Dispatcher& dispatcher, AcquireFunc acquire,
+                    DoneFunc done);
+};
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -0,0 +1,372 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/utils/token_response_parser.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+namespace {
+
+// A requested top-level field; exactly one of the output pointers is set.
+struct FieldSpec {
+  absl::string_view key;
+  std::string* string_out = nullptr;
+  int* int_out = nullptr;
+  bool found = false;
+};
+
+// Minimal JSON cursor over a flat token response. Only what the two known
+// response shapes require is implemented; anything else fails the parse.
+class Cursor {
+ public:
+  explicit Cursor(absl::string_view json) : json_(json) {}
+
+  void skipWhitespace() {
+    while (pos_ < json_.size()) {
+      const char c = json_[pos_];
+      if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        break;
+      }
+      ++pos_;
+    }
+  }
+
+  bool atEnd() const { return pos_ >= json_.size(); }
+
+  char peek() const { return json_[pos_]; }
+
+  bool consume(char expected) {
+    if (atEnd() || json_[pos_] != expected) {
+      return false;
+    }
+    ++pos_;
+    return true;
+  }
+
+  // Parses a JSON string into `out`, handling the standard escapes. Token
+  // responses are ASCII in practice, but escape handling keeps the parser
+  // honest about arbitrary server output.
+  bool parseString(std::string* out) {
+    if (!consume('"')) {
+      return false;
+    }
+    out->clear();
+    while (!atEnd()) {
+      const char c = json_[pos_++];
+      if (c == '"') {
+        return true;
+      }
+      if (c != '\\') {
+        out->push_back(c);
+        continue;
+      }
+      if (atEnd()) {
+        return false;
+      }
+      const char escaped = json_[pos_++];
+      switch (escaped) {
+        case '"':
+        case '\\':
+        case '/':
+          out->push_back(escaped);
+          break;
+        case 'b':
+          out->push_back('\b');
+          break;
+        case 'f':
+          out->push_back('\f');
+          break;
+        case 'n':
+          out->push_back('\n');
+          break;
+        case 'r':
+          out->push_back('\r');
+          break;
+        case 't':
+          out->push_back('\t');
+          break;
+        case 'u': {
+          if (!parseUnicodeEscape(out)) {
+            return false;
+          }
+          break;
+        }
+        default:
+          return false;
+      }
+    }
+    return false;
+  }
+
+  // Parses a JSON number, truncating toward zero like JsonStruct did when
+  // it cast `number_value()` to an integer.
+  bool parseInteger(int* out) {
+    bool negative = false;
+    if (!atEnd() && peek() == '-') {
+      negative = true;
+      ++pos_;
+    }
+    if (atEnd() || !isDigit(peek())) {
+      return false;
+    }
+    // Saturate instead of failing on overlong values so an oversized
+    // `expires_in` still yields a usable (capped) expiry.
+    int64_t value = 0;
+    while (!atEnd() && isDigit(peek())) {
+      if (value <= INT32_MAX) {
+        value = value * 10 + (json_[pos_] - '0');
+      }
+      ++pos_;
+    }
+    if (value > INT32_MAX) {
+      value = INT32_MAX;
+    }
+    // Discard any fractional or exponent part.
+    if (!atEnd() && peek() == '.') {
+      ++pos_;
+      if (atEnd() || !isDigit(peek())) {
+        return false;
+      }
+      while (!atEnd() && isDigit(peek())) {
+        ++pos_;
+      }
+    }
+    if (!atEnd() && (peek() == 'e' || peek() == 'E')) {
+      // An exponent could scale the value arbitrarily; token servers never
+      // send one, so treat it as malformed rather than evaluate it.
+      return false;
+    }
+    *out = static_cast<int>(negative ? -value : value);
+    return true;
+  }
+
+  // Skips a value of any type, tracking object/array nesting.
+  bool skipValue() {
+    skipWhitespace();
+    if (atEnd()) {
+      return false;
+    }
+    const char c = peek();
+    if (c == '"') {
+      std::string discarded;
+      return parseString(&discarded);
+    }
+    if (c == '{' || c == '[') {
+      return skipContainer();
+    }
+    if (c == 't') {
+      return skipLiteral("true");
+    }
+    if (c == 'f') {
+      return skipLiteral("false");
+    }
+    if (c == 'n') {
+      return skipLiteral("null");
+    }
+    if (c == '-' || isDigit(c)) {
+      ++pos_;
+      while (!atEnd() && (isDigit(peek()) || peek() == '.' || peek() == '+' ||
+                          peek() == '-' || peek() == 'e' || peek() == 'E')) {
+        ++pos_;
+      }
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+  bool skipLiteral(absl::string_view literal) {
+    if (json_.substr(pos_, literal.size()) != literal) {
+      return false;
+    }
+    pos_ += literal.size();
+    return true;
+  }
+
+  bool skipContainer() {
+    int depth = 0;
+    while (!atEnd()) {
+      const char c = json_[pos_];
+      if (c == '"') {
+        std::string discarded;
+        if (!parseString(&discarded)) {
+          return false;
+        }
+        continue;
+      }
+      ++pos_;
+      if (c == '{' || c == '[') {
+        ++depth;
+      } else if (c == '}' || c == ']') {
+        if (--depth == 0) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  bool parseHex4(uint32_t* out) {
+    if (pos_ + 4 > json_.size()) {
+      return false;
+    }
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+      const char c = json_[pos_++];
+      value <<= 4;
+      if (isDigit(c)) {
+        value |= c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        value |= c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        value |= c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    *out = value;
+    return true;
+  }
+
+  bool parseUnicodeEscape(std::string* out) {
+    uint32_t code_point;
+    if (!parseHex4(&code_point)) {
+      return false;
+    }
+    // Combine a surrogate pair when the escape is the leading half.
+    if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+      if (pos_ + 2 > json_.size() || json_[pos_] != '\\' ||
+          json_[pos_ + 1] != 'u') {
+        return false;
+      }
+      pos_ += 2;
+      uint32_t low;
+      if (!parseHex4(&low) || low < 0xDC00 || low > 0xDFFF) {
+        return false;
+      }
+      code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+    } else if (code_point >= 0xDC00 && code_point <= 0xDFFF) {
+      return false;
+    }
+    // UTF-8 encode.
+    if (code_point < 0x80) {
+      out->push_back(static_cast<char>(code_point));
+    } else if (code_point < 0x800) {
+      out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else if (code_point < 0x10000) {
+      out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    } else {
+      out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+      out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    return true;
+  }
+
+  absl::string_view json_;
+  size_t pos_ = 0;
+};
+
+// Scans the top-level object once, filling the requested fields and
+// skipping everything else. Succeeds only when every field was found with
+// the requested type.
+bool parseTopLevelFields(absl::string_view json, FieldSpec* specs,
+                         size_t num_specs) {
+  Cursor cursor(json);
+  cursor.skipWhitespace();
+  if (!cursor.consume('{')) {
+    return false;
+  }
+  cursor.skipWhitespace();
+  if (cursor.consume('}')) {
+    return false;  // Empty object cannot carry the requested fields.
+  }
+  while (true) {
+    cursor.skipWhitespace();
+    std::string key;
+    if (!cursor.parseString(&key)) {
+      return false;
+    }
+    cursor.skipWhitespace();
+    if (!cursor.consume(':')) {
+      return false;
+    }
+    cursor.skipWhitespace();
+    FieldSpec* spec = nullptr;
+    for (size_t i = 0; i < num_specs; ++i) {
+      if (key == specs[i].key) {
+        spec = &specs[i];
+        break;
+      }
+    }
+    if (spec == nullptr) {
+      if (!cursor.skipValue()) {
+        return false;
+      }
+    } else if (spec->string_out != nullptr) {
+      if (!cursor.parseString(spec->string_out)) {
+        return false;
+      }
+      spec->found = true;
+    } else {
+      if (!cursor.parseInteger(spec->int_out)) {
+        return false;
+      }
+      spec->found = true;
+    }
+    cursor.skipWhitespace();
+    if (cursor.consume('}')) {
+      break;
+    }
+    if (!cursor.consume(',')) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < num_specs; ++i) {
+    if (!specs[i].found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool parseAccessTokenResponse(absl::string_view json, std::string* access_token,
+                              int* expires_in) {
+  FieldSpec specs[2];
+  specs[0].key = "access_token";
+  specs[0].string_out = access_token;
+  specs[1].key = "expires_in";
+  specs[1].int_out = expires_in;
+  return parseTopLevelFields(json, specs, 2);
+}
+
+bool parseIdentityTokenResponse(absl::string_view json, std::string* token) {
+  FieldSpec spec;
+  spec.key = "token";
+  spec.string_out = token;
+  return parseTopLevelFields(json, &spec, 1);
+}
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
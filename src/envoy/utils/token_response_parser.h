@@ -0,0 +1,42 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+
+// Single-pass extractors for the two token response shapes ESPv2 fetches.
+// Token refreshes are frequent and the responses are tiny flat objects, so
+// these scan the body once instead of materializing a protobuf Struct via
+// JsonStringToMessage. Unknown top-level fields are skipped; a missing or
+// wrong-typed requested field fails the parse.
+
+// Parses a metadata-server access token response:
+//   {"access_token": "<string>", "expires_in": <number>}
+bool parseAccessTokenResponse(absl::string_view json, std::string* access_token,
+                              int* expires_in);
+
+// Parses an IAM identity token response:
+//   {"token": "<string>"}
+bool parseIdentityTokenResponse(absl::string_view json, std::string* token);
+
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
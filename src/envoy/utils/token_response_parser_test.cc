@@ -0,0 +1,117 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "src/envoy/utils/token_response_parser.h"
+
+#include <limits>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace Utils {
+namespace {
+
+TEST(TokenResponseParserTest, AccessTokenResponse) {
+  std::string token;
+  int expires_in = 0;
+
+  EXPECT_TRUE(parseAccessTokenResponse(
+      R"({"access_token":"TOKEN","expires_in":3599})", &token, &expires_in));
+  EXPECT_EQ(token, "TOKEN");
+  EXPECT_EQ(expires_in, 3599);
+
+  // Field order and unknown fields do not matter.
+  EXPECT_TRUE(parseAccessTokenResponse(
+      R"({
+        "token_type": "Bearer",
+        "expires_in": 100,
+        "scopes": ["a", "b"],
+        "extra": {"nested": {"deep": true}},
+        "access_token": "TOKEN2"
+      })",
+      &token, &expires_in));
+  EXPECT_EQ(token, "TOKEN2");
+  EXPECT_EQ(expires_in, 100);
+}
+
+TEST(TokenResponseParserTest, AccessTokenResponseMissingOrWrongType) {
+  std::string token;
+  int expires_in = 0;
+
+  // Missing fields.
+  EXPECT_FALSE(parseAccessTokenResponse(R"({"access_token":"TOKEN"})", &token,
+                                        &expires_in));
+  EXPECT_FALSE(
+      parseAccessTokenResponse(R"({"expires_in":100})", &token, &expires_in));
+  EXPECT_FALSE(parseAccessTokenResponse(R"({})", &token, &expires_in));
+
+  // Wrong types.
+  EXPECT_FALSE(parseAccessTokenResponse(
+      R"({"access_token":100,"expires_in":100})", &token, &expires_in));
+  EXPECT_FALSE(parseAccessTokenResponse(
+      R"({"access_token":"TOKEN","expires_in":"100"})", &token, &expires_in));
+
+  // Not JSON at all.
+  EXPECT_FALSE(parseAccessTokenResponse("not json", &token, &expires_in));
+  EXPECT_FALSE(parseAccessTokenResponse("", &token, &expires_in));
+  EXPECT_FALSE(parseAccessTokenResponse(
+      R"({"access_token":"TOKEN","expires_in":100)", &token, &expires_in));
+}
+
+TEST(TokenResponseParserTest, ExpiresInEdgeCases) {
+  std::string token;
+  int expires_in = 0;
+
+  // Fractional part is truncated, like the Struct-based parser did.
+  EXPECT_TRUE(parseAccessTokenResponse(
+      R"({"access_token":"T","expires_in":100.9})", &token, &expires_in));
+  EXPECT_EQ(expires_in, 100);
+
+  // Values beyond int range saturate rather than fail.
+  EXPECT_TRUE(parseAccessTokenResponse(
+      R"({"access_token":"T","expires_in":3597523200})", &token, &expires_in));
+  EXPECT_EQ(expires_in, std::numeric_limits<int>::max());
+}
+
+TEST(TokenResponseParserTest, StringEscapes) {
+  std::string token;
+  int expires_in = 0;
+
+  EXPECT_TRUE(parseAccessTokenResponse(
+      R"({"access_token":"a\"b\\c\ndA","expires_in":1})", &token,
+      &expires_in));
+  EXPECT_EQ(token, "a\"b\\c\ndA");
+
+  // Invalid escape fails the parse.
+  EXPECT_FALSE(parseAccessTokenResponse(
+      R"({"access_token":"a\qb","expires_in":1})", &token, &expires_in));
+}
+
+TEST(TokenResponseParserTest, IdentityTokenResponse) {
+  std::string token;
+
+  EXPECT_TRUE(parseIdentityTokenResponse(R"({"token":"ID_TOKEN"})", &token));
+  EXPECT_EQ(token, "ID_TOKEN");
+
+  EXPECT_FALSE(parseIdentityTokenResponse(R"({"access_token":"X"})", &token));
+  EXPECT_FALSE(parseIdentityTokenResponse(R"({"token":12345})", &token));
+  EXPECT_FALSE(parseIdentityTokenResponse("", &token));
+}
+
+}  // namespace
+}  // namespace Utils
+}  // namespace Extensions
+}  // namespace Envoy
@@ -13,12 +13,16 @@
 // limitations under the License.
 
 #include "src/envoy/utils/token_subscriber.h"
+
+#include <algorithm>
+
 #include "absl/strings/str_cat.h"
+#include "common/common/empty_string.h"
 #include "common/common/enum_to_int.h"
 #include "common/http/headers.h"
 #include "common/http/message_impl.h"
 #include "common/http/utility.h"
-#include "src/envoy/utils/json_struct.h"
+#include "src/envoy/utils/token_response_parser.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -35,9 +39,17 @@ const std::chrono::milliseconds kRequestTimeoutMs(5000);
 // Delay after a failed fetch
 const std::chrono::seconds kFailedRequestTimeout(60);
 
+// Delay after a failed fetch once the token already expired; retried
+// aggressively since requests are failing on the stale token.
+const std::chrono::seconds kStaleRetryTimeout(5);
+
 // If no expiration is provided in the response, refresh in this time.
 const std::chrono::seconds kSubscriberDefaultTokenExpiry(3599);
 
+// Fraction of the TTL added as random jitter to the refresh schedule so
+// subscribers created together do not stampede the token server.
+constexpr double kRefreshJitterFraction = 0.1;
+
 Envoy::Http::MessagePtr prepareHeaders(const std::string& token_url) {
   absl::string_view host, path;
   Http::Utility::extractHostPathFromUri(token_url, host, path);
@@ -59,13 +71,18 @@ Envoy::Http::MessagePtr prepareHeaders(const std::string& token_url) {
 TokenSubscriber::TokenSubscriber(
     Envoy::Server::Configuration::FactoryContext& context,
     const std::string& token_cluster, const std::string& token_url,
-    const bool json_response, TokenUpdateFunc callback)
+    const bool json_response, TokenUpdateFunc callback, double refresh_fraction)
     : cm_(context.clusterManager()),
       token_cluster_(token_cluster),
       token_url_(token_url),
       json_response_(json_response),
       callback_(callback),
       active_request_(nullptr),
+      random_(context.random()),
+      time_source_(context.timeSource()),
+      refresh_fraction_(refresh_fraction),
+      stale_token_gauge_(context.scope().gauge(
+          "token_subscriber.stale_tokens", Stats::Gauge::ImportMode::NeverImport)),
       init_target_("TokenSubscriber", [this] { refresh(); }) {
   refresh_timer_ =
       context.dispatcher().createTimer([this]() -> void { refresh(); });
@@ -73,10 +90,29 @@ TokenSubscriber::TokenSubscriber(
   context.initManager().add(init_target_);
 }
 
+TokenSubscriber::TokenSubscriber(
+    Envoy::Server::Configuration::FactoryContext& context)
+    : cm_(context.clusterManager()),
+      token_cluster_(EMPTY_STRING),
+      token_url_(),
+      json_response_(false),
+      active_request_(nullptr),
+      random_(context.random()),
+      time_source_(context.timeSource()),
+      refresh_fraction_(0),
+      stale_token_gauge_(context.scope().gauge(
+          "token_subscriber.stale_tokens", Stats::Gauge::ImportMode::NeverImport)),
+      // Never run: the dormant form registers neither the init target nor a
+      // refresh timer.
+      init_target_("TokenSubscriberHandle", [] {}) {}
+
 TokenSubscriber::~TokenSubscriber() {
   if (active_request_) {
     active_request_->cancel();
   }
+  if (counted_stale_) {
+    stale_token_gauge_.dec();
+  }
 }
 
 void TokenSubscriber::refresh() {
@@ -114,6 +150,7 @@ void TokenSubscriber::processResponse(Envoy::Http::MessagePtr&& response) {
     ENVOY_LOG(debug, "GetAccessToken success");
   } else {
     ENVOY_LOG(debug, "GetAccessToken failed: {}", status_code);
+    handleFailedRefresh();
     return;
   }
 
@@ -128,25 +165,13 @@ void TokenSubscriber::processResponse(Envoy::Http::MessagePtr&& response) {
       "expires_in": uint
     }
     */
-    ::google::protobuf::util::JsonParseOptions options;
-    ::google::protobuf::Struct response_pb;
-    const auto parse_status = ::google::protobuf::util::JsonStringToMessage(
-        response->bodyAsString(), &response_pb, options);
-    if (!parse_status.ok()) {
-      ENVOY_LOG(error, "Parsing response failed: {}", parse_status.ToString());
-      return;
-    }
-    JsonStruct json_struct(response_pb);
-
-    if (!json_struct.getString("access_token", &token).ok()) {
-      ENVOY_LOG(error,
-                "Parsing response failed. Could not find `access_token`");
-      return;
-    }
-
     int expires_seconds;
-    if (!json_struct.getInteger("expires_in", &expires_seconds).ok()) {
-      ENVOY_LOG(error, "Parsing response failed. Could not find `expires_in`");
+    if (!parseAccessTokenResponse(response->bodyAsString(), &token,
+                                  &expires_seconds)) {
+      ENVOY_LOG(error,
+                "Parsing response failed. Could not find `access_token` "
+                "and `expires_in`");
+      handleFailedRefresh();
       return;
     }
     expires_in = std::chrono::seconds(expires_seconds);
@@ -156,24 +181,49 @@ void TokenSubscriber::processResponse(Envoy::Http::MessagePtr&& response) {
     expires_in = kSubscriberDefaultTokenExpiry;
   }
 
-  // Update the token 5 seconds before the expiration
+  // Fetch the replacement well ahead of expiration so a failed refresh can
+  // be retried while the current token is still valid, with jitter so many
+  // subscribers do not stampede the token server at once.
   if (expires_in.count() <= 5) {
     refresh();
   } else {
-    refresh_timer_->enableTimer(expires_in - std::chrono::seconds(5));
+    const int64_t ttl_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(expires_in)
+            .count();
+    int64_t refresh_ms = static_cast<int64_t>(ttl_ms * refresh_fraction_);
+    const int64_t jitter_range_ms =
+        std::max<int64_t>(1, static_cast<int64_t>(ttl_ms * kRefreshJitterFraction));
+    refresh_ms += random_.random() % jitter_range_ms;
+    refresh_timer_->enableTimer(std::chrono::milliseconds(refresh_ms));
+  }
+  token_expiry_ = time_source_.monotonicTime() + expires_in;
+  if (counted_stale_) {
+    stale_token_gauge_.dec();
+    counted_stale_ = false;
   }
 
   ENVOY_LOG(debug, "Got token: {}", token);
   callback_(token);
 }
 
+void TokenSubscriber::handleFailedRefresh() {
+  // The old token keeps being served; it only counts as stale once it
+  // actually expired without a replacement.
+  if (!counted_stale_ && time_source_.monotonicTime() >= token_expiry_) {
+    stale_token_gauge_.inc();
+    counted_stale_ = true;
+  }
+  refresh_timer_->enableTimer(counted_stale_ ? kStaleRetryTimeout
+                                             : kFailedRequestTimeout);
+}
+
 void TokenSubscriber::onFailure(
     Envoy::Http::AsyncClient::FailureReason reason) {
   init_target_.ready();
   active_request_ = nullptr;
   ENVOY_LOG(debug, "GetAccessToken failed with code: {}, {}",
             enumToInt(reason));
-  refresh_timer_->enableTimer(kFailedRequestTimeout);
+  handleFailedRefresh();
 }
 
 }  // namespace Utils
@@ -21,7 +21,9 @@
 #include "envoy/event/dispatcher.h"
 #include "envoy/http/async_client.h"
 #include "envoy/http/message.h"
+#include "envoy/runtime/runtime.h"
 #include "envoy/server/filter_config.h"
+#include "envoy/stats/scope.h"
 #include "envoy/upstream/cluster_manager.h"
 
 namespace Envoy {
@@ -31,6 +33,12 @@ namespace Utils {
 // `TokenSubscriber` class fetches a token at the config time in the main
 // thread. It also registers a timer to fetch a new token before expiration.
 //
+// Refreshes are scheduled ahead of expiration, at a configurable fraction of
+// the token's TTL plus jitter, and the old token keeps being served until a
+// replacement arrives. A failed refresh therefore has most of the TTL to be
+// retried before the token actually goes stale; the `stale_tokens` gauge
+// counts subscribers whose token expired without a replacement.
+//
 // It uses `Init::Manager` object. This is how `Init::Manager` works:
 //
 // * If your filter needs to make an async remote call, and needs to wait for
@@ -46,12 +54,22 @@ class TokenSubscriber
  public:
   using TokenUpdateFunc = std::function<void(const std::string& token)>;
   // TODO(kyuc): Maybe add a name that gets passed to Init::TargetImpl.
+  // `refresh_fraction` is the fraction of a token's TTL after which the
+  // replacement fetch is issued.
   TokenSubscriber(Envoy::Server::Configuration::FactoryContext& context,
                   const std::string& token_cluster,
                   const std::string& token_url, const bool json_response,
-                  TokenUpdateFunc callback);
+                  TokenUpdateFunc callback, double refresh_fraction = 0.8);
   virtual ~TokenSubscriber();
 
+ protected:
+  // Constructs a dormant subscriber that registers no init target and never
+  // fetches; its token is delivered by someone else. Used by the shared
+  // subscriber registry, whose handles must still be TokenSubscribers so
+  // existing holders of TokenSubscriberPtr need not change.
+  explicit TokenSubscriber(
+      Envoy::Server::Configuration::FactoryContext& context);
+
  private:
   // Envoy::Http::AsyncClient::Callbacks
   void onSuccess(Envoy::Http::MessagePtr&& response) override;
@@ -59,6 +77,9 @@ class TokenSubscriber
 
   void processResponse(Envoy::Http::MessagePtr&& response);
   void refresh();
+  // Marks this subscriber stale in the gauge if its token already expired,
+  // and arms the retry timer.
+  void handleFailedRefresh();
 
   Upstream::ClusterManager& cm_;
   const std::string& token_cluster_;
@@ -68,6 +89,18 @@ class TokenSubscriber
   TokenUpdateFunc callback_;
   Envoy::Http::AsyncClient::Request* active_request_{};
 
+  // Jitter source for the refresh schedule.
+  Runtime::RandomGenerator& random_;
+  Envoy::TimeSource& time_source_;
+  const double refresh_fraction_;
+  // Number of subscribers of this process serving an expired (or never
+  // fetched) token; shared across subscribers through the stat name.
+  Stats::Gauge& stale_token_gauge_;
+  // Whether this subscriber is currently counted in the gauge.
+  bool counted_stale_{false};
+  // When the current token expires; epoch until the first token arrives.
+  Envoy::MonotonicTime token_expiry_{};
+
   Envoy::Event::TimerPtr refresh_timer_;
   // init_target_.ready() need be called at the end of request callbacks.
   Envoy::Init::TargetImpl init_target_;
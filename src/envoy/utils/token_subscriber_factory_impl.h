@@ -14,12 +14,132 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
 #include "src/envoy/utils/token_subscriber_factory.h"
 
 namespace Envoy {
 namespace Extensions {
 namespace Utils {
 
+// Process-wide registry deduplicating token subscribers by
+// (cluster, url, response type). A proxy serving several service configs
+// used to poll the metadata server once per config for the same token;
+// through the registry one subscriber does the fetch/refresh cycle and
+// fans the token out to every registered callback.
+//
+// The returned handle is a dormant TokenSubscriber, so holders of
+// TokenSubscriberPtr are unchanged; the entry (and its fetch cycle) lives
+// until the last handle for its key is destroyed. Only the first
+// subscription for a key registers an init target with its config's init
+// manager; later subscriptions get the cached token immediately when one
+// has already arrived. Subscriptions, destructions and token updates all
+// run on the main thread, so the registry needs no locking.
+class SharedTokenSubscriberRegistry {
+ public:
+  static SharedTokenSubscriberRegistry& instance() {
+    static SharedTokenSubscriberRegistry* registry =
+        new SharedTokenSubscriberRegistry;
+    return *registry;
+  }
+
+  TokenSubscriberPtr subscribe(
+      Server::Configuration::FactoryContext& context,
+      const std::string& token_cluster, const std::string& token_url,
+      const bool json_response, TokenSubscriber::TokenUpdateFunc callback) {
+    std::string key = absl::StrCat(token_cluster, "\n", token_url, "\n",
+                                   json_response ? "json" : "raw");
+    auto it = entries_.find(key);
+    std::shared_ptr<Entry> entry;
+    if (it != entries_.end()) {
+      entry = it->second;
+    } else {
+      entry = std::make_shared<Entry>();
+      // The subscriber keeps references to its cluster and url strings, so
+      // they live in the entry rather than borrowing the caller's.
+      entry->cluster = token_cluster;
+      entry->url = token_url;
+      // The entry owns the subscriber, so the raw pointer in its callback
+      // cannot outlive the entry.
+      Entry* raw_entry = entry.get();
+      entry->primary = std::make_unique<TokenSubscriber>(
+          context, entry->cluster, entry->url, json_response,
+          [raw_entry](const std::string& token) {
+            raw_entry->last_token = token;
+            raw_entry->has_token = true;
+            // Fan out from a snapshot: a callback may add or drop
+            // subscriptions for this key.
+            std::vector<TokenSubscriber::TokenUpdateFunc> callbacks;
+            callbacks.reserve(raw_entry->callbacks.size());
+            for (const auto& registered : raw_entry->callbacks) {
+              callbacks.push_back(registered.second);
+            }
+            for (const auto& cb : callbacks) {
+              cb(token);
+            }
+          });
+      entries_.emplace(key, entry);
+    }
+    const uint64_t id = entry->next_id++;
+    entry->callbacks.emplace(id, callback);
+    if (entry->has_token) {
+      callback(entry->last_token);
+    }
+    return TokenSubscriberPtr(
+        new Handle(*this, std::move(key), std::move(entry), id, context));
+  }
+
+ private:
+  SharedTokenSubscriberRegistry() = default;
+
+  struct Entry {
+    std::string cluster;
+    std::string url;
+    // The one real subscriber doing the fetch/refresh cycle for this key.
+    std::unique_ptr<TokenSubscriber> primary;
+    std::map<uint64_t, TokenSubscriber::TokenUpdateFunc> callbacks;
+    // The most recent token, replayed to late subscriptions.
+    std::string last_token;
+    bool has_token{false};
+    uint64_t next_id{0};
+  };
+
+  // What subscribe() hands back: a dormant TokenSubscriber that only pins
+  // the shared entry and unregisters its callback on destruction.
+  class Handle : public TokenSubscriber {
+   public:
+    Handle(SharedTokenSubscriberRegistry& registry, std::string key,
+           std::shared_ptr<Entry> entry, uint64_t id,
+           Server::Configuration::FactoryContext& context)
+        : TokenSubscriber(context),
+          registry_(registry),
+          key_(std::move(key)),
+          entry_(std::move(entry)),
+          id_(id) {}
+
+    ~Handle() override {
+      entry_->callbacks.erase(id_);
+      if (entry_->callbacks.empty()) {
+        // Last handle for this key; the fetch cycle stops with the entry.
+        registry_.entries_.erase(key_);
+      }
+    }
+
+   private:
+    SharedTokenSubscriberRegistry& registry_;
+    const std::string key_;
+    const std::shared_ptr<Entry> entry_;
+    const uint64_t id_;
+  };
+
+  absl::flat_hash_map<std::string, std::shared_ptr<Entry>> entries_;
+};
+
 class TokenSubscriberFactoryImpl : public TokenSubscriberFactory {
  public:
   TokenSubscriberFactoryImpl(Server::Configuration::FactoryContext& context)
@@ -29,8 +149,8 @@ class TokenSubscriberFactoryImpl : public TokenSubscriberFactory {
       const std::string& token_cluster, const std::string& token_url,
       const bool json_response,
       TokenSubscriber::TokenUpdateFunc callback) const override {
-    return std::make_unique<TokenSubscriber>(context_, token_cluster, token_url,
-                                             json_response, callback);
+    return SharedTokenSubscriberRegistry::instance().subscribe(
+        context_, token_cluster, token_url, json_response, callback);
   }
 
   IamTokenSubscriberPtr createIamTokenSubscriber(
@@ -38,6 +158,9 @@ class TokenSubscriberFactoryImpl : public TokenSubscriberFactory {
       const std::string& iam_service_cluster,
       const std::string& iam_service_uri,
       IamTokenSubscriber::TokenUpdateFunc callback) const override {
+    // Not deduplicated: an IAM call's result depends on the access token
+    // the caller supplies, so two subscribers with the same uri are not
+    // interchangeable.
     return std::make_unique<IamTokenSubscriber>(context_, access_token_fn,
                                                 iam_service_cluster,
                                                 iam_service_uri, callback);
@@ -19,11 +19,15 @@ import (
 	"regexp"
 
 	"github.com/GoogleCloudPlatform/esp-v2/src/go/configinfo"
+	"github.com/GoogleCloudPlatform/esp-v2/src/go/util"
 	"github.com/golang/glog"
+	"github.com/golang/protobuf/ptypes"
 
+	bapb "github.com/GoogleCloudPlatform/esp-v2/src/go/proto/api/envoy/http/backend_auth"
 	commonpb "github.com/GoogleCloudPlatform/esp-v2/src/go/proto/api/envoy/http/common"
 	v2pb "github.com/envoyproxy/go-control-plane/envoy/api/v2"
 	routepb "github.com/envoyproxy/go-control-plane/envoy/api/v2/route"
+	anypb "github.com/golang/protobuf/ptypes/any"
 	wrapperspb "github.com/golang/protobuf/ptypes/wrappers"
 	confpb "google.golang.org/genproto/googleapis/api/serviceconfig"
 )
@@ -115,6 +119,15 @@ func makeDynamicRoutingConfig(serviceInfo *configinfo.ServiceInfo) ([]*routepb.R
 				return nil, fmt.Errorf("error making HTTP route matcher for selector: %v", operation)
 			}
 
+			// Each dynamic routing route serves exactly one operation, so pin
+			// it on the route; the backend auth filter then resolves the
+			// operation at route load instead of per request.
+			perRouteConfig, err := ptypes.MarshalAny(&bapb.PerRouteFilterConfig{
+				Operation: operation,
+			})
+			if err != nil {
+				return nil, fmt.Errorf("error marshaling backend auth per-route config for selector: %v", operation)
+			}
 			r := routepb.Route{
 				Match: routeMatcher,
 				Action: &routepb.Route_Route{
@@ -127,6 +140,9 @@ func makeDynamicRoutingConfig(serviceInfo *configinfo.ServiceInfo) ([]*routepb.R
 						},
 					},
 				},
+				TypedPerFilterConfig: map[string]*anypb.Any{
+					util.BackendAuth: perRouteConfig,
+				},
 			}
 			glog.Infof("Add Dynamic Routing configuration: %v", r)
 			backendRoutes = append(backendRoutes, &r)
@@ -383,6 +383,12 @@ var (
                                  "route":{
                                     "cluster":"pets.appspot.com:443",
                                     "hostRewrite":"pets.appspot.com"
+                                 },
+                                 "typedPerFilterConfig":{
+                                    "envoy.filters.http.backend_auth":{
+                                       "@type":"type.googleapis.com/google.api.envoy.http.backend_auth.PerRouteFilterConfig",
+                                       "operation":"1.echo_api_endpoints_cloudesf_testing_cloud_goog.dynamic_routing_AddPet"
+                                    }
                                  }
                               },
                               {
@@ -398,6 +404,12 @@ var (
                                  "route":{
                                     "cluster":"pets.appspot.com:8008",
                                     "hostRewrite":"pets.appspot.com"
+                                 },
+                                 "typedPerFilterConfig":{
+                                    "envoy.filters.http.backend_auth":{
+                                       "@type":"type.googleapis.com/google.api.envoy.http.backend_auth.PerRouteFilterConfig",
+                                       "operation":"1.echo_api_endpoints_cloudesf_testing_cloud_goog.dynamic_routing_GetPetById"
+                                    }
                                  }
                               },
                               {
@@ -413,6 +425,12 @@ var (
                                  "route":{
                                     "cluster":"us-central1-cloud-esf.cloudfunctions.net:443",
                                     "hostRewrite":"us-central1-cloud-esf.cloudfunctions.net"
+                                 },
+                                 "typedPerFilterConfig":{
+                                    "envoy.filters.http.backend_auth":{
+                                       "@type":"type.googleapis.com/google.api.envoy.http.backend_auth.PerRouteFilterConfig",
+                                       "operation":"1.echo_api_endpoints_cloudesf_testing_cloud_goog.dynamic_routing_Hello"
+                                    }
                                  }
                               },
                               {
@@ -428,6 +446,12 @@ var (
                                  "route":{
                                     "cluster":"pets.appspot.com:443",
                                     "hostRewrite":"pets.appspot.com"
+                                 },
+                                 "typedPerFilterConfig":{
+                                    "envoy.filters.http.backend_auth":{
+                                       "@type":"type.googleapis.com/google.api.envoy.http.backend_auth.PerRouteFilterConfig",
+                                       "operation":"1.echo_api_endpoints_cloudesf_testing_cloud_goog.dynamic_routing_ListPets"
+                                    }
                                  }
                               },
                               {
@@ -443,6 +467,12 @@ var (
                                  "route":{
                                     "cluster":"us-west2-cloud-esf.cloudfunctions.net:443",
                                     "hostRewrite":"us-west2-cloud-esf.cloudfunctions.net"
+                                 },
+                                 "typedPerFilterConfig":{
+                                    "envoy.filters.http.backend_auth":{
+                                       "@type":"type.googleapis.com/google.api.envoy.http.backend_auth.PerRouteFilterConfig",
+                                       "operation":"1.echo_api_endpoints_cloudesf_testing_cloud_goog.dynamic_routing_Search"
+                                    }
                                  }
                               },
                               {
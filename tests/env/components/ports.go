@@ -56,6 +56,9 @@ const (
 	TestHttp1Basic
 	TestHttp1JWT
 	TestManagedServiceConfig
+	TestPerfRegressionGrpcMix
+	TestPerfRegressionRestLarge
+	TestPerfRegressionRestSmall
 	TestPreflightCorsWithBasicPreset
 	TestPreflightRequestWithAllowCors
 	TestReportGCPAttributes
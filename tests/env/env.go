@@ -124,6 +124,13 @@ func (e *TestEnv) Ports() *components.Ports {
 	return e.ports
 }
 
+// EnvoyPid returns the OS pid of the running envoy process. Only valid
+// after a successful Setup. The performance regression suite reads the
+// process's CPU time and RSS through it.
+func (e *TestEnv) EnvoyPid() int {
+	return e.envoy.Process.Pid
+}
+
 // OverrideAuthentication overrides Service.Authentication.
 func (e *TestEnv) OverrideAuthentication(authentication *confpb.Authentication) {
 	e.fakeServiceConfig.Authentication = authentication
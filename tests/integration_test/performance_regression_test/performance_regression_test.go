@@ -0,0 +1,383 @@
+// Copyright 2019 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Performance regression suite: boots the proxy with representative
+// configs, drives it with a built-in load generator and asserts the
+// measured added latency, CPU per request and RSS against the ceilings
+// checked in as baselines.json. The ceilings are budgets with generous
+// headroom over healthy numbers, not targets: a pass means "not
+// obviously regressed", a fail means a filter-level regression reached
+// this branch before any dashboard could show it.
+//
+// The suite is opt-in (ESPV2_PERF_REGRESSION=1; see the
+// performance-regression-test Makefile target) because wall-clock and
+// CPU assertions are only meaningful on a quiet machine.
+package performance_regression_test
+
+import (
+	"encoding/json"
+	"fmt"
+	"io/ioutil"
+	"os"
+	"regexp"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"github.com/GoogleCloudPlatform/esp-v2/tests/endpoints/echo/client"
+	grpcclient "github.com/GoogleCloudPlatform/esp-v2/tests/endpoints/grpc_echo/client"
+	"github.com/GoogleCloudPlatform/esp-v2/tests/env"
+	annotationspb "google.golang.org/genproto/googleapis/api/annotations"
+	apipb "google.golang.org/genproto/protobuf/api"
+
+	comp "github.com/GoogleCloudPlatform/esp-v2/tests/env/components"
+)
+
+const (
+	echoMessage = "hello"
+
+	// Load shape. The warmup fills the token, connection and check
+	// caches so the measurement covers the steady state the budgets
+	// describe, not the cold start.
+	warmupRequests   = 200
+	measuredRequests = 2000
+	concurrency      = 8
+
+	// Linux USER_HZ; /proc CPU times are reported in these ticks.
+	clockTicksPerSecond = 100
+)
+
+// The per-profile ceilings loaded from baselines.json. Zero-valued
+// fields are not asserted for that profile.
+type profileBaseline struct {
+	AddedP50Ms      float64 `json:"added_p50_ms"`
+	AddedP99Ms      float64 `json:"added_p99_ms"`
+	MeanLatencyMs   float64 `json:"mean_latency_ms"`
+	CpuMsPerRequest float64 `json:"cpu_ms_per_request"`
+	MaxRssMb        float64 `json:"max_rss_mb"`
+}
+
+func skipUnlessEnabled(t *testing.T) {
+	if os.Getenv("ESPV2_PERF_REGRESSION") == "" {
+		t.Skip("performance regression suite is opt-in; run it via " +
+			"'make performance-regression-test' on a quiet machine")
+	}
+}
+
+func loadBaseline(t *testing.T, profile string) profileBaseline {
+	bytes, err := ioutil.ReadFile("baselines.json")
+	if err != nil {
+		t.Fatalf("fail to read baselines.json: %v", err)
+	}
+	baselines := map[string]profileBaseline{}
+	if err := json.Unmarshal(bytes, &baselines); err != nil {
+		t.Fatalf("fail to parse baselines.json: %v", err)
+	}
+	baseline, ok := baselines[profile]
+	if !ok {
+		t.Fatalf("no baseline for profile %q in baselines.json", profile)
+	}
+	return baseline
+}
+
+// runHTTPLoad posts echoMessage to url n times across the configured
+// concurrency and returns the sorted per-request latencies. More than
+// 1% errors fails the test: an erroring run measures the error path,
+// not the budgeted one.
+func runHTTPLoad(t *testing.T, url string, n int) []time.Duration {
+	latencies := make([]time.Duration, n)
+	var next, errors int64
+	var wg sync.WaitGroup
+	for w := 0; w < concurrency; w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			for {
+				i := atomic.AddInt64(&next, 1) - 1
+				if i >= int64(n) {
+					return
+				}
+				start := time.Now()
+				if _, err := client.DoPost(url, echoMessage); err != nil {
+					atomic.AddInt64(&errors, 1)
+				}
+				latencies[i] = time.Since(start)
+			}
+		}()
+	}
+	wg.Wait()
+	if errors > int64(n)/100 {
+		t.Fatalf("load run against %v had %v/%v errors", url, errors, n)
+	}
+	sort.Slice(latencies, func(i, j int) bool {
+		return latencies[i] < latencies[j]
+	})
+	return latencies
+}
+
+// percentile reads p (0..1) from an ascending latency slice.
+func percentile(sorted []time.Duration, p float64) time.Duration {
+	if len(sorted) == 0 {
+		return 0
+	}
+	index := int(p * float64(len(sorted)-1))
+	return sorted[index]
+}
+
+// readCpuTicks returns the process's cumulative user+system CPU time in
+// USER_HZ ticks from /proc/<pid>/stat.
+func readCpuTicks(pid int) (uint64, error) {
+	bytes, err := ioutil.ReadFile(fmt.Sprintf("/proc/%v/stat", pid))
+	if err != nil {
+		return 0, err
+	}
+	// The comm field (2) may contain spaces; fields are counted from
+	// after its closing parenthesis. utime and stime are fields 14 and
+	// 15 overall, so 11 and 12 of the remainder.
+	stat := string(bytes)
+	closing := strings.LastIndex(stat, ")")
+	if closing < 0 {
+		return 0, fmt.Errorf("malformed stat: %q", stat)
+	}
+	fields := strings.Fields(stat[closing+1:])
+	if len(fields) < 13 {
+		return 0, fmt.Errorf("malformed stat: %q", stat)
+	}
+	utime, err := strconv.ParseUint(fields[11], 10, 64)
+	if err != nil {
+		return 0, err
+	}
+	stime, err := strconv.ParseUint(fields[12], 10, 64)
+	if err != nil {
+		return 0, err
+	}
+	return utime + stime, nil
+}
+
+// readRssMb returns the process's current RSS in MB from
+// /proc/<pid>/status. A post-load sample, not a true peak, but the
+// proxy's caches and buffers are at their fullest right after the run.
+func readRssMb(pid int) (float64, error) {
+	bytes, err := ioutil.ReadFile(fmt.Sprintf("/proc/%v/status", pid))
+	if err != nil {
+		return 0, err
+	}
+	for _, line := range strings.Split(string(bytes), "\n") {
+		if !strings.HasPrefix(line, "VmRSS:") {
+			continue
+		}
+		fields := strings.Fields(line)
+		if len(fields) < 2 {
+			break
+		}
+		kb, err := strconv.ParseFloat(fields[1], 64)
+		if err != nil {
+			return 0, err
+		}
+		return kb / 1024, nil
+	}
+	return 0, fmt.Errorf("no VmRSS in /proc/%v/status", pid)
+}
+
+// assertRestProfile runs the REST load against the proxy and the echo
+// backend directly, and checks the proxy-added latency percentiles, the
+// envoy CPU burned per proxied request and the post-load RSS against
+// the profile's ceilings.
+func assertRestProfile(t *testing.T, s *env.TestEnv, profile string) {
+	baseline := loadBaseline(t, profile)
+	proxyUrl := fmt.Sprintf("http://localhost:%v/echo?key=api-key",
+		s.Ports().ListenerPort)
+	backendUrl := fmt.Sprintf("http://localhost:%v/echo",
+		s.Ports().BackendServerPort)
+	pid := s.EnvoyPid()
+
+	runHTTPLoad(t, proxyUrl, warmupRequests)
+	direct := runHTTPLoad(t, backendUrl, measuredRequests)
+
+	cpuBefore, cpuErr := readCpuTicks(pid)
+	proxied := runHTTPLoad(t, proxyUrl, measuredRequests)
+	cpuAfter, cpuErr2 := readCpuTicks(pid)
+
+	addedP50 := percentile(proxied, 0.50) - percentile(direct, 0.50)
+	addedP99 := percentile(proxied, 0.99) - percentile(direct, 0.99)
+	t.Logf("%v: proxy p50=%v p99=%v, direct p50=%v p99=%v", profile,
+		percentile(proxied, 0.50), percentile(proxied, 0.99),
+		percentile(direct, 0.50), percentile(direct, 0.99))
+
+	if ms := float64(addedP50) / float64(time.Millisecond); ms > baseline.AddedP50Ms {
+		t.Errorf("%v: added P50 latency %.2fms exceeds the %.2fms budget",
+			profile, ms, baseline.AddedP50Ms)
+	}
+	if ms := float64(addedP99) / float64(time.Millisecond); ms > baseline.AddedP99Ms {
+		t.Errorf("%v: added P99 latency %.2fms exceeds the %.2fms budget",
+			profile, ms, baseline.AddedP99Ms)
+	}
+
+	if cpuErr != nil || cpuErr2 != nil {
+		t.Logf("%v: skipping CPU assertion, /proc unreadable: %v %v",
+			profile, cpuErr, cpuErr2)
+	} else {
+		cpuMsPerRequest := float64(cpuAfter-cpuBefore) * 1000 /
+			clockTicksPerSecond / measuredRequests
+		t.Logf("%v: envoy CPU per request %.3fms", profile, cpuMsPerRequest)
+		if cpuMsPerRequest > baseline.CpuMsPerRequest {
+			t.Errorf("%v: CPU per request %.3fms exceeds the %.3fms budget",
+				profile, cpuMsPerRequest, baseline.CpuMsPerRequest)
+		}
+	}
+
+	if rssMb, err := readRssMb(pid); err != nil {
+		t.Logf("%v: skipping RSS assertion, /proc unreadable: %v", profile, err)
+	} else {
+		t.Logf("%v: envoy RSS %.1fMB", profile, rssMb)
+		if rssMb > baseline.MaxRssMb {
+			t.Errorf("%v: RSS %.1fMB exceeds the %.1fMB ceiling", profile,
+				rssMb, baseline.MaxRssMb)
+		}
+	}
+}
+
+// The small-config profile: the stock echo service, a handful of rules.
+func TestPerfRegressionRestSmallConfig(t *testing.T) {
+	skipUnlessEnabled(t)
+	configID := "test-config-id"
+	args := []string{"--service_config_id=" + configID,
+		"--backend_protocol=http1", "--rollout_strategy=fixed"}
+
+	s := env.NewTestEnv(comp.TestPerfRegressionRestSmall, "echo")
+	defer s.TearDown()
+	if err := s.Setup(args); err != nil {
+		t.Fatalf("fail to setup test env, %v", err)
+	}
+	assertRestProfile(t, s, "rest_small_config")
+}
+
+// The large-config profile: the same service padded to a few hundred
+// methods and http rules, so the per-request path-matcher and
+// requirement lookups run against a production-sized rule set.
+func TestPerfRegressionRestLargeConfig(t *testing.T) {
+	skipUnlessEnabled(t)
+	configID := "test-config-id"
+	args := []string{"--service_config_id=" + configID,
+		"--backend_protocol=http1", "--rollout_strategy=fixed"}
+
+	s := env.NewTestEnv(comp.TestPerfRegressionRestLarge, "echo")
+	var methods []*apipb.Method
+	var rules []*annotationspb.HttpRule
+	for i := 0; i < 300; i++ {
+		name := fmt.Sprintf("PerfPadding%v", i)
+		methods = append(methods, &apipb.Method{Name: name})
+		rules = append(rules, &annotationspb.HttpRule{
+			Selector: "1.echo_api_endpoints_cloudesf_testing_cloud_goog." + name,
+			Pattern: &annotationspb.HttpRule_Get{
+				Get: fmt.Sprintf("/perf/padding/%v/{id}", i),
+			},
+		})
+	}
+	s.AppendApiMethods(methods)
+	s.AppendHttpRules(rules)
+	defer s.TearDown()
+	if err := s.Setup(args); err != nil {
+		t.Fatalf("fail to setup test env, %v", err)
+	}
+	assertRestProfile(t, s, "rest_large_config")
+}
+
+// The gRPC profile: the grpc-echo plan runner reports its own latency
+// stats; the mean is asserted here together with CPU and RSS, read the
+// same way as the REST profiles.
+func TestPerfRegressionGrpcMix(t *testing.T) {
+	skipUnlessEnabled(t)
+	baseline := loadBaseline(t, "grpc_mix")
+	configID := "test-config-id"
+	args := []string{"--service_config_id=" + configID,
+		"--backend_protocol=grpc", "--rollout_strategy=fixed"}
+
+	s := env.NewTestEnv(comp.TestPerfRegressionGrpcMix, "grpc-echo")
+	defer s.TearDown()
+	if err := s.Setup(args); err != nil {
+		t.Fatalf("fail to setup test env, %v", err)
+	}
+	pid := s.EnvoyPid()
+
+	plan := fmt.Sprintf(`
+plans {
+  parallel {
+    test_count: %v
+    parallel_limit: %v
+    subtests {
+      weight: 1
+      echo {
+        request {
+          text: "Hello, world!"
+        }
+        call_config {
+          api_key: "this-is-an-api-key"
+        }
+      }
+    }
+  }
+}`, measuredRequests, concurrency)
+
+	// Warmup run, then the measured one.
+	if _, err := grpcclient.RunGRPCEchoTest(plan, s.Ports().ListenerPort); err != nil {
+		t.Fatalf("warmup run failed: %v", err)
+	}
+	cpuBefore, cpuErr := readCpuTicks(pid)
+	result, err := grpcclient.RunGRPCEchoTest(plan, s.Ports().ListenerPort)
+	if err != nil {
+		t.Fatalf("measured run failed: %v", err)
+	}
+	cpuAfter, cpuErr2 := readCpuTicks(pid)
+
+	match := regexp.MustCompile(`mean_latency_micros: (\d+)`).
+		FindStringSubmatch(result)
+	if match == nil {
+		t.Fatalf("no latency stats in plan result:\n%s", result)
+	}
+	micros, _ := strconv.ParseFloat(match[1], 64)
+	meanMs := micros / 1000
+	t.Logf("grpc_mix: mean latency %.2fms", meanMs)
+	if meanMs > baseline.MeanLatencyMs {
+		t.Errorf("grpc_mix: mean latency %.2fms exceeds the %.2fms budget",
+			meanMs, baseline.MeanLatencyMs)
+	}
+
+	if cpuErr != nil || cpuErr2 != nil {
+		t.Logf("grpc_mix: skipping CPU assertion, /proc unreadable: %v %v",
+			cpuErr, cpuErr2)
+	} else {
+		cpuMsPerRequest := float64(cpuAfter-cpuBefore) * 1000 /
+			clockTicksPerSecond / measuredRequests
+		t.Logf("grpc_mix: envoy CPU per request %.3fms", cpuMsPerRequest)
+		if cpuMsPerRequest > baseline.CpuMsPerRequest {
+			t.Errorf("grpc_mix: CPU per request %.3fms exceeds the %.3fms budget",
+				cpuMsPerRequest, baseline.CpuMsPerRequest)
+		}
+	}
+
+	if rssMb, err := readRssMb(pid); err != nil {
+		t.Logf("grpc_mix: skipping RSS assertion, /proc unreadable: %v", err)
+	} else {
+		t.Logf("grpc_mix: envoy RSS %.1fMB", rssMb)
+		if rssMb > baseline.MaxRssMb {
+			t.Errorf("grpc_mix: RSS %.1fMB exceeds the %.1fMB ceiling",
+				rssMb, baseline.MaxRssMb)
+		}
+	}
+}